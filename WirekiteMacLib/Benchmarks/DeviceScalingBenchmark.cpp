@@ -0,0 +1,225 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Measures how the host side scales with the number of attached devices.
+// Each simulated device samples 8 analog inputs at 1 kHz and receives
+// coalesced digital output requests every millisecond. The devices either
+// share an I/O reactor and event executor or each get their own.
+//
+// Usage: DeviceScalingBenchmark [seconds per run]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include "SimulatedDevice.hpp"
+#include "WriteCoalescer.hpp"
+#include "EventExecutor.hpp"
+#include "IOReactor.hpp"
+
+
+#define NUM_ANALOG_PORTS 8
+#define OUTPUT_PORT_ID (NUM_ANALOG_PORTS + 1) // the simulated device assigns port IDs in order
+#define WRITES_PER_INTERVAL 4
+
+static int duration = 3;
+static std::atomic<uint64_t> numEvents(0);
+
+
+static double cpuTime()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6
+        + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+
+class EventCounter : public MessageHandler {
+public:
+    virtual void handleMessage(wk_msg_header* msg)
+    {
+        numEvents.fetch_add(1, std::memory_order_relaxed);
+        MessagePool::release(msg);
+    }
+};
+
+
+/**
+ * Host side of a device: parses the received data and
+ * hands the port events to the event executor.
+ */
+class Host : public TransportListener, public MessageHandler {
+public:
+    Host(EventExecutor* executor)
+    :   executor(executor)
+    {
+        parser.setHandler(this);
+    }
+
+    virtual void onDataReceived(const uint8_t* data, uint32_t length)
+    {
+        parser.processData(data, length);
+    }
+
+    virtual void handleMessage(wk_msg_header* msg)
+    {
+        if (msg->message_type == WK_MSG_TYPE_PORT_EVENT)
+            executor->submit(&counter, msg);
+        else
+            MessagePool::release(msg);
+    }
+
+    MessageParser parser;
+    EventExecutor* executor;
+    EventCounter counter;
+};
+
+
+struct Device {
+    IOReactor* reactor;
+    EventExecutor* executor;
+    SimulatedDevice* simulation;
+    Host* host;
+    TransferPool transferPool;
+    WriteCoalescer coalescer;
+};
+
+
+static void configurePorts(Device* device)
+{
+    wk_config_request request;
+    for (int i = 0; i <= NUM_ANALOG_PORTS; i++) {
+        memset(&request, 0, sizeof(request));
+        request.header.message_size = sizeof(request);
+        request.header.message_type = WK_MSG_TYPE_CONFIG_REQUEST;
+        request.header.request_id = (uint16_t)(i + 1);
+        request.action = WK_CFG_ACTION_CONFIG_PORT;
+        if (i < NUM_ANALOG_PORTS) {
+            request.port_type = WK_CFG_PORT_TYPE_ANALOG_IN;
+            request.pin_config = (uint16_t)i;
+            request.value1 = 1; // sample every ms
+            device->simulation->setAnalogInput((uint16_t)i, 1000 + i);
+        } else {
+            request.port_type = WK_CFG_PORT_TYPE_DIGI_PIN;
+            request.port_attributes1 = 1; // output
+        }
+        device->coalescer.write((const uint8_t*)&request, sizeof(request));
+    }
+    device->coalescer.flush();
+}
+
+
+static void writeOutputs(Device* device, int iteration)
+{
+    wk_port_request request;
+    memset(&request, 0, sizeof(request));
+    request.header.message_size = WK_PORT_REQUEST_ALLOC_SIZE(0);
+    request.header.message_type = WK_MSG_TYPE_PORT_REQUEST;
+    request.header.port_id = OUTPUT_PORT_ID;
+    request.action = WK_PORT_ACTION_SET_VALUE;
+
+    for (int i = 0; i < WRITES_PER_INTERVAL; i++) {
+        request.value1 = (iteration + i) & 1;
+        device->coalescer.write((const uint8_t*)&request, request.header.message_size);
+    }
+}
+
+
+static void run(int numDevices, bool isShared)
+{
+    IOReactor* sharedReactor = isShared ? new IOReactor(IO_REACTOR_MAX_THREADS) : NULL;
+    EventExecutor* sharedExecutor = isShared ? new EventExecutor(EVENT_EXECUTOR_DEFAULT_THREADS) : NULL;
+
+    std::vector<Device*> devices;
+    for (int i = 0; i < numDevices; i++) {
+        Device* device = new Device();
+        device->reactor = isShared ? sharedReactor : new IOReactor(1);
+        device->executor = isShared ? sharedExecutor : new EventExecutor(EVENT_EXECUTOR_DEFAULT_THREADS);
+        device->simulation = new SimulatedDevice(device->reactor);
+        device->host = new Host(device->executor);
+        device->simulation->configureLink(100, 0);
+        device->simulation->setListener(device->host);
+        device->simulation->start();
+        device->coalescer.configure(WRITE_COALESCER_DEFAULT_TRANSFER_SIZE, 100);
+        device->coalescer.start(device->simulation, device->reactor, &device->transferPool);
+        configurePorts(device);
+        devices.push_back(device);
+    }
+
+    usleep(300000);
+
+    uint64_t startEvents = numEvents.load();
+    double startCpu = cpuTime();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    int numIntervals = duration * 1000;
+    for (int i = 0; i < numIntervals; i++) {
+        for (int d = 0; d < numDevices; d++)
+            writeOutputs(devices[d], i);
+        usleep(1000);
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu = cpuTime() - startCpu;
+    uint64_t events = numEvents.load() - startEvents;
+
+    int ioThreads = 0;
+    int executorThreads = EVENT_EXECUTOR_DEFAULT_THREADS;
+    if (isShared) {
+        ioThreads = sharedReactor->numThreads();
+    } else {
+        for (int d = 0; d < numDevices; d++)
+            ioThreads += devices[d]->reactor->numThreads();
+        executorThreads *= numDevices;
+    }
+
+    double messagesPerTransfer = 0;
+    for (int d = 0; d < numDevices; d++)
+        messagesPerTransfer += devices[d]->coalescer.messagesPerTransfer() / numDevices;
+
+    printf("%-9s %2d devices: %2d I/O threads, %2d executor threads, %8.0f events/s (expected %6d), "
+           "CPU %5.1f%%, %5.2f us CPU/event, %4.1f messages/transfer\n",
+           isShared ? "shared" : "dedicated", numDevices, ioThreads, executorThreads,
+           events / elapsed, numDevices * NUM_ANALOG_PORTS * 1000,
+           100 * cpu / elapsed, events > 0 ? 1e6 * cpu / events : 0.0, messagesPerTransfer);
+
+    for (int d = 0; d < numDevices; d++) {
+        Device* device = devices[d];
+        device->coalescer.stop();
+        device->simulation->stop();
+        device->executor->remove(&device->host->counter);
+        delete device->simulation;
+        delete device->host;
+        if (!isShared) {
+            delete device->executor;
+            delete device->reactor;
+        }
+        delete device;
+    }
+    delete sharedExecutor;
+    delete sharedReactor;
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1)
+        duration = atoi(argv[1]);
+
+    int counts[] = { 1, 4, 16 };
+    for (int i = 0; i < 3; i++) {
+        run(counts[i], false);
+        run(counts[i], true);
+    }
+    return 0;
+}
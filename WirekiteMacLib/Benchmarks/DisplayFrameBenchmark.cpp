@@ -0,0 +1,193 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Measures the frame rate of a color TFT display (ST7735, 128 x 160 pixels)
+// attached to a simulated board by SPI. Each frame updates two tiles of
+// 128 x 54 pixels like the test app. The pixel data is either sent in
+// 1 KB SPI requests (like the display controller used to) or split into
+// chunks like the streaming SPI transmit does. The USB link either has the
+// bandwidth of USB full speed or is unlimited so the SPI bus is the limit.
+//
+// Usage: DisplayFrameBenchmark [seconds per run]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+#include "SimulatedDevice.hpp"
+#include "Throttler.hpp"
+#include "TransferPool.hpp"
+
+
+#define SPI_PORT_ID 1 // first port configured on the simulated board
+#define BOARD_MEM_SIZE 20000
+#define BOARD_MAX_OUTSTANDING 100
+#define SPI_BUS_SPEED (18000000 / 8) // bytes per second
+#define USB_FULL_SPEED 1000000 // bytes per second
+#define USB_LATENCY 500 // µs
+
+// same as in WirekiteDevice.mm
+#define SPI_BULK_TX_SIZE 256
+#define SPI_STREAM_CHUNKS_IN_FLIGHT 3
+
+#define TILE_WIDTH 128
+#define TILE_HEIGHT 54
+#define TILES_PER_FRAME 2
+
+static int duration = 3;
+
+
+/**
+ * Host side of the display: sends throttled SPI requests and
+ * completes them when the board responds.
+ */
+class DisplayHost : public TransportListener, public MessageHandler {
+public:
+    DisplayHost(int usbBandwidth)
+    :   lastRequestId(0)
+    {
+        parser.setHandler(this);
+        throttler.configure(BOARD_MEM_SIZE, BOARD_MAX_OUTSTANDING);
+        pool.configure(BOARD_MEM_SIZE, BOARD_MAX_OUTSTANDING);
+        device.configureLink(USB_LATENCY, usbBandwidth);
+        device.configureBuffer(BOARD_MEM_SIZE, SPI_BUS_SPEED);
+        device.setListener(this);
+        device.start();
+
+        wk_config_request request;
+        memset(&request, 0, sizeof(request));
+        request.header.message_size = sizeof(request);
+        request.header.message_type = WK_MSG_TYPE_CONFIG_REQUEST;
+        request.header.request_id = nextRequestId();
+        request.action = WK_CFG_ACTION_CONFIG_PORT;
+        request.port_type = WK_CFG_PORT_TYPE_SPI;
+        device.writeBytes((const uint8_t*)&request, sizeof(request));
+    }
+
+    ~DisplayHost()
+    {
+        device.stop();
+    }
+
+    virtual void onDataReceived(const uint8_t* data, uint32_t length)
+    {
+        parser.processData(data, length);
+    }
+
+    virtual void handleMessage(wk_msg_header* msg)
+    {
+        if (msg->message_type == WK_MSG_TYPE_PORT_EVENT) {
+            wk_port_event* event = (wk_port_event*)msg;
+            throttler.requestCompleted(msg->request_id, event->event_attribute1 == 5);
+        }
+        MessagePool::release(msg);
+    }
+
+    void sendCommand(uint8_t command, const uint8_t* data, size_t length, size_t chunkSize)
+    {
+        transmit(&command, 1);
+        for (size_t offset = 0; offset < length; offset += chunkSize)
+            transmit(data + offset, length - offset < chunkSize ? length - offset : chunkSize);
+    }
+
+    void waitUntilCompleted()
+    {
+        while (throttler.bytesInFlight() > 0)
+            usleep(100);
+    }
+
+    size_t streamChunkSize()
+    {
+        size_t size = throttler.memorySize(ThrottlerPriorityBulk) / SPI_STREAM_CHUNKS_IN_FLIGHT
+            - WK_PORT_REQUEST_ALLOC_SIZE(0) - 8;
+        if (size > TRANSFER_POOL_LARGE_SIZE - WK_PORT_REQUEST_ALLOC_SIZE(0))
+            size = TRANSFER_POOL_LARGE_SIZE - WK_PORT_REQUEST_ALLOC_SIZE(0);
+        return size;
+    }
+
+private:
+    uint16_t nextRequestId()
+    {
+        lastRequestId++;
+        if (lastRequestId == 0)
+            lastRequestId = 1;
+        return lastRequestId;
+    }
+
+    void transmit(const uint8_t* data, size_t length)
+    {
+        uint16_t requestId = nextRequestId();
+        uint16_t msgLen = WK_PORT_REQUEST_ALLOC_SIZE(length);
+        ThrottlerPriority priority = length >= SPI_BULK_TX_SIZE ? ThrottlerPriorityBulk : ThrottlerPriorityNormal;
+        throttler.waitUntilAvailable(requestId, msgLen, priority);
+
+        wk_port_request* request = (wk_port_request*)pool.acquireBuffer(msgLen);
+        memset(request, 0, WK_PORT_REQUEST_ALLOC_SIZE(0));
+        request->header.message_size = msgLen;
+        request->header.message_type = WK_MSG_TYPE_PORT_REQUEST;
+        request->header.port_id = SPI_PORT_ID;
+        request->header.request_id = requestId;
+        request->action = WK_PORT_ACTION_TX_DATA;
+        memcpy(request->data, data, length);
+        device.writeBuffer((uint8_t*)request, msgLen);
+    }
+
+private:
+    SimulatedDevice device;
+    MessageParser parser;
+    Throttler throttler;
+    TransferPool pool;
+    uint16_t lastRequestId;
+};
+
+
+static void drawTile(DisplayHost& host, const uint8_t* pixels, int y, size_t chunkSize)
+{
+    uint8_t columns[] = { 0x00, 0x00, 0x00, TILE_WIDTH - 1 };
+    uint8_t rows[] = { 0x00, (uint8_t)y, 0x00, (uint8_t)(y + TILE_HEIGHT - 1) };
+    host.sendCommand(0x2A, columns, sizeof(columns), chunkSize); // CASET
+    host.sendCommand(0x2B, rows, sizeof(rows), chunkSize); // RASET
+    host.sendCommand(0x2C, pixels, TILE_WIDTH * TILE_HEIGHT * 2, chunkSize); // RAMWR
+}
+
+
+static void run(bool isStreaming, int usbBandwidth)
+{
+    DisplayHost host(usbBandwidth);
+    std::vector<uint8_t> pixels(TILE_WIDTH * TILE_HEIGHT * 2, 0x5a);
+    size_t chunkSize = isStreaming ? host.streamChunkSize() : 1024;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point end = start + std::chrono::seconds(duration);
+    int numFrames = 0;
+    while (std::chrono::steady_clock::now() < end) {
+        for (int i = 0; i < TILES_PER_FRAME; i++)
+            drawTile(host, &pixels[0], 14 + 76 * i, chunkSize);
+        numFrames++;
+    }
+    host.waitUntilCompleted();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("USB %-9s %-9s (%4d byte chunks): %6.1f frames/s\n", usbBandwidth > 0 ? "1 MB/s" : "unlimited",
+           isStreaming ? "streaming" : "1 KB", (int)chunkSize, numFrames / elapsed);
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1)
+        duration = atoi(argv[1]);
+
+    run(false, USB_FULL_SPEED);
+    run(true, USB_FULL_SPEED);
+    run(false, 0);
+    run(true, 0);
+    return 0;
+}
@@ -0,0 +1,111 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Measures request/response round trips through the pending request list
+// with several requesting threads and a single thread delivering the
+// responses (like the I/O thread).
+//
+// Usage: PendingRequestBenchmark [requests per thread]
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include "PendingRequestList.hpp"
+#include "MessagePool.hpp"
+#include "Queue.hpp"
+
+
+static int numRequests = 200000;
+static PendingRequestList* pendingRequests;
+static Queue<uint32_t, false, true>* announced; // request IDs to respond to
+static std::atomic<uint16_t> lastRequestId(0);
+static std::atomic<int> numActiveRequesters(0);
+
+#define STOP_MARKER 0x10000
+
+
+static void* request(void* arg)
+{
+    for (int i = 0; i < numRequests; i++) {
+        uint16_t requestId = lastRequestId.fetch_add(1, std::memory_order_relaxed) + 1;
+        pendingRequests->announceRequest(requestId);
+        uint32_t id = requestId;
+        while (!announced->put(id))
+            sched_yield();
+        wk_msg_header* response = pendingRequests->waitForResponse(requestId);
+        MessagePool::release(response);
+    }
+
+    if (numActiveRequesters.fetch_sub(1) == 1) {
+        uint32_t marker = STOP_MARKER;
+        while (!announced->put(marker))
+            sched_yield();
+    }
+    return NULL;
+}
+
+
+static void* respond(void* arg)
+{
+    while (true) {
+        uint32_t requestId = announced->waitForNext();
+        if (requestId == STOP_MARKER)
+            break;
+        wk_msg_header* response = (wk_msg_header*)MessagePool::acquireBuffer();
+        memset(response, 0, sizeof(wk_config_response));
+        response->message_size = sizeof(wk_config_response);
+        response->message_type = WK_MSG_TYPE_CONFIG_RESPONSE;
+        response->request_id = (uint16_t)requestId;
+        pendingRequests->putResponse((uint16_t)requestId, response);
+    }
+    return NULL;
+}
+
+
+static void run(int numThreads)
+{
+    PendingRequestList list;
+    Queue<uint32_t, false, true> queue(1024);
+    pendingRequests = &list;
+    announced = &queue;
+    numActiveRequesters.store(numThreads);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    pthread_t responder;
+    pthread_create(&responder, NULL, respond, NULL);
+    std::vector<pthread_t> requesters(numThreads);
+    for (int i = 0; i < numThreads; i++)
+        pthread_create(&requesters[i], NULL, request, NULL);
+    for (int i = 0; i < numThreads; i++)
+        pthread_join(requesters[i], NULL);
+    pthread_join(responder, NULL);
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double total = (double)numRequests * numThreads;
+    printf("%2d requesting threads: %9.0f round trips/s, %6.2f us/round trip\n",
+           numThreads, total / elapsed, elapsed * 1e6 / total);
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1)
+        numRequests = atoi(argv[1]);
+
+    printf("pending request list: %d slots, %d bytes\n", PENDING_REQUEST_NUM_SLOTS, (int)sizeof(PendingRequestList));
+    int threads[] = { 1, 2, 4, 8, 16 };
+    for (int i = 0; i < 5; i++)
+        run(threads[i]);
+    return 0;
+}
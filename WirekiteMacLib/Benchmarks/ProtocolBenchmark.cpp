@@ -0,0 +1,747 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Measures the throughput and latency of the host protocol stack.
+//
+// The component benchmarks exercise the queue, the port list, the pending
+// request list, the throttler, the message parser and the message dump
+// (compared to its former string stream implementation) on a single
+// thread. The scenarios run end-to-end against a simulated board
+// connected by a USB full speed link:
+//
+//  - analog fan-in: 16 analog inputs sampled every millisecond
+//    (latency: deviation of the gap between samples from the interval)
+//  - I2C polling: synchronous reads of 6 registers (latency: round trip)
+//  - SPI streaming: throttled 1 KB transmissions (latency: round trip)
+//  - mixed: digital output requests while SPI data is streamed
+//    (latency: round trip, reported for both request classes)
+//
+// The results are printed as text or, with --json, as a JSON document
+// that can be compared between versions to track regressions.
+//
+// Usage: ProtocolBenchmark [--json] [seconds per scenario]
+//
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "SimulatedDevice.hpp"
+#include "MessageParser.hpp"
+#include "MessagePool.hpp"
+#include "MessageDump.hpp"
+#include "PendingRequestList.hpp"
+#include "PortList.hpp"
+#include "Port.hpp"
+#include "Queue.hpp"
+#include "Throttler.hpp"
+#include "LatencyHistogram.hpp"
+
+
+#define NUM_COMPONENT_OPS 1000000
+
+#define USB_FULL_SPEED 1000000 // bytes per second
+#define USB_LATENCY 100 // µs
+#define BOARD_MEM_SIZE 20000
+#define BOARD_MAX_OUTSTANDING 100
+#define BUS_SPEED (18000000 / 8) // bytes per second
+
+#define NUM_ANALOG_INPUTS 16
+#define ANALOG_INTERVAL 1 // ms
+#define I2C_SLAVE 0x40
+#define I2C_READ_LENGTH 6
+#define SPI_CHUNK_SIZE 1024
+#define OUTPUT_PIN 13
+
+static int duration = 3;
+
+
+/**
+ * Result of a benchmark
+ */
+struct Result {
+    std::string name;
+    double messagesPerSecond;
+    double megabytesPerSecond; // 0 if not applicable
+    double nsPerMessage; // components only
+    bool hasLatency;
+    uint32_t p50; // in µs
+    uint32_t p99;
+    uint32_t p999;
+    uint32_t max;
+};
+
+static std::vector<Result> componentResults;
+static std::vector<Result> scenarioResults;
+
+
+static double elapsedSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+static uint64_t currentTime()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+static void addComponentResult(const char* name, double elapsed, uint64_t numOps, uint64_t numBytes = 0)
+{
+    Result result;
+    result.name = name;
+    result.messagesPerSecond = numOps / elapsed;
+    result.megabytesPerSecond = numBytes / elapsed / 1e6;
+    result.nsPerMessage = elapsed * 1e9 / numOps;
+    result.hasLatency = false;
+    result.p50 = result.p99 = result.p999 = result.max = 0;
+    componentResults.push_back(result);
+}
+
+
+static void addScenarioResult(const char* name, double elapsed, uint64_t numMessages, uint64_t numBytes,
+                              LatencyHistogram& latencies)
+{
+    Result result;
+    result.name = name;
+    result.messagesPerSecond = numMessages / elapsed;
+    result.megabytesPerSecond = numBytes / elapsed / 1e6;
+    result.nsPerMessage = 0;
+    result.hasLatency = true;
+    result.p50 = latencies.percentile(50);
+    result.p99 = latencies.percentile(99);
+    result.p999 = latencies.percentile(99.9);
+    result.max = latencies.maximum();
+    scenarioResults.push_back(result);
+}
+
+
+static void fillPortEvent(uint8_t* buffer, uint16_t requestId, uint16_t dataLength)
+{
+    wk_port_event* event = (wk_port_event*)buffer;
+    memset(event, 0, WK_PORT_EVENT_ALLOC_SIZE(dataLength));
+    event->header.message_size = WK_PORT_EVENT_ALLOC_SIZE(dataLength);
+    event->header.message_type = WK_MSG_TYPE_PORT_EVENT;
+    event->header.port_id = 1;
+    event->header.request_id = requestId;
+    event->event = WK_EVENT_DATA_RECV;
+}
+
+
+// --- Components ---
+
+class ReleasingHandler : public MessageHandler {
+public:
+    ReleasingHandler() : numMessages(0) { }
+
+    virtual void handleMessage(wk_msg_header* msg)
+    {
+        numMessages++;
+        MessagePool::release(msg);
+    }
+
+    uint64_t numMessages;
+};
+
+
+static void benchmarkQueue()
+{
+    Queue<uint64_t> queue(1024);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < NUM_COMPONENT_OPS; i++) {
+        queue.put(i);
+        uint64_t elem;
+        queue.tryNext(elem);
+    }
+    addComponentResult("queue put+take", elapsedSince(start), NUM_COMPONENT_OPS);
+}
+
+
+static void benchmarkPortList()
+{
+    PortList portList;
+    for (uint16_t i = 1; i <= NUM_ANALOG_INPUTS; i++)
+        portList.addPort(new Port(i, PortTypeAnalogInputSampling, 16));
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t numFound = 0;
+    for (int i = 0; i < NUM_COMPONENT_OPS; i++) {
+        int token = portList.beginRead();
+        if (portList.getPort((uint16_t)(i % NUM_ANALOG_INPUTS + 1)) != NULL)
+            numFound++;
+        portList.endRead(token);
+    }
+    addComponentResult("port list lookup", elapsedSince(start), numFound);
+}
+
+
+static void benchmarkPendingRequestList()
+{
+    PendingRequestList list;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < NUM_COMPONENT_OPS; i++) {
+        uint16_t requestId = (uint16_t)(i % 0xffff + 1);
+        list.announceRequest(requestId);
+        wk_msg_header* response = (wk_msg_header*)MessagePool::acquireBuffer();
+        memset(response, 0, sizeof(wk_config_response));
+        response->message_size = sizeof(wk_config_response);
+        response->message_type = WK_MSG_TYPE_CONFIG_RESPONSE;
+        response->request_id = requestId;
+        list.putResponse(requestId, response);
+        MessagePool::release(list.waitForResponse(requestId));
+    }
+    addComponentResult("pending request", elapsedSince(start), NUM_COMPONENT_OPS);
+}
+
+
+static void benchmarkThrottler()
+{
+    Throttler throttler;
+    throttler.configure(BOARD_MEM_SIZE, BOARD_MAX_OUTSTANDING);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < NUM_COMPONENT_OPS; i++) {
+        uint16_t requestId = (uint16_t)(i % 0xffff + 1);
+        throttler.waitUntilAvailable(requestId, WK_PORT_REQUEST_ALLOC_SIZE(16));
+        throttler.requestCompleted(requestId);
+    }
+    addComponentResult("throttler admit+complete", elapsedSince(start), NUM_COMPONENT_OPS);
+}
+
+
+static void benchmarkParser()
+{
+    // chunks of 64 byte messages like a USB full speed packet
+    std::vector<uint8_t> chunk;
+    int messageSize = WK_PORT_EVENT_ALLOC_SIZE(64 - WK_PORT_EVENT_ALLOC_SIZE(0));
+    uint8_t message[64];
+    fillPortEvent(message, 0, (uint16_t)(messageSize - WK_PORT_EVENT_ALLOC_SIZE(0)));
+    while (chunk.size() + messageSize <= MESSAGE_POOL_BUFFER_SIZE)
+        chunk.insert(chunk.end(), message, message + messageSize);
+
+    ReleasingHandler handler;
+    MessageParser parser;
+    parser.setHandler(&handler);
+
+    int numChunks = NUM_COMPONENT_OPS / 16;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < numChunks; i++) {
+        // like the USB transport, receive into a pool buffer
+        uint8_t* buffer = MessagePool::acquireBuffer();
+        memcpy(buffer, &chunk[0], chunk.size());
+        parser.processData(buffer, (uint32_t)chunk.size());
+        MessagePool::release(buffer);
+    }
+    addComponentResult("parser", elapsedSince(start), handler.numMessages, (uint64_t)numChunks * chunk.size());
+}
+
+
+// Reference: the message dump before it was formatted into a caller buffer
+// (a string stream per message). Kept to compare the two implementations.
+
+namespace StreamDump {
+
+static const char* Invalid = "<invalid>";
+static const char* MessageTypes[] = { "<invalid>", "config_request", "config_response", "port_request", "port_event" };
+static const char* ConfigActions[] = { "<invalid>", "config_port", "release", "reset", "config_module" };
+static const char* PortTypes[] = { "<invalid>", "digi_pin", "analog_in", "pwm_out", "i2c", "spi", "analog_scan" };
+static const char* PortActions[] = { "<invalid>", "set_value", "get_value", "tx_data", "rx_data", "tx_n_rx_data" };
+static const char* PortEvents[] = { "dodo", "single_sample", "tx_complete", "data_recv", "set_done", "scan_frames" };
+
+#define SafeElement(array, index) (index < sizeof(array) / sizeof(array[0]) ? array[index] : Invalid)
+
+
+static void dumpData(std::stringstream& buf, uint8_t* data, int len)
+{
+    buf << "data: ";
+    for (int i = 0; i < len; i++)
+        buf << std::setw(2) << std::setfill('0') << (int)data[i];
+    buf << "\n";
+}
+
+
+static void dumpFrames(std::stringstream& buf, uint8_t* data, int len, int numChannels)
+{
+    if (numChannels == 0) {
+        dumpData(buf, data, len);
+        return;
+    }
+
+    int numFrames = len / (numChannels * 4);
+    buf << std::dec;
+    for (int i = 0; i < numFrames; i++) {
+        buf << "frame " << i << ":";
+        for (int j = 0; j < numChannels; j++) {
+            int32_t sample;
+            memcpy(&sample, data + (i * numChannels + j) * 4, 4);
+            buf << " " << sample;
+        }
+        buf << "\n";
+    }
+    buf << std::hex;
+}
+
+
+static std::string dump(wk_msg_header* msg)
+{
+    std::stringstream buf;
+
+    buf << std::hex << "\n";
+    buf << "message_size: " << msg->message_size << "\n";
+    buf << "message_type: " << SafeElement(MessageTypes, msg->message_type) << " (" << (int)msg->message_type << ")\n";
+    buf << "port_id: " << msg->port_id << "\n";
+    buf << "request_id: " << msg->request_id << "\n";
+
+    if (msg->message_type == WK_MSG_TYPE_CONFIG_REQUEST) {
+        wk_config_request* request = (wk_config_request*)msg;
+        buf << "action: " << SafeElement(ConfigActions, request->action) << " (" << (int)request->action << ")\n";
+        buf << "port_type: " << SafeElement(PortTypes, request->port_type) << " (" << (int)request->port_type << ")\n";
+        buf << "pin_config: " << request->pin_config << "\n";
+        buf << "value1: " << request->value1 << "\n";
+        buf << "port_attributes1: " << request->port_attributes1 << "\n";
+        buf << "port_attributes2: " << request->port_attributes2 << "\n";
+    } else if (msg->message_type == WK_MSG_TYPE_CONFIG_RESPONSE) {
+        wk_config_response* response = (wk_config_response*)msg;
+        buf << "result: " << response->result << "\n";
+        buf << "optional1: " << response->optional1 << "\n";
+        buf << "value1: " << response->value1 << "\n";
+    } else if (msg->message_type == WK_MSG_TYPE_PORT_REQUEST) {
+        wk_port_request* request = (wk_port_request*)msg;
+        buf << "action: " << SafeElement(PortActions, request->action) << " (" << (int)request->action << ")\n";
+        buf << "action_attribute1: " << (int)request->action_attribute1 << "\n";
+        buf << "action_attribute2: " << request->action_attribute2 << "\n";
+        buf << "value1: " << request->value1 << "\n";
+        int data_length = msg->message_size - sizeof(wk_port_request) + 4;
+        dumpData(buf, request->data, data_length);
+    } else if (msg->message_type == WK_MSG_TYPE_PORT_EVENT) {
+        wk_port_event* event = (wk_port_event*)msg;
+        buf << "event: " << SafeElement(PortEvents, event->event) << " (" << (int)event->event << ")\n";
+        buf << "event_attribute1: " << (int)event->event_attribute1 << "\n";
+        buf << "event_attribute2: " << (int)event->event_attribute2 << "\n";
+        buf << "value1: " << event->value1 << "\n";
+        int data_length = msg->message_size - sizeof(wk_port_event) + 4;
+        if (event->event == WK_EVENT_SCAN_FRAMES)
+            dumpFrames(buf, event->data, data_length, event->event_attribute2);
+        else
+            dumpData(buf, event->data, data_length);
+    }
+
+    return buf.str();
+}
+
+#undef SafeElement
+
+}
+
+
+static void benchmarkMessageDump()
+{
+    uint8_t message[WK_PORT_EVENT_ALLOC_SIZE(8)];
+    fillPortEvent(message, 17, 8);
+    char text[256];
+    int numOps = NUM_COMPONENT_OPS / 4;
+    size_t totalLength = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < numOps; i++)
+        totalLength += MessageDump::format((wk_msg_header*)message, text, sizeof(text));
+    addComponentResult("message dump", elapsedSince(start), numOps, totalLength);
+
+    totalLength = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < numOps; i++)
+        totalLength += StreamDump::dump((wk_msg_header*)message).size();
+    addComponentResult("message dump (stream)", elapsedSince(start), numOps, totalLength);
+}
+
+
+// --- Scenarios ---
+
+/**
+ * Host side of the simulated board: sends requests, throttles them
+ * and records their round-trip time when the response arrives.
+ */
+class Host : public TransportListener, public MessageHandler {
+public:
+    Host()
+    :   numEvents(0),
+        numBytesReceived(0),
+        lastRequestId(0)
+    {
+        requests = new PendingRequest[0x10000];
+        for (int i = 0; i < 0x10000; i++) {
+            requests[i].histogram = NULL;
+            requests[i].isThrottled = false;
+            requests[i].startTime = 0;
+        }
+        for (int i = 0; i <= NUM_ANALOG_INPUTS; i++)
+            lastSampleTimes[i] = 0;
+
+        parser.setHandler(this);
+        throttler.configure(BOARD_MEM_SIZE, BOARD_MAX_OUTSTANDING);
+        device.configureLink(USB_LATENCY, USB_FULL_SPEED);
+        device.configureBuffer(BOARD_MEM_SIZE, BUS_SPEED);
+        device.setListener(this);
+        device.start();
+    }
+
+    ~Host()
+    {
+        device.stop();
+        pendingRequests.clear();
+        delete[] requests;
+    }
+
+    virtual void onDataReceived(const uint8_t* data, uint32_t length)
+    {
+        numBytesReceived.fetch_add(length, std::memory_order_relaxed);
+        parser.processData(data, length);
+    }
+
+    virtual void handleMessage(wk_msg_header* msg)
+    {
+        uint16_t requestId = msg->request_id;
+        if (requestId == 0) {
+            if (msg->message_type == WK_MSG_TYPE_PORT_EVENT)
+                sampleReceived(msg->port_id);
+            MessagePool::release(msg);
+            return;
+        }
+
+        PendingRequest& request = requests[requestId];
+        if (request.histogram != NULL)
+            request.histogram->record((uint32_t)(currentTime() - request.startTime));
+        if (request.isThrottled) {
+            bool overrun = msg->message_type == WK_MSG_TYPE_PORT_EVENT
+                && ((wk_port_event*)msg)->event_attribute1 == 5;
+            throttler.requestCompleted(requestId, overrun);
+        }
+        pendingRequests.putResponse(requestId, msg);
+    }
+
+    /**
+     * Configures a port and waits for the response.
+     * @return the port ID
+     */
+    uint16_t configurePort(uint8_t portType, uint16_t pin, uint16_t attributes, uint32_t value1)
+    {
+        wk_config_request request;
+        memset(&request, 0, sizeof(request));
+        request.header.message_size = sizeof(request);
+        request.header.message_type = WK_MSG_TYPE_CONFIG_REQUEST;
+        request.header.request_id = nextRequestId();
+        request.action = WK_CFG_ACTION_CONFIG_PORT;
+        request.port_type = portType;
+        request.pin_config = pin;
+        request.port_attributes1 = attributes;
+        request.value1 = value1;
+
+        wk_config_response* response = (wk_config_response*)send(&request.header, NULL, false, true);
+        uint16_t portId = response != NULL ? response->header.port_id : 0;
+        MessagePool::release(response);
+        return portId;
+    }
+
+    /**
+     * Sends a port request.
+     * @param request the request (the request ID is assigned)
+     * @param histogram the histogram receiving the round-trip time
+     * @param priority the throttler priority
+     * @param waitForResponse `true` to wait for the response, `false` to return immediately
+     */
+    void sendPortRequest(wk_port_request* request, LatencyHistogram* histogram, ThrottlerPriority priority,
+                         bool waitForResponse)
+    {
+        request->header.request_id = nextRequestId();
+        throttler.waitUntilAvailable(request->header.request_id, request->header.message_size, priority);
+        MessagePool::release(send(&request->header, histogram, true, waitForResponse));
+    }
+
+    void waitUntilCompleted()
+    {
+        while (throttler.bytesInFlight() > 0)
+            usleep(100);
+    }
+
+    SimulatedDevice device;
+    std::atomic<uint64_t> numEvents; // samples received
+    std::atomic<uint64_t> numBytesReceived;
+    LatencyHistogram sampleJitter;
+
+private:
+    struct PendingRequest {
+        LatencyHistogram* histogram;
+        bool isThrottled;
+        uint64_t startTime;
+    };
+
+    uint16_t nextRequestId()
+    {
+        uint16_t requestId;
+        do {
+            requestId = lastRequestId.fetch_add(1, std::memory_order_relaxed) + 1;
+        } while (requestId == 0);
+        return requestId;
+    }
+
+    wk_msg_header* send(wk_msg_header* msg, LatencyHistogram* histogram, bool isThrottled, bool waitForResponse)
+    {
+        // the device's mutex publishes the request data to the I/O thread
+        PendingRequest& request = requests[msg->request_id];
+        request.histogram = histogram;
+        request.isThrottled = isThrottled;
+        request.startTime = currentTime();
+        if (waitForResponse)
+            pendingRequests.announceRequest(msg->request_id);
+        device.writeBytes((const uint8_t*)msg, msg->message_size);
+        return waitForResponse ? pendingRequests.waitForResponse(msg->request_id) : NULL;
+    }
+
+    void sampleReceived(uint16_t portId)
+    {
+        numEvents.fetch_add(1, std::memory_order_relaxed);
+        if (portId > NUM_ANALOG_INPUTS)
+            return;
+        uint64_t now = currentTime();
+        uint64_t last = lastSampleTimes[portId];
+        lastSampleTimes[portId] = now;
+        if (last == 0)
+            return;
+        int64_t deviation = (int64_t)(now - last) - ANALOG_INTERVAL * 1000;
+        sampleJitter.record((uint32_t)(deviation >= 0 ? deviation : -deviation));
+    }
+
+private:
+    MessageParser parser;
+    Throttler throttler;
+    PendingRequestList pendingRequests;
+    PendingRequest* requests; // indexed by request ID
+    std::atomic<uint16_t> lastRequestId;
+    uint64_t lastSampleTimes[NUM_ANALOG_INPUTS + 1]; // indexed by port ID; I/O thread only
+};
+
+
+static void initPortRequest(wk_port_request* request, uint16_t portId, uint8_t action, uint16_t dataLength)
+{
+    memset(request, 0, WK_PORT_REQUEST_ALLOC_SIZE(0));
+    request->header.message_size = WK_PORT_REQUEST_ALLOC_SIZE(dataLength);
+    request->header.message_type = WK_MSG_TYPE_PORT_REQUEST;
+    request->header.port_id = portId;
+    request->action = action;
+}
+
+
+static void runAnalogFanIn()
+{
+    Host host;
+    for (uint16_t i = 0; i < NUM_ANALOG_INPUTS; i++) {
+        host.device.setAnalogInput(i, 1000 + i);
+        host.configurePort(WK_CFG_PORT_TYPE_ANALOG_IN, i, 0, ANALOG_INTERVAL);
+    }
+
+    // skip the start-up
+    usleep(200000);
+    host.sampleJitter.reset();
+    uint64_t startEvents = host.numEvents.load();
+    uint64_t startBytes = host.numBytesReceived.load();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    sleep(duration);
+
+    double elapsed = elapsedSince(start);
+    addScenarioResult("analog fan-in", elapsed, host.numEvents.load() - startEvents,
+                      host.numBytesReceived.load() - startBytes, host.sampleJitter);
+}
+
+
+static void runI2CPolling()
+{
+    Host host;
+    uint8_t registers[16];
+    for (int i = 0; i < 16; i++)
+        registers[i] = (uint8_t)i;
+    host.device.setI2CRegisters(I2C_SLAVE, 0, registers, sizeof(registers));
+    uint16_t portId = host.configurePort(WK_CFG_PORT_TYPE_I2C, 0, 0, 0);
+
+    LatencyHistogram latencies;
+    uint8_t buffer[WK_PORT_REQUEST_ALLOC_SIZE(1)];
+    wk_port_request* request = (wk_port_request*)buffer;
+
+    uint64_t numRequests = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point end = start + std::chrono::seconds(duration);
+    while (std::chrono::steady_clock::now() < end) {
+        initPortRequest(request, portId, WK_PORT_ACTION_TX_N_RX_DATA, 1);
+        request->action_attribute2 = I2C_SLAVE;
+        request->value1 = I2C_READ_LENGTH;
+        request->data[0] = 0; // first register
+        host.sendPortRequest(request, &latencies, ThrottlerPriorityNormal, true);
+        numRequests++;
+    }
+
+    double elapsed = elapsedSince(start);
+    uint64_t numBytes = numRequests * (WK_PORT_REQUEST_ALLOC_SIZE(1) + WK_PORT_EVENT_ALLOC_SIZE(I2C_READ_LENGTH));
+    addScenarioResult("I2C polling", elapsed, numRequests, numBytes, latencies);
+}
+
+
+struct StreamContext {
+    Host* host;
+    uint16_t portId;
+    LatencyHistogram* latencies;
+    std::atomic<bool>* isRunning;
+    uint64_t numRequests;
+};
+
+
+static void* streamSPI(void* arg)
+{
+    StreamContext* context = (StreamContext*)arg;
+    std::vector<uint8_t> buffer(WK_PORT_REQUEST_ALLOC_SIZE(SPI_CHUNK_SIZE));
+    wk_port_request* request = (wk_port_request*)&buffer[0];
+    while (context->isRunning->load(std::memory_order_relaxed)) {
+        initPortRequest(request, context->portId, WK_PORT_ACTION_TX_DATA, SPI_CHUNK_SIZE);
+        memset(request->data, 0x5a, SPI_CHUNK_SIZE);
+        context->host->sendPortRequest(request, context->latencies, ThrottlerPriorityBulk, false);
+        context->numRequests++;
+    }
+    return NULL;
+}
+
+
+static void runSPIStreaming(bool withControl)
+{
+    Host host;
+    uint16_t spiPortId = host.configurePort(WK_CFG_PORT_TYPE_SPI, 0, 0, 0);
+    uint16_t outputPortId = host.configurePort(WK_CFG_PORT_TYPE_DIGI_PIN, OUTPUT_PIN, 1, 0);
+
+    LatencyHistogram bulkLatencies;
+    LatencyHistogram controlLatencies;
+    std::atomic<bool> isRunning(true);
+    StreamContext context = { &host, spiPortId, &bulkLatencies, &isRunning, 0 };
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pthread_t streamer;
+    pthread_create(&streamer, NULL, streamSPI, &context);
+
+    uint64_t numControlRequests = 0;
+    if (withControl) {
+        // toggle a digital output every millisecond and wait for the confirmation
+        wk_port_request request;
+        std::chrono::steady_clock::time_point end = start + std::chrono::seconds(duration);
+        while (std::chrono::steady_clock::now() < end) {
+            initPortRequest(&request, outputPortId, WK_PORT_ACTION_SET_VALUE, 0);
+            request.value1 = numControlRequests & 1;
+            host.sendPortRequest(&request, &controlLatencies, ThrottlerPriorityControl, true);
+            numControlRequests++;
+            usleep(1000);
+        }
+    } else {
+        sleep(duration);
+    }
+
+    isRunning = false;
+    pthread_join(streamer, NULL);
+    host.waitUntilCompleted();
+    double elapsed = elapsedSince(start);
+
+    uint64_t bulkBytes = context.numRequests * WK_PORT_REQUEST_ALLOC_SIZE(SPI_CHUNK_SIZE);
+    if (withControl) {
+        addScenarioResult("mixed bulk", elapsed, context.numRequests, bulkBytes, bulkLatencies);
+        addScenarioResult("mixed control", elapsed, numControlRequests,
+                          numControlRequests * WK_PORT_REQUEST_ALLOC_SIZE(0), controlLatencies);
+    } else {
+        addScenarioResult("SPI streaming", elapsed, context.numRequests, bulkBytes, bulkLatencies);
+    }
+}
+
+
+// --- Output ---
+
+static void printText()
+{
+    printf("components:\n");
+    for (size_t i = 0; i < componentResults.size(); i++) {
+        Result& r = componentResults[i];
+        printf("  %-26s %9.2f M ops/s, %7.1f ns/op", r.name.c_str(), r.messagesPerSecond / 1e6, r.nsPerMessage);
+        if (r.megabytesPerSecond > 0)
+            printf(", %7.1f MB/s", r.megabytesPerSecond);
+        printf("\n");
+    }
+
+    printf("scenarios (latency in µs):\n");
+    for (size_t i = 0; i < scenarioResults.size(); i++) {
+        Result& r = scenarioResults[i];
+        printf("  %-14s %8.0f msgs/s, %6.3f MB/s, p50 %5u, p99 %5u, p999 %5u, max %5u\n", r.name.c_str(),
+               r.messagesPerSecond, r.megabytesPerSecond, r.p50, r.p99, r.p999, r.max);
+    }
+}
+
+
+static void printJSONResults(const char* name, std::vector<Result>& results)
+{
+    printf("\"%s\":[", name);
+    for (size_t i = 0; i < results.size(); i++) {
+        Result& r = results[i];
+        printf("%s{\"name\":\"%s\",\"messagesPerSecond\":%.1f,\"megabytesPerSecond\":%.3f", i > 0 ? "," : "",
+               r.name.c_str(), r.messagesPerSecond, r.megabytesPerSecond);
+        if (r.hasLatency)
+            printf(",\"latency\":{\"p50\":%u,\"p99\":%u,\"p999\":%u,\"max\":%u}", r.p50, r.p99, r.p999, r.max);
+        else
+            printf(",\"nsPerMessage\":%.1f", r.nsPerMessage);
+        printf("}");
+    }
+    printf("]");
+}
+
+
+static void printJSON()
+{
+    // latencies in µs
+    printf("{\"durationSeconds\":%d,", duration);
+    printJSONResults("components", componentResults);
+    printf(",");
+    printJSONResults("scenarios", scenarioResults);
+    printf("}\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+    bool isJSON = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0)
+            isJSON = true;
+        else
+            duration = atoi(argv[i]);
+    }
+
+    benchmarkQueue();
+    benchmarkPortList();
+    benchmarkPendingRequestList();
+    benchmarkThrottler();
+    benchmarkParser();
+    benchmarkMessageDump();
+
+    runAnalogFanIn();
+    runI2CPolling();
+    runSPIStreaming(false);
+    runSPIStreaming(true);
+
+    if (isJSON)
+        printJSON();
+    else
+        printText();
+    return 0;
+}
@@ -0,0 +1,171 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Measures the throughput of the queue for the producer/consumer
+// topologies it is used with, compared to the former queue protected
+// by a mutex and a condition variable (LockedQueue).
+//
+// Usage: QueueBenchmark [elements per producer]
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <chrono>
+#include <queue>
+#include <vector>
+#include "Queue.hpp"
+
+
+#define QUEUE_LENGTH 1024
+#define END_MARKER UINT64_MAX
+
+
+static uint64_t numElements = 2000000;
+
+
+/**
+ * Baseline: the former queue (a standard queue protected by a mutex,
+ * consumers waiting on a condition variable)
+ */
+template <class E> class LockedQueue {
+
+public:
+    LockedQueue(int maxSize);
+    ~LockedQueue();
+
+    E waitForNext();
+    bool put(E& elem);
+
+private:
+    std::queue<E> elements;
+    size_t maxSize;
+    pthread_cond_t not_empty;
+    pthread_mutex_t mutex;
+};
+
+
+template <class E> LockedQueue<E>::LockedQueue(int maxSize)
+:   maxSize(maxSize)
+{
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&not_empty, NULL);
+}
+
+
+template <class E> LockedQueue<E>::~LockedQueue()
+{
+    pthread_cond_destroy(&not_empty);
+    pthread_mutex_destroy(&mutex);
+}
+
+
+template <class E> bool LockedQueue<E>::put(E& elem)
+{
+    pthread_mutex_lock(&mutex);
+
+    bool success = true;
+    if (elements.size() <= maxSize)
+        elements.push(elem);
+    else
+        success = false; // cannot add; queue is full
+
+    pthread_cond_signal(&not_empty);
+    pthread_mutex_unlock(&mutex);
+
+    return success;
+}
+
+
+template <class E> E LockedQueue<E>::waitForNext()
+{
+    pthread_mutex_lock(&mutex);
+    while (elements.empty())
+        pthread_cond_wait(&not_empty, &mutex);
+
+    E result = elements.front();
+    elements.pop();
+
+    pthread_mutex_unlock(&mutex);
+
+    return result;
+}
+
+
+template <class Q> static void* produce(void* arg)
+{
+    Q* queue = (Q*)arg;
+    for (uint64_t i = 0; i < numElements; i++) {
+        while (!queue->put(i))
+            sched_yield();
+    }
+    return NULL;
+}
+
+
+template <class Q> static void* consume(void* arg)
+{
+    Q* queue = (Q*)arg;
+    while (queue->waitForNext() != END_MARKER)
+        ;
+    return NULL;
+}
+
+
+template <class Q> static void run(const char* name, int numProducers, int numConsumers)
+{
+    Q queue(QUEUE_LENGTH);
+    std::vector<pthread_t> producers(numProducers), consumers(numConsumers);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < numConsumers; i++)
+        pthread_create(&consumers[i], NULL, consume<Q>, &queue);
+    for (int i = 0; i < numProducers; i++)
+        pthread_create(&producers[i], NULL, produce<Q>, &queue);
+    for (int i = 0; i < numProducers; i++)
+        pthread_join(producers[i], NULL);
+    for (int i = 0; i < numConsumers; i++) {
+        uint64_t marker = END_MARKER;
+        while (!queue.put(marker))
+            sched_yield();
+    }
+    for (int i = 0; i < numConsumers; i++)
+        pthread_join(consumers[i], NULL);
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double total = (double)numElements * numProducers;
+    printf("%-6s %d producer(s) %d consumer(s): %8.2f M elements/s, %6.1f ns/element\n",
+           name, numProducers, numConsumers, total / elapsed / 1e6, elapsed * 1e9 / total);
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1)
+        numElements = strtoull(argv[1], NULL, 10);
+
+    // single producer, several consumers (port queue)
+    run<LockedQueue<uint64_t> >("locked", 1, 1);
+    run<Queue<uint64_t> >("MPMC", 1, 1);
+    run<Queue<uint64_t, true, false> >("SPMC", 1, 1);
+    run<LockedQueue<uint64_t> >("locked", 1, 3);
+    run<Queue<uint64_t> >("MPMC", 1, 3);
+    run<Queue<uint64_t, true, false> >("SPMC", 1, 3);
+
+    // several producers, single consumer (sample recorder)
+    run<LockedQueue<uint64_t> >("locked", 3, 1);
+    run<Queue<uint64_t> >("MPMC", 3, 1);
+    run<Queue<uint64_t, false, true> >("MPSC", 3, 1);
+
+    // single producer, single consumer
+    run<LockedQueue<uint64_t> >("locked", 1, 1);
+    run<Queue<uint64_t, true, true> >("SPSC", 1, 1);
+    return 0;
+}
@@ -0,0 +1,85 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+// Measures the throughput of each filter type when the samples are
+// processed one at a time (as a single event does) and in batches
+// (as the event executor's batches and larger blocks do).
+//
+// Usage: SampleFilterBenchmark [samples]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "SampleFilter.hpp"
+#include "Port.hpp"
+
+
+static int numSamples = 10000000;
+
+struct FilterConfig {
+    const char* name;
+    SampleFilterType type;
+    int parameter;
+};
+
+static const FilterConfig configs[] = {
+    { "boxcar 16", SampleFilterBoxcar, 16 },
+    { "decimation 8", SampleFilterDecimation, 8 },
+    { "exponential 4", SampleFilterExponential, 4 },
+    { "median 15", SampleFilterMedian, 15 },
+    { "minimum 8", SampleFilterMinimum, 8 },
+    { "maximum 8", SampleFilterMaximum, 8 }
+};
+
+
+static double run(const FilterConfig& config, int batchSize)
+{
+    SampleFilter filter;
+    filter.addStage(config.type, config.parameter);
+
+    std::vector<int32_t> values(batchSize);
+    std::vector<uint64_t> timestamps(batchSize);
+    uint32_t seed = 1;
+    int64_t checksum = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int n = 0; n < numSamples; n += batchSize) {
+        for (int i = 0; i < batchSize; i++) {
+            seed = seed * 1664525 + 1013904223;
+            values[i] = (int32_t)seed >> 4;
+            timestamps[i] = (uint64_t)(n + i) * 1000;
+        }
+        int count = filter.process(&values[0], &timestamps[0], batchSize);
+        for (int i = 0; i < count; i++)
+            checksum += values[i];
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (checksum == 1)
+        printf(" "); // keeps the results alive
+    return numSamples / elapsed / 1e6;
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1)
+        numSamples = atoi(argv[1]);
+
+    int batchSizes[] = { 1, PORT_FILTER_BATCH_SIZE, 256 };
+    printf("%-14s  %12s  %12s  %12s   (million samples/s)\n", "filter", "1 sample", "16 samples", "256 samples");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        printf("%-14s", configs[i].name);
+        for (int j = 0; j < 3; j++)
+            printf("  %12.1f", run(configs[i], batchSizes[j]));
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,236 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <sched.h>
+#include "EventExecutor.hpp"
+
+
+EventExecutor::EventExecutor(int numThreads)
+:   numThreads(numThreads),
+    isRunning(true),
+    numScheduled(0),
+    numWaiting(0),
+    mutex(PTHREAD_MUTEX_INITIALIZER),
+    available(PTHREAD_COND_INITIALIZER)
+{
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&available, NULL);
+
+    if (this->numThreads < 1)
+        this->numThreads = 1;
+    if (this->numThreads > EVENT_EXECUTOR_MAX_THREADS)
+        this->numThreads = EVENT_EXECUTOR_MAX_THREADS;
+
+    for (int i = 0; i < EVENT_EXECUTOR_NUM_STRANDS; i++) {
+        pthread_mutex_init(&strands[i].mutex, NULL);
+        strands[i].isScheduled = false;
+        strands[i].isBusy.store(false, std::memory_order_relaxed);
+    }
+
+    for (int i = 0; i < EVENT_EXECUTOR_MAX_THREADS; i++) {
+        workers[i].executor = this;
+        workers[i].index = i;
+        pthread_mutex_init(&workers[i].mutex, NULL);
+    }
+
+    for (int i = 0; i < this->numThreads; i++)
+        pthread_create(&workers[i].thread, NULL, threadMain, &workers[i]);
+}
+
+
+EventExecutor::~EventExecutor()
+{
+    pthread_mutex_lock(&mutex);
+    isRunning.store(false, std::memory_order_seq_cst);
+    pthread_cond_broadcast(&available);
+    pthread_mutex_unlock(&mutex);
+
+    for (int i = 0; i < numThreads; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    // discard the events that have not been handled
+    for (int i = 0; i < EVENT_EXECUTOR_NUM_STRANDS; i++) {
+        Strand& strand = strands[i];
+        for (std::deque<Event>::iterator it = strand.events.begin(); it != strand.events.end(); it++)
+            MessagePool::release(it->msg);
+        pthread_mutex_destroy(&strand.mutex);
+    }
+
+    for (int i = 0; i < EVENT_EXECUTOR_MAX_THREADS; i++)
+        pthread_mutex_destroy(&workers[i].mutex);
+    pthread_cond_destroy(&available);
+    pthread_mutex_destroy(&mutex);
+}
+
+
+EventExecutor* EventExecutor::shared()
+{
+    // lives until the process exits
+    static EventExecutor* executor = new EventExecutor(EVENT_EXECUTOR_DEFAULT_THREADS);
+    return executor;
+}
+
+
+void EventExecutor::submit(MessageHandler* handler, wk_msg_header* msg)
+{
+    // spread the ports of all devices over the strands
+    uint32_t hash = (uint32_t)((uintptr_t)handler >> 4) * 2654435761u + msg->port_id;
+    int strandIndex = hash % EVENT_EXECUTOR_NUM_STRANDS;
+    Strand* strand = &strands[strandIndex];
+
+    Event event;
+    event.handler = handler;
+    event.msg = msg;
+
+    pthread_mutex_lock(&strand->mutex);
+    strand->events.push_back(event);
+    bool needsScheduling = !strand->isScheduled;
+    strand->isScheduled = true;
+    pthread_mutex_unlock(&strand->mutex);
+
+    // a scheduled strand is already on a deque or being run
+    if (needsScheduling)
+        schedule(strand, strandIndex % numThreads);
+}
+
+
+void EventExecutor::remove(MessageHandler* handler)
+{
+    for (int i = 0; i < EVENT_EXECUTOR_NUM_STRANDS; i++) {
+        Strand& strand = strands[i];
+
+        pthread_mutex_lock(&strand.mutex);
+        std::deque<Event>::iterator it = strand.events.begin();
+        while (it != strand.events.end()) {
+            if (it->handler == handler) {
+                MessagePool::release(it->msg);
+                it = strand.events.erase(it);
+            } else {
+                it++;
+            }
+        }
+        pthread_mutex_unlock(&strand.mutex);
+
+        // a batch taken before might contain events of the handler
+        while (strand.isBusy.load(std::memory_order_acquire))
+            sched_yield();
+    }
+}
+
+
+void EventExecutor::schedule(Strand* strand, int worker)
+{
+    Worker& w = workers[worker];
+    pthread_mutex_lock(&w.mutex);
+    w.strands.push_back(strand);
+    pthread_mutex_unlock(&w.mutex);
+
+    numScheduled.fetch_add(1, std::memory_order_seq_cst);
+    if (numWaiting.load(std::memory_order_seq_cst) > 0) {
+        pthread_mutex_lock(&mutex);
+        pthread_cond_signal(&available);
+        pthread_mutex_unlock(&mutex);
+    }
+}
+
+
+EventExecutor::Strand* EventExecutor::takeStrand(int worker)
+{
+    // own deque first (oldest strand), then steal from the other deques (newest strand)
+    for (int i = 0; i < numThreads; i++) {
+        Worker& w = workers[(worker + i) % numThreads];
+        Strand* strand = NULL;
+        pthread_mutex_lock(&w.mutex);
+        if (!w.strands.empty()) {
+            if (i == 0) {
+                strand = w.strands.front();
+                w.strands.pop_front();
+            } else {
+                strand = w.strands.back();
+                w.strands.pop_back();
+            }
+        }
+        pthread_mutex_unlock(&w.mutex);
+
+        if (strand != NULL) {
+            numScheduled.fetch_sub(1, std::memory_order_relaxed);
+            return strand;
+        }
+    }
+
+    return NULL;
+}
+
+
+void EventExecutor::runStrand(Strand* strand, int worker)
+{
+    Event batch[EVENT_EXECUTOR_BATCH_SIZE];
+
+    pthread_mutex_lock(&strand->mutex);
+    int count = 0;
+    while (count < EVENT_EXECUTOR_BATCH_SIZE && !strand->events.empty()) {
+        batch[count] = strand->events.front();
+        strand->events.pop_front();
+        count++;
+    }
+    strand->isBusy.store(true, std::memory_order_relaxed);
+    pthread_mutex_unlock(&strand->mutex);
+
+    uint16_t portIds[EVENT_EXECUTOR_BATCH_SIZE];
+    for (int i = 0; i < count; i++) {
+        portIds[i] = batch[i].msg->port_id;
+        batch[i].handler->handleMessage(batch[i].msg);
+    }
+
+    // complete the batch once for each port (the messages have been released by now)
+    for (int i = 0; i < count; i++) {
+        bool isFirst = true;
+        for (int j = 0; j < i && isFirst; j++)
+            isFirst = batch[j].handler != batch[i].handler || portIds[j] != portIds[i];
+        if (isFirst)
+            batch[i].handler->handleBatchEnd(portIds[i]);
+    }
+
+    pthread_mutex_lock(&strand->mutex);
+    strand->isBusy.store(false, std::memory_order_release);
+    bool hasMore = !strand->events.empty();
+    if (!hasMore)
+        strand->isScheduled = false;
+    pthread_mutex_unlock(&strand->mutex);
+
+    // the strand remains scheduled so no other thread handles its events meanwhile
+    if (hasMore)
+        schedule(strand, worker);
+}
+
+
+void EventExecutor::run(int worker)
+{
+    while (isRunning.load(std::memory_order_relaxed)) {
+        Strand* strand = takeStrand(worker);
+        if (strand != NULL) {
+            runStrand(strand, worker);
+            continue;
+        }
+
+        pthread_mutex_lock(&mutex);
+        numWaiting.fetch_add(1, std::memory_order_seq_cst);
+        while (numScheduled.load(std::memory_order_seq_cst) == 0 && isRunning.load(std::memory_order_relaxed))
+            pthread_cond_wait(&available, &mutex);
+        numWaiting.fetch_sub(1, std::memory_order_relaxed);
+        pthread_mutex_unlock(&mutex);
+    }
+}
+
+
+void* EventExecutor::threadMain(void* arg)
+{
+    Worker* worker = (Worker*)arg;
+    worker->executor->run(worker->index);
+    return NULL;
+}
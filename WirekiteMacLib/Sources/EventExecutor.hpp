@@ -0,0 +1,117 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef EventExecutor_hpp
+#define EventExecutor_hpp
+
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include "MessageParser.hpp"
+
+
+#define EVENT_EXECUTOR_MAX_THREADS 8
+#define EVENT_EXECUTOR_DEFAULT_THREADS 3
+#define EVENT_EXECUTOR_NUM_STRANDS 256
+#define EVENT_EXECUTOR_BATCH_SIZE 16
+
+
+/**
+ * Pool of threads handling the port events of one or more devices
+ *
+ * Events are assigned to a strand by their handler (the device) and port ID.
+ * The events of a strand are handled one at a time in the order they were
+ * submitted, so the event order of each port is retained. Different strands
+ * are handled in parallel.
+ *
+ * A strand with pending events is scheduled on the deque of its home thread.
+ * An idle thread steals strands from the other threads' deques. So a slow
+ * handler only delays the ports sharing its strand. After a batch of events,
+ * the handler completes the batch for each of its ports (`handleBatchEnd`)
+ * and the strand is rescheduled to give the other strands a turn.
+ *
+ * The events of a device are expected to be submitted from a single thread
+ * (its I/O thread).
+ */
+class EventExecutor {
+public:
+    /**
+     * Creates a new instance and starts the threads.
+     * @param numThreads the number of threads (1 to EVENT_EXECUTOR_MAX_THREADS)
+     */
+    EventExecutor(int numThreads);
+    ~EventExecutor();
+
+    /**
+     * Gets the executor shared by all devices.
+     * @return the executor
+     */
+    static EventExecutor* shared();
+
+    /**
+     * Submits an event for handling.
+     *
+     * The executor takes ownership of the event and passes it on to the handler.
+     *
+     * @param handler the handler
+     * @param msg the event
+     */
+    void submit(MessageHandler* handler, wk_msg_header* msg);
+
+    /**
+     * Releases the events of the specified handler that have not been handled yet.
+     *
+     * When the call returns, none of its events is being handled anymore.
+     * No further events must be submitted for the handler. Must not be
+     * called from a thread of the executor.
+     *
+     * @param handler the handler
+     */
+    void remove(MessageHandler* handler);
+
+private:
+    struct Event {
+        MessageHandler* handler;
+        wk_msg_header* msg;
+    };
+
+    struct Strand {
+        pthread_mutex_t mutex;
+        std::deque<Event> events;
+        bool isScheduled;
+        std::atomic<bool> isBusy; // a batch is being handled
+    };
+
+    struct Worker {
+        EventExecutor* executor;
+        int index;
+        pthread_t thread;
+        pthread_mutex_t mutex;
+        std::deque<Strand*> strands;
+    };
+
+    void schedule(Strand* strand, int worker);
+    Strand* takeStrand(int worker);
+    void runStrand(Strand* strand, int worker);
+    void run(int worker);
+    static void* threadMain(void* arg);
+
+private:
+    int numThreads;
+    Strand strands[EVENT_EXECUTOR_NUM_STRANDS];
+    Worker workers[EVENT_EXECUTOR_MAX_THREADS];
+    std::atomic<bool> isRunning;
+    std::atomic<int> numScheduled;
+    std::atomic<int> numWaiting;
+    pthread_mutex_t mutex;
+    pthread_cond_t available;
+};
+
+
+#endif /* EventExecutor_hpp */
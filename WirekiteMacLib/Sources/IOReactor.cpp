@@ -0,0 +1,405 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include "IOReactor.hpp"
+
+
+#ifdef __APPLE__
+// interval of the wake-up timer (it is rescheduled before it fires)
+#define TIMER_INTERVAL 1.0e9
+#endif
+
+
+static int64_t currentTime()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+IOReactor::IOReactor(int maxThreads)
+:   maxThreads(std::min(std::max(maxThreads, 1), IO_REACTOR_MAX_THREADS)),
+    _numThreads(0),
+    mutex(PTHREAD_MUTEX_INITIALIZER),
+    changed(PTHREAD_COND_INITIALIZER),
+    isRunning(true)
+{
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&changed, NULL);
+
+    for (int i = 0; i < IO_REACTOR_MAX_THREADS; i++) {
+        Thread& thread = threads[i];
+        thread.reactor = this;
+        thread.isStarted = false;
+#ifdef __APPLE__
+        thread.runLoop = NULL;
+        thread.wakeSource = NULL;
+        thread.timer = NULL;
+#else
+        pthread_cond_init(&thread.wakeUp, NULL);
+        thread.isSignaled = false;
+        thread.nextPass = IO_REACTOR_NEVER;
+#endif
+        thread.numAttached = 0;
+        thread.passesStarted = 0;
+        thread.passesCompleted = 0;
+    }
+}
+
+
+IOReactor::~IOReactor()
+{
+    pthread_mutex_lock(&mutex);
+    isRunning = false;
+    int n = _numThreads;
+    _numThreads = 0;
+#ifndef __APPLE__
+    for (int i = 0; i < n; i++)
+        pthread_cond_signal(&threads[i].wakeUp);
+#endif
+    pthread_mutex_unlock(&mutex);
+
+    for (int i = 0; i < n; i++) {
+#ifdef __APPLE__
+        CFRunLoopStop(threads[i].runLoop);
+#endif
+        pthread_join(threads[i].thread, NULL);
+#ifdef __APPLE__
+        threads[i].runLoop = NULL;
+#endif
+    }
+
+#ifndef __APPLE__
+    for (int i = 0; i < IO_REACTOR_MAX_THREADS; i++)
+        pthread_cond_destroy(&threads[i].wakeUp);
+#endif
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&mutex);
+}
+
+
+IOReactor* IOReactor::shared()
+{
+    // lives until the process exits
+    static IOReactor* reactor = new IOReactor(IO_REACTOR_MAX_THREADS);
+    return reactor;
+}
+
+
+#ifdef __APPLE__
+int IOReactor::attachSource(CFRunLoopSourceRef source)
+{
+    pthread_mutex_lock(&mutex);
+    int index = selectThread();
+    if (index >= 0) {
+        Thread& thread = threads[index];
+        thread.numAttached++;
+        CFRunLoopAddSource(thread.runLoop, source, kCFRunLoopDefaultMode);
+        CFRunLoopWakeUp(thread.runLoop);
+    }
+    pthread_mutex_unlock(&mutex);
+    return index;
+}
+
+
+void IOReactor::detachSource(CFRunLoopSourceRef source, int index)
+{
+    pthread_mutex_lock(&mutex);
+    Thread& thread = threads[index];
+    CFRunLoopRemoveSource(thread.runLoop, source, kCFRunLoopDefaultMode);
+    thread.numAttached--;
+    waitForPass(thread);
+    pthread_mutex_unlock(&mutex);
+}
+#endif
+
+
+bool IOReactor::attach(IOReactorClient* client)
+{
+    pthread_mutex_lock(&mutex);
+    int index = selectThread();
+    if (index >= 0) {
+        Thread& thread = threads[index];
+        client->reactorThread = index;
+        client->dueTime = 0;
+        thread.clients.push_back(client);
+        thread.numAttached++;
+        signal(thread);
+    }
+    pthread_mutex_unlock(&mutex);
+    return index >= 0;
+}
+
+
+void IOReactor::detach(IOReactorClient* client)
+{
+    pthread_mutex_lock(&mutex);
+    int index = client->reactorThread;
+    if (index >= 0) {
+        Thread& thread = threads[index];
+        thread.clients.erase(std::find(thread.clients.begin(), thread.clients.end(), client));
+        thread.numAttached--;
+        client->reactorThread = -1;
+        waitForPass(thread);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+
+void IOReactor::wake(IOReactorClient* client)
+{
+    pthread_mutex_lock(&mutex);
+    int index = client->reactorThread;
+    if (index >= 0 && client->dueTime != 0) {
+        client->dueTime = 0;
+        signal(threads[index]);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+
+int IOReactor::numThreads()
+{
+    pthread_mutex_lock(&mutex);
+    int n = _numThreads;
+    pthread_mutex_unlock(&mutex);
+    return n;
+}
+
+
+int IOReactor::selectThread()
+{
+    // thread with the fewest transports; a new one if all are fully loaded
+    int index = -1;
+    for (int i = 0; i < _numThreads; i++) {
+        if (index < 0 || threads[i].numAttached < threads[index].numAttached)
+            index = i;
+    }
+
+    if ((index < 0 || threads[index].numAttached >= IO_REACTOR_CLIENTS_PER_THREAD)
+            && _numThreads < maxThreads && isRunning) {
+        if (startThread(threads[_numThreads])) {
+            index = _numThreads;
+            _numThreads++;
+        }
+    }
+
+    return index;
+}
+
+
+bool IOReactor::startThread(Thread& thread)
+{
+    thread.isStarted = false;
+    if (pthread_create(&thread.thread, NULL, threadMain, &thread) != 0) {
+        fprintf(stderr, "Wirekite: Unable to start I/O thread\n");
+        return false;
+    }
+
+    while (!thread.isStarted)
+        pthread_cond_wait(&changed, &mutex);
+    return true;
+}
+
+
+void IOReactor::signal(Thread& thread)
+{
+#ifdef __APPLE__
+    CFRunLoopSourceSignal(thread.wakeSource);
+    CFRunLoopWakeUp(thread.runLoop);
+#else
+    thread.isSignaled = true;
+    pthread_cond_signal(&thread.wakeUp);
+#endif
+}
+
+
+void IOReactor::scheduleNextPass(Thread& thread, int64_t next, int64_t now)
+{
+    // called on the reactor thread with the mutex locked
+#ifdef __APPLE__
+    if (next <= now)
+        CFRunLoopSourceSignal(thread.wakeSource);
+    else if (next == IO_REACTOR_NEVER)
+        CFRunLoopTimerSetNextFireDate(thread.timer, CFAbsoluteTimeGetCurrent() + TIMER_INTERVAL);
+    else
+        CFRunLoopTimerSetNextFireDate(thread.timer,
+                CFAbsoluteTimeGetCurrent() + (next - now + IO_REACTOR_TIMER_LEEWAY) / 1000000.0);
+#else
+    if (next <= now)
+        thread.isSignaled = true;
+    else if (next == IO_REACTOR_NEVER)
+        thread.nextPass = IO_REACTOR_NEVER;
+    else
+        thread.nextPass = next + IO_REACTOR_TIMER_LEEWAY;
+#endif
+}
+
+
+void IOReactor::waitForPass(Thread& thread)
+{
+    // A callout in progress is not interrupted by the wake source. So once
+    // a pass started after this call has completed, the callout is over.
+    if (pthread_equal(pthread_self(), thread.thread))
+        return;
+
+    uint64_t pass = thread.passesStarted + 1;
+    signal(thread);
+    while (thread.passesCompleted < pass)
+        pthread_cond_wait(&changed, &mutex);
+}
+
+
+void IOReactor::runPass(Thread& thread)
+{
+    std::vector<IOReactorClient*>& dueClients = thread.dueClients;
+    std::vector<int64_t>& nextDueTimes = thread.nextDueTimes;
+    dueClients.clear();
+
+    pthread_mutex_lock(&mutex);
+    thread.passesStarted++;
+    int64_t now = currentTime();
+    for (std::vector<IOReactorClient*>::iterator it = thread.clients.begin(); it != thread.clients.end(); it++) {
+        if ((*it)->dueTime <= now) {
+            (*it)->dueTime = IO_REACTOR_NEVER;
+            dueClients.push_back(*it);
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+
+    // detached clients remain valid until the pass has completed
+    nextDueTimes.resize(dueClients.size());
+    for (size_t i = 0; i < dueClients.size(); i++)
+        nextDueTimes[i] = dueClients[i]->service(now);
+
+    pthread_mutex_lock(&mutex);
+    // clients woken up during the pass have a due time of 0
+    for (size_t i = 0; i < dueClients.size(); i++)
+        dueClients[i]->dueTime = std::min(dueClients[i]->dueTime, nextDueTimes[i]);
+
+    int64_t next = IO_REACTOR_NEVER;
+    for (std::vector<IOReactorClient*>::iterator it = thread.clients.begin(); it != thread.clients.end(); it++)
+        next = std::min(next, (*it)->dueTime);
+
+    scheduleNextPass(thread, next, currentTime());
+
+    thread.passesCompleted++;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&mutex);
+}
+
+
+#ifdef __APPLE__
+
+void IOReactor::runLoop(Thread& thread)
+{
+    CFRunLoopSourceContext sourceContext;
+    memset(&sourceContext, 0, sizeof(sourceContext));
+    sourceContext.info = &thread;
+    sourceContext.perform = performWake;
+    thread.wakeSource = CFRunLoopSourceCreate(NULL, 0, &sourceContext);
+
+    CFRunLoopTimerContext timerContext;
+    memset(&timerContext, 0, sizeof(timerContext));
+    timerContext.info = &thread;
+    thread.timer = CFRunLoopTimerCreate(NULL, CFAbsoluteTimeGetCurrent() + TIMER_INTERVAL, TIMER_INTERVAL,
+                                        0, 0, timerFired, &timerContext);
+
+    CFRunLoopRef runLoop = CFRunLoopGetCurrent();
+    CFRunLoopAddSource(runLoop, thread.wakeSource, kCFRunLoopDefaultMode);
+    CFRunLoopAddTimer(runLoop, thread.timer, kCFRunLoopDefaultMode);
+
+    pthread_mutex_lock(&mutex);
+    thread.runLoop = runLoop;
+    thread.isStarted = true;
+    pthread_cond_broadcast(&changed);
+
+    // Keep processing events until the reactor is destroyed.
+    while (isRunning) {
+        pthread_mutex_unlock(&mutex);
+        CFRunLoopRunInMode(kCFRunLoopDefaultMode, 1.0, false);
+        pthread_mutex_lock(&mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    CFRunLoopRemoveTimer(runLoop, thread.timer, kCFRunLoopDefaultMode);
+    CFRunLoopRemoveSource(runLoop, thread.wakeSource, kCFRunLoopDefaultMode);
+    CFRunLoopTimerInvalidate(thread.timer);
+    CFRelease(thread.timer);
+    thread.timer = NULL;
+    CFRelease(thread.wakeSource);
+    thread.wakeSource = NULL;
+}
+
+#else
+
+void IOReactor::runLoop(Thread& thread)
+{
+    pthread_mutex_lock(&mutex);
+    thread.isStarted = true;
+    pthread_cond_broadcast(&changed);
+
+    // Keep servicing clients until the reactor is destroyed.
+    while (isRunning) {
+        int64_t now = currentTime();
+        if (!thread.isSignaled && thread.nextPass > now) {
+            if (thread.nextPass == IO_REACTOR_NEVER) {
+                pthread_cond_wait(&thread.wakeUp, &mutex);
+            } else {
+                // the condition variable uses the realtime clock
+                struct timespec deadline;
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                int64_t nanos = deadline.tv_nsec + (thread.nextPass - now) * 1000;
+                deadline.tv_sec += nanos / 1000000000;
+                deadline.tv_nsec = nanos % 1000000000;
+                pthread_cond_timedwait(&thread.wakeUp, &mutex, &deadline);
+            }
+            continue;
+        }
+
+        thread.isSignaled = false;
+        thread.nextPass = IO_REACTOR_NEVER;
+        pthread_mutex_unlock(&mutex);
+        runPass(thread);
+        pthread_mutex_lock(&mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+#endif
+
+
+void* IOReactor::threadMain(void* arg)
+{
+    Thread* thread = (Thread*)arg;
+    thread->reactor->runLoop(*thread);
+    return NULL;
+}
+
+
+#ifdef __APPLE__
+
+void IOReactor::performWake(void* info)
+{
+    Thread* thread = (Thread*)info;
+    thread->reactor->runPass(*thread);
+}
+
+
+void IOReactor::timerFired(CFRunLoopTimerRef timer, void* info)
+{
+    Thread* thread = (Thread*)info;
+    thread->reactor->runPass(*thread);
+}
+
+#endif
@@ -0,0 +1,154 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef IOReactor_hpp
+#define IOReactor_hpp
+
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+#ifdef __APPLE__
+#include <CoreFoundation/CoreFoundation.h>
+#endif
+#include "IOReactorClient.hpp"
+
+
+#define IO_REACTOR_MAX_THREADS 4
+#define IO_REACTOR_CLIENTS_PER_THREAD 8
+#define IO_REACTOR_TIMER_LEEWAY 250 // µs
+
+
+/**
+ * Small set of I/O threads shared by the transports of many devices
+ *
+ * Each thread runs a run loop. Transports attach the run loop source of
+ * their asynchronous I/O or register as a client serviced at the time they
+ * request or when they are woken up. Each transport stays on the same thread
+ * so its state remains local to it.
+ *
+ * A transport is attached to the thread with the fewest transports. A new thread
+ * is only started if all threads have IO_REACTOR_CLIENTS_PER_THREAD transports.
+ * Threads are kept until the reactor is destroyed.
+ *
+ * Clients may be serviced up to IO_REACTOR_TIMER_LEEWAY later than requested
+ * so that clients due at about the same time are serviced in a single pass.
+ *
+ * Run loop sources are only supported on Apple platforms. Elsewhere, the
+ * threads wait on a condition variable and only service clients, e.g.
+ * simulated devices.
+ */
+class IOReactor {
+public:
+    /**
+     * Creates a new instance.
+     * @param maxThreads the maximum number of threads (1 to IO_REACTOR_MAX_THREADS)
+     */
+    IOReactor(int maxThreads);
+    ~IOReactor();
+
+    /**
+     * Gets the reactor shared by all devices.
+     * @return the reactor
+     */
+    static IOReactor* shared();
+
+#ifdef __APPLE__
+    /**
+     * Attaches a run loop source.
+     * @param source the run loop source
+     * @return the index of the thread it has been attached to, or -1 on failure
+     */
+    int attachSource(CFRunLoopSourceRef source);
+
+    /**
+     * Detaches a run loop source.
+     *
+     * Unless called from the reactor thread, the call returns after a
+     * callout of the source in progress has completed.
+     *
+     * @param source the run loop source
+     * @param thread the index of the thread
+     */
+    void detachSource(CFRunLoopSourceRef source, int thread);
+#endif
+
+    /**
+     * Attaches a client. It is serviced immediately.
+     * @param client the client
+     * @return `true` if successful
+     */
+    bool attach(IOReactorClient* client);
+
+    /**
+     * Detaches a client.
+     *
+     * Unless called from the reactor thread, the call returns after a
+     * service call in progress has completed.
+     *
+     * @param client the client
+     */
+    void detach(IOReactorClient* client);
+
+    /**
+     * Requests that a client is serviced as soon as possible.
+     * @param client the client
+     */
+    void wake(IOReactorClient* client);
+
+    /**
+     * Gets the number of threads started.
+     * @return the number of threads
+     */
+    int numThreads();
+
+private:
+    struct Thread {
+        IOReactor* reactor;
+        pthread_t thread;
+        bool isStarted;
+#ifdef __APPLE__
+        CFRunLoopRef runLoop;
+        CFRunLoopSourceRef wakeSource;
+        CFRunLoopTimerRef timer;
+#else
+        pthread_cond_t wakeUp;
+        bool isSignaled;
+        int64_t nextPass;
+#endif
+        std::vector<IOReactorClient*> clients;
+        std::vector<IOReactorClient*> dueClients; // only used by the thread itself
+        std::vector<int64_t> nextDueTimes; // only used by the thread itself
+        int numAttached; // clients and sources
+        uint64_t passesStarted;
+        uint64_t passesCompleted;
+    };
+
+    int selectThread();
+    bool startThread(Thread& thread);
+    void signal(Thread& thread);
+    void scheduleNextPass(Thread& thread, int64_t next, int64_t now);
+    void waitForPass(Thread& thread);
+    void runPass(Thread& thread);
+    void runLoop(Thread& thread);
+    static void* threadMain(void* arg);
+#ifdef __APPLE__
+    static void performWake(void* info);
+    static void timerFired(CFRunLoopTimerRef timer, void* info);
+#endif
+
+private:
+    int maxThreads;
+    int _numThreads;
+    Thread threads[IO_REACTOR_MAX_THREADS];
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    bool isRunning;
+};
+
+
+#endif /* IOReactor_hpp */
@@ -0,0 +1,43 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef IOReactorClient_hpp
+#define IOReactorClient_hpp
+
+#include <stdint.h>
+
+
+#define IO_REACTOR_NEVER INT64_MAX
+
+
+/**
+ * Client whose work is scheduled by an I/O reactor
+ */
+class IOReactorClient {
+public:
+    IOReactorClient() : reactorThread(-1), dueTime(0) {}
+    virtual ~IOReactorClient() {}
+
+    /**
+     * Processes the work that is due.
+     *
+     * Called on the reactor thread the client is attached to.
+     *
+     * @param now the current time (in µs, steady clock)
+     * @return the time when work is due next (in µs), or `IO_REACTOR_NEVER`
+     */
+    virtual int64_t service(int64_t now) = 0;
+
+private:
+    friend class IOReactor;
+    int reactorThread;
+    int64_t dueTime; // guarded by the reactor's mutex
+};
+
+
+#endif /* IOReactorClient_hpp */
@@ -0,0 +1,97 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include "LatencyHistogram.hpp"
+
+
+LatencyHistogram::LatencyHistogram()
+:   totalCount(0),
+    maxValue(0)
+{
+    for (int i = 0; i < LATENCY_HISTOGRAM_NUM_BUCKETS; i++)
+        buckets[i].store(0, std::memory_order_relaxed);
+}
+
+
+int LatencyHistogram::bucketIndex(uint32_t value)
+{
+    if (value < LATENCY_HISTOGRAM_SUB_BUCKETS)
+        return value;
+    
+    int exponent = 31 - __builtin_clz(value);
+    int shift = exponent - LATENCY_HISTOGRAM_SUB_BITS;
+    return (shift + 1) * LATENCY_HISTOGRAM_SUB_BUCKETS + ((value >> shift) & (LATENCY_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+
+uint32_t LatencyHistogram::bucketValue(int index)
+{
+    if (index < LATENCY_HISTOGRAM_SUB_BUCKETS)
+        return index;
+    
+    // middle of the bucket
+    int shift = index / LATENCY_HISTOGRAM_SUB_BUCKETS - 1;
+    uint32_t lower = (uint32_t)(LATENCY_HISTOGRAM_SUB_BUCKETS + index % LATENCY_HISTOGRAM_SUB_BUCKETS) << shift;
+    return lower + (shift > 0 ? (1u << (shift - 1)) : 0);
+}
+
+
+void LatencyHistogram::record(uint32_t value)
+{
+    buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    totalCount.fetch_add(1, std::memory_order_relaxed);
+    
+    uint32_t max = maxValue.load(std::memory_order_relaxed);
+    while (value > max && !maxValue.compare_exchange_weak(max, value, std::memory_order_relaxed))
+        ;
+}
+
+
+uint64_t LatencyHistogram::count()
+{
+    return totalCount.load(std::memory_order_relaxed);
+}
+
+
+uint32_t LatencyHistogram::maximum()
+{
+    return maxValue.load(std::memory_order_relaxed);
+}
+
+
+uint32_t LatencyHistogram::percentile(double percentile)
+{
+    uint64_t total = totalCount.load(std::memory_order_relaxed);
+    if (total == 0)
+        return 0;
+    
+    uint64_t threshold = (uint64_t)(percentile / 100 * total + 0.5);
+    if (threshold < 1)
+        threshold = 1;
+    
+    uint64_t sum = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_NUM_BUCKETS; i++) {
+        sum += buckets[i].load(std::memory_order_relaxed);
+        if (sum >= threshold) {
+            uint32_t value = bucketValue(i);
+            uint32_t max = maxValue.load(std::memory_order_relaxed);
+            return value < max ? value : max;
+        }
+    }
+    
+    return maxValue.load(std::memory_order_relaxed);
+}
+
+
+void LatencyHistogram::reset()
+{
+    for (int i = 0; i < LATENCY_HISTOGRAM_NUM_BUCKETS; i++)
+        buckets[i].store(0, std::memory_order_relaxed);
+    totalCount.store(0, std::memory_order_relaxed);
+    maxValue.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,77 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef LatencyHistogram_hpp
+#define LatencyHistogram_hpp
+
+#include <stdint.h>
+#include <atomic>
+
+
+// number of sub-buckets per power of two (as bits)
+#define LATENCY_HISTOGRAM_SUB_BITS 4
+#define LATENCY_HISTOGRAM_SUB_BUCKETS (1 << LATENCY_HISTOGRAM_SUB_BITS)
+#define LATENCY_HISTOGRAM_NUM_BUCKETS ((32 - LATENCY_HISTOGRAM_SUB_BITS + 1) * LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+
+/**
+ * Histogram of latencies (in µs)
+ *
+ * Values below 16 are counted exactly. Larger values are counted in
+ * buckets with 16 sub-buckets per power of two, i.e. with a relative
+ * error of less than 6.25%.
+ *
+ * Recording is lock-free and can be called from any thread. Percentiles
+ * computed while values are being recorded are approximate.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+    
+    /**
+     * Records a value.
+     * @param value the value (in µs)
+     */
+    void record(uint32_t value);
+    
+    /**
+     * Gets the number of recorded values.
+     * @return the number of values
+     */
+    uint64_t count();
+    
+    /**
+     * Gets the largest recorded value.
+     * @return the value (in µs)
+     */
+    uint32_t maximum();
+    
+    /**
+     * Gets the value below which the specified percentage of values fall.
+     * @param percentile the percentile (between 0 and 100)
+     * @return the value (in µs), or 0 if no values have been recorded
+     */
+    uint32_t percentile(double percentile);
+    
+    /**
+     * Removes all recorded values.
+     */
+    void reset();
+    
+private:
+    static int bucketIndex(uint32_t value);
+    static uint32_t bucketValue(int index);
+    
+private:
+    std::atomic<uint32_t> buckets[LATENCY_HISTOGRAM_NUM_BUCKETS];
+    std::atomic<uint64_t> totalCount;
+    std::atomic<uint32_t> maxValue;
+};
+
+
+#endif /* LatencyHistogram_hpp */
@@ -0,0 +1,295 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <chrono>
+#include "MessageCapture.hpp"
+
+
+#define CAPTURE_MAGIC "WKCAPTUR"
+#define CAPTURE_VERSION 1
+#define CAPTURE_FILE_HEADER_SIZE 16
+#define CAPTURE_RECORD_HEADER_SIZE 16
+#define CAPTURE_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+
+struct CaptureFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct CaptureRecordHeader {
+    uint64_t timestamp;
+    uint32_t length;
+    uint8_t direction;
+    uint8_t reserved[3];
+};
+
+
+static uint64_t currentTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+MessageCapture::MessageCapture()
+:   mapping(NULL),
+    mappingSize(0),
+    fd(-1),
+    writeOffset(0),
+    activeWriters(0),
+    numDropped(0)
+{
+}
+
+
+MessageCapture::~MessageCapture()
+{
+    close();
+}
+
+
+bool MessageCapture::open(const char* path, size_t maxSize)
+{
+    close();
+    
+    if (maxSize < CAPTURE_FILE_HEADER_SIZE + CAPTURE_RECORD_HEADER_SIZE)
+        return false;
+    
+    fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Wirekite: Unable to create capture file %s\n", path);
+        return false;
+    }
+    
+    if (ftruncate(fd, maxSize) != 0) {
+        fprintf(stderr, "Wirekite: Unable to size capture file %s\n", path);
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    
+    void* m = mmap(NULL, maxSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) {
+        fprintf(stderr, "Wirekite: Unable to map capture file %s\n", path);
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    
+    CaptureFileHeader* header = (CaptureFileHeader*)m;
+    memcpy(header->magic, CAPTURE_MAGIC, sizeof(header->magic));
+    header->version = CAPTURE_VERSION;
+    header->reserved = 0;
+    
+    mappingSize = maxSize;
+    writeOffset.store(CAPTURE_FILE_HEADER_SIZE, std::memory_order_relaxed);
+    numDropped.store(0, std::memory_order_relaxed);
+    mapping.store((uint8_t*)m, std::memory_order_release);
+    return true;
+}
+
+
+void MessageCapture::close()
+{
+    uint8_t* m = mapping.exchange(NULL, std::memory_order_seq_cst);
+    if (m == NULL)
+        return;
+    
+    // wait for appends that have already seen the mapping
+    while (activeWriters.load(std::memory_order_seq_cst) != 0)
+        sched_yield();
+    
+    size_t usedSize = writeOffset.load(std::memory_order_relaxed);
+    if (usedSize > mappingSize)
+        usedSize = mappingSize;
+    
+    munmap(m, mappingSize);
+    if (ftruncate(fd, usedSize) != 0)
+        fprintf(stderr, "Wirekite: Unable to truncate capture file\n");
+    ::close(fd);
+    fd = -1;
+}
+
+
+void MessageCapture::append(uint8_t direction, const uint8_t* data, uint32_t length)
+{
+    if (mapping.load(std::memory_order_relaxed) == NULL)
+        return;
+    
+    activeWriters.fetch_add(1, std::memory_order_seq_cst);
+    uint8_t* m = mapping.load(std::memory_order_seq_cst);
+    if (m == NULL) {
+        activeWriters.fetch_sub(1, std::memory_order_release);
+        return; // closed in the meantime
+    }
+    
+    // Reserve space. The timestamp is taken between reading the offset and
+    // advancing it so that records are in the same order as their timestamps.
+    size_t recordSize = CAPTURE_RECORD_HEADER_SIZE + CAPTURE_ALIGN(length);
+    size_t offset = writeOffset.load(std::memory_order_acquire);
+    uint64_t timestamp;
+    do {
+        timestamp = currentTime();
+    } while (!writeOffset.compare_exchange_weak(offset, offset + recordSize,
+                                                std::memory_order_acq_rel, std::memory_order_acquire));
+    
+    if (offset + recordSize > mappingSize) {
+        // file is full; keep the offset beyond the end so all later records are dropped too
+        numDropped.fetch_add(1, std::memory_order_relaxed);
+        activeWriters.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+    
+    CaptureRecordHeader* header = (CaptureRecordHeader*)(m + offset);
+    header->timestamp = timestamp;
+    header->length = length;
+    header->direction = direction;
+    memcpy(m + offset + CAPTURE_RECORD_HEADER_SIZE, data, length);
+    
+    activeWriters.fetch_sub(1, std::memory_order_release);
+}
+
+
+
+MessageReplay::MessageReplay()
+:   mapping(NULL),
+    mappingSize(0),
+    readOffset(0)
+{
+}
+
+
+MessageReplay::~MessageReplay()
+{
+    close();
+}
+
+
+bool MessageReplay::open(const char* path)
+{
+    close();
+    
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Wirekite: Unable to open capture file %s\n", path);
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < CAPTURE_FILE_HEADER_SIZE) {
+        fprintf(stderr, "Wirekite: Invalid capture file %s\n", path);
+        ::close(fd);
+        return false;
+    }
+    
+    void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) {
+        fprintf(stderr, "Wirekite: Unable to map capture file %s\n", path);
+        return false;
+    }
+    
+    CaptureFileHeader* header = (CaptureFileHeader*)m;
+    if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) != 0 || header->version != CAPTURE_VERSION) {
+        fprintf(stderr, "Wirekite: Invalid capture file %s\n", path);
+        munmap(m, st.st_size);
+        return false;
+    }
+    
+    mapping = (uint8_t*)m;
+    mappingSize = st.st_size;
+    readOffset = CAPTURE_FILE_HEADER_SIZE;
+    return true;
+}
+
+
+void MessageReplay::close()
+{
+    if (mapping == NULL)
+        return;
+    
+    munmap(mapping, mappingSize);
+    mapping = NULL;
+    mappingSize = 0;
+}
+
+
+void MessageReplay::rewind()
+{
+    readOffset = CAPTURE_FILE_HEADER_SIZE;
+}
+
+
+bool MessageReplay::next(CaptureRecord& record)
+{
+    if (mapping == NULL || readOffset + CAPTURE_RECORD_HEADER_SIZE > mappingSize)
+        return false;
+    
+    CaptureRecordHeader* header = (CaptureRecordHeader*)(mapping + readOffset);
+    size_t recordSize = CAPTURE_RECORD_HEADER_SIZE + CAPTURE_ALIGN(header->length);
+    // a zero direction marks space that was reserved but never written (e.g. after a crash)
+    if (header->direction == 0 || readOffset + recordSize > mappingSize)
+        return false;
+    
+    record.timestamp = header->timestamp;
+    record.direction = header->direction;
+    record.data = mapping + readOffset + CAPTURE_RECORD_HEADER_SIZE;
+    record.length = header->length;
+    readOffset += recordSize;
+    return true;
+}
+
+
+long MessageReplay::replay(MessageHandler* handler, bool originalSpeed)
+{
+    MessageParser parser;
+    parser.setHandler(handler);
+    
+    long numChunks = 0;
+    uint64_t firstTimestamp = 0;
+    uint64_t startTime = currentTime();
+    CaptureRecord record;
+    
+    while (next(record)) {
+        if (numChunks == 0 && firstTimestamp == 0)
+            firstTimestamp = record.timestamp;
+        if (record.direction != CAPTURE_DIRECTION_RX)
+            continue;
+        
+        if (originalSpeed) {
+            // records captured out of order are replayed without delay
+            uint64_t offset = record.timestamp > firstTimestamp ? record.timestamp - firstTimestamp : 0;
+            uint64_t due = startTime + offset;
+            uint64_t now = currentTime();
+            if (due > now)
+                usleep((useconds_t)((due - now) / 1000));
+        }
+        
+        // like the USB transport, receive into a pool buffer if possible
+        uint8_t* buffer = record.length <= MESSAGE_POOL_BUFFER_SIZE ? MessagePool::acquireBuffer() : NULL;
+        if (buffer != NULL) {
+            memcpy(buffer, record.data, record.length);
+            parser.processData(buffer, record.length);
+            MessagePool::release(buffer);
+        } else {
+            parser.processData(record.data, record.length);
+        }
+        numChunks++;
+    }
+    
+    return numChunks;
+}
@@ -0,0 +1,154 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef MessageCapture_hpp
+#define MessageCapture_hpp
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "MessageParser.hpp"
+
+
+#define CAPTURE_DIRECTION_TX 1 // message sent to the board
+#define CAPTURE_DIRECTION_RX 2 // data chunk received from the board
+
+
+/**
+ * Captured message or data chunk
+ */
+struct CaptureRecord {
+    uint64_t timestamp; // in ns (steady clock)
+    uint8_t direction; // `CAPTURE_DIRECTION_TX` or `CAPTURE_DIRECTION_RX`
+    const uint8_t* data;
+    uint32_t length;
+};
+
+
+/**
+ * Binary capture of the communication with the board
+ *
+ * Records are appended to a memory-mapped file of fixed maximum size.
+ * Sent messages are captured one by one. Received data is captured
+ * in the chunks it was received in so that a replay exercises the
+ * parser the same way as the original traffic.
+ *
+ * Appending is lock-free and can be called from any thread.
+ * The records in the file are ordered by their timestamps.
+ * If the file is full, further records are dropped.
+ *
+ * File format: a 16 byte file header ("WKCAPTUR", version, reserved),
+ * followed by records consisting of a 16 byte record header (timestamp,
+ * length, direction, reserved) and the data, padded to a multiple of 8 bytes.
+ * All values are little endian.
+ */
+class MessageCapture {
+public:
+    MessageCapture();
+    ~MessageCapture();
+    
+    /**
+     * Creates the capture file and starts capturing.
+     * @param path the file path
+     * @param maxSize the maximum file size (in bytes)
+     * @return `true` if successful
+     */
+    bool open(const char* path, size_t maxSize);
+    
+    /**
+     * Stops capturing and closes the file.
+     *
+     * Waits for concurrent appends to complete and truncates the file to the used size.
+     */
+    void close();
+    
+    /**
+     * Indicates if capturing is active.
+     * @return `true` if active
+     */
+    bool isOpen() { return mapping.load(std::memory_order_relaxed) != NULL; }
+    
+    /**
+     * Appends a record if capturing is active.
+     * @param direction `CAPTURE_DIRECTION_TX` or `CAPTURE_DIRECTION_RX`
+     * @param data the message or data chunk
+     * @param length the length of the data (in bytes)
+     */
+    void append(uint8_t direction, const uint8_t* data, uint32_t length);
+    
+    /**
+     * Gets the number of records dropped because the file was full.
+     * @return the number of records
+     */
+    uint64_t droppedRecords() { return numDropped.load(std::memory_order_relaxed); }
+    
+private:
+    std::atomic<uint8_t*> mapping;
+    size_t mappingSize;
+    int fd;
+    std::atomic<size_t> writeOffset;
+    std::atomic<int> activeWriters;
+    std::atomic<uint64_t> numDropped;
+};
+
+
+/**
+ * Replays a capture file
+ */
+class MessageReplay {
+public:
+    MessageReplay();
+    ~MessageReplay();
+    
+    /**
+     * Opens a capture file.
+     * @param path the file path
+     * @return `true` if successful
+     */
+    bool open(const char* path);
+    
+    /**
+     * Closes the capture file.
+     */
+    void close();
+    
+    /**
+     * Reads the next record.
+     *
+     * The record data remains valid until the file is closed.
+     *
+     * @param record receives the record
+     * @return `true` if successful, `false` at the end of the file
+     */
+    bool next(CaptureRecord& record);
+    
+    /**
+     * Restarts reading at the first record.
+     */
+    void rewind();
+    
+    /**
+     * Feeds the received data of the capture through a message parser.
+     *
+     * The data chunks are copied into `MessagePool` buffers before they are parsed,
+     * like data received from a board. The handler takes ownership of the messages.
+     *
+     * @param handler the handler for the parsed messages
+     * @param originalSpeed `true` to reproduce the original timing, `false` for maximum speed
+     * @return the number of replayed data chunks
+     */
+    long replay(MessageHandler* handler, bool originalSpeed);
+    
+private:
+    uint8_t* mapping;
+    size_t mappingSize;
+    size_t readOffset;
+};
+
+
+#endif /* MessageCapture_hpp */
@@ -7,8 +7,7 @@
 //
 
 #include "MessageDump.hpp"
-#include <iomanip>
-#include <sstream>
+#include <string.h>
 
 static const char* Invalid = "<invalid>";
 
@@ -25,7 +24,8 @@ static const char* ConfigActions[] = {
     "config_port",
     "release",
     "reset",
-    "config_module"
+    "config_module",
+    "query"
 };
 
 static const char* PortTypes[] = {
@@ -34,7 +34,8 @@ static const char* PortTypes[] = {
     "analog_in",
     "pwm_out",
     "i2c",
-    "spi"
+    "spi",
+    "analog_scan"
 };
 
 static const char* PortActions[] = {
@@ -43,71 +44,238 @@ static const char* PortActions[] = {
     "get_value",
     "tx_data",
     "rx_data",
-    "tx_n_rx_data"
+    "tx_n_rx_data",
+    "reset",
+    "start_polling",
+    "stop_polling"
 };
 
 static const char* PortEvents[] = {
     "dodo",
     "single_sample",
     "tx_complete",
-    "data_recv"
+    "data_recv",
+    "set_done",
+    "scan_frames"
 };
 
+// two hex digits per byte value
+static const char HexPairs[] =
+    "000102030405060708090a0b0c0d0e0f"
+    "101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f"
+    "303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f"
+    "505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f"
+    "707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f"
+    "909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+    "b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+    "d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+    "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+static const char Truncated[] = "...\n";
+
 
 #define SafeElement(array, index) (index < sizeof(array) / sizeof(array[0]) ? array[index] : Invalid)
 
-static void dumpData(std::stringstream& buf, uint8_t* data, int len);
 
+/*
+ * Appends text to a fixed buffer.
+ *
+ * Output exceeding the buffer is discarded. The last bytes of the
+ * buffer are reserved for the truncation marker and the terminating NUL.
+ */
+struct DumpWriter {
+    char* p;
+    char* end;
+    bool isTruncated;
+    
+    DumpWriter(char* buffer, size_t size)
+    :   p(buffer),
+        end(buffer + size - sizeof(Truncated)),
+        isTruncated(false)
+    {
+    }
+    
+    void put(char c)
+    {
+        if (p < end)
+            *p++ = c;
+        else
+            isTruncated = true;
+    }
+    
+    void put(const char* s)
+    {
+        while (*s != 0)
+            put(*s++);
+    }
+    
+    void putHex(uint32_t value)
+    {
+        char digits[8];
+        int n = 0;
+        do {
+            digits[n++] = HexPairs[(value & 0xf) * 2 + 1];
+            value >>= 4;
+        } while (value != 0);
+        while (n > 0)
+            put(digits[--n]);
+    }
+    
+    void putDec(int32_t value)
+    {
+        char digits[10];
+        int n = 0;
+        uint32_t v = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+        do {
+            digits[n++] = '0' + v % 10;
+            v /= 10;
+        } while (v != 0);
+        if (value < 0)
+            put('-');
+        while (n > 0)
+            put(digits[--n]);
+    }
+    
+    void putField(const char* name, uint32_t value)
+    {
+        put(name);
+        put(": ");
+        putHex(value);
+        put('\n');
+    }
+    
+    void putEnumField(const char* name, const char* text, uint32_t value)
+    {
+        put(name);
+        put(": ");
+        put(text);
+        put(" (");
+        putHex(value);
+        put(")\n");
+    }
+    
+    void putData(const uint8_t* data, int len)
+    {
+        put("data: ");
+        for (int i = 0; i < len; i++) {
+            if (end - p < 2) {
+                isTruncated = true;
+                break;
+            }
+            const char* pair = &HexPairs[data[i] * 2];
+            p[0] = pair[0];
+            p[1] = pair[1];
+            p += 2;
+        }
+        put('\n');
+    }
+    
+    void putFrames(const uint8_t* data, int len, int numChannels)
+    {
+        if (numChannels == 0) {
+            putData(data, len);
+            return;
+        }
+        
+        int numFrames = len / (numChannels * 4);
+        for (int i = 0; i < numFrames; i++) {
+            put("frame ");
+            putDec(i);
+            put(':');
+            for (int j = 0; j < numChannels; j++) {
+                int32_t sample;
+                memcpy(&sample, data + (i * numChannels + j) * 4, 4);
+                put(' ');
+                putDec(sample);
+            }
+            put('\n');
+        }
+    }
+    
+    size_t finish(char* buffer)
+    {
+        if (isTruncated) {
+            memcpy(p, Truncated, sizeof(Truncated) - 1);
+            p += sizeof(Truncated) - 1;
+        }
+        *p = 0;
+        return p - buffer;
+    }
+};
 
-std::string MessageDump::dump(wk_msg_header* msg)
+
+size_t MessageDump::format(wk_msg_header* msg, char* buffer, size_t bufferSize)
 {
-    std::stringstream buf;
+    if (bufferSize < sizeof(Truncated) + 1) {
+        if (bufferSize > 0)
+            buffer[0] = 0;
+        return 0;
+    }
     
-    buf << std::hex << "\n";
-    buf << "message_size: " << msg->message_size << "\n";
-    buf << "message_type: " << SafeElement(MessageTypes, msg->message_type) << " (" << (int)msg->message_type << ")\n";
-    buf << "port_id: " << msg->port_id << "\n";
-    buf << "request_id: " << msg->request_id << "\n";
+    DumpWriter w(buffer, bufferSize);
+    
+    w.put('\n');
+    w.putField("message_size", msg->message_size);
+    w.putEnumField("message_type", SafeElement(MessageTypes, msg->message_type), msg->message_type);
+    w.putField("port_id", msg->port_id);
+    w.putField("request_id", msg->request_id);
 
     if (msg->message_type == WK_MSG_TYPE_CONFIG_REQUEST) {
         wk_config_request* request = (wk_config_request*)msg;
-        buf << "action: " << SafeElement(ConfigActions, request->action) << " (" << (int)request->action << ")\n";
-        buf << "port_type: " << SafeElement(PortTypes, request->port_type) << " (" << (int)request->port_type << ")\n";
-        buf << "pin_config: " << request->pin_config << "\n";
-        buf << "value1: " << request->value1 << "\n";
-        buf << "port_attributes1: " << request->port_attributes1 << "\n";
-        buf << "port_attributes2: " << request->port_attributes2 << "\n";
+        w.putEnumField("action", SafeElement(ConfigActions, request->action), request->action);
+        w.putEnumField("port_type", SafeElement(PortTypes, request->port_type), request->port_type);
+        w.putField("pin_config", request->pin_config);
+        w.putField("value1", request->value1);
+        w.putField("port_attributes1", request->port_attributes1);
+        w.putField("port_attributes2", request->port_attributes2);
     } else if (msg->message_type == WK_MSG_TYPE_CONFIG_RESPONSE) {
         wk_config_response* response = (wk_config_response*)msg;
-        buf << "result: " << response->result << "\n";
-        buf << "optional1: " << response->optional1 << "\n";
-        buf << "value1: " << response->value1 << "\n";
+        w.putField("result", response->result);
+        w.putField("optional1", response->optional1);
+        w.putField("value1", response->value1);
     } else if (msg->message_type == WK_MSG_TYPE_PORT_REQUEST) {
         wk_port_request* request = (wk_port_request*)msg;
-        buf << "action: " << SafeElement(PortActions, request->action) << " (" << (int)request->action << ")\n";
-        buf << "action_attribute1: " << (int)request->action_attribute1 << "\n";
-        buf << "action_attribute2: " << request->action_attribute2 << "\n";
-        buf << "value1: " << request->value1 << "\n";
+        w.putEnumField("action", SafeElement(PortActions, request->action), request->action);
+        w.putField("action_attribute1", request->action_attribute1);
+        w.putField("action_attribute2", request->action_attribute2);
+        w.putField("value1", request->value1);
         int data_length = msg->message_size - sizeof(wk_port_request) + 4;
-        dumpData(buf, request->data, data_length);
+        w.putData(request->data, data_length);
     } else if (msg->message_type == WK_MSG_TYPE_PORT_EVENT) {
         wk_port_event* event = (wk_port_event*)msg;
-        buf << "event: " << SafeElement(PortEvents, event->event) << " (" << (int)event->event << ")\n";
-        buf << "event_attribute1: " << (int)event->event_attribute1 << "\n";
-        buf << "event_attribute2: " << (int)event->event_attribute2 << "\n";
-        buf << "value1: " << event->value1 << "\n";
-       int data_length = msg->message_size - sizeof(wk_port_event) + 4;
-        dumpData(buf, event->data, data_length);
+        w.putEnumField("event", SafeElement(PortEvents, event->event), event->event);
+        w.putField("event_attribute1", event->event_attribute1);
+        w.putField("event_attribute2", event->event_attribute2);
+        w.putField("value1", event->value1);
+        int data_length = msg->message_size - sizeof(wk_port_event) + 4;
+        if (event->event == WK_EVENT_SCAN_FRAMES)
+            w.putFrames(event->data, data_length, event->event_attribute2);
+        else
+            w.putData(event->data, data_length);
     }
     
-    return buf.str();
+    return w.finish(buffer);
+}
+
+
+std::string MessageDump::dump(wk_msg_header* msg)
+{
+    // large enough for the message (scan frames need up to 6 characters per data byte)
+    std::string result(512 + 6 * (size_t)msg->message_size, 0);
+    size_t length = format(msg, &result[0], result.size());
+    result.resize(length);
+    return result;
 }
 
 
-void dumpData(std::stringstream& buf, uint8_t* data, int len)
+const char* MessageDump::portActionName(uint8_t action)
 {
-    buf << "data: ";
-    for (int i = 0; i < len; i++)
-        buf << std::setw(2) << std::setfill('0') << (int)data[i];
-    buf << "\n";
+    return SafeElement(PortActions, action);
 }
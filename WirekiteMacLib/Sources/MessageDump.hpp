@@ -10,11 +10,41 @@
 #define MessageDump_hpp
 
 #include "proto.h"
+#include <stddef.h>
 #include <string>
 
+
+/**
+ * Formats messages as human-readable text
+ */
 class MessageDump {
 public:
+    /**
+     * Formats the message into the buffer.
+     *
+     * Does not allocate memory. If the buffer is too small, the text is
+     * truncated and ends with "...". The text is always NUL terminated.
+     *
+     * @param msg the message
+     * @param buffer the buffer receiving the text
+     * @param bufferSize the size of the buffer (in bytes)
+     * @return the length of the text (excluding the terminating NUL)
+     */
+    static size_t format(wk_msg_header* msg, char* buffer, size_t bufferSize);
+    
+    /**
+     * Formats the message as a string.
+     * @param msg the message
+     * @return the text
+     */
     static std::string dump(wk_msg_header* msg);
+    
+    /**
+     * Gets the name of a port action.
+     * @param action the action (`WK_PORT_ACTION_*`)
+     * @return the name
+     */
+    static const char* portActionName(uint8_t action);
 };
 
 #endif /* MessageDump_hpp */
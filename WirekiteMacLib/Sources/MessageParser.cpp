@@ -0,0 +1,151 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "MessageParser.hpp"
+
+
+// alignment of the message structures (32 bit fields)
+#define MESSAGE_ALIGNMENT 4
+
+
+static wk_msg_header* CopyMessage(const uint8_t* data, uint16_t msgSize)
+{
+    // prefer a pool buffer; it is aligned and releasing it is cheap
+    uint8_t* copy = NULL;
+    if (msgSize <= MESSAGE_POOL_BUFFER_SIZE)
+        copy = MessagePool::acquireBuffer();
+    if (copy == NULL)
+        copy = (uint8_t*)malloc(msgSize);
+    memcpy(copy, data, msgSize);
+    return (wk_msg_header*)copy;
+}
+
+
+MessageParser::MessageParser()
+:   handler(NULL),
+    partialMessage(NULL),
+    partialMessageSize(0),
+    partialSize(0)
+{
+}
+
+
+MessageParser::~MessageParser()
+{
+    reset();
+}
+
+
+void MessageParser::reset()
+{
+    free(partialMessage);
+    partialMessage = NULL;
+    partialMessageSize = 0;
+    partialSize = 0;
+}
+
+
+bool MessageParser::processData(const uint8_t* data, uint32_t receivedBytes)
+{
+    if (receivedBytes == 0)
+        return true;
+
+    if (partialSize > 0) {
+        // there is a partial message from the last chunk
+
+        if (partialSize == 1) {
+            // super special case: only half of the first word
+            // was transmitted
+            partialMessageSize += ((uint32_t)data[0]) << 8;
+            if (partialMessageSize < sizeof(wk_msg_header)) {
+                reset();
+                return false;
+            }
+            partialMessage = (wk_msg_header*)malloc(partialMessageSize);
+            partialMessage->message_size = partialMessageSize;
+        }
+
+        uint32_t len = receivedBytes;
+        if (partialSize + len > partialMessageSize)
+            len = partialMessageSize - partialSize;
+
+        // append to partial message (buffer is big enough)
+        memcpy(((uint8_t*)partialMessage) + partialSize, data, len);
+        data += len;
+        receivedBytes -= len;
+        partialSize += len;
+
+        // if message is complete handle it
+        if (partialSize == partialMessageSize) {
+            wk_msg_header* msg = partialMessage;
+            partialSize = 0;
+            partialMessageSize = 0;
+            partialMessage = NULL;
+            handler->handleMessage(msg);
+        }
+    }
+
+    bool isPoolBuffer = MessagePool::contains(data);
+
+    // Handle entire messages
+    while (receivedBytes >= 2) {
+        // the message might not be aligned
+        uint16_t msgSize;
+        memcpy(&msgSize, data, sizeof(msgSize));
+        if (receivedBytes < msgSize)
+            break; // partial message
+
+        if (msgSize < sizeof(wk_msg_header))
+            return false;
+
+        wk_msg_header* msg;
+        if (isPoolBuffer && ((uintptr_t)data & (MESSAGE_ALIGNMENT - 1)) == 0) {
+            // hand out view into buffer
+            msg = (wk_msg_header*)data;
+            MessagePool::retain(msg);
+        } else {
+            // create copy (the fields of an unaligned message must not be accessed in place)
+            msg = CopyMessage(data, msgSize);
+        }
+
+        handler->handleMessage(msg);
+
+        data += msgSize;
+        receivedBytes -= msgSize;
+    }
+
+    // Handle remainder
+    if (receivedBytes > 0) {
+        // a partial message remains
+
+        if (receivedBytes == 1) {
+            // super special case: only 1 byte was transmitted;
+            // we don't know the size of the message
+            partialSize = 1;
+            partialMessageSize = data[0];
+
+        } else {
+            // allocate buffer
+            uint16_t msgSize;
+            memcpy(&msgSize, data, sizeof(msgSize));
+            partialMessageSize = msgSize;
+            if (partialMessageSize < sizeof(wk_msg_header)) {
+                partialMessageSize = 0;
+                return false;
+            }
+            partialMessage = (wk_msg_header*)malloc(partialMessageSize);
+            partialSize = receivedBytes;
+            memcpy(partialMessage, data, receivedBytes);
+        }
+    }
+
+    return true;
+}
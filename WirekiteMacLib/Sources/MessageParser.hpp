@@ -0,0 +1,90 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef MessageParser_hpp
+#define MessageParser_hpp
+
+#include "proto.h"
+#include "MessagePool.hpp"
+
+
+/**
+ * Handles the messages extracted by the parser
+ */
+class MessageHandler {
+public:
+    virtual ~MessageHandler() {}
+
+    /**
+     * Handles a message.
+     *
+     * The handler takes ownership of the message and must release it with `MessagePool::release()`.
+     *
+     * @param msg the message
+     */
+    virtual void handleMessage(wk_msg_header* msg) = 0;
+
+    /**
+     * Completes the handling of a batch of messages of a port.
+     *
+     * The event executor calls it on the same thread after it has handled a batch of
+     * messages, once for each port with messages in the batch. Handlers accumulating
+     * work across messages (such as the filtering of samples) complete it here.
+     *
+     * @param portId the port ID
+     */
+    virtual void handleBatchEnd(uint16_t portId) { }
+};
+
+
+/**
+ * Splits a stream of data chunks into messages
+ *
+ * If the chunk is a `MessagePool` buffer, the messages are handed out as views
+ * into the buffer. Only messages spanning several chunks and messages that are
+ * not 4 byte aligned within the chunk are copied (so all fields can be read
+ * in place).
+ *
+ * The parser is not thread-safe. It is expected to be called from a single I/O thread.
+ */
+class MessageParser {
+public:
+    MessageParser();
+    ~MessageParser();
+
+    /**
+     * Sets the handler for the extracted messages.
+     * @param h the message handler
+     */
+    void setHandler(MessageHandler* h) { handler = h; }
+
+    /**
+     * Processes the next chunk of data.
+     *
+     * For each complete message, the message handler is called.
+     *
+     * @param data the data chunk
+     * @param length the length of the chunk (in bytes)
+     * @return `false` if invalid data was encountered and the rest of the chunk was discarded
+     */
+    bool processData(const uint8_t* data, uint32_t length);
+
+    /**
+     * Discards a partially received message.
+     */
+    void reset();
+
+private:
+    MessageHandler* handler;
+    wk_msg_header* partialMessage;
+    uint32_t partialMessageSize;
+    uint32_t partialSize;
+};
+
+
+#endif /* MessageParser_hpp */
@@ -0,0 +1,94 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <atomic>
+#include "MessagePool.hpp"
+
+
+struct PoolBuffer {
+    uint8_t data[MESSAGE_POOL_BUFFER_SIZE];
+    std::atomic<int> refCount;
+};
+
+
+static PoolBuffer buffers[MESSAGE_POOL_NUM_BUFFERS];
+static int freeList[MESSAGE_POOL_NUM_BUFFERS];
+static int numFree = 0;
+static int numNeverUsed = MESSAGE_POOL_NUM_BUFFERS;
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static inline PoolBuffer* bufferFor(const void* ptr)
+{
+    size_t offset = (const uint8_t*)ptr - (const uint8_t*)buffers;
+    return &buffers[offset / sizeof(PoolBuffer)];
+}
+
+
+uint8_t* MessagePool::acquireBuffer()
+{
+    int index = -1;
+
+    pthread_mutex_lock(&poolMutex);
+    if (numFree > 0) {
+        numFree--;
+        index = freeList[numFree];
+    } else if (numNeverUsed > 0) {
+        index = MESSAGE_POOL_NUM_BUFFERS - numNeverUsed;
+        numNeverUsed--;
+    }
+    pthread_mutex_unlock(&poolMutex);
+
+    if (index < 0)
+        return NULL;
+
+    PoolBuffer* buffer = &buffers[index];
+    buffer->refCount.store(1, std::memory_order_relaxed);
+    return buffer->data;
+}
+
+
+bool MessagePool::contains(const void* ptr)
+{
+    return ptr >= (const void*)buffers && ptr < (const void*)(buffers + MESSAGE_POOL_NUM_BUFFERS);
+}
+
+
+void MessagePool::retain(const void* ptr)
+{
+    bufferFor(ptr)->refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void MessagePool::release(const void* ptr)
+{
+    if (!contains(ptr)) {
+        free((void*)ptr);
+        return;
+    }
+
+    PoolBuffer* buffer = bufferFor(ptr);
+    if (buffer->refCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    pthread_mutex_lock(&poolMutex);
+    freeList[numFree] = (int)(buffer - buffers);
+    numFree++;
+    pthread_mutex_unlock(&poolMutex);
+}
+
+
+int MessagePool::buffersInUse()
+{
+    pthread_mutex_lock(&poolMutex);
+    int result = MESSAGE_POOL_NUM_BUFFERS - numNeverUsed - numFree;
+    pthread_mutex_unlock(&poolMutex);
+    return result;
+}
@@ -0,0 +1,75 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef MessagePool_hpp
+#define MessagePool_hpp
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define MESSAGE_POOL_BUFFER_SIZE 512
+#define MESSAGE_POOL_NUM_BUFFERS 256
+
+
+/**
+ * Pool of reference counted receive buffers
+ *
+ * Data is received directly into buffers from the pool. Messages that are
+ * completely contained in a buffer are handed out as views into the buffer.
+ * Each view holds a reference on the buffer. The buffer is returned
+ * to the pool once all views have been released.
+ *
+ * Messages spanning two buffers and messages received while the pool
+ * was exhausted are copied to the heap instead. `release` handles both cases.
+ *
+ * The pool is shared by all devices. All methods are thread-safe.
+ */
+class MessagePool {
+public:
+    /**
+     * Acquires a receive buffer of `MESSAGE_POOL_BUFFER_SIZE` bytes.
+     *
+     * The caller holds a reference and must release it using `release`.
+     *
+     * @return the buffer, or `NULL` if the pool is exhausted
+     */
+    static uint8_t* acquireBuffer();
+
+    /**
+     * Indicates if the memory is part of a pool buffer.
+     * @param ptr a pointer to the memory
+     * @return `true` if it is part of a pool buffer
+     */
+    static bool contains(const void* ptr);
+
+    /**
+     * Adds a reference to the pool buffer containing the memory.
+     * @param ptr a pointer into the pool buffer (e.g. a message)
+     */
+    static void retain(const void* ptr);
+
+    /**
+     * Releases a message or a buffer.
+     *
+     * If the memory is part of a pool buffer, a reference on the buffer is released.
+     * Otherwise the memory is released with `free()`.
+     *
+     * @param ptr a pointer to the message or buffer (can be `NULL`)
+     */
+    static void release(const void* ptr);
+
+    /**
+     * Returns the number of buffers currently in use.
+     * @return the number of buffers
+     */
+    static int buffersInUse();
+};
+
+
+#endif /* MessagePool_hpp */
@@ -0,0 +1,219 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <stdio.h>
+#include <chrono>
+#include "Metrics.hpp"
+#include "MessageDump.hpp"
+
+
+static const char* PriorityNames[THROTTLER_NUM_PRIORITIES] = {
+    "control",
+    "normal",
+    "bulk"
+};
+
+
+static uint32_t currentTime()
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void LatencySummary::summarize(LatencyHistogram& histogram)
+{
+    count = histogram.count();
+    p50 = histogram.percentile(50);
+    p90 = histogram.percentile(90);
+    p99 = histogram.percentile(99);
+    p999 = histogram.percentile(99.9);
+    max = histogram.maximum();
+}
+
+
+static void formatSummary(std::string& text, const char* name, const LatencySummary& summary)
+{
+    char line[160];
+    snprintf(line, sizeof(line), "  %-16s n=%llu p50=%u p90=%u p99=%u p999=%u max=%u\n", name,
+             (unsigned long long)summary.count, summary.p50, summary.p90, summary.p99, summary.p999, summary.max);
+    text += line;
+}
+
+
+static void formatSummaryJSON(std::string& text, const char* name, const LatencySummary& summary)
+{
+    char line[200];
+    snprintf(line, sizeof(line), "\"%s\":{\"count\":%llu,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"p999\":%u,\"max\":%u}",
+             name, (unsigned long long)summary.count, summary.p50, summary.p90, summary.p99, summary.p999, summary.max);
+    text += line;
+}
+
+
+std::string MetricsSnapshot::format()
+{
+    std::string text;
+    char line[160];
+    
+    text += "throttle wait (µs):\n";
+    for (int i = 0; i < THROTTLER_NUM_PRIORITIES; i++)
+        formatSummary(text, PriorityNames[i], throttleWaits[i]);
+    
+    snprintf(line, sizeof(line), "bytes in flight: %d (peak %d)\nqueue drops: %llu\n",
+             bytesInFlight, peakBytesInFlight, (unsigned long long)queueDrops);
+    text += line;
+    
+    for (std::vector<PortMetricsSnapshot>::iterator it = ports.begin(); it != ports.end(); it++) {
+        snprintf(line, sizeof(line), "port %u: events %llu, queue drops %llu, suppressed samples %llu\n", it->portId,
+                 (unsigned long long)it->events, (unsigned long long)it->queueDrops,
+                 (unsigned long long)it->suppressedSamples);
+        text += line;
+        for (int action = 0; action < METRICS_NUM_ACTIONS; action++) {
+            if (it->roundTrips[action].count == 0)
+                continue;
+            snprintf(line, sizeof(line), "%s rtt (µs)", MessageDump::portActionName(action));
+            formatSummary(text, line, it->roundTrips[action]);
+        }
+    }
+    
+    return text;
+}
+
+
+std::string MetricsSnapshot::formatJSON()
+{
+    // times in µs
+    std::string text;
+    char line[160];
+    
+    text += "{\"throttleWaits\":{";
+    for (int i = 0; i < THROTTLER_NUM_PRIORITIES; i++) {
+        if (i > 0)
+            text += ",";
+        formatSummaryJSON(text, PriorityNames[i], throttleWaits[i]);
+    }
+    
+    snprintf(line, sizeof(line), "},\"bytesInFlight\":%d,\"peakBytesInFlight\":%d,\"queueDrops\":%llu,\"ports\":[",
+             bytesInFlight, peakBytesInFlight, (unsigned long long)queueDrops);
+    text += line;
+    
+    for (std::vector<PortMetricsSnapshot>::iterator it = ports.begin(); it != ports.end(); it++) {
+        if (it != ports.begin())
+            text += ",";
+        snprintf(line, sizeof(line), "{\"portId\":%u,\"events\":%llu,\"queueDrops\":%llu,\"suppressedSamples\":%llu,\"roundTrips\":{",
+                 it->portId, (unsigned long long)it->events, (unsigned long long)it->queueDrops,
+                 (unsigned long long)it->suppressedSamples);
+        text += line;
+        bool isFirst = true;
+        for (int action = 0; action < METRICS_NUM_ACTIONS; action++) {
+            if (it->roundTrips[action].count == 0)
+                continue;
+            if (!isFirst)
+                text += ",";
+            formatSummaryJSON(text, MessageDump::portActionName(action), it->roundTrips[action]);
+            isFirst = false;
+        }
+        text += "}}";
+    }
+    
+    text += "]}";
+    return text;
+}
+
+
+
+PortMetrics::PortMetrics()
+:   events(0),
+    queueDrops(0),
+    suppressedSamples(0)
+{
+    for (int i = 0; i < METRICS_NUM_ACTIONS; i++)
+        roundTrips[i].store(NULL, std::memory_order_relaxed);
+}
+
+
+PortMetrics::~PortMetrics()
+{
+    for (int i = 0; i < METRICS_NUM_ACTIONS; i++)
+        delete roundTrips[i].load(std::memory_order_relaxed);
+}
+
+
+void PortMetrics::recordRoundTrip(uint8_t action, uint32_t roundTrip)
+{
+    if (action >= METRICS_NUM_ACTIONS)
+        return;
+    
+    LatencyHistogram* histogram = roundTrips[action].load(std::memory_order_acquire);
+    if (histogram == NULL) {
+        // first use; another thread might install a histogram at the same time
+        LatencyHistogram* newHistogram = new LatencyHistogram();
+        if (roundTrips[action].compare_exchange_strong(histogram, newHistogram, std::memory_order_acq_rel)) {
+            histogram = newHistogram;
+        } else {
+            delete newHistogram;
+        }
+    }
+    
+    histogram->record(roundTrip);
+}
+
+
+void PortMetrics::snapshot(PortMetricsSnapshot& snapshot)
+{
+    snapshot.events = events.load(std::memory_order_relaxed);
+    snapshot.queueDrops = queueDrops.load(std::memory_order_relaxed);
+    snapshot.suppressedSamples = suppressedSamples.load(std::memory_order_relaxed);
+    for (int i = 0; i < METRICS_NUM_ACTIONS; i++) {
+        LatencyHistogram* histogram = roundTrips[i].load(std::memory_order_acquire);
+        if (histogram != NULL) {
+            snapshot.roundTrips[i].summarize(*histogram);
+        } else {
+            LatencySummary empty = { 0, 0, 0, 0, 0, 0 };
+            snapshot.roundTrips[i] = empty;
+        }
+    }
+}
+
+
+
+RequestTimer::RequestTimer()
+{
+    for (int i = 0; i < REQUEST_TIMER_NUM_SLOTS; i++)
+        slots[i].store(0, std::memory_order_relaxed);
+}
+
+
+RequestTimer::~RequestTimer()
+{
+}
+
+
+void RequestTimer::requestSent(uint16_t requestId, uint8_t action)
+{
+    uint64_t entry = ((uint64_t)currentTime() << 32) | ((uint64_t)requestId << 8) | action;
+    slots[requestId % REQUEST_TIMER_NUM_SLOTS].store(entry, std::memory_order_relaxed);
+}
+
+
+bool RequestTimer::requestCompleted(uint16_t requestId, uint8_t* action, uint32_t* roundTrip)
+{
+    std::atomic<uint64_t>& slot = slots[requestId % REQUEST_TIMER_NUM_SLOTS];
+    uint64_t entry = slot.load(std::memory_order_relaxed);
+    uint8_t a = (uint8_t)entry;
+    if (a == 0 || (uint16_t)(entry >> 8) != requestId)
+        return false;
+    
+    // the slot might be reused for the next request meanwhile
+    if (!slot.compare_exchange_strong(entry, 0, std::memory_order_relaxed))
+        return false;
+    
+    *action = a;
+    *roundTrip = currentTime() - (uint32_t)(entry >> 32);
+    return true;
+}
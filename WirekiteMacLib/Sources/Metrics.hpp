@@ -0,0 +1,150 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef Metrics_hpp
+#define Metrics_hpp
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "proto.h"
+#include "LatencyHistogram.hpp"
+#include "Throttler.hpp"
+
+
+// port actions are indexed by their WK_PORT_ACTION_* value
+#define METRICS_NUM_ACTIONS (WK_PORT_ACTION_STOP_POLLING + 1)
+
+// requests in flight are timed in slots at index `requestId % N`
+#define REQUEST_TIMER_NUM_SLOTS (2 * THROTTLER_MAX_OUTSTANDING)
+
+
+/**
+ * Summary of a latency histogram
+ */
+struct LatencySummary {
+    uint64_t count;
+    uint32_t p50; // in µs
+    uint32_t p90;
+    uint32_t p99;
+    uint32_t p999;
+    uint32_t max;
+    
+    void summarize(LatencyHistogram& histogram);
+};
+
+
+/**
+ * Snapshot of the metrics of a port
+ */
+struct PortMetricsSnapshot {
+    uint16_t portId;
+    uint64_t events; // events received from the board
+    uint64_t queueDrops; // events dropped because the port's queue was full
+    uint64_t suppressedSamples; // samples not reported by the board (deadband)
+    LatencySummary roundTrips[METRICS_NUM_ACTIONS]; // indexed by WK_PORT_ACTION_*
+};
+
+
+/**
+ * Snapshot of the metrics of a device
+ */
+struct MetricsSnapshot {
+    LatencySummary throttleWaits[THROTTLER_NUM_PRIORITIES]; // indexed by throttler priority
+    int bytesInFlight;
+    int peakBytesInFlight;
+    uint64_t queueDrops; // sum over all ports
+    std::vector<PortMetricsSnapshot> ports;
+    
+    /**
+     * Formats the snapshot as human-readable text.
+     * @return the text
+     */
+    std::string format();
+    
+    /**
+     * Formats the snapshot as JSON (e.g. for tracking performance regressions).
+     * @return the JSON text
+     */
+    std::string formatJSON();
+};
+
+
+/**
+ * Counters and round-trip times of a port
+ *
+ * All methods are lock-free. The histograms are only allocated
+ * for actions that are actually used.
+ */
+class PortMetrics {
+public:
+    PortMetrics();
+    ~PortMetrics();
+    
+    void eventReceived() { events.fetch_add(1, std::memory_order_relaxed); }
+    void eventDropped() { queueDrops.fetch_add(1, std::memory_order_relaxed); }
+    void samplesSuppressed(uint32_t count) { suppressedSamples.fetch_add(count, std::memory_order_relaxed); }
+    
+    /**
+     * Records the round-trip time of a request.
+     * @param action the request's action (`WK_PORT_ACTION_*`)
+     * @param roundTrip the round-trip time (in µs)
+     */
+    void recordRoundTrip(uint8_t action, uint32_t roundTrip);
+    
+    /**
+     * Takes a snapshot.
+     * @param snapshot receives the metrics (except the port ID)
+     */
+    void snapshot(PortMetricsSnapshot& snapshot);
+    
+private:
+    std::atomic<uint64_t> events;
+    std::atomic<uint64_t> queueDrops;
+    std::atomic<uint64_t> suppressedSamples;
+    std::atomic<LatencyHistogram*> roundTrips[METRICS_NUM_ACTIONS];
+};
+
+
+/**
+ * Tracks the time port requests are in flight
+ *
+ * The send time, request ID and action are kept in the slot at index
+ * `requestId % REQUEST_TIMER_NUM_SLOTS` so that the round-trip time can be
+ * determined when the response arrives. If a request still occupies the
+ * slot when another request is sent, its round-trip time is not recorded.
+ */
+class RequestTimer {
+public:
+    RequestTimer();
+    ~RequestTimer();
+    
+    /**
+     * Records that a request has been sent.
+     * @param requestId the request ID
+     * @param action the request's action (`WK_PORT_ACTION_*`)
+     */
+    void requestSent(uint16_t requestId, uint8_t action);
+    
+    /**
+     * Determines the round-trip time of a completed request.
+     * @param requestId the request ID
+     * @param action receives the request's action
+     * @param roundTrip receives the round-trip time (in µs)
+     * @return `true` if the request was tracked, `false` otherwise
+     */
+    bool requestCompleted(uint16_t requestId, uint8_t* action, uint32_t* roundTrip);
+    
+private:
+    // send time in µs (truncated, bits 32 to 63), request ID (bits 8 to 23) and action (bits 0 to 7, 0 if free)
+    std::atomic<uint64_t> slots[REQUEST_TIMER_NUM_SLOTS];
+};
+
+
+#endif /* Metrics_hpp */
@@ -7,97 +7,232 @@
 //
 
 #include <stdlib.h>
+#include <sched.h>
 #include "PendingRequestList.hpp"
+#include "MessagePool.hpp"
 
 
+// slot states
+#define SLOT_IDLE 0
+#define SLOT_RESERVED 1 // being announced
+#define SLOT_ANNOUNCED 2
+#define SLOT_WAITING 3
+#define SLOT_DELIVERING 4 // response being stored, by the thread that changed the state
+#define SLOT_COMPLETED 5
+#define SLOT_ASYNC 6
 
-PendingRequestList::PendingRequestList()
+
+PendingRequestWaiter::PendingRequestWaiter()
 :   mutex(PTHREAD_MUTEX_INITIALIZER),
-    inserted(PTHREAD_COND_INITIALIZER),
-    isDestroyed(false)
+    signaled(PTHREAD_COND_INITIALIZER),
+    isSignaled(false)
 {
     pthread_mutex_init(&mutex, NULL);
-    pthread_cond_init(&inserted, NULL);
+    pthread_cond_init(&signaled, NULL);
 }
 
 
-PendingRequestList::~PendingRequestList()
+PendingRequestWaiter::~PendingRequestWaiter()
 {
-    isDestroyed = true;
-    pthread_cond_destroy(&inserted);
+    pthread_cond_destroy(&signaled);
     pthread_mutex_destroy(&mutex);
 }
 
 
-void PendingRequestList::putResponse(uint16_t requestId, wk_msg_header* response)
+void PendingRequestWaiter::wait()
 {
     pthread_mutex_lock(&mutex);
-    
-    if (waitingForRequests.count(requestId) > 0)
-    {
-        PendingRequest request;
-        request.requestId = requestId;
-        request.response = response;
-        completedRequests.push_back(request);
-        
-        pthread_cond_broadcast(&inserted);
-    }
-    else
-    {
-        free(response);
-    }
-    
+    while (!isSignaled)
+        pthread_cond_wait(&signaled, &mutex);
     pthread_mutex_unlock(&mutex);
 }
 
 
-void PendingRequestList::announceRequest(uint16_t requestId)
+void PendingRequestWaiter::wakeUp()
 {
     pthread_mutex_lock(&mutex);
-    waitingForRequests.insert(requestId);
+    isSignaled = true;
+    pthread_cond_signal(&signaled);
     pthread_mutex_unlock(&mutex);
 }
 
 
-wk_msg_header* PendingRequestList::waitForResponse(uint16_t requestId)
+
+PendingRequestList::PendingRequestList()
 {
-    pthread_mutex_lock(&mutex);
-    
-    waitingForRequests.insert(requestId);
-    
-    std::vector<PendingRequest>::iterator it;
-    while (!isDestroyed) {
-        for (it = completedRequests.begin(); it != completedRequests.end(); it++)
-            if ((*it).requestId == requestId)
-                break;
-        if (it != completedRequests.end())
+    for (int i = 0; i < PENDING_REQUEST_NUM_SLOTS; i++) {
+        slots[i].state.store(SLOT_IDLE, std::memory_order_relaxed);
+        slots[i].requestId.store(0, std::memory_order_relaxed);
+        slots[i].response = NULL;
+        slots[i].waiter = NULL;
+        slots[i].callback = NULL;
+        slots[i].context = NULL;
+    }
+}
+
+
+PendingRequestList::~PendingRequestList()
+{
+    clear();
+
+    // responses nobody has picked up
+    for (int i = 0; i < PENDING_REQUEST_NUM_SLOTS; i++) {
+        if (slots[i].state.load(std::memory_order_acquire) == SLOT_COMPLETED && slots[i].response != NULL)
+            MessagePool::release(slots[i].response);
+    }
+}
+
+
+PendingRequestSlot* PendingRequestList::acquireSlot(uint16_t requestId)
+{
+    while (true) {
+        for (int i = 0; i < PENDING_REQUEST_MAX_PROBES; i++) {
+            PendingRequestSlot* slot = &slots[(requestId + i) & (PENDING_REQUEST_NUM_SLOTS - 1)];
+            int state = SLOT_IDLE;
+            if (slot->state.compare_exchange_strong(state, SLOT_RESERVED, std::memory_order_acquire)) {
+                slot->requestId.store(requestId, std::memory_order_relaxed);
+                return slot;
+            }
+        }
+
+        // all probed slots are in use by requests that have not completed yet
+        sched_yield();
+    }
+}
+
+
+PendingRequestSlot* PendingRequestList::findSlot(uint16_t requestId)
+{
+    for (int i = 0; i < PENDING_REQUEST_MAX_PROBES; i++) {
+        PendingRequestSlot* slot = &slots[(requestId + i) & (PENDING_REQUEST_NUM_SLOTS - 1)];
+        int state = slot->state.load(std::memory_order_acquire);
+        if (state != SLOT_IDLE && state != SLOT_RESERVED && slot->requestId.load(std::memory_order_relaxed) == requestId)
+            return slot;
+    }
+    return NULL;
+}
+
+
+void PendingRequestList::complete(PendingRequestSlot* slot, int state, wk_msg_header* response)
+{
+    // the slot is in the delivering state, owned by the calling thread
+    slot->response = response;
+    PendingRequestWaiter* waiter = slot->waiter;
+    slot->state.store(SLOT_COMPLETED, std::memory_order_release);
+
+    // the waiter does not return before it has been woken up
+    if (state == SLOT_WAITING)
+        waiter->wakeUp();
+}
+
+
+void PendingRequestList::putResponse(uint16_t requestId, wk_msg_header* response)
+{
+    PendingRequestSlot* slot = findSlot(requestId);
+    if (slot == NULL) {
+        // nobody is interested in the response
+        MessagePool::release(response);
+        return;
+    }
+
+    int state = slot->state.load(std::memory_order_acquire);
+    while (true) {
+        if (state == SLOT_ASYNC) {
+            PendingRequestCallback callback = slot->callback;
+            void* context = slot->context;
+            if (slot->state.compare_exchange_strong(state, SLOT_IDLE, std::memory_order_acq_rel)) {
+                callback(context, response);
+                return;
+            }
+            // cancelled in the meantime
+            continue;
+        }
+
+        if (state != SLOT_ANNOUNCED && state != SLOT_WAITING) {
+            // nobody is interested in the response
+            MessagePool::release(response);
+            return;
+        }
+
+        // the waiter might concurrently change the state from announced to waiting
+        if (slot->state.compare_exchange_weak(state, SLOT_DELIVERING, std::memory_order_acq_rel))
             break;
-        pthread_cond_wait(&inserted, &mutex);
     }
-    
-    wk_msg_header* result = NULL;
-    if (!isDestroyed)
-    {
-        result = (*it).response;
-        completedRequests.erase(it);
+
+    complete(slot, state, response);
+}
+
+
+void PendingRequestList::announceRequest(uint16_t requestId)
+{
+    PendingRequestSlot* slot = acquireSlot(requestId);
+    slot->state.store(SLOT_ANNOUNCED, std::memory_order_release);
+}
+
+
+void PendingRequestList::announceRequest(uint16_t requestId, PendingRequestCallback callback, void* context)
+{
+    PendingRequestSlot* slot = acquireSlot(requestId);
+    slot->callback = callback;
+    slot->context = context;
+    slot->state.store(SLOT_ASYNC, std::memory_order_release);
+}
+
+
+wk_msg_header* PendingRequestList::waitForResponse(uint16_t requestId)
+{
+    PendingRequestSlot* slot = findSlot(requestId);
+    if (slot == NULL)
+        return NULL;
+
+    int state = slot->state.load(std::memory_order_acquire);
+    while (state != SLOT_COMPLETED) {
+        if (state == SLOT_ANNOUNCED) {
+            PendingRequestWaiter waiter;
+            slot->waiter = &waiter;
+            if (slot->state.compare_exchange_strong(state, SLOT_WAITING, std::memory_order_acq_rel)) {
+                waiter.wait();
+                state = slot->state.load(std::memory_order_acquire);
+            }
+            // else the response is being delivered
+            slot->waiter = NULL;
+
+        } else {
+            // the response is being delivered; this takes a moment only
+            sched_yield();
+            state = slot->state.load(std::memory_order_acquire);
+        }
     }
-    
-    waitingForRequests.erase(requestId);
-    
-    pthread_mutex_unlock(&mutex);
-    
+
+    wk_msg_header* result = slot->response;
+    slot->response = NULL;
+    slot->state.store(SLOT_IDLE, std::memory_order_release);
     return result;
 }
 
 
 void PendingRequestList::clear()
 {
-    pthread_mutex_lock(&mutex);
-    
-    for (std::vector<PendingRequest>::iterator it = completedRequests.begin(); it != completedRequests.end(); it++)
-        free((*it).response);
-    completedRequests.clear();
-    waitingForRequests.clear();
-    
-    pthread_mutex_unlock(&mutex);
+    // cancel the requests still waiting for a response; the owners of completed slots pick up their response
+    for (int i = 0; i < PENDING_REQUEST_NUM_SLOTS; i++) {
+        PendingRequestSlot* slot = &slots[i];
+        int state = slot->state.load(std::memory_order_acquire);
+        while (true) {
+            if (state == SLOT_ASYNC) {
+                PendingRequestCallback callback = slot->callback;
+                void* context = slot->context;
+                if (slot->state.compare_exchange_weak(state, SLOT_IDLE, std::memory_order_acq_rel)) {
+                    callback(context, NULL);
+                    break;
+                }
+            } else if (state == SLOT_ANNOUNCED || state == SLOT_WAITING) {
+                if (slot->state.compare_exchange_weak(state, SLOT_DELIVERING, std::memory_order_acq_rel)) {
+                    complete(slot, state, NULL);
+                    break;
+                }
+            } else {
+                break;
+            }
+        }
+    }
 }
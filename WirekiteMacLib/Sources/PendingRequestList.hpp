@@ -10,34 +10,120 @@
 #define PendingRequestList_hpp
 
 #include <pthread.h>
-#include <vector>
-#include <unordered_set>
+#include <atomic>
 #include "proto.h"
+#include "Throttler.hpp"
 
 
-class PendingRequest {
+// twice the throttled requests to leave room for configuration requests
+// and unthrottled port requests (must be a power of 2)
+#define PENDING_REQUEST_NUM_SLOTS (2 * THROTTLER_MAX_OUTSTANDING)
+// number of slots probed for a request ID
+#define PENDING_REQUEST_MAX_PROBES 8
+
+
+/**
+ * Thread blocked until the response to its request has arrived
+ */
+class PendingRequestWaiter {
 public:
-    uint16_t requestId;
+    PendingRequestWaiter();
+    ~PendingRequestWaiter();
+
+    void wait();
+    void wakeUp();
+
+private:
+    pthread_mutex_t mutex;
+    pthread_cond_t signaled;
+    bool isSignaled;
+};
+
+
+/**
+ * Function called when the response to an asynchronous request has arrived
+ *
+ * The function takes ownership of the response. It is called on the thread
+ * delivering the response and must return quickly.
+ *
+ * @param context the context specified when the request was announced
+ * @param response the response, or `NULL` if the request was cancelled
+ */
+typedef void (*PendingRequestCallback)(void* context, wk_msg_header* response);
+
+
+/**
+ * Completion slot for a pending request
+ */
+struct PendingRequestSlot {
+    std::atomic<int> state;
+    std::atomic<uint16_t> requestId;
     wk_msg_header* response;
+    PendingRequestWaiter* waiter;
+    PendingRequestCallback callback;
+    void* context;
 };
 
 
+/**
+ * List of requests waiting for a response
+ *
+ * A request occupies a completion slot from the time it is announced until
+ * the response is picked up. The slot is found at the index `requestId % N`
+ * or, if that slot is in use, one of the following slots. The number of
+ * slots is twice the maximum number of throttled outstanding requests.
+ * If all probed slots are in use, announcing a request waits for a slot.
+ *
+ * Announcing a request, putting its response and picking it up are lock-free.
+ * Only a thread that has to block uses a wait primitive, and it is the only
+ * thread woken up by the response.
+ *
+ * Asynchronous requests do not wait. Instead, a callback is called
+ * when the response arrives.
+ */
 class PendingRequestList {
 public:
     PendingRequestList();
     ~PendingRequestList();
     
     void announceRequest(uint16_t requestId);
+
+    /**
+     * Announces an asynchronous request.
+     *
+     * The callback is called when the response arrives, or with a `NULL`
+     * response when the list is cleared before.
+     *
+     * @param requestId the request ID
+     * @param callback the function to call
+     * @param context the context passed to the callback
+     */
+    void announceRequest(uint16_t requestId, PendingRequestCallback callback, void* context);
     void putResponse(uint16_t requestId, wk_msg_header* response);
+
+    /**
+     * Waits for the response of an announced request.
+     * @param requestId the request ID
+     * @return the response, or `NULL` if the list was cleared before the response arrived
+     */
     wk_msg_header* waitForResponse(uint16_t requestId);
+
+    /**
+     * Cancels all requests.
+     *
+     * Waiting threads receive a `NULL` response and asynchronous requests
+     * are completed with a `NULL` response. Responses that have arrived
+     * remain with the thread that is about to pick them up.
+     */
     void clear();
 
 private:
-    std::vector<PendingRequest> completedRequests;
-    std::unordered_set<uint16_t> waitingForRequests;
-    pthread_cond_t inserted;
-    pthread_mutex_t mutex;
-    bool isDestroyed;
+    PendingRequestSlot* acquireSlot(uint16_t requestId);
+    PendingRequestSlot* findSlot(uint16_t requestId);
+    static void complete(PendingRequestSlot* slot, int state, wk_msg_header* response);
+
+private:
+    PendingRequestSlot slots[PENDING_REQUEST_NUM_SLOTS];
 };
 
 #endif /* PendingRequest_hpp */
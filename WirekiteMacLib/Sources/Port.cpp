@@ -8,16 +8,18 @@
 
 #include <stdlib.h>
 #include "Port.hpp"
+#include "MessagePool.hpp"
+#include "SampleFilter.hpp"
 
 
 static void free_event(wk_port_event* event)
 {
-    free(event);
+    MessagePool::release(event);
 }
 
 
 Port::Port(uint16_t portId, PortType type, int queueLength)
-: _portId(portId), _type(type), _lastSample(0), queue(queueLength)
+: refCount(1), _portId(portId), _type(type), _sampleSequence(0), _lastSample(0), _sampleTimestamp(0), _context(NULL), _releaseContext(NULL), _filter(NULL), _numFilterSamples(0), queue(queueLength)
 {
 }
 
@@ -25,13 +27,91 @@ Port::Port(uint16_t portId, PortType type, int queueLength)
 Port::~Port()
 {
     queue.clear(free_event);
+    delete _filter;
+    void* context = _context.load(std::memory_order_acquire);
+    if (context != NULL && _releaseContext != NULL)
+        _releaseContext(context);
+}
+
+
+void Port::release()
+{
+    if (refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete this;
+}
+
+
+bool Port::setContext(void* context, void (*releaseContext)(void* context))
+{
+    void* expected = NULL;
+    if (!_context.compare_exchange_strong(expected, context, std::memory_order_acq_rel))
+        return false;
+    
+    // only read by the destructor, which runs after the last reference has been released
+    _releaseContext = releaseContext;
+    return true;
+}
+
+
+bool Port::addFilterSample(int32_t value, uint64_t timestamp)
+{
+    _filterValues[_numFilterSamples] = value;
+    _filterTimestamps[_numFilterSamples] = timestamp;
+    _numFilterSamples++;
+    return _numFilterSamples == PORT_FILTER_BATCH_SIZE;
+}
+
+
+int Port::filterSamples(int32_t** values, uint64_t** timestamps)
+{
+    int count = _numFilterSamples;
+    _numFilterSamples = 0;
+    *values = _filterValues;
+    *timestamps = _filterTimestamps;
+    return count > 0 ? _filter->process(_filterValues, _filterTimestamps, count) : 0;
+}
+
+
+void Port::setLastSample(int32_t sample, uint64_t timestamp)
+{
+    // enter the write section (several threads might update the result of I2C and SPI ports)
+    uint32_t seq = _sampleSequence.load(std::memory_order_relaxed);
+    do {
+        while ((seq & 1) != 0)
+            seq = _sampleSequence.load(std::memory_order_relaxed);
+    } while (!_sampleSequence.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire));
+    std::atomic_thread_fence(std::memory_order_release);
+    
+    _lastSample.store(sample, std::memory_order_relaxed);
+    _sampleTimestamp.store(timestamp, std::memory_order_relaxed);
+    
+    _sampleSequence.store(seq + 2, std::memory_order_release);
+}
+
+
+PortSample Port::lastSampleSnapshot()
+{
+    PortSample sample;
+    uint32_t seq1, seq2;
+    do {
+        seq1 = _sampleSequence.load(std::memory_order_acquire);
+        sample.value = _lastSample.load(std::memory_order_relaxed);
+        sample.timestamp = _sampleTimestamp.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        seq2 = _sampleSequence.load(std::memory_order_relaxed);
+    } while ((seq1 & 1) != 0 || seq1 != seq2);
+    
+    sample.sequence = seq1 / 2;
+    return sample;
 }
 
 
 void Port::pushEvent(wk_port_event* event)
 {
-    if (!queue.put(event))
-        free(event);
+    if (!queue.put(event)) {
+        _metrics.eventDropped();
+        MessagePool::release(event);
+    }
 }
 
 
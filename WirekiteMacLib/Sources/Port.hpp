@@ -11,6 +11,13 @@
 
 #include "proto.h"
 #include "Queue.hpp"
+#include "Metrics.hpp"
+#include <atomic>
+
+class SampleFilter;
+
+
+#define PORT_FILTER_BATCH_SIZE 16 // the event executor's batch size
 
 enum PortType {
     PortTypeDigitalOutput,
@@ -19,32 +26,126 @@ enum PortType {
     PortTypeDigitalInputTriggering,
     PortTypeAnalogInputOnDemand,
     PortTypeAnalogInputSampling,
+    PortTypeAnalogScan,
     PortTypePWMOutput,
     PortTypeI2C,
     PortTypeSPI
 };
 
 
+/**
+ * Consistent snapshot of the last sample of a port
+ */
+struct PortSample {
+    int32_t value;
+    uint32_t sequence; // number of updates (0 if never updated)
+    uint64_t timestamp; // host time of the update (in ns)
+};
+
+
+/**
+ * Port on the Wirekite board
+ *
+ * The last sample is protected by a sequence lock: readers never block
+ * the writer and retry if the sample was updated while they read it.
+ *
+ * A port is reference counted. The port list holds the initial reference.
+ * Threads that use a port beyond a read section of the port list, such as
+ * a thread waiting for an event of the port, hold a reference of their own.
+ */
 class Port
 {
 public:
     Port(uint16_t portId, PortType type, int queueLength);
-    ~Port();
+    
+    void retain() { refCount.fetch_add(1, std::memory_order_relaxed); }
+    void release();
     
     uint16_t portId() { return _portId; }
     PortType type() { return _type; }
     
-    int32_t lastSample() { return _lastSample; }
-    void setLastSample(int32_t sample) { _lastSample = sample; }
+    int32_t lastSample() { return _lastSample.load(std::memory_order_relaxed); }
+    void setLastSample(int32_t sample, uint64_t timestamp = 0);
+    PortSample lastSampleSnapshot();
+    
+    void* context() { return _context.load(std::memory_order_acquire); }
+    
+    /**
+     * Installs the context if the port has none yet.
+     *
+     * The context is published with release semantics so that threads that
+     * see it also see its initialization. Install it before adding the port
+     * to the port list if events might arrive immediately.
+     *
+     * @param context the context
+     * @param releaseContext the function releasing the context when the port is deleted
+     * @return `true` if installed, `false` if another context was installed before
+     */
+    bool setContext(void* context, void (*releaseContext)(void* context));
+    
+    /**
+     * Gets the filter pipeline applied to the samples of the port.
+     *
+     * The filter is only used by the port's strand of the event executor.
+     *
+     * @return the filter, or `NULL` if the samples are not filtered
+     */
+    SampleFilter* filter() { return _filter; }
+    
+    /**
+     * Sets the filter pipeline. The port takes ownership of the filter.
+     *
+     * The filter must be set before the port is added to the port list.
+     *
+     * @param filter the filter
+     */
+    void setFilter(SampleFilter* filter) { _filter = filter; }
+    
+    /**
+     * Adds a sample to the batch processed by the filter.
+     *
+     * Only used by the port's strand of the event executor.
+     *
+     * @param value the sample value
+     * @param timestamp the sample timestamp (in ns)
+     * @return `true` if the batch is full and must be filtered now
+     */
+    bool addFilterSample(int32_t value, uint64_t timestamp);
+    
+    /**
+     * Filters the samples added since the last call.
+     *
+     * The filtered samples remain valid until the next sample is added.
+     *
+     * @param values receives a pointer to the filtered values
+     * @param timestamps receives a pointer to the timestamps of the filtered values
+     * @return the number of filtered samples
+     */
+    int filterSamples(int32_t** values, uint64_t** timestamps);
     
     void pushEvent(wk_port_event* event);
     wk_port_event* waitForEvent();
     
+    PortMetrics& metrics() { return _metrics; }
+    
+private:
+    ~Port();
+    
 private:
+    std::atomic<int> refCount;
     uint16_t _portId;
     PortType _type;
-    int32_t _lastSample;
-    Queue<wk_port_event*> queue;
+    std::atomic<uint32_t> _sampleSequence; // odd while an update is in progress
+    std::atomic<int32_t> _lastSample;
+    std::atomic<uint64_t> _sampleTimestamp;
+    std::atomic<void*> _context;
+    void (*_releaseContext)(void* context);
+    SampleFilter* _filter;
+    int32_t _filterValues[PORT_FILTER_BATCH_SIZE];
+    uint64_t _filterTimestamps[PORT_FILTER_BATCH_SIZE];
+    int _numFilterSamples;
+    Queue<wk_port_event*, true, false> queue; // single producer: the port's strand
+    PortMetrics _metrics;
 };
 
 #endif /* Port_hpp */
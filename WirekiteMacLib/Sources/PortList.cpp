@@ -6,47 +6,62 @@
 // https://opensource.org/licenses/MIT
 //
 
+#include <sched.h>
+#include <vector>
 #include "PortList.hpp"
 
 
 PortList::PortList()
-: port_mutex(PTHREAD_MUTEX_INITIALIZER),
+:   port_mutex(PTHREAD_MUTEX_INITIALIZER),
+    epoch(0),
     lastRequestId(0)
 {
     pthread_mutex_init(&port_mutex, NULL);
+    for (int i = 0; i < PORT_LIST_NUM_PAGES; i++)
+        pages[i].store(NULL, std::memory_order_relaxed);
+    activeReaders[0].store(0, std::memory_order_relaxed);
+    activeReaders[1].store(0, std::memory_order_relaxed);
 }
 
 
 PortList::~PortList()
 {
     clear();
+    for (int i = 0; i < PORT_LIST_NUM_PAGES; i++)
+        delete[] pages[i].load(std::memory_order_relaxed);
     pthread_mutex_destroy(&port_mutex);
 }
 
 
 Port* PortList::getPort(uint16_t portId)
 {
-    Port* port = NULL;
-    pthread_mutex_lock(&port_mutex);
-    
-    for (std::vector<Port*>::iterator it = ports.begin(); it != ports.end(); it++) {
-        if ((*it)->portId() == portId) {
-            port = *it;
-            break;
-        }
-    }
-    
-    pthread_mutex_unlock(&port_mutex);
-    return port;
+    std::atomic<Port*>* page = pages[portId / PORT_LIST_PAGE_SIZE].load(std::memory_order_seq_cst);
+    if (page == NULL)
+        return NULL;
+    return page[portId % PORT_LIST_PAGE_SIZE].load(std::memory_order_seq_cst);
 }
 
 
 void PortList::addPort(Port* port)
 {
+    uint16_t portId = port->portId();
     pthread_mutex_lock(&port_mutex);
-    
-    ports.push_back(port);
-    
+
+    std::atomic<Port*>* page = pages[portId / PORT_LIST_PAGE_SIZE].load(std::memory_order_relaxed);
+    if (page == NULL) {
+        page = new std::atomic<Port*>[PORT_LIST_PAGE_SIZE];
+        for (int i = 0; i < PORT_LIST_PAGE_SIZE; i++)
+            page[i].store(NULL, std::memory_order_relaxed);
+        pages[portId / PORT_LIST_PAGE_SIZE].store(page, std::memory_order_release);
+    }
+
+    Port* oldPort = page[portId % PORT_LIST_PAGE_SIZE].exchange(port, std::memory_order_seq_cst);
+    if (oldPort != NULL) {
+        // stale port with the same ID
+        waitForReaders();
+        oldPort->release();
+    }
+
     pthread_mutex_unlock(&port_mutex);
 }
 
@@ -54,41 +69,119 @@ void PortList::addPort(Port* port)
 void PortList::removePort(uint16_t portId)
 {
     pthread_mutex_lock(&port_mutex);
-    
-    for (std::vector<Port*>::iterator it = ports.begin(); it != ports.end(); it++) {
-        if ((*it)->portId() == portId) {
-            ports.erase(it);
-            break;
-        }
+
+    Port* port = NULL;
+    std::atomic<Port*>* page = pages[portId / PORT_LIST_PAGE_SIZE].load(std::memory_order_relaxed);
+    if (page != NULL)
+        port = page[portId % PORT_LIST_PAGE_SIZE].exchange(NULL, std::memory_order_seq_cst);
+
+    if (port != NULL) {
+        waitForReaders();
+        port->release();
     }
-    
+
     pthread_mutex_unlock(&port_mutex);
 }
 
 
-uint16_t PortList::nextRequestId()
+void PortList::clear()
 {
     pthread_mutex_lock(&port_mutex);
-    
-    lastRequestId++;
-    if (lastRequestId >= 0xff00)
-        lastRequestId = 1;
-    uint16_t result = lastRequestId;
-    
+
+    std::vector<Port*> removedPorts;
+    for (int i = 0; i < PORT_LIST_NUM_PAGES; i++) {
+        std::atomic<Port*>* page = pages[i].load(std::memory_order_relaxed);
+        if (page == NULL)
+            continue;
+        for (int j = 0; j < PORT_LIST_PAGE_SIZE; j++) {
+            Port* port = page[j].exchange(NULL, std::memory_order_seq_cst);
+            if (port != NULL)
+                removedPorts.push_back(port);
+        }
+    }
+
+    if (!removedPorts.empty()) {
+        waitForReaders();
+        for (std::vector<Port*>::iterator it = removedPorts.begin(); it != removedPorts.end(); it++)
+            (*it)->release();
+    }
+
     pthread_mutex_unlock(&port_mutex);
-    
-    return result;
 }
 
 
-void PortList::clear()
+Port* PortList::retainPort(uint16_t portId)
 {
-    pthread_mutex_lock(&port_mutex);
+    int token = beginRead();
+    Port* port = getPort(portId);
+    if (port != NULL)
+        port->retain();
+    endRead(token);
+    return port;
+}
+
+
+int PortList::beginRead()
+{
+    // The epoch might change between reading it and registering the reader.
+    // The removal flipping it would then not wait for this reader. So retry
+    // until the reader is registered for the epoch that is still current.
+    while (true) {
+        unsigned currentEpoch = epoch.load(std::memory_order_seq_cst);
+        int token = currentEpoch & 1;
+        activeReaders[token].fetch_add(1, std::memory_order_seq_cst);
+        if (epoch.load(std::memory_order_seq_cst) == currentEpoch)
+            return token;
+        activeReaders[token].fetch_sub(1, std::memory_order_release);
+    }
+}
+
+
+void PortList::endRead(int token)
+{
+    activeReaders[token].fetch_sub(1, std::memory_order_release);
+}
+
+
+void PortList::waitForReaders()
+{
+    // New read sections use the other counter and can no longer see the
+    // removed ports (see beginRead). So only the old counter needs to drain.
+    unsigned oldEpoch = epoch.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic<int>& readers = activeReaders[oldEpoch & 1];
+    while (readers.load(std::memory_order_acquire) != 0)
+        sched_yield();
+}
+
+
+void PortList::forEachPort(void (*visitor)(Port* port, void* context), void* context)
+{
+    int token = beginRead();
     
-    for (std::vector<Port*>::iterator it = ports.begin(); it != ports.end(); it++)
-        delete (*it);
-    ports.clear();
+    for (int i = 0; i < PORT_LIST_NUM_PAGES; i++) {
+        std::atomic<Port*>* page = pages[i].load(std::memory_order_acquire);
+        if (page == NULL)
+            continue;
+        for (int j = 0; j < PORT_LIST_PAGE_SIZE; j++) {
+            Port* port = page[j].load(std::memory_order_seq_cst);
+            if (port != NULL)
+                visitor(port, context);
+        }
+    }
     
-    pthread_mutex_unlock(&port_mutex);
+    endRead(token);
 }
 
+
+uint16_t PortList::nextRequestId()
+{
+    uint16_t requestId = lastRequestId.load(std::memory_order_relaxed);
+    uint16_t next;
+    do {
+        next = requestId + 1;
+        if (next >= 0xff00)
+            next = 1;
+    } while (!lastRequestId.compare_exchange_weak(requestId, next, std::memory_order_relaxed));
+
+    return next;
+}
@@ -10,27 +10,104 @@
 #define PortList_hpp
 
 #include <pthread.h>
-#include <vector>
+#include <atomic>
 #include "Port.hpp"
 
 
+#define PORT_LIST_PAGE_SIZE 256
+#define PORT_LIST_NUM_PAGES (0x10000 / PORT_LIST_PAGE_SIZE)
+
+
+/**
+ * List of ports, indexed by port ID
+ *
+ * Lookups are wait-free. Adding and removing ports is serialized by a mutex.
+ *
+ * Threads that use a port beyond the lookup (such as the USB reader thread
+ * handling an event) enter a read section. A removed port is only released
+ * after all read sections that might still use it have been left.
+ * Threads that block while using a port retain it instead.
+ */
 class PortList
 {
 public:
     PortList();
     ~PortList();
-    
+
+    /**
+     * Gets the port with the specified ID.
+     * @param portId the port ID
+     * @return the port, or `NULL` if there is no such port
+     */
     Port* getPort(uint16_t portId);
+
+    /**
+     * Gets and retains the port with the specified ID.
+     *
+     * The port remains valid even if it is removed in the meantime. The
+     * caller must release it.
+     *
+     * @param portId the port ID
+     * @return the port, or `NULL` if there is no such port
+     */
+    Port* retainPort(uint16_t portId);
+
+    /**
+     * Adds a port. The list takes ownership of the port.
+     * @param port the port
+     */
     void addPort(Port* port);
+
+    /**
+     * Removes and releases the port.
+     *
+     * Waits until no read section uses the port anymore.
+     * @param portId the port ID
+     */
     void removePort(uint16_t portId);
+
+    /**
+     * Removes and releases all ports.
+     */
     void clear();
-    
+
+    /**
+     * Enters a read section.
+     *
+     * Ports looked up within the read section are not deleted before the
+     * read section is left. Read sections must be short and must not block.
+     *
+     * @return the token to pass to `endRead`
+     */
+    int beginRead();
+
+    /**
+     * Leaves a read section.
+     * @param token the token returned by `beginRead`
+     */
+    void endRead(int token);
+
+    /**
+     * Calls the visitor for each port.
+     *
+     * The ports are visited within a read section. So the visitor must not block.
+     *
+     * @param visitor the function called for each port
+     * @param context the context passed to the visitor
+     */
+    void forEachPort(void (*visitor)(Port* port, void* context), void* context);
+
     uint16_t nextRequestId();
-    
+
+private:
+    void waitForReaders();
+
 private:
     pthread_mutex_t port_mutex;
-    std::vector<Port*> ports;
-    uint16_t lastRequestId;
+    std::atomic<std::atomic<Port*>*> pages[PORT_LIST_NUM_PAGES];
+    std::atomic<unsigned> epoch;
+    std::atomic<int> activeReaders[2];
+    std::atomic<uint16_t> lastRequestId;
 };
 
 
@@ -10,86 +10,212 @@
 #define Queue_hpp
 
 #include <pthread.h>
-#include <algorithm>
-#include <queue>
+#include <stddef.h>
+#include <atomic>
+
+
+// number of attempts to remove an element before blocking
+#define QUEUE_SPIN_COUNT 100
+
+
+/**
+ * Bounded queue
+ *
+ * Adding and removing elements is lock-free (ring buffer with a sequence
+ * number per cell). By default, it is safe for any number of producers and
+ * consumers. If there is only a single producer or a single consumer, the
+ * respective template parameter can be set. That side then advances its
+ * position with a plain store instead of a compare-and-swap loop.
+ *
+ * The queues in use have a single producer or a single consumer but not both:
+ * - port queue: events are added by the port's strand of the event executor
+ *   (single producer); several user threads may wait for events of the same
+ *   port (multiple consumers).
+ * - retired chunks of the sample recorder: chunks are added by the event
+ *   executor threads of all channels (multiple producers); they are removed
+ *   by the recorder thread only (single consumer).
+ *
+ * A consumer only takes the mutex if the queue is empty and it has to block.
+ * A producer only takes the mutex if a consumer is waiting.
+ *
+ * The queue holds up to `maxSize` elements.
+ */
+template <class E, bool singleProducer = false, bool singleConsumer = false> class Queue {
 
-
-template <class E> class Queue {
-   
 public:
     Queue(int maxSize);
     ~Queue();
-    
+
+    /**
+     * Removes the next element from the queue.
+     *
+     * Blocks until an element is available.
+     * @return the element
+     */
     E waitForNext();
+
+    /**
+     * Removes the next element if one is available.
+     * @param elem receives the element
+     * @return `true` if an element was removed, `false` if the queue was empty
+     */
+    bool tryNext(E& elem);
+
+    /**
+     * Adds an element to the queue.
+     * @param elem the element
+     * @return `true` if it was added, `false` if the queue is full and the element was not added
+     */
     bool put(E& elem);
+
+    /**
+     * Removes all elements and calls the deleter for each one.
+     * @param deleter function called for each removed element
+     */
     void clear(void(*deleter)(E));
-    
+
 private:
-    std::queue<E> elements;
-    int maxSize;
+    struct Cell {
+        std::atomic<size_t> sequence;
+        E element;
+    };
+
+    Cell* cells;
+    size_t maxSize;
+    std::atomic<size_t> enqueuePos;
+    std::atomic<size_t> dequeuePos;
+    std::atomic<int> numWaiting;
     pthread_cond_t not_empty;
     pthread_mutex_t mutex;
 };
 
 
-template <class E> Queue<E>::Queue(int maxSize):
+template <class E, bool singleProducer, bool singleConsumer>
+Queue<E, singleProducer, singleConsumer>::Queue(int maxSize):
 maxSize(maxSize),
-mutex(PTHREAD_MUTEX_INITIALIZER),
-not_empty(PTHREAD_COND_INITIALIZER)
+enqueuePos(0),
+dequeuePos(0),
+numWaiting(0),
+not_empty(PTHREAD_COND_INITIALIZER),
+mutex(PTHREAD_MUTEX_INITIALIZER)
 {
+    cells = new Cell[maxSize];
+    for (size_t i = 0; i < this->maxSize; i++)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+
     pthread_mutex_init(&mutex, NULL);
     pthread_cond_init(&not_empty, NULL);
 }
 
 
-template <class E> Queue<E>::~Queue()
+template <class E, bool singleProducer, bool singleConsumer>
+Queue<E, singleProducer, singleConsumer>::~Queue()
 {
     pthread_cond_destroy(&not_empty);
     pthread_mutex_destroy(&mutex);
+    delete[] cells;
 }
 
 
-template <class E> bool Queue<E>::put(E& elem)
+template <class E, bool singleProducer, bool singleConsumer>
+bool Queue<E, singleProducer, singleConsumer>::put(E& elem)
 {
-    pthread_mutex_lock(&mutex);
-   
-    bool success = true;
-    if (elements.size() <= maxSize)
-        elements.push(elem);
-    else
-        success = false; // cannot add; queue is full
-    
-    pthread_cond_signal(&not_empty);
-    pthread_mutex_unlock(&mutex);
-    
-    return success;
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Cell* cell;
+
+    if (singleProducer) {
+        cell = &cells[pos % maxSize];
+        if (cell->sequence.load(std::memory_order_acquire) != pos)
+            return false; // cannot add; queue is full
+        enqueuePos.store(pos + 1, std::memory_order_relaxed);
+    } else {
+        while (true) {
+            cell = &cells[pos % maxSize];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            if (seq == pos) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (seq < pos) {
+                return false; // cannot add; queue is full
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    cell->element = elem;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+
+    // wake up consumer if one is waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (numWaiting.load(std::memory_order_seq_cst) > 0) {
+        pthread_mutex_lock(&mutex);
+        pthread_cond_signal(&not_empty);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    return true;
 }
 
 
-template <class E> E Queue<E>::waitForNext() {
+template <class E, bool singleProducer, bool singleConsumer>
+bool Queue<E, singleProducer, singleConsumer>::tryNext(E& elem)
+{
+    size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    Cell* cell;
+
+    if (singleConsumer) {
+        cell = &cells[pos % maxSize];
+        if (cell->sequence.load(std::memory_order_acquire) != pos + 1)
+            return false; // queue is empty
+        dequeuePos.store(pos + 1, std::memory_order_relaxed);
+    } else {
+        while (true) {
+            cell = &cells[pos % maxSize];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            if (seq == pos + 1) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (seq < pos + 1) {
+                return false; // queue is empty
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    elem = cell->element;
+    cell->sequence.store(pos + maxSize, std::memory_order_release);
+    return true;
+}
+
+
+template <class E, bool singleProducer, bool singleConsumer>
+E Queue<E, singleProducer, singleConsumer>::waitForNext() {
+    E result;
+    for (int i = 0; i < QUEUE_SPIN_COUNT; i++)
+        if (tryNext(result))
+            return result;
+
     pthread_mutex_lock(&mutex);
-    while (elements.empty())
+    numWaiting.fetch_add(1, std::memory_order_seq_cst);
+
+    // re-check after announcing the waiter so a concurrent put cannot be missed
+    while (!tryNext(result))
         pthread_cond_wait(&not_empty, &mutex);
-    
-    E result = elements.front();
-    elements.pop();
-    
+
+    numWaiting.fetch_sub(1, std::memory_order_relaxed);
     pthread_mutex_unlock(&mutex);
-    
+
     return result;
 }
 
 
-template <class E> void Queue<E>::clear(void (*deleter)(E)) {
-    pthread_mutex_lock(&mutex);
-    
-    while (!elements.empty()) {
-        E elem = elements.front();
-        elements.pop();
+template <class E, bool singleProducer, bool singleConsumer>
+void Queue<E, singleProducer, singleConsumer>::clear(void (*deleter)(E)) {
+    E elem;
+    while (tryNext(elem))
         deleter(elem);
-    }
-    
-    pthread_mutex_unlock(&mutex);
 }
 
 
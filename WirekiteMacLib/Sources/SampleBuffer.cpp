@@ -0,0 +1,125 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include "SampleBuffer.hpp"
+
+
+// number of blocks the ring buffer can hold
+#define SAMPLE_BUFFER_NUM_BLOCKS 4
+// minimum capacity (in samples)
+#define SAMPLE_BUFFER_MIN_CAPACITY 64
+
+
+SampleBuffer::SampleBuffer(int blockSize, uint64_t maxDelay)
+:   _blockSize(blockSize > 0 ? blockSize : 1),
+    maxDelay(maxDelay),
+    head(0),
+    tail(0),
+    isDeliveryScheduled(false),
+    isTimerScheduled(false),
+    numDropped(0)
+{
+    capacity = (size_t)_blockSize * SAMPLE_BUFFER_NUM_BLOCKS;
+    if (capacity < SAMPLE_BUFFER_MIN_CAPACITY)
+        capacity = SAMPLE_BUFFER_MIN_CAPACITY;
+    samples = new Sample[capacity];
+}
+
+
+SampleBuffer::~SampleBuffer()
+{
+    delete[] samples;
+}
+
+
+bool SampleBuffer::add(int32_t value, uint64_t timestamp)
+{
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+    if (h - t >= capacity) {
+        numDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    
+    Sample* sample = &samples[h % capacity];
+    sample->value = value;
+    sample->timestamp = timestamp;
+    head.store(h + 1, std::memory_order_release);
+    
+    // Only the producer writes samples. So the oldest sample is stable
+    // even if the consumer removes it concurrently.
+    bool isDue = h + 1 - t >= (size_t)_blockSize
+        || (maxDelay != 0 && timestamp - samples[t % capacity].timestamp >= maxDelay);
+    if (!isDue)
+        return false;
+    
+    return !isDeliveryScheduled.exchange(true, std::memory_order_acq_rel);
+}
+
+
+bool SampleBuffer::needsFlushTimer()
+{
+    if (maxDelay == 0 || isTimerScheduled.load(std::memory_order_relaxed))
+        return false;
+    
+    return !isTimerScheduled.exchange(true, std::memory_order_acq_rel);
+}
+
+
+bool SampleBuffer::flushTimerFired(uint64_t now, uint64_t* delay)
+{
+    *delay = 0;
+    
+    // samples added from now on start a new timer unless it is restarted below
+    isTimerScheduled.store(false, std::memory_order_seq_cst);
+    
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    if (h == t)
+        return false;
+    
+    // The consumer is the only one removing samples. So the oldest sample is stable.
+    uint64_t due = samples[t % capacity].timestamp + maxDelay;
+    if (now >= due)
+        return true;
+    
+    if (!isTimerScheduled.exchange(true, std::memory_order_acq_rel))
+        *delay = due - now;
+    return false;
+}
+
+
+void SampleBuffer::beginDelivery()
+{
+    isDeliveryScheduled.store(false, std::memory_order_seq_cst);
+}
+
+
+int SampleBuffer::take(int32_t* values, uint64_t* timestamps, int maxCount)
+{
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    size_t n = h - t;
+    if (n > (size_t)maxCount)
+        n = maxCount;
+    
+    for (size_t i = 0; i < n; i++) {
+        Sample* sample = &samples[(t + i) % capacity];
+        values[i] = sample->value;
+        timestamps[i] = sample->timestamp;
+    }
+    
+    tail.store(t + n, std::memory_order_release);
+    return (int)n;
+}
+
+
+uint64_t SampleBuffer::droppedSamples()
+{
+    return numDropped.load(std::memory_order_relaxed);
+}
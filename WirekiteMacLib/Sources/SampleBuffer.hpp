@@ -0,0 +1,121 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef SampleBuffer_hpp
+#define SampleBuffer_hpp
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+
+/**
+ * Ring buffer accumulating the samples of a port for batched delivery
+ *
+ * The buffer has a single producer (the thread handling the port events)
+ * and a single consumer (the delivery). Both sides are lock-free.
+ *
+ * The producer is told to schedule a delivery once a block of samples is
+ * complete or once the oldest sample has waited for the maximum delay.
+ * Only one delivery is scheduled at a time. If the consumer falls behind
+ * and the buffer is full, new samples are dropped.
+ *
+ * As the maximum delay is otherwise only checked when a sample arrives,
+ * the producer is also told to start a flush timer for a partial block.
+ * The timer runs on the consumer side and delivers the partial block once
+ * the oldest sample is due. Only one timer is running at a time.
+ */
+class SampleBuffer {
+public:
+    /**
+     * Creates a new instance.
+     * @param blockSize the number of samples per delivered block
+     * @param maxDelay the maximum time a sample is held back (in ns, or 0 for no limit)
+     */
+    SampleBuffer(int blockSize, uint64_t maxDelay);
+    ~SampleBuffer();
+    
+    /**
+     * Gets the block size.
+     * @return the number of samples per block
+     */
+    int blockSize() { return _blockSize; }
+    
+    /**
+     * Adds a sample (producer side).
+     * @param value the sample value
+     * @param timestamp the time the sample was received (in ns)
+     * @return `true` if a delivery must be scheduled
+     */
+    bool add(int32_t value, uint64_t timestamp);
+    
+    /**
+     * Indicates if a flush timer must be started (producer side).
+     *
+     * Called after a sample has been added. If the result is `true`,
+     * `flushTimerFired` must be called on the consumer side after the
+     * maximum delay.
+     *
+     * @return `true` if a timer must be started
+     */
+    bool needsFlushTimer();
+    
+    /**
+     * Checks if the partial block is due when the flush timer fires (consumer side).
+     *
+     * If samples remain that are not due yet, the timer must be restarted
+     * with the returned delay.
+     *
+     * @param now the current time (in ns, same clock as the timestamps)
+     * @param delay receives the delay for restarting the timer (in ns), or 0 if not needed
+     * @return `true` if the samples must be delivered
+     */
+    bool flushTimerFired(uint64_t now, uint64_t* delay);
+    
+    /**
+     * Indicates the start of a delivery (consumer side).
+     *
+     * Must be called before the samples are taken so that samples
+     * added in the meantime schedule a new delivery.
+     */
+    void beginDelivery();
+    
+    /**
+     * Removes up to the specified number of samples (consumer side).
+     * @param values array receiving the sample values
+     * @param timestamps array receiving the timestamps
+     * @param maxCount the maximum number of samples to remove
+     * @return the number of removed samples
+     */
+    int take(int32_t* values, uint64_t* timestamps, int maxCount);
+    
+    /**
+     * Gets the number of samples dropped because the buffer was full.
+     * @return the number of samples
+     */
+    uint64_t droppedSamples();
+    
+private:
+    struct Sample {
+        int32_t value;
+        uint64_t timestamp;
+    };
+    
+    int _blockSize;
+    uint64_t maxDelay;
+    size_t capacity;
+    Sample* samples;
+    std::atomic<size_t> head; // next sample to write
+    std::atomic<size_t> tail; // next sample to read
+    std::atomic<bool> isDeliveryScheduled;
+    std::atomic<bool> isTimerScheduled;
+    std::atomic<uint64_t> numDropped;
+};
+
+
+#endif /* SampleBuffer_hpp */
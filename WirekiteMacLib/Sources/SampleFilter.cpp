@@ -0,0 +1,253 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <algorithm>
+#include "SampleFilter.hpp"
+
+
+// fractional bits of the exponential smoothing state
+#define EXPONENTIAL_FRACTION_BITS 16
+
+
+SampleFilter::SampleFilter()
+:   _numStages(0)
+{
+}
+
+
+SampleFilter::~SampleFilter()
+{
+    for (int i = 0; i < _numStages; i++)
+        delete[] stages[i].window;
+}
+
+
+bool SampleFilter::addStage(SampleFilterType type, int parameter)
+{
+    if (_numStages >= SAMPLE_FILTER_MAX_STAGES)
+        return false;
+
+    int windowSize = 0;
+    switch (type) {
+        case SampleFilterBoxcar:
+            if (parameter < 1 || parameter > SAMPLE_FILTER_MAX_WINDOW)
+                return false;
+            windowSize = parameter;
+            break;
+        case SampleFilterMedian:
+            if (parameter < 1 || parameter > SAMPLE_FILTER_MAX_MEDIAN)
+                return false;
+            windowSize = 2 * parameter; // ring buffer and sorted window
+            break;
+        case SampleFilterExponential:
+            if (parameter < 1 || parameter > 16)
+                return false;
+            break;
+        case SampleFilterDecimation:
+        case SampleFilterMinimum:
+        case SampleFilterMaximum:
+            if (parameter < 1)
+                return false;
+            break;
+        default:
+            return false;
+    }
+
+    Stage& stage = stages[_numStages];
+    stage.type = type;
+    stage.parameter = parameter;
+    stage.window = windowSize > 0 ? new int32_t[windowSize] : NULL;
+    _numStages++;
+
+    reset();
+    return true;
+}
+
+
+void SampleFilter::reset()
+{
+    for (int i = 0; i < _numStages; i++) {
+        Stage& stage = stages[i];
+        stage.position = 0;
+        stage.filled = 0;
+        stage.accumulator = 0;
+    }
+}
+
+
+int SampleFilter::process(int32_t* values, uint64_t* timestamps, int count)
+{
+    for (int i = 0; i < _numStages && count > 0; i++) {
+        Stage& stage = stages[i];
+        switch (stage.type) {
+            case SampleFilterBoxcar:
+                count = processBoxcar(stage, values, count);
+                break;
+            case SampleFilterDecimation:
+                count = processDecimation(stage, values, timestamps, count);
+                break;
+            case SampleFilterExponential:
+                count = processExponential(stage, values, count);
+                break;
+            case SampleFilterMedian:
+                count = processMedian(stage, values, count);
+                break;
+            case SampleFilterMinimum:
+            case SampleFilterMaximum:
+                count = processExtreme(stage, values, timestamps, count);
+                break;
+        }
+    }
+
+    return count;
+}
+
+
+int SampleFilter::processBoxcar(Stage& stage, int32_t* values, int count)
+{
+    // running sum over the ring buffer
+    int32_t* window = stage.window;
+    int size = stage.parameter;
+    int64_t sum = stage.accumulator;
+    int position = stage.position;
+    int filled = stage.filled;
+
+    for (int i = 0; i < count; i++) {
+        int32_t value = values[i];
+        if (filled == size)
+            sum -= window[position];
+        else
+            filled++;
+        window[position] = value;
+        sum += value;
+        position++;
+        if (position == size)
+            position = 0;
+        values[i] = (int32_t)(sum / filled);
+    }
+
+    stage.accumulator = sum;
+    stage.position = position;
+    stage.filled = filled;
+    return count;
+}
+
+
+int SampleFilter::processDecimation(Stage& stage, int32_t* values, uint64_t* timestamps, int count)
+{
+    // keep the last sample of each block
+    int factor = stage.parameter;
+    int next = factor - 1 - stage.position;
+    int numOut = 0;
+    for (int i = next; i < count; i += factor) {
+        values[numOut] = values[i];
+        timestamps[numOut] = timestamps[i];
+        numOut++;
+    }
+
+    stage.position = (stage.position + count) % factor;
+    return numOut;
+}
+
+
+int SampleFilter::processExponential(Stage& stage, int32_t* values, int count)
+{
+    int shift = stage.parameter;
+    int64_t state = stage.accumulator;
+    int i = 0;
+
+    if (stage.filled == 0) {
+        state = (int64_t)values[0] << EXPONENTIAL_FRACTION_BITS;
+        stage.filled = 1;
+        i = 1;
+    }
+
+    for (; i < count; i++) {
+        state += (((int64_t)values[i] << EXPONENTIAL_FRACTION_BITS) - state) >> shift;
+        values[i] = (int32_t)(state >> EXPONENTIAL_FRACTION_BITS);
+    }
+
+    stage.accumulator = state;
+    return count;
+}
+
+
+int SampleFilter::processMedian(Stage& stage, int32_t* values, int count)
+{
+    // the sorted window is updated incrementally: the oldest sample is
+    // replaced with the new one, which is then moved to its position
+    int size = stage.parameter;
+    int32_t* ring = stage.window;
+    int32_t* sorted = stage.window + size;
+
+    for (int i = 0; i < count; i++) {
+        int32_t value = values[i];
+        int index;
+        if (stage.filled == size) {
+            index = (int)(std::lower_bound(sorted, sorted + size, ring[stage.position]) - sorted);
+        } else {
+            index = stage.filled;
+            stage.filled++;
+        }
+
+        while (index > 0 && sorted[index - 1] > value) {
+            sorted[index] = sorted[index - 1];
+            index--;
+        }
+        while (index < stage.filled - 1 && sorted[index + 1] < value) {
+            sorted[index] = sorted[index + 1];
+            index++;
+        }
+        sorted[index] = value;
+
+        ring[stage.position] = value;
+        stage.position++;
+        if (stage.position == size)
+            stage.position = 0;
+
+        values[i] = sorted[stage.filled / 2];
+    }
+
+    return count;
+}
+
+
+int SampleFilter::processExtreme(Stage& stage, int32_t* values, uint64_t* timestamps, int count)
+{
+    int blockSize = stage.parameter;
+    bool isMinimum = stage.type == SampleFilterMinimum;
+    int32_t extreme = (int32_t)stage.accumulator;
+    int numOut = 0;
+    int i = 0;
+
+    while (i < count) {
+        // reduce the part of the block contained in this batch
+        int n = std::min(blockSize - stage.position, count - i);
+        int32_t e = stage.position == 0 ? values[i] : extreme;
+        if (isMinimum) {
+            for (int j = i; j < i + n; j++)
+                e = std::min(e, values[j]);
+        } else {
+            for (int j = i; j < i + n; j++)
+                e = std::max(e, values[j]);
+        }
+        extreme = e;
+        i += n;
+        stage.position += n;
+
+        if (stage.position == blockSize) {
+            values[numOut] = extreme;
+            timestamps[numOut] = timestamps[i - 1];
+            numOut++;
+            stage.position = 0;
+        }
+    }
+
+    stage.accumulator = extreme;
+    return numOut;
+}
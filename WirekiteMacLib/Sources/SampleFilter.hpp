@@ -0,0 +1,99 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef SampleFilter_hpp
+#define SampleFilter_hpp
+
+#include <stdint.h>
+
+
+#define SAMPLE_FILTER_MAX_STAGES 8
+#define SAMPLE_FILTER_MAX_WINDOW 1024
+#define SAMPLE_FILTER_MAX_MEDIAN 63
+
+
+enum SampleFilterType {
+    SampleFilterBoxcar = 0,         // moving average over N samples
+    SampleFilterDecimation = 1,     // every N-th sample
+    SampleFilterExponential = 2,    // exponential smoothing with a factor of 1 / 2^N
+    SampleFilterMedian = 3,         // moving median over N samples
+    SampleFilterMinimum = 4,        // minimum of each block of N samples
+    SampleFilterMaximum = 5         // maximum of each block of N samples
+};
+
+
+/**
+ * Pipeline of filter stages for the samples of an analog input
+ *
+ * The samples are processed in fixed-point arithmetic (32 bit samples
+ * as received from the board) one batch at a time, stage by stage.
+ * Decimation, minimum and maximum reduce the number of samples.
+ * The other stages produce a sample for each input sample; until their
+ * window is filled, they work on the samples received so far.
+ *
+ * A reduced sample takes the timestamp of the last input sample it covers.
+ *
+ * The filter keeps state between batches, so processing a batch yields
+ * the same samples as processing its samples one at a time.
+ * It is not thread-safe.
+ */
+class SampleFilter {
+public:
+    SampleFilter();
+    ~SampleFilter();
+
+    /**
+     * Appends a stage to the pipeline.
+     * @param type the filter type
+     * @param parameter the window or block size N (for exponential smoothing: the shift N, 1 to 16)
+     * @return `true` if the stage was added, `false` if the parameter is invalid or there are too many stages
+     */
+    bool addStage(SampleFilterType type, int parameter);
+
+    /**
+     * Gets the number of stages.
+     * @return the number of stages
+     */
+    int numStages() { return _numStages; }
+
+    /**
+     * Filters a batch of samples in place.
+     * @param values the sample values; replaced with the filtered values
+     * @param timestamps the sample timestamps; replaced with the timestamps of the filtered values
+     * @param count the number of samples
+     * @return the number of filtered samples
+     */
+    int process(int32_t* values, uint64_t* timestamps, int count);
+
+    /**
+     * Discards the state of all stages.
+     */
+    void reset();
+
+private:
+    struct Stage {
+        SampleFilterType type;
+        int parameter;
+        int32_t* window; // ring buffer (boxcar and median), followed by the sorted window (median)
+        int position; // position in the ring buffer or block
+        int filled; // number of samples in the window
+        int64_t accumulator; // sum (boxcar), smoothed value (exponential) or extreme value (minimum, maximum)
+    };
+
+    static int processBoxcar(Stage& stage, int32_t* values, int count);
+    static int processDecimation(Stage& stage, int32_t* values, uint64_t* timestamps, int count);
+    static int processExponential(Stage& stage, int32_t* values, int count);
+    static int processMedian(Stage& stage, int32_t* values, int count);
+    static int processExtreme(Stage& stage, int32_t* values, uint64_t* timestamps, int count);
+
+    Stage stages[SAMPLE_FILTER_MAX_STAGES];
+    int _numStages;
+};
+
+
+#endif /* SampleFilter_hpp */
@@ -0,0 +1,447 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "SampleRecorder.hpp"
+
+
+#define RECORDER_MAGIC "WKSAMPLE"
+#define RECORDER_VERSION 1
+#define CHUNK_MAGIC "WKCH"
+#define CHUNK_HEADER_SIZE 32
+#define CHUNK_CAPACITY ((RECORDER_CHUNK_SIZE - CHUNK_HEADER_SIZE) / 12)
+#define CHUNK_TIMESTAMPS_OFFSET(capacity) (CHUNK_HEADER_SIZE + (((capacity) * 4 + 7) & ~(size_t)7))
+
+
+struct RecorderFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t chunkSize;
+    uint32_t capacity;
+    uint32_t numChannels;
+    uint32_t reserved;
+    uint16_t portIds[RECORDER_MAX_CHANNELS];
+};
+
+struct RecorderChunkHeader {
+    char magic[4];
+    uint16_t channel;
+    uint16_t portId;
+    uint32_t count;
+    uint32_t capacity;
+    uint64_t firstTimestamp;
+    uint64_t reserved;
+};
+
+
+SampleRecorder::SampleRecorder()
+:   isActive(false),
+    activeWriters(0),
+    fd(-1),
+    numChannels(0),
+    numChunks(0),
+    retiredChunks(RECORDER_MAX_CHANNELS * 4),
+    numDropped(0)
+{
+    for (int i = 0; i < RECORDER_MAX_CHANNELS; i++) {
+        channels[i].portId = 0;
+        channels[i].current = NULL;
+        channels[i].count = 0;
+        channels[i].spare.store(NULL, std::memory_order_relaxed);
+        channels[i].spareRequest.mapping = NULL;
+        channels[i].spareRequest.channel = i;
+        channels[i].isSpareRequested.store(false, std::memory_order_relaxed);
+    }
+}
+
+
+SampleRecorder::~SampleRecorder()
+{
+    close();
+}
+
+
+bool SampleRecorder::open(const char* path, const uint16_t* portIds, int numChannels)
+{
+    close();
+
+    if (numChannels < 1 || numChannels > RECORDER_MAX_CHANNELS)
+        return false;
+
+    fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Wirekite: Unable to create recording file %s\n", path);
+        return false;
+    }
+
+    if (ftruncate(fd, RECORDER_HEADER_SIZE) != 0) {
+        fprintf(stderr, "Wirekite: Unable to size recording file %s\n", path);
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    RecorderFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RECORDER_MAGIC, sizeof(header.magic));
+    header.version = RECORDER_VERSION;
+    header.headerSize = RECORDER_HEADER_SIZE;
+    header.chunkSize = RECORDER_CHUNK_SIZE;
+    header.capacity = CHUNK_CAPACITY;
+    header.numChannels = numChannels;
+    memcpy(header.portIds, portIds, numChannels * sizeof(uint16_t));
+    if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+        fprintf(stderr, "Wirekite: Unable to write recording file %s\n", path);
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    // map the current and the spare chunk of each channel
+    this->numChannels = numChannels;
+    numChunks = 0;
+    bool success = true;
+    for (int i = 0; i < numChannels; i++) {
+        Channel& channel = channels[i];
+        channel.portId = portIds[i];
+        channel.count = 0;
+        channel.isSpareRequested.store(false, std::memory_order_relaxed);
+        channel.current = mapChunk(i);
+        channel.spare.store(mapChunk(i), std::memory_order_relaxed);
+        if (channel.current == NULL || channel.spare.load(std::memory_order_relaxed) == NULL)
+            success = false;
+    }
+
+    if (success && pthread_create(&thread, NULL, threadMain, this) != 0) {
+        fprintf(stderr, "Wirekite: Unable to start recording thread\n");
+        success = false;
+    }
+
+    if (!success) {
+        for (int i = 0; i < numChannels; i++) {
+            unmapChunk(channels[i].current);
+            channels[i].current = NULL;
+            unmapChunk(channels[i].spare.exchange(NULL, std::memory_order_relaxed));
+        }
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    numDropped.store(0, std::memory_order_relaxed);
+    isActive.store(true, std::memory_order_release);
+    return true;
+}
+
+
+void SampleRecorder::close()
+{
+    if (!isActive.exchange(false, std::memory_order_seq_cst))
+        return;
+
+    // wait for records that have already seen the active flag
+    while (activeWriters.load(std::memory_order_seq_cst) != 0)
+        sched_yield();
+
+    // stop the background thread
+    Chunk* stopMarker = NULL;
+    while (!retiredChunks.put(stopMarker))
+        sched_yield();
+    pthread_join(thread, NULL);
+
+    for (int i = 0; i < numChannels; i++) {
+        unmapChunk(channels[i].current);
+        channels[i].current = NULL;
+        unmapChunk(channels[i].spare.exchange(NULL, std::memory_order_relaxed));
+    }
+
+    ::close(fd);
+    fd = -1;
+}
+
+
+void SampleRecorder::record(uint16_t portId, int32_t value, uint64_t timestamp)
+{
+    if (!isActive.load(std::memory_order_relaxed))
+        return;
+
+    activeWriters.fetch_add(1, std::memory_order_seq_cst);
+    if (isActive.load(std::memory_order_seq_cst)) {
+        for (int i = 0; i < numChannels; i++) {
+            if (channels[i].portId == portId) {
+                append(channels[i], value, timestamp);
+                break;
+            }
+        }
+    }
+    activeWriters.fetch_sub(1, std::memory_order_release);
+}
+
+
+void SampleRecorder::append(Channel& channel, int32_t value, uint64_t timestamp)
+{
+    Chunk* chunk = channel.current;
+    if (chunk == NULL) {
+        // the background thread has not provided a spare chunk in time;
+        // no chunk is retired here, so the thread must be asked for the next spare
+        chunk = channel.spare.exchange(NULL, std::memory_order_acq_rel);
+        requestSpare(channel);
+        if (chunk == NULL) {
+            numDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        channel.current = chunk;
+        channel.count = 0;
+    }
+
+    RecorderChunkHeader* header = (RecorderChunkHeader*)chunk->mapping;
+    int32_t* values = (int32_t*)(chunk->mapping + CHUNK_HEADER_SIZE);
+    uint64_t* timestamps = (uint64_t*)(chunk->mapping + CHUNK_TIMESTAMPS_OFFSET(CHUNK_CAPACITY));
+
+    uint32_t index = channel.count;
+    values[index] = value;
+    timestamps[index] = timestamp;
+    if (index == 0)
+        header->firstTimestamp = timestamp;
+    channel.count = index + 1;
+    header->count = index + 1;
+
+    if (channel.count == CHUNK_CAPACITY) {
+        // switch to the spare chunk; the background thread unmaps the full one and provides a new spare
+        channel.current = channel.spare.exchange(NULL, std::memory_order_acq_rel);
+        channel.count = 0;
+        if (!retiredChunks.put(chunk))
+            unmapChunk(chunk);
+    }
+}
+
+
+void SampleRecorder::requestSpare(Channel& channel)
+{
+    // at most one request per channel is queued
+    if (channel.isSpareRequested.exchange(true, std::memory_order_acq_rel))
+        return;
+
+    Chunk* request = &channel.spareRequest;
+    if (!retiredChunks.put(request))
+        channel.isSpareRequested.store(false, std::memory_order_release);
+}
+
+
+SampleRecorder::Chunk* SampleRecorder::mapChunk(int channel)
+{
+    // chunks are appended at the end of the file
+    size_t offset = RECORDER_HEADER_SIZE + (size_t)numChunks * RECORDER_CHUNK_SIZE;
+    if (ftruncate(fd, offset + RECORDER_CHUNK_SIZE) != 0) {
+        fprintf(stderr, "Wirekite: Unable to extend recording file\n");
+        return NULL;
+    }
+
+    void* m = mmap(NULL, RECORDER_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+    if (m == MAP_FAILED) {
+        fprintf(stderr, "Wirekite: Unable to map recording file\n");
+        return NULL;
+    }
+    numChunks++;
+
+    RecorderChunkHeader* header = (RecorderChunkHeader*)m;
+    memcpy(header->magic, CHUNK_MAGIC, sizeof(header->magic));
+    header->channel = (uint16_t)channel;
+    header->portId = channels[channel].portId;
+    header->count = 0;
+    header->capacity = CHUNK_CAPACITY;
+    header->firstTimestamp = 0;
+    header->reserved = 0;
+
+    Chunk* chunk = new Chunk();
+    chunk->mapping = (uint8_t*)m;
+    chunk->channel = channel;
+    return chunk;
+}
+
+
+void SampleRecorder::unmapChunk(Chunk* chunk)
+{
+    if (chunk == NULL)
+        return;
+
+    munmap(chunk->mapping, RECORDER_CHUNK_SIZE);
+    delete chunk;
+}
+
+
+void SampleRecorder::run()
+{
+    while (true) {
+        Chunk* chunk = retiredChunks.waitForNext();
+        if (chunk == NULL)
+            break; // recorder is closed
+
+        if (chunk->mapping == NULL) {
+            // request for a spare chunk (see append)
+            channels[chunk->channel].isSpareRequested.store(false, std::memory_order_release);
+        } else {
+            unmapChunk(chunk);
+        }
+
+        // replenish the spare chunks of all channels (a full queue may have swallowed a request)
+        for (int i = 0; i < numChannels; i++) {
+            if (channels[i].spare.load(std::memory_order_acquire) == NULL) {
+                Chunk* spare = mapChunk(i);
+                if (spare != NULL)
+                    channels[i].spare.store(spare, std::memory_order_release);
+            }
+        }
+    }
+}
+
+
+void* SampleRecorder::threadMain(void* arg)
+{
+    SampleRecorder* recorder = (SampleRecorder*)arg;
+    recorder->run();
+    return NULL;
+}
+
+
+
+SampleReader::SampleReader()
+:   mapping(NULL),
+    mappingSize(0),
+    readOffset(0)
+{
+}
+
+
+SampleReader::~SampleReader()
+{
+    close();
+}
+
+
+bool SampleReader::open(const char* path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Wirekite: Unable to open recording file %s\n", path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < RECORDER_HEADER_SIZE) {
+        fprintf(stderr, "Wirekite: Invalid recording file %s\n", path);
+        ::close(fd);
+        return false;
+    }
+
+    void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) {
+        fprintf(stderr, "Wirekite: Unable to map recording file %s\n", path);
+        return false;
+    }
+
+    RecorderFileHeader* header = (RecorderFileHeader*)m;
+    if (memcmp(header->magic, RECORDER_MAGIC, sizeof(header->magic)) != 0 || header->version != RECORDER_VERSION
+            || header->numChannels > RECORDER_MAX_CHANNELS || header->headerSize > (size_t)st.st_size
+            || header->chunkSize < CHUNK_TIMESTAMPS_OFFSET(header->capacity) + (size_t)header->capacity * 8) {
+        fprintf(stderr, "Wirekite: Invalid recording file %s\n", path);
+        munmap(m, st.st_size);
+        return false;
+    }
+
+    mapping = (uint8_t*)m;
+    mappingSize = st.st_size;
+    readOffset = header->headerSize;
+    return true;
+}
+
+
+void SampleReader::close()
+{
+    if (mapping == NULL)
+        return;
+
+    munmap(mapping, mappingSize);
+    mapping = NULL;
+    mappingSize = 0;
+}
+
+
+int SampleReader::numChannels()
+{
+    return mapping != NULL ? ((RecorderFileHeader*)mapping)->numChannels : 0;
+}
+
+
+uint16_t SampleReader::portId(int channel)
+{
+    if (channel < 0 || channel >= numChannels())
+        return 0;
+    return ((RecorderFileHeader*)mapping)->portIds[channel];
+}
+
+
+void SampleReader::rewind()
+{
+    if (mapping != NULL)
+        readOffset = ((RecorderFileHeader*)mapping)->headerSize;
+}
+
+
+bool SampleReader::nextChunk(RecordedChunk& chunk)
+{
+    if (mapping == NULL)
+        return false;
+
+    RecorderFileHeader* fileHeader = (RecorderFileHeader*)mapping;
+    while (readOffset + fileHeader->chunkSize <= mappingSize) {
+        uint8_t* data = mapping + readOffset;
+        readOffset += fileHeader->chunkSize;
+
+        // skip unused chunks (spare chunks at the end of the recording)
+        RecorderChunkHeader* header = (RecorderChunkHeader*)data;
+        if (memcmp(header->magic, CHUNK_MAGIC, sizeof(header->magic)) != 0 || header->count == 0
+                || header->count > fileHeader->capacity || header->channel >= fileHeader->numChannels)
+            continue;
+
+        chunk.channel = header->channel;
+        chunk.portId = header->portId;
+        chunk.count = header->count;
+        chunk.values = (const int32_t*)(data + CHUNK_HEADER_SIZE);
+        chunk.timestamps = (const uint64_t*)(data + CHUNK_TIMESTAMPS_OFFSET(fileHeader->capacity));
+        return true;
+    }
+
+    return false;
+}
+
+
+uint64_t SampleReader::sampleCount(int channel)
+{
+    size_t savedOffset = readOffset;
+    rewind();
+
+    uint64_t count = 0;
+    RecordedChunk chunk;
+    while (nextChunk(chunk))
+        if (chunk.channel == channel)
+            count += chunk.count;
+
+    readOffset = savedOffset;
+    return count;
+}
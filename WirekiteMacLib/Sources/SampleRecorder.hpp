@@ -0,0 +1,198 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef SampleRecorder_hpp
+#define SampleRecorder_hpp
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "Queue.hpp"
+
+
+#define RECORDER_MAX_CHANNELS 16
+#define RECORDER_HEADER_SIZE 16384 // multiple of the page size
+#define RECORDER_CHUNK_SIZE (256 * 1024) // multiple of the page size
+
+
+/**
+ * Chunk of recorded samples of a single channel
+ */
+struct RecordedChunk {
+    int channel;
+    uint16_t portId;
+    uint32_t count;
+    const int32_t* values;
+    const uint64_t* timestamps; // in ns (host time)
+};
+
+
+/**
+ * Recorder writing the samples of one or more ports to a file
+ *
+ * The file consists of a header followed by chunks of fixed size. Each chunk
+ * belongs to a single channel (port) and holds its samples in columnar form:
+ * a chunk header, the sample values (int32) and the timestamps (uint64).
+ *
+ * Each channel has two memory-mapped chunks: the one currently filled and a
+ * spare one. When the current chunk is full, the spare chunk takes its place
+ * without any system call. A background thread unmaps the full chunk and maps
+ * a new spare one at the end of the file. So the memory use is constant
+ * regardless of the recording duration. If the background thread falls behind,
+ * samples are dropped until it has mapped a new chunk.
+ *
+ * `record` must not be called concurrently for the same port (the events of
+ * a port are handled in order). Opening and closing the recorder is safe while
+ * it is called.
+ *
+ * File format: a header of RECORDER_HEADER_SIZE bytes ("WKSAMPLE", version, header size,
+ * chunk size, chunk capacity, number of channels, reserved, port IDs) followed by chunks
+ * of RECORDER_CHUNK_SIZE bytes, each consisting of a 32 byte chunk header ("WKCH",
+ * channel, port ID, count, capacity, first timestamp, reserved), `capacity` sample values
+ * and `capacity` timestamps (8 byte aligned). Chunks with a count of 0 are unused.
+ * All values are little endian.
+ */
+class SampleRecorder {
+public:
+    SampleRecorder();
+    ~SampleRecorder();
+
+    /**
+     * Creates the file and starts recording.
+     * @param path the file path
+     * @param portIds the IDs of the ports to record (one channel per port)
+     * @param numChannels the number of ports (1 to RECORDER_MAX_CHANNELS)
+     * @return `true` if successful
+     */
+    bool open(const char* path, const uint16_t* portIds, int numChannels);
+
+    /**
+     * Stops recording and closes the file.
+     */
+    void close();
+
+    /**
+     * Indicates if recording is active.
+     * @return `true` if active
+     */
+    bool isOpen() { return isActive.load(std::memory_order_relaxed); }
+
+    /**
+     * Records a sample if the port is recorded.
+     * @param portId the port ID
+     * @param value the sample value
+     * @param timestamp the time the sample was received (in ns)
+     */
+    void record(uint16_t portId, int32_t value, uint64_t timestamp);
+
+    /**
+     * Gets the number of samples dropped because no chunk was available.
+     * @return the number of samples
+     */
+    uint64_t droppedSamples() { return numDropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Chunk {
+        uint8_t* mapping;
+        int channel;
+    };
+
+    struct Channel {
+        uint16_t portId;
+        Chunk* current; // only used by the thread handling the port
+        uint32_t count;
+        std::atomic<Chunk*> spare;
+        Chunk spareRequest; // queued (without mapping) to request a new spare chunk
+        std::atomic<bool> isSpareRequested;
+    };
+
+    void append(Channel& channel, int32_t value, uint64_t timestamp);
+    void requestSpare(Channel& channel);
+    Chunk* mapChunk(int channel);
+    static void unmapChunk(Chunk* chunk);
+    void run();
+    static void* threadMain(void* arg);
+
+private:
+    std::atomic<bool> isActive;
+    std::atomic<int> activeWriters;
+    int fd;
+    int numChannels;
+    uint32_t numChunks;
+    Channel channels[RECORDER_MAX_CHANNELS];
+    Queue<Chunk*, false, true> retiredChunks; // single consumer: the recorder thread
+    pthread_t thread;
+    std::atomic<uint64_t> numDropped;
+};
+
+
+/**
+ * Reader for files written by the sample recorder
+ */
+class SampleReader {
+public:
+    SampleReader();
+    ~SampleReader();
+
+    /**
+     * Opens a recording.
+     * @param path the file path
+     * @return `true` if successful
+     */
+    bool open(const char* path);
+
+    /**
+     * Closes the recording.
+     */
+    void close();
+
+    /**
+     * Gets the number of channels.
+     * @return the number of channels
+     */
+    int numChannels();
+
+    /**
+     * Gets the port ID of a channel.
+     * @param channel the channel index
+     * @return the port ID
+     */
+    uint16_t portId(int channel);
+
+    /**
+     * Gets the total number of samples of a channel.
+     * @param channel the channel index
+     * @return the number of samples
+     */
+    uint64_t sampleCount(int channel);
+
+    /**
+     * Reads the next chunk.
+     *
+     * The chunks of a channel are returned in the order they were recorded.
+     * The chunk data remains valid until the file is closed.
+     *
+     * @param chunk receives the chunk
+     * @return `true` if successful, `false` at the end of the file
+     */
+    bool nextChunk(RecordedChunk& chunk);
+
+    /**
+     * Restarts reading at the first chunk.
+     */
+    void rewind();
+
+private:
+    uint8_t* mapping;
+    size_t mappingSize;
+    size_t readOffset;
+};
+
+
+#endif /* SampleRecorder_hpp */
@@ -0,0 +1,778 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <chrono>
+#include "SimulatedDevice.hpp"
+#include "IOReactor.hpp"
+
+
+#define SIM_MEM_SIZE 4200
+#define SIM_FIRMWARE_VERSION 0x0050
+#define SIM_MAX_SAMPLES_PER_WAKEUP 100
+#define SIM_RESULT_OUT_OF_MEMORY 5
+#define SIM_REQUEST_OVERHEAD 8
+
+static const int64_t Never = INT64_MAX;
+
+
+static int64_t currentTime()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+static void waitFor(pthread_cond_t* cond, pthread_mutex_t* mutex, int64_t delay)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t usec = tv.tv_usec + delay;
+    struct timespec deadline;
+    deadline.tv_sec = tv.tv_sec + (time_t)(usec / 1000000);
+    deadline.tv_nsec = (long)(usec % 1000000) * 1000;
+    pthread_cond_timedwait(cond, mutex, &deadline);
+}
+
+
+SimulatedDevice::SimulatedDevice(IOReactor* reactor)
+:   reactor(reactor),
+    mutex(PTHREAD_MUTEX_INITIALIZER),
+    changed(PTHREAD_COND_INITIALIZER),
+    isRunning(false),
+    latency(0),
+    bandwidth(0),
+    packetSize(64),
+    rxLinkFree(0),
+    txLinkFree(0),
+    memSize(SIM_MEM_SIZE),
+    memUsed(0),
+    busSpeed(0),
+    busFree(0),
+    overruns(0),
+    lastPortId(0)
+{
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&changed, NULL);
+    parser.setHandler(this);
+}
+
+
+SimulatedDevice::~SimulatedDevice()
+{
+    stop();
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&mutex);
+}
+
+
+void SimulatedDevice::configureLink(int lat, int bw)
+{
+    pthread_mutex_lock(&mutex);
+    latency = lat;
+    bandwidth = bw;
+    notifyChanged();
+    pthread_mutex_unlock(&mutex);
+}
+
+
+void SimulatedDevice::configurePacketSize(int size)
+{
+    pthread_mutex_lock(&mutex);
+    packetSize = size;
+    pthread_mutex_unlock(&mutex);
+}
+
+
+void SimulatedDevice::configureBuffer(int size, int speed)
+{
+    pthread_mutex_lock(&mutex);
+    memSize = size;
+    busSpeed = speed;
+    pthread_mutex_unlock(&mutex);
+}
+
+
+int SimulatedDevice::overrunCount()
+{
+    pthread_mutex_lock(&mutex);
+    int result = overruns;
+    pthread_mutex_unlock(&mutex);
+    return result;
+}
+
+
+bool SimulatedDevice::start()
+{
+    pthread_mutex_lock(&mutex);
+    isRunning = true;
+    rxLinkFree = 0;
+    txLinkFree = 0;
+    pthread_mutex_unlock(&mutex);
+
+    bool started = reactor != NULL ? reactor->attach(this)
+            : pthread_create(&thread, NULL, threadMain, this) == 0;
+    if (!started) {
+        pthread_mutex_lock(&mutex);
+        isRunning = false;
+        pthread_mutex_unlock(&mutex);
+        return false;
+    }
+    return true;
+}
+
+
+void SimulatedDevice::stop()
+{
+    pthread_mutex_lock(&mutex);
+    bool wasRunning = isRunning;
+    isRunning = false;
+    pthread_cond_signal(&changed);
+    pthread_mutex_unlock(&mutex);
+
+    if (!wasRunning)
+        return;
+
+    if (reactor != NULL)
+        reactor->detach(this);
+    else if (pthread_equal(pthread_self(), thread))
+        pthread_detach(thread);
+    else
+        pthread_join(thread, NULL);
+
+    rxChunks.clear();
+    txChunks.clear();
+    txPending.clear();
+    busJobs.clear();
+    memUsed = 0;
+    parser.reset();
+}
+
+
+bool SimulatedDevice::isOpen()
+{
+    pthread_mutex_lock(&mutex);
+    bool result = isRunning;
+    pthread_mutex_unlock(&mutex);
+    return result;
+}
+
+
+void SimulatedDevice::writeBytes(const uint8_t* bytes, uint16_t size)
+{
+    pthread_mutex_lock(&mutex);
+
+    if (isRunning && size > 0) {
+        int64_t now = currentTime();
+        if (rxLinkFree < now)
+            rxLinkFree = now;
+        rxLinkFree += transferTime(size);
+
+        rxChunks.push_back(Chunk());
+        Chunk& chunk = rxChunks.back();
+        chunk.time = rxLinkFree + latency;
+        chunk.data.assign(bytes, bytes + size);
+
+        notifyChanged();
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+
+void SimulatedDevice::setDigitalInput(uint16_t pin, bool value)
+{
+    pthread_mutex_lock(&mutex);
+
+    bool oldValue = digitalPins[pin];
+    digitalPins[pin] = value;
+
+    if (value != oldValue) {
+        uint16_t trigger = value ? 16 : 32;
+        for (std::map<uint16_t, SimulatedPort>::iterator it = ports.begin(); it != ports.end(); it++) {
+            SimulatedPort& port = it->second;
+            if (port.portType == WK_CFG_PORT_TYPE_DIGI_PIN && port.pin == pin
+                    && (port.attributes & 1) == 0 && (port.attributes & trigger) != 0)
+                sendEvent(port.portId, 0, WK_EVENT_SINGLE_SAMPLE, 0, 0, value ? 1 : 0, NULL, 0);
+        }
+        notifyChanged();
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+
+void SimulatedDevice::setAnalogInput(uint16_t pin, int32_t value)
+{
+    pthread_mutex_lock(&mutex);
+    analogPins[pin] = value;
+    pthread_mutex_unlock(&mutex);
+}
+
+
+void SimulatedDevice::setI2CRegisters(uint16_t slave, uint8_t reg, const uint8_t* data, int length)
+{
+    pthread_mutex_lock(&mutex);
+    I2CSlave& s = i2cSlaves[slave];
+    for (int i = 0; i < length; i++)
+        s.registers[(uint8_t)(reg + i)] = data[i];
+    pthread_mutex_unlock(&mutex);
+}
+
+
+#pragma mark - Message handling
+
+
+void SimulatedDevice::handleMessage(wk_msg_header* msg)
+{
+    if (msg->message_type == WK_MSG_TYPE_CONFIG_REQUEST)
+        handleConfigRequest((wk_config_request*)msg);
+    else if (msg->message_type == WK_MSG_TYPE_PORT_REQUEST)
+        handlePortRequest((wk_port_request*)msg);
+
+    MessagePool::release(msg);
+}
+
+
+void SimulatedDevice::handleConfigRequest(wk_config_request* request)
+{
+    if (request->action == WK_CFG_ACTION_CONFIG_PORT) {
+        uint8_t portType = request->port_type;
+        uint32_t channels = request->port_attributes1 | ((uint32_t)request->port_attributes2 << 16);
+        if (portType < WK_CFG_PORT_TYPE_DIGI_PIN || portType > WK_CFG_PORT_TYPE_ANALOG_SCAN
+                || (portType == WK_CFG_PORT_TYPE_ANALOG_SCAN && (channels == 0 || request->value1 == 0))) {
+            sendConfigResponse(request, 0, WK_RESULT_INV_DATA, 0, 0);
+            return;
+        }
+
+        do {
+            lastPortId++;
+            if (lastPortId == 0 || lastPortId == 0xffff)
+                lastPortId = 1;
+        } while (ports.count(lastPortId) > 0);
+
+        SimulatedPort& port = ports[lastPortId];
+        port.portId = lastPortId;
+        port.portType = portType;
+        port.pin = request->pin_config;
+        port.attributes = request->port_attributes1;
+        port.channels = portType == WK_CFG_PORT_TYPE_ANALOG_SCAN ? channels : 0;
+        port.sequence = 0;
+        port.interval = 0;
+        port.nextSample = Never;
+        port.deadband = 0;
+        port.minReportInterval = 0;
+        port.maxReportInterval = 0;
+        port.hasReported = false;
+        port.lastReported = 0;
+        port.samplesSinceReport = 0;
+        port.pollSlave = 0;
+        port.pollLength = 0;
+
+        uint16_t optional1 = 0;
+        if (portType == WK_CFG_PORT_TYPE_DIGI_PIN) {
+            if ((port.attributes & 1) != 0)
+                digitalPins[port.pin] = request->value1 != 0;
+            else
+                optional1 = digitalPins[port.pin] ? 1 : 0;
+
+        } else if ((portType == WK_CFG_PORT_TYPE_ANALOG_IN || portType == WK_CFG_PORT_TYPE_ANALOG_SCAN) && request->value1 != 0) {
+            port.interval = (int64_t)request->value1 * 1000;
+            port.nextSample = currentTime() + port.interval;
+            if (portType == WK_CFG_PORT_TYPE_ANALOG_IN) {
+                port.deadband = request->port_attributes1;
+                port.minReportInterval = (uint8_t)request->port_attributes2;
+                port.maxReportInterval = (uint8_t)(request->port_attributes2 >> 8);
+            }
+        }
+
+        sendConfigResponse(request, port.portId, WK_RESULT_OK, optional1, 0);
+
+    } else if (request->action == WK_CFG_ACTION_RELEASE) {
+        uint16_t result = ports.erase(request->header.port_id) > 0 ? WK_RESULT_OK : WK_RESULT_INV_DATA;
+        sendConfigResponse(request, request->header.port_id, result, 0, 0);
+
+    } else if (request->action == WK_CFG_ACTION_RESET) {
+        ports.clear();
+        digitalPins.clear();
+        sendConfigResponse(request, 0, WK_RESULT_OK, 0, 0);
+
+    } else if (request->action == WK_CFG_ACTION_CONFIG_MODULE) {
+        sendConfigResponse(request, 0, WK_RESULT_OK, 0, 0);
+
+    } else if (request->action == WK_CFG_ACTION_QUERY) {
+        uint16_t result = WK_RESULT_OK;
+        uint32_t value = queryValue(request->port_type, &result);
+        sendConfigResponse(request, 0, result, 0, value);
+
+    } else {
+        sendConfigResponse(request, 0, WK_RESULT_INV_DATA, 0, 0);
+    }
+}
+
+
+uint32_t SimulatedDevice::queryValue(uint8_t item, uint16_t* result)
+{
+    switch (item) {
+        case WK_CFG_QUERY_MEM_AVAIL:
+        case WK_CFG_QUERY_MEM_MAX_BLOCK:
+            return memSize - memUsed;
+        case WK_CFG_QUERY_MEM_MCU:
+            return WK_CFG_MCU_TEENSY_3_2;
+        case WK_CFG_QUERY_VERSION:
+            return SIM_FIRMWARE_VERSION;
+        default:
+            *result = WK_RESULT_INV_DATA;
+            return 0;
+    }
+}
+
+
+void SimulatedDevice::handlePortRequest(wk_port_request* request)
+{
+    std::map<uint16_t, SimulatedPort>::iterator it = ports.find(request->header.port_id);
+    if (it == ports.end())
+        return; // unknown port; the board ignores the request
+
+    SimulatedPort& port = it->second;
+    uint16_t portId = port.portId;
+    uint16_t requestId = request->header.request_id;
+
+    switch (port.portType) {
+        case WK_CFG_PORT_TYPE_DIGI_PIN:
+            if (request->action == WK_PORT_ACTION_SET_VALUE) {
+                digitalPins[port.pin] = request->value1 != 0;
+                if (requestId != 0)
+                    sendEvent(portId, requestId, WK_EVENT_SET_DONE, 0, 0, 0, NULL, 0);
+            } else if (request->action == WK_PORT_ACTION_GET_VALUE) {
+                sendEvent(portId, requestId, WK_EVENT_SINGLE_SAMPLE, 0, 0, digitalPins[port.pin] ? 1 : 0, NULL, 0);
+            }
+            break;
+
+        case WK_CFG_PORT_TYPE_ANALOG_IN:
+            if (request->action == WK_PORT_ACTION_GET_VALUE)
+                sendEvent(portId, requestId, WK_EVENT_SINGLE_SAMPLE, 0, 0, (uint32_t)analogPins[port.pin], NULL, 0);
+            break;
+
+        case WK_CFG_PORT_TYPE_PWM:
+            if (request->action == WK_PORT_ACTION_SET_VALUE && requestId != 0)
+                sendEvent(portId, requestId, WK_EVENT_SET_DONE, 0, 0, 0, NULL, 0);
+            break;
+
+        case WK_CFG_PORT_TYPE_I2C:
+        case WK_CFG_PORT_TYPE_SPI:
+            if (request->action == WK_PORT_ACTION_START_POLLING || request->action == WK_PORT_ACTION_STOP_POLLING)
+                handlePollingRequest(port, request);
+            else if (busSpeed > 0)
+                handleBusRequest(port, request);
+            else if (port.portType == WK_CFG_PORT_TYPE_I2C)
+                handleI2CRequest(port, request);
+            else
+                handleSPIRequest(port, request);
+            break;
+    }
+}
+
+
+void SimulatedDevice::handleBusRequest(SimulatedPort& port, wk_port_request* request)
+{
+    // same memory model as the host's throttler
+    uint16_t txLength = WK_PORT_REQUEST_DATA_LEN(request);
+    uint16_t rxLength = request->action == WK_PORT_ACTION_TX_DATA ? 0 : (uint16_t)request->value1;
+    if (request->action == WK_PORT_ACTION_TX_N_RX_DATA && port.portType == WK_CFG_PORT_TYPE_SPI)
+        rxLength = txLength;
+    int size = request->header.message_size;
+    if (WK_PORT_EVENT_ALLOC_SIZE(rxLength) > size)
+        size = WK_PORT_EVENT_ALLOC_SIZE(rxLength);
+    size += SIM_REQUEST_OVERHEAD;
+
+    if (memUsed + size > memSize) {
+        overruns++;
+        uint8_t event = request->action == WK_PORT_ACTION_TX_DATA || request->action == WK_PORT_ACTION_RESET
+            ? WK_EVENT_TX_COMPLETE : WK_EVENT_DATA_RECV;
+        sendEvent(port.portId, request->header.request_id, event, SIM_RESULT_OUT_OF_MEMORY, 0, 0, NULL, 0);
+        return;
+    }
+
+    // execute request but hold back the response until the bus has transmitted the data
+    size_t pendingSize = txPending.size();
+    if (port.portType == WK_CFG_PORT_TYPE_I2C)
+        handleI2CRequest(port, request);
+    else
+        handleSPIRequest(port, request);
+
+    int64_t now = currentTime();
+    if (busFree < now)
+        busFree = now;
+    busFree += (int64_t)(txLength + rxLength) * 1000000 / busSpeed;
+
+    memUsed += size;
+    busJobs.push_back(BusJob());
+    BusJob& job = busJobs.back();
+    job.time = busFree;
+    job.memSize = size;
+    job.response.assign(txPending.begin() + pendingSize, txPending.end());
+    txPending.resize(pendingSize);
+}
+
+
+void SimulatedDevice::completeBusJobs(int64_t now)
+{
+    while (!busJobs.empty() && busJobs.front().time <= now) {
+        BusJob& job = busJobs.front();
+        txPending.insert(txPending.end(), job.response.begin(), job.response.end());
+        memUsed -= job.memSize;
+        busJobs.pop_front();
+    }
+}
+
+
+void SimulatedDevice::handleI2CRequest(SimulatedPort& port, wk_port_request* request)
+{
+    uint16_t requestId = request->header.request_id;
+    I2CSlave& slave = i2cSlaves[request->action_attribute2];
+    uint16_t txLength = WK_PORT_REQUEST_DATA_LEN(request);
+
+    if (request->action == WK_PORT_ACTION_TX_DATA) {
+        transferI2C(slave, request->data, txLength, NULL, 0);
+        sendEvent(port.portId, requestId, WK_EVENT_TX_COMPLETE, WK_RESULT_OK, txLength, 0, NULL, 0);
+
+    } else if (request->action == WK_PORT_ACTION_RX_DATA || request->action == WK_PORT_ACTION_TX_N_RX_DATA) {
+        if (request->action == WK_PORT_ACTION_RX_DATA)
+            txLength = 0;
+        uint16_t rxLength = (uint16_t)request->value1;
+        std::vector<uint8_t> data(rxLength);
+        transferI2C(slave, request->data, txLength, rxLength > 0 ? &data[0] : NULL, rxLength);
+        sendEvent(port.portId, requestId, WK_EVENT_DATA_RECV, WK_RESULT_OK, rxLength, 0,
+                  rxLength > 0 ? &data[0] : NULL, rxLength);
+
+    } else if (request->action == WK_PORT_ACTION_RESET) {
+        sendEvent(port.portId, requestId, WK_EVENT_TX_COMPLETE, WK_RESULT_OK, 0, 0, NULL, 0);
+    }
+}
+
+
+void SimulatedDevice::handlePollingRequest(SimulatedPort& port, wk_port_request* request)
+{
+    uint16_t requestId = request->header.request_id;
+    if (port.portType != WK_CFG_PORT_TYPE_I2C
+            || (request->action == WK_PORT_ACTION_START_POLLING && request->value1 == 0)) {
+        sendEvent(port.portId, requestId, WK_EVENT_TX_COMPLETE, WK_RESULT_INV_DATA, 0, 0, NULL, 0);
+        return;
+    }
+
+    if (request->action == WK_PORT_ACTION_START_POLLING) {
+        port.pollSlave = request->action_attribute2;
+        port.pollLength = request->action_attribute1;
+        port.pollData.assign(request->data, request->data + WK_PORT_REQUEST_DATA_LEN(request));
+        port.sequence = 0;
+        port.interval = request->value1;
+        port.nextSample = currentTime() + port.interval;
+    } else {
+        port.interval = 0;
+        port.nextSample = Never;
+    }
+
+    sendEvent(port.portId, requestId, WK_EVENT_TX_COMPLETE, WK_RESULT_OK, 0, 0, NULL, 0);
+}
+
+
+void SimulatedDevice::pollI2C(SimulatedPort& port)
+{
+    uint8_t data[256];
+    transferI2C(i2cSlaves[port.pollSlave], port.pollData.empty() ? NULL : &port.pollData[0],
+                (int)port.pollData.size(), data, port.pollLength);
+    sendEvent(port.portId, 0, WK_EVENT_DATA_RECV, WK_RESULT_OK, port.pollLength, port.sequence,
+              data, port.pollLength);
+    port.sequence++;
+}
+
+
+void SimulatedDevice::transferI2C(I2CSlave& slave, const uint8_t* txData, int txLength, uint8_t* rxData, int rxLength)
+{
+    // first byte selects the register; the remaining bytes are written
+    if (txLength > 0)
+        slave.pointer = txData[0];
+    for (int i = 1; i < txLength; i++) {
+        slave.registers[slave.pointer] = txData[i];
+        slave.pointer++;
+    }
+
+    for (int i = 0; i < rxLength; i++) {
+        rxData[i] = slave.registers[slave.pointer];
+        slave.pointer++;
+    }
+}
+
+
+void SimulatedDevice::handleSPIRequest(SimulatedPort& port, wk_port_request* request)
+{
+    uint16_t requestId = request->header.request_id;
+    uint16_t txLength = WK_PORT_REQUEST_DATA_LEN(request);
+
+    if (request->action == WK_PORT_ACTION_TX_DATA) {
+        sendEvent(port.portId, requestId, WK_EVENT_TX_COMPLETE, WK_RESULT_OK, txLength, 0, NULL, 0);
+
+    } else if (request->action == WK_PORT_ACTION_RX_DATA) {
+        uint16_t rxLength = (uint16_t)request->value1;
+        std::vector<uint8_t> data(rxLength, request->action_attribute1);
+        sendEvent(port.portId, requestId, WK_EVENT_DATA_RECV, WK_RESULT_OK, rxLength, 0,
+                  rxLength > 0 ? &data[0] : NULL, rxLength);
+
+    } else if (request->action == WK_PORT_ACTION_TX_N_RX_DATA) {
+        sendEvent(port.portId, requestId, WK_EVENT_DATA_RECV, WK_RESULT_OK, txLength, 0, request->data, txLength);
+    }
+}
+
+
+void SimulatedDevice::sendConfigResponse(wk_config_request* request, uint16_t portId, uint16_t result, uint16_t optional1, uint32_t value1)
+{
+    wk_config_response response;
+    memset(&response, 0, sizeof(response));
+    response.header.message_size = sizeof(wk_config_response);
+    response.header.message_type = WK_MSG_TYPE_CONFIG_RESPONSE;
+    response.header.port_id = portId;
+    response.header.request_id = request->header.request_id;
+    response.result = result;
+    response.optional1 = optional1;
+    response.value1 = value1;
+
+    const uint8_t* bytes = (const uint8_t*)&response;
+    txPending.insert(txPending.end(), bytes, bytes + sizeof(response));
+}
+
+
+void SimulatedDevice::sendEvent(uint16_t portId, uint16_t requestId, uint8_t event, uint8_t attribute1,
+                                uint16_t attribute2, uint32_t value1, const uint8_t* data, uint16_t dataLength)
+{
+    wk_port_event header;
+    memset(&header, 0, sizeof(header));
+    header.header.message_size = WK_PORT_EVENT_ALLOC_SIZE(dataLength);
+    header.header.message_type = WK_MSG_TYPE_PORT_EVENT;
+    header.header.port_id = portId;
+    header.header.request_id = requestId;
+    header.event = event;
+    header.event_attribute1 = attribute1;
+    header.event_attribute2 = attribute2;
+    header.value1 = value1;
+
+    const uint8_t* bytes = (const uint8_t*)&header;
+    txPending.insert(txPending.end(), bytes, bytes + WK_PORT_EVENT_ALLOC_SIZE(0));
+    if (dataLength > 0)
+        txPending.insert(txPending.end(), data, data + dataLength);
+}
+
+
+#pragma mark - Simulation thread
+
+
+int64_t SimulatedDevice::transferTime(size_t size)
+{
+    if (bandwidth <= 0)
+        return 0;
+    return (int64_t)size * 1000000 / bandwidth;
+}
+
+
+void SimulatedDevice::sampleInputs(int64_t now)
+{
+    for (std::map<uint16_t, SimulatedPort>::iterator it = ports.begin(); it != ports.end(); it++) {
+        SimulatedPort& port = it->second;
+        int numSamples = 0;
+        while (port.nextSample <= now) {
+            if (numSamples < SIM_MAX_SAMPLES_PER_WAKEUP) {
+                if (port.portType == WK_CFG_PORT_TYPE_ANALOG_IN)
+                    sampleAnalogInput(port);
+                else if (port.portType == WK_CFG_PORT_TYPE_I2C)
+                    pollI2C(port);
+                numSamples++;
+            } else {
+                port.sequence++; // frame or poll is lost
+            }
+            port.nextSample += port.interval;
+        }
+        
+        // frames that are due at the same time are sent in a single event
+        if (port.portType == WK_CFG_PORT_TYPE_ANALOG_SCAN && numSamples > 0)
+            sendScanFrames(port, numSamples);
+    }
+}
+
+
+void SimulatedDevice::sampleAnalogInput(SimulatedPort& port)
+{
+    int32_t value = analogPins[port.pin];
+    port.samplesSinceReport++;
+
+    if (port.hasReported) {
+        int64_t change = (int64_t)value - port.lastReported;
+        if (change < 0)
+            change = -change;
+        bool hasChanged = change >= ((int64_t)port.deadband << 16);
+        bool isDue = port.maxReportInterval != 0 && port.samplesSinceReport >= port.maxReportInterval;
+        if (port.samplesSinceReport < port.minReportInterval || !(hasChanged || isDue))
+            return;
+    }
+
+    uint16_t intervals = port.samplesSinceReport <= 0xffff ? (uint16_t)port.samplesSinceReport : 0xffff;
+    sendEvent(port.portId, 0, WK_EVENT_SINGLE_SAMPLE, 0, intervals, (uint32_t)value, NULL, 0);
+    port.hasReported = true;
+    port.lastReported = value;
+    port.samplesSinceReport = 0;
+}
+
+
+void SimulatedDevice::sendScanFrames(SimulatedPort& port, int numFrames)
+{
+    std::vector<int32_t> samples;
+    int numChannels = 0;
+    for (int frame = 0; frame < numFrames; frame++) {
+        for (int bit = 0; bit < 32; bit++) {
+            if ((port.channels & (1u << bit)) == 0)
+                continue;
+            samples.push_back(analogPins[WK_SCAN_CHANNEL_PIN(bit)]);
+            if (frame == 0)
+                numChannels++;
+        }
+    }
+    
+    // at most 32 channels and SIM_MAX_SAMPLES_PER_WAKEUP frames fit into a message
+    uint32_t sequence = port.sequence;
+    port.sequence += numFrames;
+    
+    sendEvent(port.portId, 0, WK_EVENT_SCAN_FRAMES, 0, (uint16_t)numChannels, sequence,
+              (const uint8_t*)&samples[0], (uint16_t)(numFrames * numChannels * 4));
+}
+
+
+void SimulatedDevice::packetize(int64_t now)
+{
+    // split pending data into packets as long as the link is free
+    size_t offset = 0;
+    while (offset < txPending.size() && txLinkFree <= now) {
+        size_t size = txPending.size() - offset;
+        if (size > (size_t)packetSize)
+            size = packetSize;
+
+        txLinkFree = now + transferTime(size);
+
+        txChunks.push_back(Chunk());
+        Chunk& chunk = txChunks.back();
+        chunk.time = txLinkFree + latency;
+        chunk.data.assign(txPending.begin() + offset, txPending.begin() + offset + size);
+        offset += size;
+    }
+
+    txPending.erase(txPending.begin(), txPending.begin() + offset);
+}
+
+
+int64_t SimulatedDevice::nextDueTime()
+{
+    int64_t next = Never;
+    if (!rxChunks.empty() && rxChunks.front().time < next)
+        next = rxChunks.front().time;
+    if (!txChunks.empty() && txChunks.front().time < next)
+        next = txChunks.front().time;
+    if (!txPending.empty() && txLinkFree < next)
+        next = txLinkFree;
+    if (!busJobs.empty() && busJobs.front().time < next)
+        next = busJobs.front().time;
+    for (std::map<uint16_t, SimulatedPort>::iterator it = ports.begin(); it != ports.end(); it++)
+        if (it->second.nextSample < next)
+            next = it->second.nextSample;
+    return next;
+}
+
+
+void SimulatedDevice::notifyChanged()
+{
+    if (reactor != NULL)
+        reactor->wake(this);
+    else
+        pthread_cond_signal(&changed);
+}
+
+
+int64_t SimulatedDevice::process(int64_t now)
+{
+    // process requests that have arrived on the board
+    while (!rxChunks.empty() && rxChunks.front().time <= now) {
+        Chunk chunk;
+        chunk.data.swap(rxChunks.front().data);
+        rxChunks.pop_front();
+        parser.processData(&chunk.data[0], (uint32_t)chunk.data.size());
+    }
+
+    completeBusJobs(now);
+    sampleInputs(now);
+    packetize(now);
+
+    // deliver packets that have arrived on the host
+    while (isRunning && !txChunks.empty() && txChunks.front().time <= now) {
+        Chunk chunk;
+        chunk.data.swap(txChunks.front().data);
+        txChunks.pop_front();
+
+        pthread_mutex_unlock(&mutex);
+
+        // deliver in pool buffer like the USB transport
+        uint32_t size = (uint32_t)chunk.data.size();
+        uint8_t* buffer = size <= MESSAGE_POOL_BUFFER_SIZE ? MessagePool::acquireBuffer() : NULL;
+        if (buffer != NULL) {
+            memcpy(buffer, &chunk.data[0], size);
+            listener->onDataReceived(buffer, size);
+            MessagePool::release(buffer);
+        } else {
+            listener->onDataReceived(&chunk.data[0], size);
+        }
+
+        pthread_mutex_lock(&mutex);
+    }
+
+    return isRunning ? nextDueTime() : Never;
+}
+
+
+int64_t SimulatedDevice::service(int64_t now)
+{
+    pthread_mutex_lock(&mutex);
+    int64_t next = isRunning ? process(now) : Never;
+    pthread_mutex_unlock(&mutex);
+    return next;
+}
+
+
+void SimulatedDevice::run()
+{
+    pthread_mutex_lock(&mutex);
+
+    while (isRunning) {
+        int64_t next = process(currentTime());
+        if (!isRunning)
+            break;
+
+        int64_t now = currentTime();
+        if (next == Never)
+            pthread_cond_wait(&changed, &mutex);
+        else if (next > now)
+            waitFor(&changed, &mutex, next - now);
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+
+void* SimulatedDevice::threadMain(void* arg)
+{
+    SimulatedDevice* device = (SimulatedDevice*)arg;
+    device->run();
+    return NULL;
+}
@@ -0,0 +1,211 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef SimulatedDevice_hpp
+#define SimulatedDevice_hpp
+
+#include <pthread.h>
+#include <deque>
+#include <map>
+#include <vector>
+#include "proto.h"
+#include "Transport.hpp"
+#include "MessageParser.hpp"
+#include "IOReactorClient.hpp"
+
+
+class IOReactor;
+
+
+/**
+ * In-process simulation of a Wirekite board
+ *
+ * The simulated board is connected by a simulated USB link with configurable
+ * latency and bandwidth. It understands the configuration and port requests
+ * and responds with the same messages as a real board. Analog inputs and
+ * analog scan groups with an interval are sampled automatically and I2C polls are
+ * executed automatically. I2C slaves are simulated as 256 byte register files and
+ * SPI slaves as a loopback (MISO = MOSI).
+ *
+ * It allows to run the host protocol stack without a board being attached.
+ *
+ * The simulation either runs on its own thread or, like the USB transport,
+ * on a thread of an I/O reactor shared with other devices.
+ */
+class SimulatedDevice : public Transport, private MessageHandler, private IOReactorClient {
+public:
+    /**
+     * Creates a new instance.
+     * @param reactor the I/O reactor to run on, or `NULL` to run on a separate thread
+     */
+    SimulatedDevice(IOReactor* reactor = NULL);
+    virtual ~SimulatedDevice();
+
+    /**
+     * Configures the simulated USB link.
+     *
+     * @param latency the latency in each direction (in µs)
+     * @param bandwidth the bandwidth in each direction (in bytes per second, or 0 for unlimited)
+     */
+    void configureLink(int latency, int bandwidth);
+
+    /**
+     * Configures the maximum size of the data chunks delivered to the host.
+     *
+     * @param size the maximum chunk size (in bytes)
+     */
+    void configurePacketSize(int size);
+
+    /**
+     * Configures the memory for buffering I2C and SPI requests and the speed of the buses.
+     *
+     * If the bus speed is 0 (the default), requests are executed immediately and
+     * the memory is never exhausted. Otherwise, requests are executed one after the
+     * other and occupy memory until their response is sent. If a request does not fit
+     * into the remaining memory, it fails with the result code 5 (out of memory).
+     *
+     * @param memSize the memory size (in bytes)
+     * @param busSpeed the speed of the I2C and SPI buses (in bytes per second, or 0 for unlimited)
+     */
+    void configureBuffer(int memSize, int busSpeed);
+
+    /**
+     * Returns the number of requests that failed because the memory was exhausted.
+     * @return the number of requests
+     */
+    int overrunCount();
+
+    /**
+     * Sets the value of a simulated digital input.
+     *
+     * If a port with triggers is configured for the pin, an event is sent to the host.
+     *
+     * @param pin the pin number
+     * @param value the new value
+     */
+    void setDigitalInput(uint16_t pin, bool value);
+
+    /**
+     * Sets the value of a simulated analog input.
+     *
+     * @param pin the analog pin
+     * @param value the new value (in the range of a 32 bit signed integer)
+     */
+    void setAnalogInput(uint16_t pin, int32_t value);
+
+    /**
+     * Sets the content of registers of a simulated I2C slave.
+     *
+     * @param slave the slave address
+     * @param reg the first register
+     * @param data the register data
+     * @param length the length of the data (in bytes)
+     */
+    void setI2CRegisters(uint16_t slave, uint8_t reg, const uint8_t* data, int length);
+
+    virtual bool start();
+    virtual void stop();
+    virtual bool isOpen();
+    virtual void writeBytes(const uint8_t* bytes, uint16_t size);
+
+private:
+    struct SimulatedPort {
+        uint16_t portId;
+        uint8_t portType;
+        uint16_t pin;
+        uint16_t attributes;
+        uint32_t channels; // channel mask of analog scan ports
+        uint32_t sequence; // next frame of analog scan ports or next poll of I2C ports
+        int64_t interval;
+        int64_t nextSample;
+        uint16_t deadband; // deadband of sampled analog inputs
+        uint8_t minReportInterval;
+        uint8_t maxReportInterval;
+        bool hasReported;
+        int32_t lastReported;
+        uint32_t samplesSinceReport;
+        uint16_t pollSlave;
+        uint16_t pollLength;
+        std::vector<uint8_t> pollData;
+    };
+
+    struct Chunk {
+        int64_t time;
+        std::vector<uint8_t> data;
+    };
+
+    struct I2CSlave {
+        uint8_t registers[256];
+        uint8_t pointer;
+    };
+
+    struct BusJob {
+        int64_t time;
+        int memSize;
+        std::vector<uint8_t> response;
+    };
+
+    virtual void handleMessage(wk_msg_header* msg);
+    void handleConfigRequest(wk_config_request* request);
+    void handlePortRequest(wk_port_request* request);
+    void handleI2CRequest(SimulatedPort& port, wk_port_request* request);
+    void handlePollingRequest(SimulatedPort& port, wk_port_request* request);
+    void pollI2C(SimulatedPort& port);
+    void transferI2C(I2CSlave& slave, const uint8_t* txData, int txLength, uint8_t* rxData, int rxLength);
+    void handleSPIRequest(SimulatedPort& port, wk_port_request* request);
+    void handleBusRequest(SimulatedPort& port, wk_port_request* request);
+    void completeBusJobs(int64_t now);
+    uint32_t queryValue(uint8_t item, uint16_t* result);
+    void sendConfigResponse(wk_config_request* request, uint16_t portId, uint16_t result, uint16_t optional1, uint32_t value1);
+    void sendEvent(uint16_t portId, uint16_t requestId, uint8_t event, uint8_t attribute1, uint16_t attribute2,
+                   uint32_t value1, const uint8_t* data, uint16_t dataLength);
+    void sampleInputs(int64_t now);
+    void sampleAnalogInput(SimulatedPort& port);
+    void sendScanFrames(SimulatedPort& port, int numFrames);
+    void packetize(int64_t now);
+    int64_t nextDueTime();
+    int64_t transferTime(size_t size);
+    void notifyChanged();
+    int64_t process(int64_t now);
+    virtual int64_t service(int64_t now);
+    void run();
+    static void* threadMain(void* arg);
+
+private:
+    IOReactor* reactor;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    bool isRunning;
+
+    int latency;
+    int bandwidth;
+    int packetSize;
+    int64_t rxLinkFree;
+    int64_t txLinkFree;
+    std::deque<Chunk> rxChunks;
+    std::deque<Chunk> txChunks;
+    std::vector<uint8_t> txPending;
+    MessageParser parser;
+
+    int memSize;
+    int memUsed;
+    int busSpeed;
+    int64_t busFree;
+    int overruns;
+    std::deque<BusJob> busJobs;
+
+    std::map<uint16_t, SimulatedPort> ports;
+    uint16_t lastPortId;
+    std::map<uint16_t, bool> digitalPins;
+    std::map<uint16_t, int32_t> analogPins;
+    std::map<uint16_t, I2CSlave> i2cSlaves;
+};
+
+
+#endif /* SimulatedDevice_hpp */
@@ -7,21 +7,63 @@
 //
 
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
 #include "Throttler.hpp"
 
 
+// additive increase of the window per window of completed bytes
+#define THROTTLER_ADDITIVE_INCREASE 64
+// the window no longer grows if the round-trip time exceeds the minimum by this factor
+#define THROTTLER_RTT_FACTOR 4
+
+// default reservations for control and normal priority requests
+#define THROTTLER_CONTROL_RESERVED_MEM 256
+#define THROTTLER_CONTROL_RESERVED_REQUESTS 2
+#define THROTTLER_NORMAL_RESERVED_MEM 512
+#define THROTTLER_NORMAL_RESERVED_REQUESTS 2
+
+
+static int64_t currentTime()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 
 Throttler::Throttler()
-:   memSize(4200),
+:   memSize(THROTTLER_DEFAULT_MEM_SIZE),
     occupiedSize(0),
-    maxOutstandingRequests(20),
+    peakOccupiedSize(0),
+    maxOutstandingRequests(THROTTLER_DEFAULT_MAX_OUTSTANDING),
     outstandingRequests(0),
-    mutex(PTHREAD_MUTEX_INITIALIZER),
+    adaptive(false),
+    window(THROTTLER_DEFAULT_MEM_SIZE),
+    minWindow(0),
+    isMeasuringRtt(false),
+    rttRequestId(0),
+    rttStart(0),
+    minRtt(0),
+    smoothedRtt(0),
     available(PTHREAD_COND_INITIALIZER),
+    mutex(PTHREAD_MUTEX_INITIALIZER),
     isDestroyed(false)
 {
     pthread_mutex_init(&mutex, NULL);
     pthread_cond_init(&available, NULL);
+    memset(requests, 0, sizeof(requests));
+    
+    for (int i = 0; i < THROTTLER_NUM_PRIORITIES; i++) {
+        priorities[i].reservedMemSize = 0;
+        priorities[i].reservedRequests = 0;
+        priorities[i].head = NULL;
+        priorities[i].tail = NULL;
+    }
+    priorities[ThrottlerPriorityControl].reservedMemSize = THROTTLER_CONTROL_RESERVED_MEM;
+    priorities[ThrottlerPriorityControl].reservedRequests = THROTTLER_CONTROL_RESERVED_REQUESTS;
+    priorities[ThrottlerPriorityNormal].reservedMemSize = THROTTLER_NORMAL_RESERVED_MEM;
+    priorities[ThrottlerPriorityNormal].reservedRequests = THROTTLER_NORMAL_RESERVED_REQUESTS;
 }
 
 
@@ -44,6 +86,7 @@ void Throttler::configureMemorySize(int size)
     pthread_mutex_lock(&mutex);
     int oldMemSize = memSize;
     memSize = size;
+    adaptive = false;
     
     if (memSize > oldMemSize)
         pthread_cond_broadcast(&available);
@@ -62,7 +105,7 @@ void Throttler::configureMaximumOutstanding(int maxReq)
 {
     pthread_mutex_lock(&mutex);
     int oldMaxRequests = maxOutstandingRequests;
-    maxOutstandingRequests = maxReq;
+    maxOutstandingRequests = std::min(maxReq, THROTTLER_MAX_OUTSTANDING);
     
     if (maxOutstandingRequests > oldMaxRequests)
         pthread_cond_broadcast(&available);
@@ -77,7 +120,8 @@ void Throttler::configure(int size, int maxReq)
     int oldMemSize = memSize;
     memSize = size;
     int oldMaxRequests = maxOutstandingRequests;
-    maxOutstandingRequests = maxReq;
+    maxOutstandingRequests = std::min(maxReq, THROTTLER_MAX_OUTSTANDING);
+    adaptive = false;
     
     if (memSize > oldMemSize || maxOutstandingRequests > oldMaxRequests)
         pthread_cond_broadcast(&available);
@@ -86,43 +130,274 @@ void Throttler::configure(int size, int maxReq)
 }
 
 
-void Throttler::waitUntilAvailable(uint16_t requestId, uint16_t requiredMemSize)
+void Throttler::configureAdaptive(int memAvail, int maxBlock)
 {
-    requiredMemSize += 8;
     pthread_mutex_lock(&mutex);
     
-    while (!isDestroyed) {
-        if (memSize - occupiedSize >= requiredMemSize
-                && outstandingRequests < maxOutstandingRequests)
-            break;
-        pthread_cond_wait(&available, &mutex);
+    memSize = memAvail;
+    minWindow = maxBlock < memAvail ? maxBlock : memAvail;
+    window = memAvail / 2;
+    if (window < minWindow)
+        window = minWindow;
+    minRtt = 0;
+    smoothedRtt = 0;
+    isMeasuringRtt = false;
+    adaptive = true;
+    
+    pthread_cond_broadcast(&available);
+    pthread_mutex_unlock(&mutex);
+}
+
+
+bool Throttler::isAdaptive()
+{
+    return adaptive;
+}
+
+
+int Throttler::windowSize()
+{
+    return adaptive ? window : memSize;
+}
+
+
+int Throttler::roundTripTime()
+{
+    return (int)smoothedRtt;
+}
+
+
+void Throttler::configureReservation(ThrottlerPriority priority, int memSize, int numRequests)
+{
+    pthread_mutex_lock(&mutex);
+    priorities[priority].reservedMemSize = memSize;
+    priorities[priority].reservedRequests = numRequests;
+    pthread_cond_broadcast(&available);
+    pthread_mutex_unlock(&mutex);
+}
+
+
+int Throttler::memorySize(ThrottlerPriority priority)
+{
+    pthread_mutex_lock(&mutex);
+    int limit = adaptive ? window : memSize;
+    int reserved = 0;
+    for (int i = 0; i < priority; i++)
+        reserved += priorities[i].reservedMemSize;
+    if (reserved > limit / 2)
+        reserved = limit / 2;
+    pthread_mutex_unlock(&mutex);
+    return limit - reserved;
+}
+
+
+bool Throttler::canAdmit(int priority, int requiredMemSize)
+{
+    // memory and requests reserved for higher priority classes
+    int reservedMem = 0;
+    int reservedReq = 0;
+    for (int i = 0; i < priority; i++) {
+        if (priorities[i].head != NULL)
+            return false; // higher priority request is waiting
+        reservedMem += priorities[i].reservedMemSize;
+        reservedReq += priorities[i].reservedRequests;
+    }
+    
+    int limit = adaptive ? window : memSize;
+    if (reservedMem > limit / 2)
+        reservedMem = limit / 2;
+    if (reservedReq > maxOutstandingRequests / 2)
+        reservedReq = maxOutstandingRequests / 2;
+    
+    // a single request is always admitted so that requests larger than the memory
+    // left after the reservations (or the adaptive window) cannot block forever
+    if (outstandingRequests == 0)
+        return true;
+    
+    return limit - reservedMem - occupiedSize >= requiredMemSize
+        && outstandingRequests < maxOutstandingRequests - reservedReq;
+}
+
+
+void Throttler::removeWaiter(int priority, Waiter* waiter)
+{
+    PriorityClass* pc = &priorities[priority];
+    Waiter* prev = NULL;
+    Waiter* w = pc->head;
+    while (w != waiter) {
+        prev = w;
+        w = w->next;
+    }
+    
+    if (prev == NULL)
+        pc->head = waiter->next;
+    else
+        prev->next = waiter->next;
+    if (pc->tail == waiter)
+        pc->tail = prev;
+}
+
+
+int Throttler::freeSlot(uint16_t requestId)
+{
+    for (int i = 0; i < THROTTLER_MAX_PROBES; i++) {
+        int index = (requestId + i) & (THROTTLER_NUM_SLOTS - 1);
+        if (requests[index].size == 0)
+            return index;
+    }
+    return -1;
+}
+
+
+int Throttler::findSlot(uint16_t requestId)
+{
+    for (int i = 0; i < THROTTLER_MAX_PROBES; i++) {
+        int index = (requestId + i) & (THROTTLER_NUM_SLOTS - 1);
+        if (requests[index].size != 0 && requests[index].requestId == requestId)
+            return index;
+    }
+    return -1;
+}
+
+
+void Throttler::waitUntilAvailable(uint16_t requestId, uint16_t requiredMemSize, ThrottlerPriority priority)
+{
+    // widened: the overhead must not wrap around for large requests
+    int size = requiredMemSize + 8;
+    int64_t startTime = currentTime();
+    pthread_mutex_lock(&mutex);
+    
+    // besides memory, the request needs a free slot (all probed slots are rarely in use)
+    PriorityClass* pc = &priorities[priority];
+    int slot = -1;
+    if (pc->head == NULL && canAdmit(priority, size) && (slot = freeSlot(requestId)) >= 0) {
+        // fast path: nobody is waiting
+    } else {
+        // wait in line
+        Waiter waiter;
+        waiter.next = NULL;
+        if (pc->tail != NULL)
+            pc->tail->next = &waiter;
+        else
+            pc->head = &waiter;
+        pc->tail = &waiter;
+        
+        while (!isDestroyed && !(pc->head == &waiter && canAdmit(priority, size) && (slot = freeSlot(requestId)) >= 0))
+            pthread_cond_wait(&available, &mutex);
+        
+        removeWaiter(priority, &waiter);
+        
+        // give the next request in line (or of a lower priority class) a chance
+        pthread_cond_broadcast(&available);
     }
     
     if (!isDestroyed)
     {
-        occupiedSize += requiredMemSize;
+        occupiedSize += size;
+        if (occupiedSize > peakOccupiedSize)
+            peakOccupiedSize = occupiedSize;
         outstandingRequests++;
-        requests[requestId] = requiredMemSize;
+        OutstandingRequest& request = requests[slot];
+        request.requestId = requestId;
+        request.priority = (uint8_t)priority;
+        request.size = size;
+        request.startTime = (uint32_t)startTime;
+        int64_t now = currentTime();
+        pc->waitTimes.record((uint32_t)(now - startTime));
+        
+        // measure the round-trip time of one request at a time
+        if (adaptive && !isMeasuringRtt) {
+            isMeasuringRtt = true;
+            rttRequestId = requestId;
+            rttStart = now;
+        }
     }
     
     pthread_mutex_unlock(&mutex);
 }
 
 
-void Throttler::requestCompleted(uint16_t requestId)
+void Throttler::requestCompleted(uint16_t requestId, bool overrun)
 {
     pthread_mutex_lock(&mutex);
     
-    uint16_t requestSize = requests[requestId];
-    requests.erase(requestId);
-    occupiedSize -= requestSize;
-    outstandingRequests--;
+    int slot = findSlot(requestId);
+    if (slot >= 0) {
+        OutstandingRequest& request = requests[slot];
+        int requestSize = request.size;
+        request.size = 0;
+        occupiedSize -= requestSize;
+        outstandingRequests--;
+        uint32_t latency = (uint32_t)currentTime() - request.startTime;
+        priorities[request.priority].latencies.record(latency);
+        if (adaptive)
+            adaptWindow(requestSize, overrun);
+        pthread_cond_broadcast(&available);
+    }
+    
+    if (isMeasuringRtt && requestId == rttRequestId) {
+        isMeasuringRtt = false;
+        int64_t rtt = currentTime() - rttStart;
+        if (minRtt == 0 || rtt < minRtt)
+            minRtt = rtt;
+        smoothedRtt = smoothedRtt == 0 ? rtt : (7 * smoothedRtt + rtt) / 8;
+    }
     
-    pthread_cond_broadcast(&available);
     pthread_mutex_unlock(&mutex);
 }
 
 
+int Throttler::bytesInFlight()
+{
+    pthread_mutex_lock(&mutex);
+    int size = occupiedSize;
+    pthread_mutex_unlock(&mutex);
+    return size;
+}
+
+
+int Throttler::peakBytesInFlight()
+{
+    pthread_mutex_lock(&mutex);
+    int size = peakOccupiedSize;
+    pthread_mutex_unlock(&mutex);
+    return size;
+}
+
+
+LatencyHistogram& Throttler::waitTimes(ThrottlerPriority priority)
+{
+    return priorities[priority].waitTimes;
+}
+
+
+LatencyHistogram& Throttler::latencies(ThrottlerPriority priority)
+{
+    return priorities[priority].latencies;
+}
+
+
+void Throttler::adaptWindow(int requestSize, bool overrun)
+{
+    if (overrun) {
+        // multiplicative decrease
+        window /= 2;
+        if (window < minWindow)
+            window = minWindow;
+        return;
+    }
+    
+    // additive increase unless requests are queuing up on the board
+    if (smoothedRtt > 0 && smoothedRtt > THROTTLER_RTT_FACTOR * minRtt)
+        return;
+    
+    int increase = THROTTLER_ADDITIVE_INCREASE * requestSize / window;
+    window += increase > 0 ? increase : 1;
+    if (window > memSize)
+        window = memSize;
+}
+
+
 void Throttler::clear()
 {
     pthread_mutex_lock(&mutex);
@@ -134,6 +409,7 @@ void Throttler::clear()
     isDestroyed = false;
     occupiedSize = 0;
     outstandingRequests = 0;
-    requests.clear();
+    isMeasuringRtt = false;
+    memset(requests, 0, sizeof(requests));
     pthread_mutex_unlock(&mutex);
 }
@@ -10,10 +10,47 @@
 #define Throttler_hpp
 
 #include <pthread.h>
-#include <unordered_map>
+#include <stdint.h>
+#include "LatencyHistogram.hpp"
+
+
+/**
+ * Priority class of throttled requests
+ */
+enum ThrottlerPriority {
+    ThrottlerPriorityControl = 0, //!< small, latency sensitive requests (e.g. digital output synchronized with SPI)
+    ThrottlerPriorityNormal = 1,  //!< regular I2C and SPI transactions
+    ThrottlerPriorityBulk = 2     //!< large transfers (e.g. display frames)
+};
+
+#define THROTTLER_NUM_PRIORITIES 3
+
+// upper limit for the maximum number of outstanding requests
+#define THROTTLER_MAX_OUTSTANDING 256
+// outstanding requests are tracked in slots at index `requestId % N` (or one of the following slots)
+#define THROTTLER_NUM_SLOTS (2 * THROTTLER_MAX_OUTSTANDING)
+#define THROTTLER_MAX_PROBES 8
+
+// default memory size and maximum number of outstanding requests
+#define THROTTLER_DEFAULT_MEM_SIZE 4200
+#define THROTTLER_DEFAULT_MAX_OUTSTANDING 20
 
 /**
  * Throttles sending messages to the Wirekite such that the memory on the Wirekite is not overlaoded
+ *
+ * In adaptive mode, the number of bytes in flight is limited by a window
+ * instead of the fixed memory size. The window is seeded from the memory
+ * reported by the board. It grows additively while requests complete and
+ * the round-trip time stays close to the minimum observed round-trip time.
+ * It is halved whenever the board reports it has run out of memory.
+ *
+ * Requests are admitted by priority class. Each class can reserve memory
+ * and requests that lower priority classes may not use. Within a class,
+ * requests are admitted in the order they arrived. A request is not
+ * admitted while a request of a higher priority class is waiting.
+ *
+ * A request is always admitted if no other request is outstanding, even
+ * if it is larger than the memory left after the reservations.
  */
 class Throttler {
 public:
@@ -40,17 +77,66 @@ public:
     
     /**
      * Configures the maximum number of outstanding requets.
-     * @param maxReq the number of requests
+     * @param maxReq the number of requests (at most THROTTLER_MAX_OUTSTANDING)
      */
     void configureMaximumOutstanding(int maxReq);
     
     /**
      * Configures the available memory size and the number of outstanding requets.
      * @param memSize memory size (in bytes) available on the microcontroller board for buffering data
-     * @param maxReq the maximum number of requests to be outstanding at any time
+     * @param maxReq the maximum number of requests to be outstanding at any time (at most THROTTLER_MAX_OUTSTANDING)
      */
     void configure(int memSize, int maxReq);
     
+    /**
+     * Enables adaptive flow control.
+     *
+     * The memory size and window are seeded from the values reported by the board.
+     * Calling `configure` or `configureMemorySize` disables adaptive flow control.
+     *
+     * @param memAvail the available memory reported by the board (`WK_CFG_QUERY_MEM_AVAIL`)
+     * @param maxBlock the largest memory block reported by the board (`WK_CFG_QUERY_MEM_MAX_BLOCK`)
+     */
+    void configureAdaptive(int memAvail, int maxBlock);
+    
+    /**
+     * Indicates if adaptive flow control is enabled.
+     * @return `true` if enabled
+     */
+    bool isAdaptive();
+    
+    /**
+     * Gets the current window, i.e. the number of bytes allowed in flight.
+     * @return the window size (in bytes)
+     */
+    int windowSize();
+    
+    /**
+     * Gets the smoothed round-trip time of throttled requests.
+     * @return the round-trip time (in µs), or 0 if not measured yet
+     */
+    int roundTripTime();
+    
+    /**
+     * Configures the memory and the number of requests reserved for a priority class.
+     *
+     * Requests of lower priority classes cannot use the reserved memory and requests.
+     * The reservation of `ThrottlerPriorityBulk` has no effect.
+     * In total, at most half of the memory and requests are reserved.
+     *
+     * @param priority the priority class
+     * @param memSize the reserved memory (in bytes)
+     * @param numRequests the reserved number of requests
+     */
+    void configureReservation(ThrottlerPriority priority, int memSize, int numRequests);
+    
+    /**
+     * Gets the memory size usable by requests of the specified priority class.
+     * @param priority the priority class
+     * @return the memory size (in bytes)
+     */
+    int memorySize(ThrottlerPriority priority);
+    
     /**
      * Waits until the specified amount of memory is available on the Wirekite.
      *
@@ -59,25 +145,91 @@ public:
      *
      * @param requestId the ID of the request
      * @param requiredMemSize the required memory size (in bytes)
+     * @param priority the priority class of the request
      */
-    void waitUntilAvailable(uint16_t requestId, uint16_t requiredMemSize);
+    void waitUntilAvailable(uint16_t requestId, uint16_t requiredMemSize,
+                            ThrottlerPriority priority = ThrottlerPriorityNormal);
     
     /**
      * Decreases the amount of occupied memory by the amount speicified for the request.
      *
      * @param requestId the ID of the request
+     * @param overrun `true` if the board could not execute the request because it ran out of memory
+     */
+    void requestCompleted(uint16_t requestId, bool overrun = false);
+    
+    /**
+     * Gets the number of bytes currently in flight.
+     * @return the number of bytes
+     */
+    int bytesInFlight();
+    
+    /**
+     * Gets the highest number of bytes that have been in flight at the same time.
+     * @return the number of bytes
+     */
+    int peakBytesInFlight();
+    
+    /**
+     * Gets the histogram of the time requests of a priority class have waited for admission.
+     * @param priority the priority class
+     * @return the histogram (in µs)
+     */
+    LatencyHistogram& waitTimes(ThrottlerPriority priority);
+    
+    /**
+     * Gets the histogram of the time from submission to completion of requests of a priority class.
+     * @param priority the priority class
+     * @return the histogram (in µs)
      */
-    void requestCompleted(uint16_t requestId);
+    LatencyHistogram& latencies(ThrottlerPriority priority);
     
     
     void clear();
     
+private:
+    struct Waiter {
+        Waiter* next;
+    };
+    
+    struct PriorityClass {
+        int reservedMemSize;
+        int reservedRequests;
+        Waiter* head; // FIFO of waiting requests
+        Waiter* tail;
+        LatencyHistogram waitTimes;
+        LatencyHistogram latencies;
+    };
+    
+    struct OutstandingRequest {
+        uint16_t requestId;
+        uint8_t priority;
+        int size; // 0 if the slot is free
+        uint32_t startTime; // in µs, truncated
+    };
+    
+    void adaptWindow(int requestSize, bool overrun);
+    bool canAdmit(int priority, int requiredMemSize);
+    void removeWaiter(int priority, Waiter* waiter);
+    int freeSlot(uint16_t requestId);
+    int findSlot(uint16_t requestId);
+    
 private:
     int memSize;
     int occupiedSize;
+    int peakOccupiedSize;
     int maxOutstandingRequests;
     int outstandingRequests;
-    std::unordered_map<uint16_t, uint16_t> requests;
+    OutstandingRequest requests[THROTTLER_NUM_SLOTS];
+    PriorityClass priorities[THROTTLER_NUM_PRIORITIES];
+    bool adaptive;
+    int window;
+    int minWindow;
+    bool isMeasuringRtt;
+    uint16_t rttRequestId;
+    int64_t rttStart;
+    int64_t minRtt;
+    int64_t smoothedRtt;
     pthread_cond_t available;
     pthread_mutex_t mutex;
     bool isDestroyed;
@@ -0,0 +1,215 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <stdlib.h>
+#include <algorithm>
+#include "TransferPool.hpp"
+#include "Throttler.hpp"
+
+
+// the header precedes the buffer and keeps it 16 byte aligned
+#define TRANSFER_POOL_HEADER_SIZE 16
+// memory the throttler accounts for in addition to the request
+#define TRANSFER_POOL_REQUEST_OVERHEAD 8
+
+static const size_t classSizes[TRANSFER_POOL_NUM_CLASSES] = {
+    TRANSFER_POOL_SMALL_SIZE,
+    TRANSFER_POOL_MEDIUM_SIZE,
+    TRANSFER_POOL_BLOCK_SIZE,
+    TRANSFER_POOL_LARGE_SIZE
+};
+
+
+TransferPool::TransferPool()
+{
+    state = new State();
+    pthread_mutex_init(&state->mutex, NULL);
+    state->isDestroyed = false;
+
+    for (int i = 0; i < TRANSFER_POOL_NUM_CLASSES; i++) {
+        state->sizeClasses[i].bufferSize = classSizes[i];
+        state->sizeClasses[i].capacity = 0;
+        state->sizeClasses[i].numAllocated = 0;
+    }
+
+    configure(THROTTLER_DEFAULT_MEM_SIZE, THROTTLER_DEFAULT_MAX_OUTSTANDING);
+}
+
+
+TransferPool::~TransferPool()
+{
+    pthread_mutex_lock(&state->mutex);
+    for (int i = 0; i < TRANSFER_POOL_NUM_CLASSES; i++) {
+        SizeClass& sizeClass = state->sizeClasses[i];
+        for (size_t j = 0; j < sizeClass.freeList.size(); j++)
+            free(sizeClass.freeList[j] - TRANSFER_POOL_HEADER_SIZE);
+        sizeClass.numAllocated -= (int)sizeClass.freeList.size();
+        sizeClass.freeList.clear();
+    }
+    state->isDestroyed = true;
+    bool isUnused = allocatedCount(state) == 0;
+    pthread_mutex_unlock(&state->mutex);
+
+    // otherwise, the last buffer still in use deletes the state
+    if (isUnused) {
+        pthread_mutex_destroy(&state->mutex);
+        delete state;
+    }
+}
+
+
+void TransferPool::configure(int memSize, int maxOutstanding)
+{
+    pthread_mutex_lock(&state->mutex);
+
+    size_t smallerSize = 0;
+    for (int i = 0; i < TRANSFER_POOL_NUM_CLASSES; i++) {
+        SizeClass& sizeClass = state->sizeClasses[i];
+
+        // requests of this class are larger than the buffers of the next smaller class
+        int maxInFlight = memSize / (int)(smallerSize + 1 + TRANSFER_POOL_REQUEST_OVERHEAD);
+        int count = std::min(maxInFlight, maxOutstanding) + TRANSFER_POOL_SPARE_COUNT;
+        if (i == 0)
+            count = std::max(count, TRANSFER_POOL_MIN_SMALL_COUNT);
+
+        if (count > sizeClass.capacity) {
+            sizeClass.capacity = count;
+            // releasing a buffer must not allocate memory
+            sizeClass.freeList.reserve(count);
+        }
+        smallerSize = sizeClass.bufferSize;
+    }
+
+    pthread_mutex_unlock(&state->mutex);
+}
+
+
+uint8_t* TransferPool::acquireBuffer(size_t size)
+{
+    int classIndex = -1;
+    for (int i = 0; i < TRANSFER_POOL_NUM_CLASSES; i++) {
+        if (size <= classSizes[i]) {
+            classIndex = i;
+            break;
+        }
+    }
+    if (classIndex < 0)
+        return allocateBuffer(size);
+
+    uint8_t* buffer = NULL;
+    bool mayAllocate = false;
+
+    SizeClass& sizeClass = state->sizeClasses[classIndex];
+    pthread_mutex_lock(&state->mutex);
+    if (!sizeClass.freeList.empty()) {
+        buffer = sizeClass.freeList.back();
+        sizeClass.freeList.pop_back();
+    } else if (sizeClass.numAllocated < sizeClass.capacity) {
+        sizeClass.numAllocated++;
+        mayAllocate = true;
+    }
+    pthread_mutex_unlock(&state->mutex);
+
+    if (buffer != NULL)
+        return buffer;
+    if (mayAllocate)
+        return allocate(state, classIndex, sizeClass.bufferSize);
+    return allocateBuffer(size);
+}
+
+
+uint8_t* TransferPool::allocateBuffer(size_t size)
+{
+    return allocate(NULL, -1, size);
+}
+
+
+void TransferPool::release(void* buffer)
+{
+    if (buffer == NULL)
+        return;
+
+    BufferHeader* header = headerOf(buffer);
+    if (header->state != NULL)
+        releaseBuffer(header->state, header->sizeClass, (uint8_t*)buffer);
+    else
+        free(header);
+}
+
+
+void TransferPool::releaseBuffer(State* state, int sizeClass, uint8_t* buffer)
+{
+    pthread_mutex_lock(&state->mutex);
+    if (!state->isDestroyed) {
+        state->sizeClasses[sizeClass].freeList.push_back(buffer);
+        pthread_mutex_unlock(&state->mutex);
+        return;
+    }
+
+    // the pool has been destroyed while the buffer was in use
+    free(headerOf(buffer));
+    state->sizeClasses[sizeClass].numAllocated--;
+    bool isUnused = allocatedCount(state) == 0;
+    pthread_mutex_unlock(&state->mutex);
+
+    if (isUnused) {
+        pthread_mutex_destroy(&state->mutex);
+        delete state;
+    }
+}
+
+
+bool TransferPool::contains(const void* buffer)
+{
+    return buffer != NULL && headerOf(buffer)->state == state;
+}
+
+
+int TransferPool::buffersInUse()
+{
+    int result = 0;
+    pthread_mutex_lock(&state->mutex);
+    for (int i = 0; i < TRANSFER_POOL_NUM_CLASSES; i++)
+        result += state->sizeClasses[i].numAllocated - (int)state->sizeClasses[i].freeList.size();
+    pthread_mutex_unlock(&state->mutex);
+    return result;
+}
+
+
+int TransferPool::capacity(int sizeClass)
+{
+    pthread_mutex_lock(&state->mutex);
+    int result = state->sizeClasses[sizeClass].capacity;
+    pthread_mutex_unlock(&state->mutex);
+    return result;
+}
+
+
+int TransferPool::allocatedCount(State* state)
+{
+    int result = 0;
+    for (int i = 0; i < TRANSFER_POOL_NUM_CLASSES; i++)
+        result += state->sizeClasses[i].numAllocated;
+    return result;
+}
+
+
+uint8_t* TransferPool::allocate(State* state, int sizeClass, size_t size)
+{
+    uint8_t* memory = (uint8_t*)malloc(TRANSFER_POOL_HEADER_SIZE + size);
+    BufferHeader* header = (BufferHeader*)memory;
+    header->state = state;
+    header->sizeClass = sizeClass;
+    return memory + TRANSFER_POOL_HEADER_SIZE;
+}
+
+
+TransferPool::BufferHeader* TransferPool::headerOf(const void* buffer)
+{
+    return (BufferHeader*)((uint8_t*)buffer - TRANSFER_POOL_HEADER_SIZE);
+}
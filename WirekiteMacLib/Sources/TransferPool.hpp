@@ -0,0 +1,148 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef TransferPool_hpp
+#define TransferPool_hpp
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+
+/*
+ * Size classes
+ *
+ * The block class fits a request with 1 KB of data (e.g. a chunk of a
+ * display update) without taking a 4 KB buffer.
+ */
+#define TRANSFER_POOL_NUM_CLASSES 4
+#define TRANSFER_POOL_SMALL_SIZE 64
+#define TRANSFER_POOL_MEDIUM_SIZE 512
+#define TRANSFER_POOL_BLOCK_SIZE 1088
+#define TRANSFER_POOL_LARGE_SIZE 4096
+
+// minimum number of small buffers (for messages that are not throttled)
+#define TRANSFER_POOL_MIN_SMALL_COUNT 128
+// buffers per class in addition to the ones the throttler can admit
+#define TRANSFER_POOL_SPARE_COUNT 4
+
+
+/**
+ * Pool of transmit buffers of a device
+ *
+ * Requests are built directly in a buffer from the pool. The buffer is
+ * then handed to the transport, which returns it to the pool once the
+ * USB transfer has completed.
+ *
+ * Buffers are taken from the smallest size class that fits. The number
+ * of buffers per class is derived from the throttler configuration: it is
+ * the number of requests of that class that can be in flight at the same
+ * time (plus a few spare ones). Buffers are allocated on first use and
+ * reused afterwards. If the request is larger than the largest class
+ * or if the class is exhausted, the buffer is allocated with `malloc()`
+ * instead. `release` handles both cases.
+ *
+ * Buffers may outlive the pool: a buffer still in use when the pool is
+ * destroyed (e.g. by a USB transfer that has not completed yet) is freed
+ * when it is released. All methods are thread-safe.
+ */
+class TransferPool {
+public:
+    TransferPool();
+    ~TransferPool();
+
+    /**
+     * Configures the number of buffers from the throttler configuration.
+     *
+     * The pool only grows; buffers that are already allocated are kept.
+     *
+     * @param memSize the memory size of the throttler (in bytes)
+     * @param maxOutstanding the maximum number of outstanding requests of the throttler
+     */
+    void configure(int memSize, int maxOutstanding);
+
+    /**
+     * Acquires a buffer of at least the specified size.
+     * @param size the minimum buffer size (in bytes)
+     * @return the buffer
+     */
+    uint8_t* acquireBuffer(size_t size);
+
+    /**
+     * Allocates a buffer of at least the specified size outside of any pool.
+     *
+     * The buffer must be released with `release`.
+     *
+     * @param size the minimum buffer size (in bytes)
+     * @return the buffer
+     */
+    static uint8_t* allocateBuffer(size_t size);
+
+    /**
+     * Returns the buffer to its pool (or frees it if it is not a pool buffer).
+     * @param buffer the buffer (can be `NULL`)
+     */
+    static void release(void* buffer);
+
+    /**
+     * Indicates if the buffer is part of this pool.
+     * @param buffer the buffer
+     * @return `true` if it is part of the pool
+     */
+    bool contains(const void* buffer);
+
+    /**
+     * Returns the number of pool buffers currently in use.
+     * @return the number of buffers
+     */
+    int buffersInUse();
+
+    /**
+     * Returns the number of buffers of the specified class.
+     * @param sizeClass the index of the size class
+     * @return the number of buffers
+     */
+    int capacity(int sizeClass);
+
+private:
+    struct SizeClass {
+        size_t bufferSize;
+        int capacity;
+        int numAllocated;
+        std::vector<uint8_t*> freeList;
+    };
+
+    /**
+     * Buffers and bookkeeping, shared with the buffers in use.
+     *
+     * The state is deleted when both the pool has been destroyed
+     * and the last buffer has been released.
+     */
+    struct State {
+        SizeClass sizeClasses[TRANSFER_POOL_NUM_CLASSES];
+        pthread_mutex_t mutex;
+        bool isDestroyed;
+    };
+
+    struct BufferHeader {
+        State* state; // `NULL` if the buffer is not part of a pool
+        int sizeClass;
+    };
+
+    static uint8_t* allocate(State* state, int sizeClass, size_t size);
+    static BufferHeader* headerOf(const void* buffer);
+    static void releaseBuffer(State* state, int sizeClass, uint8_t* buffer);
+    static int allocatedCount(State* state);
+
+private:
+    State* state;
+};
+
+
+#endif /* TransferPool_hpp */
@@ -0,0 +1,105 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef Transport_hpp
+#define Transport_hpp
+
+#include <stdint.h>
+#include <stddef.h>
+#include "TransferPool.hpp"
+
+
+/**
+ * Receives the data arriving on a transport
+ */
+class TransportListener {
+public:
+    virtual ~TransportListener() {}
+
+    /**
+     * Called when a chunk of data (usually a USB packet) has been received.
+     *
+     * The method is called on the transport's I/O thread. The data is
+     * only valid for the duration of the call.
+     *
+     * @param data the received data
+     * @param length the length of the data (in bytes)
+     */
+    virtual void onDataReceived(const uint8_t* data, uint32_t length) = 0;
+};
+
+
+/**
+ * Byte transport between the host and the Wirekite board
+ *
+ * The transport neither knows about message boundaries nor about
+ * the meaning of the messages.
+ */
+class Transport {
+public:
+    Transport() : listener(NULL) {}
+    virtual ~Transport() {}
+
+    /**
+     * Sets the listener receiving the incoming data.
+     *
+     * Must be set before the transport is started.
+     * @param l the listener
+     */
+    void setListener(TransportListener* l) { listener = l; }
+
+    /**
+     * Starts the I/O thread and starts receiving data.
+     * @return `true` if successful
+     */
+    virtual bool start() = 0;
+
+    /**
+     * Stops the I/O thread and closes the transport.
+     *
+     * No more data is received after this call returns.
+     */
+    virtual void stop() = 0;
+
+    /**
+     * Indicates if the transport is open.
+     * @return `true` if it is open
+     */
+    virtual bool isOpen() = 0;
+
+    /**
+     * Asynchronously writes the data to the board.
+     *
+     * The data is copied. So the buffer can be reused when the call returns.
+     *
+     * @param bytes the data
+     * @param size the length of the data (in bytes)
+     */
+    virtual void writeBytes(const uint8_t* bytes, uint16_t size) = 0;
+
+    /**
+     * Asynchronously writes the buffer to the board.
+     *
+     * The transport takes ownership of the buffer and returns it
+     * to the `TransferPool` when it is no longer needed.
+     *
+     * @param buffer the buffer acquired from `TransferPool`
+     * @param size the length of the data (in bytes)
+     */
+    virtual void writeBuffer(uint8_t* buffer, uint16_t size)
+    {
+        writeBytes(buffer, size);
+        TransferPool::release(buffer);
+    }
+
+protected:
+    TransportListener* listener;
+};
+
+
+#endif /* Transport_hpp */
@@ -0,0 +1,237 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "USBTransport.hpp"
+
+
+#define EndpointTransmit 2
+#define EndpointReceive  1
+
+// maximum time to wait for aborted transfers to complete when stopping (in ms)
+#define STOP_TIMEOUT 1000
+
+
+static void WriteCompletion(void *refCon, IOReturn result, void *arg0);
+static void ReadCompletion(void *refCon, IOReturn result, void *arg0);
+
+
+USBTransport::USBTransport(IOUSBInterfaceInterface** interface)
+:   interface(interface),
+    runLoopSource(NULL),
+    reactor(IOReactor::shared()),
+    reactorThread(-1),
+    isRunning(false),
+    isReadPending(false),
+    readBuffer(NULL),
+    writeMutex(PTHREAD_MUTEX_INITIALIZER),
+    pendingBuffer(0)
+{
+    pthread_mutex_init(&writeMutex, NULL);
+}
+
+
+USBTransport::~USBTransport()
+{
+    stop();
+    pthread_mutex_destroy(&writeMutex);
+}
+
+
+bool USBTransport::start()
+{
+    IOReturn kr = (*interface)->CreateInterfaceAsyncEventSource(interface, &runLoopSource);
+    if (kr != kIOReturnSuccess) {
+        fprintf(stderr, "Wirekite: Unable to create asynchronous event source (%08x)\n", kr);
+        return false;
+    }
+
+    isRunning = true;
+
+    reactorThread = reactor->attachSource(runLoopSource);
+    if (reactorThread < 0) {
+        isRunning = false;
+        return false;
+    }
+
+    pendingBuffer = 0;
+    submitRead();
+
+    return true;
+}
+
+
+void USBTransport::stop()
+{
+    isRunning = false;
+
+    // Closing the interface aborts the pending transfers. Their completions
+    // are delivered on the reactor thread, so the source must stay attached
+    // until they have arrived.
+    if (interface) {
+        (*interface)->USBInterfaceClose(interface);
+        waitForCompletions();
+    }
+
+    // no more callbacks after the source has been detached
+    if (reactorThread >= 0) {
+        reactor->detachSource(runLoopSource, reactorThread);
+        reactorThread = -1;
+    }
+
+    if (interface) {
+        (*interface)->Release(interface);
+        interface = NULL;
+    }
+
+    if (runLoopSource) {
+        CFRelease(runLoopSource);
+        runLoopSource = NULL;
+    }
+}
+
+
+void USBTransport::waitForCompletions()
+{
+    for (int i = 0; i < STOP_TIMEOUT; i++) {
+        pthread_mutex_lock(&writeMutex);
+        bool isDone = pendingWrites.empty() && !isReadPending.load();
+        pthread_mutex_unlock(&writeMutex);
+        if (isDone)
+            return;
+        usleep(1000);
+    }
+
+    // the transfer pool frees the buffers of late completions even if it has been destroyed
+    fprintf(stderr, "Wirekite: Aborted USB transfers have not completed\n");
+}
+
+
+bool USBTransport::isOpen()
+{
+    return interface != NULL;
+}
+
+
+void USBTransport::submitRead()
+{
+    readBuffer = MessagePool::acquireBuffer();
+    if (readBuffer == NULL) {
+        // pool is exhausted; use local buffer (messages will be copied)
+        readBuffer = rxBuffer[pendingBuffer];
+        pendingBuffer ^= 1;
+    }
+
+    isReadPending = true;
+    IOReturn result = (*interface)->ReadPipeAsync(interface, EndpointReceive, readBuffer,
+                                                  USB_RX_BUFFER_SIZE, ReadCompletion, this);
+    if (result != kIOReturnSuccess) {
+        fprintf(stderr, "Wirekite: Unable to perform asynchronous bulk read (%08x)\n", result);
+        if (MessagePool::contains(readBuffer))
+            MessagePool::release(readBuffer);
+        readBuffer = NULL;
+        isReadPending = false;
+    }
+}
+
+
+void USBTransport::writeBytes(const uint8_t* bytes, uint16_t size)
+{
+    if (interface == NULL)
+        return; // has probably been disconnected
+
+    // data must be copied
+    uint8_t* buffer = TransferPool::allocateBuffer(size);
+    memcpy(buffer, bytes, size);
+    writeBuffer(buffer, size);
+}
+
+
+void USBTransport::writeBuffer(uint8_t* buffer, uint16_t size)
+{
+    if (interface == NULL) {
+        TransferPool::release(buffer);
+        return; // has probably been disconnected
+    }
+
+    // writes on a pipe complete in the order they were submitted
+    pthread_mutex_lock(&writeMutex);
+    IOReturn kr = (*interface)->WritePipeAsync(interface,
+                                               EndpointTransmit,
+                                               buffer,
+                                               size,
+                                               WriteCompletion,
+                                               this);
+    if (kr == kIOReturnSuccess)
+        pendingWrites.push_back(buffer);
+    pthread_mutex_unlock(&writeMutex);
+
+    if (kr) {
+        fprintf(stderr, "Wirekite: Error on submitting write (0x%08x)\n", kr);
+        TransferPool::release(buffer);
+    }
+}
+
+
+void USBTransport::onWriteCompleted(IOReturn result)
+{
+    if (result && isRunning)
+        fprintf(stderr, "Wirekite: Write error (0x%08x)\n", result);
+
+    pthread_mutex_lock(&writeMutex);
+    uint8_t* buffer = pendingWrites.front();
+    pendingWrites.pop_front();
+    pthread_mutex_unlock(&writeMutex);
+
+    TransferPool::release(buffer);
+}
+
+
+void USBTransport::onReadCompleted(IOReturn result, uint32_t receivedBytes)
+{
+    uint8_t* data = readBuffer;
+    bool isPoolBuffer = MessagePool::contains(data);
+
+    readBuffer = NULL;
+
+    if (result || !isRunning) {
+        if (result && isRunning)
+            fprintf(stderr, "Wirekite: Read error (0x%08x)\n", result);
+        if (isPoolBuffer)
+            MessagePool::release(data);
+        isReadPending = false;
+        return;
+    }
+
+    submitRead();
+
+    listener->onDataReceived(data, receivedBytes);
+
+    if (isPoolBuffer)
+        MessagePool::release(data);
+}
+
+
+#pragma mark - Callback helpers
+
+
+void WriteCompletion(void *refCon, IOReturn result, void *arg0)
+{
+    USBTransport* transport = (USBTransport*)refCon;
+    transport->onWriteCompleted(result);
+}
+
+
+void ReadCompletion(void *refCon, IOReturn result, void *arg0)
+{
+    USBTransport* transport = (USBTransport*)refCon;
+    transport->onReadCompleted(result, (uint32_t)(unsigned long)arg0);
+}
@@ -0,0 +1,76 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef USBTransport_hpp
+#define USBTransport_hpp
+
+#include <pthread.h>
+#include <atomic>
+#include <deque>
+#include <IOKit/IOKitLib.h>
+#include <IOKit/usb/IOUSBLib.h>
+#include "Transport.hpp"
+#include "MessagePool.hpp"
+#include "IOReactor.hpp"
+
+
+#define USB_RX_BUFFER_SIZE MESSAGE_POOL_BUFFER_SIZE
+
+
+/**
+ * Transport using the bulk endpoints of the Wirekite USB interface
+ *
+ * The I/O is processed on a thread of the shared I/O reactor. So the
+ * transports of many boards are serviced by a few threads.
+ *
+ * When stopped, the transport closes the interface and waits until the
+ * aborted reads and writes have completed on the reactor thread so their
+ * buffers are returned. It must not be stopped from the reactor thread.
+ */
+class USBTransport : public Transport {
+public:
+    /**
+     * Creates a new instance for the specified USB interface.
+     *
+     * The transport takes ownership of the opened interface and
+     * closes and releases it when it is stopped.
+     *
+     * @param interface the opened USB interface
+     */
+    USBTransport(IOUSBInterfaceInterface** interface);
+    virtual ~USBTransport();
+
+    virtual bool start();
+    virtual void stop();
+    virtual bool isOpen();
+    virtual void writeBytes(const uint8_t* bytes, uint16_t size);
+    virtual void writeBuffer(uint8_t* buffer, uint16_t size);
+
+    void onReadCompleted(IOReturn result, uint32_t receivedBytes);
+    void onWriteCompleted(IOReturn result);
+
+private:
+    void submitRead();
+    void waitForCompletions();
+
+private:
+    IOUSBInterfaceInterface** interface;
+    CFRunLoopSourceRef runLoopSource;
+    IOReactor* reactor;
+    int reactorThread;
+    std::atomic<bool> isRunning; // cleared by stop() on another thread
+    std::atomic<bool> isReadPending;
+    uint8_t* readBuffer;
+    pthread_mutex_t writeMutex;
+    std::deque<uint8_t*> pendingWrites; // buffers of submitted writes in submission order
+    uint8_t rxBuffer[2][USB_RX_BUFFER_SIZE];
+    int pendingBuffer;
+};
+
+
+#endif /* USBTransport_hpp */
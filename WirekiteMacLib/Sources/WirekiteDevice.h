@@ -206,8 +206,80 @@ typedef NS_ENUM(NSInteger, BoardInfo) {
 };
 
 
+/*! @brief Priority class for flow control of requests */
+typedef NS_ENUM(NSInteger, RequestPriority) {
+    /*! @brief Small, latency sensitive requests (digital output synchronized with SPI, I2C bus reset) */
+    RequestPriorityControl = 0,
+    /*! @brief Regular I2C and SPI transactions */
+    RequestPriorityNormal = 1,
+    /*! @brief Large SPI transmissions (e.g. display frames) */
+    RequestPriorityBulk = 2
+};
+
+
+/*! @brief Filter for the samples of an analog input */
+typedef NS_ENUM(NSInteger, AnalogFilter) {
+    /*! @brief Moving average over N samples */
+    AnalogFilterBoxcar = 0,
+    /*! @brief Every N-th sample (reduces the number of samples) */
+    AnalogFilterDecimation = 1,
+    /*! @brief Exponential smoothing with a smoothing factor of 1 / 2^N (N = 1 to 16) */
+    AnalogFilterExponential = 2,
+    /*! @brief Moving median over N samples (N = 1 to 63) */
+    AnalogFilterMedian = 3,
+    /*! @brief Minimum of each block of N samples (reduces the number of samples) */
+    AnalogFilterMinimum = 4,
+    /*! @brief Maximum of each block of N samples (reduces the number of samples) */
+    AnalogFilterMaximum = 5
+};
+
+
+/*! @brief Stage of a filter pipeline for analog samples */
+typedef struct {
+    /*! @brief Filter type */
+    AnalogFilter filter;
+    /*! @brief Window or block size N (shift N for exponential smoothing) */
+    long parameter;
+} AnalogFilterStage;
+
+
+/*! @brief Snapshot of the last value of an input */
+typedef struct {
+    /*! @brief Port ID of the input (to be set by the caller) */
+    PortID port;
+    /*! @brief Last value (0 or 1 for digital inputs, in the range [-1 to 1] for analog inputs) */
+    double value;
+    /*! @brief Number of updates received so far (0 if none or if the port is invalid) */
+    uint32_t sequence;
+    /*! @brief Host time of the last update (in ns, based on mach_absolute_time()) */
+    uint64_t timestamp;
+} InputSnapshot;
+
+
+/*! @brief Register read from an I2C slave (as part of a burst) */
+typedef struct {
+    /*! @brief Slave address (to be set by the caller) */
+    uint16_t slave;
+    /*! @brief Address of the first register to read (to be set by the caller) */
+    uint8_t startRegister;
+    /*! @brief Number of bytes to read (to be set by the caller) */
+    uint16_t length;
+    /*! @brief Buffer receiving the register data (at least `length` bytes, to be provided by the caller) */
+    uint8_t* _Nonnull data;
+    /*! @brief Number of bytes received */
+    uint16_t receivedLength;
+    /*! @brief Result code of the transaction */
+    I2CResult result;
+} I2CRegisterRead;
+
+
 typedef void (^DigitalInputPinCallback)(PortID, BOOL);
 typedef void (^AnalogInputPinCallback)(PortID, double);
+typedef void (^AnalogScanCallback)(PortID, const double* _Nonnull values, NSUInteger numChannels, NSUInteger numFrames);
+typedef void (^AnalogInputBatchCallback)(PortID, const double* _Nonnull values, const uint64_t* _Nonnull timestamps, NSUInteger count);
+typedef void (^I2CCompletion)(PortID, NSData* _Nullable, I2CResult);
+typedef void (^I2CPollCallback)(PortID, NSData* _Nullable data, I2CResult result, NSUInteger sequence);
+typedef void (^SPICompletion)(PortID, NSData* _Nullable, SPIResult);
 
 
 /*! @brief Invalid port ID
@@ -282,6 +354,141 @@ extern long InvalidPortID;
  */
 - (void) configureFlowControlMemSize: (int)memSize maxOutstandingRequest: (int)maxRequests;
 
+/*! @brief Enables adaptive flow control for data intensive ports (I2C and SPI)
+ 
+    @discussion The available memory is queried from the Wirekite board and used as the upper limit
+        for the data in flight. Within that limit, the amount of data in flight grows as long as
+        requests complete quickly and shrinks if the board runs out of memory.
+ 
+    @discussion Call it when no I2C or SPI requests are outstanding, e.g. after the ports have been
+        configured. [WirekiteDevice configureFlowControlMemSize:maxOutstandingRequest:] disables
+        adaptive flow control again.
+ */
+- (void) enableAdaptiveFlowControl;
+
+/*! @brief Reserves flow control capacity for a priority class
+ 
+    @discussion Requests of lower priority cannot use the reserved memory and requests. So
+        bulk transfers cannot fill up the board's memory and delay control requests. By default,
+        256 bytes and 2 requests are reserved for control requests and 512 bytes and 2 requests for
+        normal requests. At most half of the memory and requests can be reserved in total.
+        Reservations for bulk requests have no effect.
+ 
+    @param memSize the reserved memory (in bytes)
+ 
+    @param maxRequests the reserved number of requests
+ 
+    @param priority the priority class
+ */
+- (void) reserveFlowControlMemSize: (int)memSize maxOutstandingRequests: (int)maxRequests forPriority: (RequestPriority)priority;
+
+/*! @brief Returns the latency of requests of a priority class
+ 
+    @discussion The latency is measured from the submission of a request, including the time waiting
+        for flow control, until its completion is received from the board.
+ 
+    @param priority the priority class
+ 
+    @param percentile the percentile (between 0 and 100, e.g. 99 for the 99th percentile)
+ 
+    @return the latency (in µs) that the specified percentage of requests did not exceed, or 0 if no requests have completed
+ */
+- (long) latencyForPriority: (RequestPriority)priority percentile: (double)percentile;
+
+/*! @brief Configures how messages are combined into USB transfers
+ 
+    @discussion Coalescing is off by default: each message is sent immediately in a USB
+        transfer of its own. If a deadline is configured, messages sent without awaiting a
+        response (such as setting a digital output or a PWM value) are held back for up to
+        the deadline and combined with subsequent messages into a single USB transfer.
+        This reduces the number of transfers for bursts of small messages at the cost of
+        added latency. Requests awaiting a response are always sent immediately.
+        The default transfer size is 64 bytes.
+ 
+    @param transferSize the maximum size of a USB transfer (in bytes, 64 to 512)
+ 
+    @param deadline the maximum time a message is held back (in µs, or 0 to send each message immediately)
+ */
+- (void) configureWriteCoalescingTransferSize: (long)transferSize deadline: (long)deadline;
+
+/*! @brief Immediately sends all messages held back for combining them into a single USB transfer.
+ */
+- (void) flush;
+
+/*! @brief Average number of messages per USB transfer
+ 
+    @return the number of messages
+ */
+- (double) messagesPerTransfer;
+
+/*! @brief Returns a report of the performance metrics
+ 
+    @discussion The report contains the time requests waited for flow control (per priority class),
+        the bytes in flight, the number of events dropped because a port's queue was full and,
+        per port, the number of events and the round-trip time of requests (per action).
+        Times are in µs and given as 50th, 90th, 99th and 99.9th percentile and maximum.
+ 
+    @return the report as multi-line text
+ */
+- (NSString* _Nonnull) metricsReport;
+
+/*! @brief Returns the performance metrics as JSON
+ 
+    @discussion Contains the same metrics as [WirekiteDevice metricsReport] plus the 99.9th
+        percentile in a machine-readable format, e.g. for tracking performance regressions.
+ 
+    @return the metrics as a JSON object
+ */
+- (NSString* _Nonnull) metricsReportAsJSON;
+
+/*! @brief Starts capturing the communication with the device to a file.
+ 
+    @discussion All messages sent to the device and all data received from the device are
+        appended with a timestamp to a memory-mapped binary file. Capturing has a low overhead
+        and can be left on in production. If the maximum size is reached, further data is dropped.
+        The capture can be replayed offline with the C++ class MessageReplay.
+ 
+    @param path the path of the capture file (an existing file is overwritten)
+ 
+    @param maxSize the maximum file size (in bytes)
+ 
+    @return YES if the capture has been started
+ */
+- (BOOL) startCaptureToFile: (NSString* _Nonnull)path maxSize: (long)maxSize;
+
+/*! @brief Stops capturing the communication and closes the capture file.
+ */
+- (void) stopCapture;
+
+/*! @brief Logs the messages sent to and received from the device.
+ 
+    @discussion Each message is formatted as text and written to the system log. Meant for
+        debugging as it slows down the communication. Disabled by default.
+ */
+@property BOOL logsMessages;
+
+/*! @brief Starts recording the samples of analog inputs to a file.
+ 
+    @discussion The samples of the specified ports are written to a memory-mapped file as
+        they are received, together with their timestamps (host time in ns). Each port is
+        recorded in chunks of contiguous values and timestamps. The memory use is constant
+        regardless of the recording duration. Only analog inputs configured for sampling
+        are recorded. The recording can be read with the C++ class SampleReader.
+ 
+    @param ports array of port IDs of analog inputs
+ 
+    @param count number of ports (1 to 16)
+ 
+    @param path the path of the recording file (an existing file is overwritten)
+ 
+    @return YES if the recording has been started
+ */
+- (BOOL) startRecordingPorts: (const PortID* _Nonnull)ports count: (NSUInteger)count toFile: (NSString* _Nonnull)path;
+
+/*! @brief Stops recording the samples and closes the recording file.
+ */
+- (void) stopRecording;
+
 /*! @brief Indicates if the device has been closed (or disconnected).
  */
 -(bool)isClosed;
@@ -458,6 +665,143 @@ extern long InvalidPortID;
  */
 - (PortID) configureAnalogInputPin: (AnalogPin)pin interval:(long)interval dispatchQueue: (dispatch_queue_t _Nonnull)dispatchQueue notification: (AnalogInputPinCallback _Nullable)notifyBlock;
 
+/*! @brief Configures a pin as an analog input pin with automatic sampling and change detection.
+ 
+    @discussion The analog value is sampled automatically at the specified interval. The device only
+        sends a sample to the host if it differs from the last sent sample by at least the deadband
+        and the minimum report interval has elapsed. If the value does not change significantly,
+        a sample is still sent after the maximum report interval. This considerably reduces
+        the number of notifications for slowly varying signals.
+        The notification block is dispatched to the specified queue.
+ 
+    @discussion The report intervals are rounded to a multiple of the sampling interval and
+        limited to 255 sampling intervals.
+ 
+    @param pin the analog pin
+ 
+    @param interval interval between two samples (in ms)
+ 
+    @param deadband the minimum change of the value to report a sample (in the range [0 to 2])
+ 
+    @param minReportInterval the minimum time between two reported samples (in ms, or 0 for no limit)
+ 
+    @param maxReportInterval the maximum time between two reported samples (in ms, or 0 for no limit)
+ 
+    @param dispatchQueue the dispatch queue for the notification block
+ 
+    @param notifyBlock the notification block to be called for each reported sample
+ 
+    @return the port ID
+ */
+- (PortID) configureAnalogInputPin: (AnalogPin)pin interval:(long)interval deadband:(double)deadband minReportInterval:(long)minReportInterval maxReportInterval:(long)maxReportInterval dispatchQueue: (dispatch_queue_t _Nonnull)dispatchQueue notification: (AnalogInputPinCallback _Nullable)notifyBlock;
+
+/*! @brief Configures a pin as an analog input pin with automatic sampling and filtering.
+ 
+    @discussion The analog value is sampled automatically at the specified interval. The samples
+        pass through a pipeline of filters on the receiving thread before the notification block
+        is dispatched. The filters are applied in the specified order and use fixed-point arithmetic.
+        Decimation, minimum and maximum reduce the number of samples; the notification block is then
+        called less often. The notification block is dispatched to the specified queue.
+ 
+    @param pin the analog pin
+ 
+    @param interval interval between two samples (in ms)
+ 
+    @param filters array of filter stages
+ 
+    @param count the number of filter stages (at most 8)
+ 
+    @param dispatchQueue the dispatch queue for the notification block
+ 
+    @param notifyBlock the notification block to be called for each filtered sample
+ 
+    @return the port ID
+ */
+- (PortID) configureAnalogInputPin: (AnalogPin)pin interval:(long)interval filters:(const AnalogFilterStage* _Nullable)filters count:(NSUInteger)count dispatchQueue: (dispatch_queue_t _Nonnull)dispatchQueue notification: (AnalogInputPinCallback _Nullable)notifyBlock;
+
+/*! @brief Configures a pin as an analog input pin with automatic sampling and batched delivery.
+ 
+    @discussion The analog value is sampled automatically at the specified interval. The samples
+        are collected on the host and delivered in blocks, thus calling the notification block
+        far less often than once per sample. A block is delivered when it is complete or when the
+        oldest sample has waited for the maximum delay, even if no further samples arrive.
+        The notification block is dispatched to the specified queue.
+ 
+    @discussion The values and timestamps passed to the notification block are only valid during the
+        call. The timestamps indicate when the samples were received by the host. They are in
+        nanoseconds based on mach_absolute_time().
+ 
+    @param pin the analog pin
+ 
+    @param interval interval between two samples (in ms)
+ 
+    @param blockSize the maximum number of samples per call of the notification block
+ 
+    @param maxDelay the maximum time a sample is held back (in ms, or 0 for no limit)
+ 
+    @param dispatchQueue the dispatch queue for the notification block
+ 
+    @param notifyBlock the notification block to be called for each block of samples
+ 
+    @return the port ID
+ */
+- (PortID) configureAnalogInputPin: (AnalogPin)pin interval:(long)interval blockSize:(long)blockSize maxDelay:(long)maxDelay dispatchQueue: (dispatch_queue_t _Nonnull)dispatchQueue notification: (AnalogInputBatchCallback _Nonnull)notifyBlock;
+
+/*! @brief Configures a pin as an analog input pin with automatic sampling, filtering and batched delivery.
+ 
+    @discussion Same as [WirekiteDevice configureAnalogInputPin:interval:blockSize:maxDelay:dispatchQueue:notification:]
+        except that the samples pass through a pipeline of filters on the receiving thread before they are
+        added to a block. The filters are applied in the specified order and use fixed-point arithmetic.
+        Decimation, minimum and maximum reduce the number of samples; the notification block then receives
+        fewer values. A reduced value has the timestamp of the last sample it covers.
+ 
+    @param pin the analog pin
+ 
+    @param interval interval between two samples (in ms)
+ 
+    @param filters array of filter stages
+ 
+    @param count the number of filter stages (at most 8)
+ 
+    @param blockSize the maximum number of filtered samples per call of the notification block
+ 
+    @param maxDelay the maximum time a sample is held back (in ms, or 0 for no limit)
+ 
+    @param dispatchQueue the dispatch queue for the notification block
+ 
+    @param notifyBlock the notification block to be called for each block of filtered samples
+ 
+    @return the port ID
+ */
+- (PortID) configureAnalogInputPin: (AnalogPin)pin interval:(long)interval filters:(const AnalogFilterStage* _Nullable)filters count:(NSUInteger)count blockSize:(long)blockSize maxDelay:(long)maxDelay dispatchQueue: (dispatch_queue_t _Nonnull)dispatchQueue notification: (AnalogInputBatchCallback _Nonnull)notifyBlock;
+
+/*! @brief Configures a group of analog input pins that are sampled together at a specified interval.
+ 
+    @discussion All pins of the group are sampled at the same time. The samples are sent to the host
+        as frames consisting of one value per pin. Frames that are ready at the same time are
+        combined into a single message and a single call of the notification block.
+        The notification block is dispatched to the specified queue.
+ 
+    @discussion The values passed to the notification block are interleaved: all values of the first frame
+        (in the order of the specified pins), then all values of the second frame etc. They are
+        only valid during the call.
+ 
+    @discussion The port is released with [WirekiteDevice releaseAnalogPinOnPort:].
+ 
+    @param pins array of analog pins (at most 32 different pins)
+ 
+    @param count the number of pins
+ 
+    @param interval interval between two frames (in ms)
+ 
+    @param dispatchQueue the dispatch queue for the notification block
+ 
+    @param notifyBlock the notification block to be called for the frames
+ 
+    @return the port ID
+ */
+- (PortID) configureAnalogScanOnPins: (const AnalogPin* _Nonnull)pins count:(NSUInteger)count interval:(long)interval dispatchQueue: (dispatch_queue_t _Nonnull)dispatchQueue notification: (AnalogScanCallback _Nonnull)notifyBlock;
+
 /*! @brief Releases the analog input or output pin
  
     @param port the port ID of the pin
@@ -468,6 +812,7 @@ extern long InvalidPortID;
  
     @discussion Read an analog values takes some time. It requires a communication between
         the host and the device and the digital-to-analog conversion also takes noticeable time.
+        For inputs with automatic sampling, the last sample is returned immediately instead.
  
     @param port the port ID of the pin
  
@@ -475,6 +820,20 @@ extern long InvalidPortID;
  */
 - (double) readAnalogPinOnPort: (PortID)port;
 
+/*! @brief Reads the last values of several inputs without communicating with the device.
+ 
+    @discussion Supports digital inputs with communication mode @[InputCommunicationPrecached] or with
+        notifications and analog inputs with automatic sampling. Each value is read together with
+        its update count and timestamp as a consistent snapshot, without locking. By comparing the
+        update count with the one of the previous call, missed updates can be detected.
+        Snapshots of other and invalid ports have a sequence number of 0.
+ 
+    @param snapshots array of snapshots (the port ID must be set by the caller, the remaining fields are filled in)
+ 
+    @param count the number of snapshots
+ */
+- (void) readInputSnapshots: (InputSnapshot* _Nonnull)snapshots count: (NSUInteger)count;
+
 
 /*!
  @name Working with PWM output
@@ -652,6 +1011,140 @@ extern long InvalidPortID;
  */
 - (NSData* _Nullable) sendAndRequestOnI2CPort: (PortID)port data: (NSData* _Nonnull)data toSlave: (long)slave receiveLength: (long)receiveLength;
 
+/*! @brief Send data to an I2C slave without blocking
+ 
+    @discussion The operation performs a complete I2C transaction, starting with a START condition
+        and ending with a STOP condition.
+ 
+    @discussion The request is executed asychnronously, i.e. the call returns as soon as the
+        request has been sent. Once the transaction has completed or failed, the completion block
+        is dispatched to the specified queue. Several transactions can be in flight at the same time.
+        The call only blocks if the Wirekite cannot buffer any more requests.
+ 
+    @discussion The result code is passed to the completion block. [WirekiteDevice lastI2CResult:]
+        is not affected. The data passed to the completion block is always `nil`.
+ 
+    @param port the I2C port ID
+ 
+    @param data the data to transmit
+ 
+    @param slave the slave address
+ 
+    @param dispatchQueue the queue for dispatching the completion block (`nil` for the main queue)
+ 
+    @param completion the block called when the transaction has completed
+ */
+- (void) sendOnI2CPort: (PortID)port data: (NSData* _Nonnull)data toSlave: (long)slave dispatchQueue: (dispatch_queue_t _Nullable)dispatchQueue completion: (I2CCompletion _Nullable)completion;
+
+/*! @brief Request data from an I2C slave without blocking
+ 
+    @discussion The operation performs a complete I2C transaction, starting with a START condition
+        and ending with a STOP condition.
+ 
+    @discussion The request is executed asychnronously, i.e. the call returns as soon as the
+        request has been sent. Once the transaction has completed or failed, the completion block
+        is dispatched to the specified queue with the received data (or `nil`) and the result code.
+        Several transactions can be in flight at the same time.
+ 
+    @param port the I2C port ID
+ 
+    @param slave the slave address
+ 
+    @param length the number of bytes of data requested from the slave
+ 
+    @param dispatchQueue the queue for dispatching the completion block (`nil` for the main queue)
+ 
+    @param completion the block called when the transaction has completed
+ */
+- (void) requestDataOnI2CPort: (PortID)port fromSlave: (long)slave length: (long)length dispatchQueue: (dispatch_queue_t _Nullable)dispatchQueue completion: (I2CCompletion _Nonnull)completion;
+
+/*! @brief Send data to and request data from an I2C slave in a single operation without blocking
+ 
+    @discussion The operation performs a complete I2C transaction, starting with a START condition,
+        a RESTART condition when switching from transmission to receipt, and ending with
+        a STOP condition.
+ 
+    @discussion The request is executed asychnronously, i.e. the call returns as soon as the
+        request has been sent. Once the transaction has completed or failed, the completion block
+        is dispatched to the specified queue with the received data (or `nil`) and the result code.
+        Several transactions can be in flight at the same time.
+ 
+    @param port the I2C port ID
+ 
+    @param data the data to transmit
+ 
+    @param slave the slave address
+ 
+    @param receiveLength the number of bytes of data request from the slave
+ 
+    @param dispatchQueue the queue for dispatching the completion block (`nil` for the main queue)
+ 
+    @param completion the block called when the transaction has completed
+ */
+- (void) sendAndRequestOnI2CPort: (PortID)port data: (NSData* _Nonnull)data toSlave: (long)slave receiveLength: (long)receiveLength dispatchQueue: (dispatch_queue_t _Nullable)dispatchQueue completion: (I2CCompletion _Nonnull)completion;
+
+/*! @brief Reads several register blocks from I2C slaves in a single burst
+ 
+    @discussion Each read is a complete I2C transaction transmitting the start register
+        and receiving the register data. All transactions are sent to the device back-to-back
+        without waiting for the responses in between. So reading several sensors or register
+        blocks costs about a single USB round-trip instead of one per read.
+ 
+    @discussion The call blocks until all transactions have completed or failed. If the
+        Wirekite cannot buffer all requests, they are sent as soon as memory becomes available.
+        Bursts of more than 256 reads are sent in consecutive windows of 256 reads.
+        The result code of each transaction is stored in the read's `result` field.
+        [WirekiteDevice lastI2CResult:] returns the result code of the last read.
+ 
+    @param port the I2C port ID
+ 
+    @param reads array of reads (slave, start register, length and data buffer must be set by the caller)
+ 
+    @param count the number of reads
+ 
+    @return `YES` if all reads have received the requested number of bytes, `NO` otherwise
+ */
+- (BOOL) readRegistersOnI2CPort: (PortID)port reads: (I2CRegisterRead* _Nonnull)reads count: (NSUInteger)count;
+
+/*! @brief Starts polling an I2C slave periodically
+ 
+    @discussion The device repeats the transaction at the specified interval by itself: it transmits
+        the data (typically the start register), receives the specified number of bytes and sends
+        them to the host. So polling a sensor no longer requires a USB round-trip per read.
+ 
+    @discussion The notification block is dispatched to the specified queue with the received
+        data and the result code of each poll. The sequence number increases by 1 with each
+        poll and starts at 0; gaps indicate lost polls.
+ 
+    @discussion A port can have a single active poll. Starting a new one replaces the previous one.
+ 
+    @param port the I2C port ID
+ 
+    @param data the data to transmit at the start of each transaction
+ 
+    @param slave the slave address
+ 
+    @param receiveLength the number of bytes of data requested from the slave (1 to 255)
+ 
+    @param interval the interval between two polls (in µs)
+ 
+    @param dispatchQueue the queue for dispatching the notification block (`nil` for the main queue)
+ 
+    @param notifyBlock the block called with the result of each poll
+ 
+    @return `YES` if polling has been started, `NO` otherwise
+ */
+- (BOOL) startPollingOnI2CPort: (PortID)port data: (NSData* _Nonnull)data toSlave: (long)slave receiveLength: (long)receiveLength interval: (long)interval dispatchQueue: (dispatch_queue_t _Nullable)dispatchQueue notification: (I2CPollCallback _Nonnull)notifyBlock;
+
+/*! @brief Stops polling an I2C slave
+ 
+    @discussion Once the call returns, the notification block will not be called for further polls.
+        Notifications already dispatched might still be pending.
+ 
+    @param port the I2C port ID
+ */
+- (void) stopPollingOnI2CPort: (PortID)port;
+
 /*! @brief Result code of the last send or receive
  
     @param port the I2C port ID
@@ -803,6 +1296,124 @@ extern long InvalidPortID;
  */
 - (NSData* _Nullable) transmitAndRequestOnSPIPort: (PortID)port data:(NSData* _Nonnull)data chipSelect:(PortID)chipSelect;
 
+/*! @brief Transmit data to a SPI slave without blocking
+ 
+    @discussion The operation performs a complete SPI transaction, i.e. enables the clock for the duration of
+        transation and transmits the data. Optionally, a digital output can be used as the chip select (CS),
+        which is then held low for the duration of the transaction and set to high at the end of the transaction.
+ 
+    @discussion The request is executed asychnronously, i.e. the call returns as soon as the
+        request has been sent. Once the transaction has completed or failed, the completion block
+        is dispatched to the specified queue. Several transactions can be in flight at the same time.
+        The call only blocks if the Wirekite cannot buffer any more requests.
+ 
+    @discussion The result code is passed to the completion block. [WirekiteDevice lastSPIResult:]
+        is not affected. The data passed to the completion block is always `nil`.
+ 
+    @param port the SPI port ID
+ 
+    @param data the data to transmit
+ 
+    @param chipSelect the digital output port ID to use as chip select (or `InvalidPortID` if not used)
+ 
+    @param dispatchQueue the queue for dispatching the completion block (`nil` for the main queue)
+ 
+    @param completion the block called when the transaction has completed
+ */
+-(void) transmitOnSPIPort:(PortID)port data:(NSData* _Nonnull)data chipSelect:(PortID)chipSelect dispatchQueue: (dispatch_queue_t _Nullable)dispatchQueue completion: (SPICompletion _Nullable)completion;
+
+/*! @brief Request data from an SPI slave without blocking
+ 
+    @discussion The operation performs a complete SPI transaction, i.e. enables the clock for the duration of
+        transation and receives the data.
+ 
+    @discussion The request is executed asychnronously, i.e. the call returns as soon as the
+        request has been sent. Once the transaction has completed or failed, the completion block
+        is dispatched to the specified queue with the received data (or `nil`) and the result code.
+        Several transactions can be in flight at the same time.
+ 
+    @param port the SPI port ID
+ 
+    @param chipSelect the digital output port ID to use as chip select (or `InvalidPortID` if not used)
+ 
+    @param length the number of bytes of data requested from the slave
+ 
+    @param mosiValue byte value sent on MOSI signal during reading
+ 
+    @param dispatchQueue the queue for dispatching the completion block (`nil` for the main queue)
+ 
+    @param completion the block called when the transaction has completed
+ */
+- (void) requestOnSPIPort: (PortID)port chipSelect:(PortID)chipSelect length: (long)length mosiValue:(long)mosiValue dispatchQueue: (dispatch_queue_t _Nullable)dispatchQueue completion: (SPICompletion _Nonnull)completion;
+
+/*! @brief Transmit and request data from an SPI slave without blocking
+ 
+    @discussion The operations is performed in a full-duplex fashion, i.e. the data is transmitted and received at
+        the same time. For that reason, the number of received bytes equals the number of transmitted bytes.
+ 
+    @discussion The request is executed asychnronously, i.e. the call returns as soon as the
+        request has been sent. Once the transaction has completed or failed, the completion block
+        is dispatched to the specified queue with the received data (or `nil`) and the result code.
+        Several transactions can be in flight at the same time.
+ 
+    @param port the SPI port ID
+ 
+    @param data the data to transmit
+ 
+    @param chipSelect the digital output port ID to use as chip select (or `InvalidPortID` if not used)
+ 
+    @param dispatchQueue the queue for dispatching the completion block (`nil` for the main queue)
+ 
+    @param completion the block called when the transaction has completed
+ */
+- (void) transmitAndRequestOnSPIPort: (PortID)port data:(NSData* _Nonnull)data chipSelect:(PortID)chipSelect dispatchQueue: (dispatch_queue_t _Nullable)dispatchQueue completion: (SPICompletion _Nonnull)completion;
+
+/*! @brief Transmits a large amount of data to an SPI slave
+ 
+    @discussion The data is split into several SPI transactions, each small enough that
+        several of them fit into the memory of the Wirekite board at the same time. The
+        transactions are sent back-to-back so the SPI bus is kept busy. Use it to transmit
+        entire frames to a display.
+ 
+    @discussion The call blocks until all data has been handed to the USB transport. So
+        the buffer can be reused as soon as the call returns. Once all transactions have
+        completed, the completion block is dispatched once to the specified queue. It receives
+        the first error of any transaction, or `SPIResultOK`.
+ 
+    @discussion If a chip select is specified, it is released between the transactions.
+ 
+    @param port the SPI port ID
+ 
+    @param bytes the data to transmit
+ 
+    @param length the length of the data (in bytes)
+ 
+    @param chipSelect the digital output port ID to use as chip select (or `InvalidPortID` if not used)
+ 
+    @param dispatchQueue the queue for dispatching the completion block (`nil` for the main queue)
+ 
+    @param completion the block called when all data has been transmitted
+ */
+- (void) transmitOnSPIPort: (PortID)port bytes:(const void* _Nonnull)bytes length:(long)length chipSelect:(PortID)chipSelect dispatchQueue: (dispatch_queue_t _Nullable)dispatchQueue completion: (SPICompletion _Nullable)completion;
+
+/*! @brief Transmits a list of data buffers to an SPI slave as a single stream
+ 
+    @discussion The buffers are concatenated and transmitted like
+        [WirekiteDevice transmitOnSPIPort:bytes:length:chipSelect:dispatchQueue:completion:].
+        The buffers are not copied into a single buffer first.
+ 
+    @param port the SPI port ID
+ 
+    @param dataArray the data buffers to transmit
+ 
+    @param chipSelect the digital output port ID to use as chip select (or `InvalidPortID` if not used)
+ 
+    @param dispatchQueue the queue for dispatching the completion block (`nil` for the main queue)
+ 
+    @param completion the block called when all data has been transmitted
+ */
+- (void) transmitOnSPIPort: (PortID)port dataArray:(NSArray<NSData*>* _Nonnull)dataArray chipSelect:(PortID)chipSelect dispatchQueue: (dispatch_queue_t _Nullable)dispatchQueue completion: (SPICompletion _Nullable)completion;
+
 /*! @brief Result code of the last transmission or receipt
  
     @param port the SPI port ID
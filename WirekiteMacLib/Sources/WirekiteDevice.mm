@@ -14,23 +14,56 @@
 #import "PortList.hpp"
 #import "Throttler.hpp"
 #import "MessageDump.hpp"
+#import "MessageCapture.hpp"
+#import "Metrics.hpp"
+#import "SampleFilter.hpp"
+#import "SampleRecorder.hpp"
+#import "MessageParser.hpp"
+#import "EventExecutor.hpp"
+#import "IOReactor.hpp"
+#import "MessagePool.hpp"
+#import "Transport.hpp"
+#import "USBTransport.hpp"
+#import "WriteCoalescer.hpp"
+#import "TransferPool.hpp"
+#import "SampleBuffer.hpp"
 
 #import <IOKit/IOKitLib.h>
 #import <IOKit/IOMessage.h>
 #import <IOKit/IOCFPlugIn.h>
 #import <IOKit/usb/IOUSBLib.h>
+#import <mach/mach_time.h>
 
+#include <vector>
 
 
-#define EndpointTransmit 2
-#define EndpointReceive  1
-
-#define RX_BUFFER_SIZE 512
-
 
 static void DeviceNotification(void *refCon, io_service_t service, natural_t messageType, void *messageArgument);
-static void WriteCompletion(void *refCon, IOReturn result, void *arg0);
-static void ReadCompletion(void *refCon, IOReturn result, void *arg0);
+static void AsyncPortRequestCompleted(void* context, wk_msg_header* response);
+static void SPIStreamChunkCompleted(void* context, wk_msg_header* response);
+static void ReleaseObject(void* object);
+static void AddPortMetrics(Port* port, void* context);
+static uint64_t HostTimeNanos();
+static uint8_t ReportIntervals(long reportInterval, long interval);
+static bool CreateFilter(const AnalogFilterStage* filters, NSUInteger count, SampleFilter** filter);
+
+// number of SPI stream messages that fit into the throttler's memory at the same time
+#define SPI_STREAM_CHUNKS_IN_FLIGHT 3
+// SPI transmissions of at least this size (in bytes) are throttled as bulk requests
+#define SPI_BULK_TX_SIZE 256
+// maximum number of I2C register reads in flight per burst (half the capacity of the pending request list)
+#define I2C_REGISTER_READ_WINDOW (PENDING_REQUEST_NUM_SLOTS / 2)
+// size of the text of a logged message (longer messages are truncated)
+#define MESSAGE_LOG_SIZE 1024
+
+
+/*
+ * Contiguous piece of data to be transmitted
+ */
+struct DataSegment {
+    const uint8_t* bytes;
+    size_t length;
+};
 
 long InvalidPortID = 0xffff;
 
@@ -41,37 +74,154 @@ enum DeviceStatus {
     StatusClosed
 };
 
-typedef struct {
-    WirekiteDevice* device;
-    void* buffer;
-} Transfer;
+
+/*
+ * Connects the transport and the message parser to the device
+ */
+class DeviceListener : public TransportListener, public MessageHandler {
+public:
+    DeviceListener() : device(nil) {}
+    virtual void onDataReceived(const uint8_t* data, uint32_t length);
+    virtual void handleMessage(wk_msg_header* msg);
+    
+    __unsafe_unretained WirekiteDevice* device;
+};
+
+
+/*
+ * Handles the port events on the threads of the event executor
+ */
+class PortEventListener : public MessageHandler {
+public:
+    PortEventListener() : device(nil) {}
+    virtual void handleMessage(wk_msg_header* msg);
+    virtual void handleBatchEnd(uint16_t portId);
+    
+    __unsafe_unretained WirekiteDevice* device;
+};
+
+
+/*
+ * I2C or SPI request whose completion block is called when the response arrives
+ */
+@interface AsyncPortRequest : NSObject
+
+@property PortID port;
+@property BOOL isSPI;
+@property (strong) dispatch_queue_t dispatchQueue;
+@property (copy) id completion;
+
+- (void) completeWithData: (NSData*)data result: (NSInteger)result;
+
+@end
+
+
+/*
+ * SPI transmission split into several messages with a single completion block
+ */
+@interface AsyncSPIStream : AsyncPortRequest
+{
+@public
+    std::atomic<int> remainingChunks;
+    std::atomic<int> firstError;
+}
+
+- (void) chunkCompletedWithResult: (NSInteger)result;
+
+@end
+
+
+/*
+ * Samples of an analog input port delivered in blocks
+ */
+@interface AnalogSampleBatch : NSObject
+{
+@public
+    SampleBuffer* sampleBuffer;
+}
+
+- (instancetype) initWithPort: (PortID)port blockSize: (int)blockSize maxDelay: (uint64_t)maxDelay dispatchQueue: (dispatch_queue_t)dispatchQueue completion: (AnalogInputBatchCallback)completion;
+- (void) addSample: (int32_t)value timestamp: (uint64_t)timestamp;
+
+@end
+
+
+/*
+ * Periodic I2C transaction executed by the device
+ */
+@interface I2CPoll : NSObject
+
+@property PortID port;
+@property (strong) dispatch_queue_t dispatchQueue;
+@property (copy) I2CPollCallback completion;
+
+- (void) handleEvent: (wk_port_event*)event;
+
+@end
+
+
+/*
+ * Group of analog pins sampled together
+ */
+@interface AnalogScanGroup : NSObject
+
+- (instancetype) initWithPort: (PortID)port channelOrder: (const int*)channelOrder numChannels: (int)numChannels dispatchQueue: (dispatch_queue_t)dispatchQueue completion: (AnalogScanCallback)completion;
+- (void) handleEvent: (wk_port_event*)event;
+
+@end
+
+
+/*
+ * Notification block of an input pin and the queue it is dispatched to
+ */
+@interface InputPinCallback : NSObject
+
+@property (readonly, copy) id block;
+@property (readonly, strong) dispatch_queue_t dispatchQueue;
+
+- (instancetype) initWithBlock: (id)block dispatchQueue: (dispatch_queue_t)dispatchQueue;
+
+@end
 
 
 @interface WirekiteDevice ()
 {
     io_object_t notification;
     IOUSBDeviceInterface** device;
-    IOUSBInterfaceInterface** interface;
-    uint8_t rxBuffer[2][RX_BUFFER_SIZE];
-    int pendingBuffer;
-    wk_msg_header* partialMessage;
-    UInt32 partialMessageSize;
-    UInt32 partialSize;
+    Transport* transport;
+    DeviceListener listener;
+    MessageParser parser;
+    PortEventListener portEventListener;
+    EventExecutor* eventExecutor;
+    TransferPool transferPool;
+    WriteCoalescer writeCoalescer;
+    MessageCapture capture;
+    SampleRecorder recorder;
+    RequestTimer requestTimer;
     
     DeviceStatus deviceStatus;
 
     PendingRequestList pendingRequests;
     PortList portList;
     Throttler throttler;
-    NSThread* workerThread;
     
-    NSMutableDictionary<NSNumber*, DigitalInputPinCallback>* digitalInputPinCallbacks;
-    NSMutableDictionary<NSNumber*, dispatch_queue_t>* digitalInputDispatchQueues;
-    NSMutableDictionary<NSNumber*, AnalogInputPinCallback>* analogInputPinCallbacks;
-    NSMutableDictionary<NSNumber*, dispatch_queue_t>* analogInputDispatchQueues;
+    pthread_mutex_t callbackMutex; // serializes updates of the input pin callbacks
 }
 
+// Immutable snapshots indexed by port ID. They are replaced on the user's threads
+// and read on the event executor's threads without locking.
+@property (atomic, copy) NSDictionary<NSNumber*, InputPinCallback*>* digitalInputCallbacks;
+@property (atomic, copy) NSDictionary<NSNumber*, InputPinCallback*>* analogInputCallbacks;
+
 - (void) writeMessage:(wk_msg_header*)msg;
+- (void) writeMessageBuffer:(wk_msg_header*)msg;
+- (void) logMessage:(wk_msg_header*)msg;
+- (void) trackRequest:(wk_msg_header*)msg;
+- (void) onDataReceived: (const uint8_t*)data length: (uint32_t)length;
+- (void) handleMessage: (wk_msg_header*)msg;
+- (void) handlePortEvent: (wk_port_event*)event;
+- (void) completePortEvents: (PortID)portId;
+- (void) setInputCallback: (InputPinCallback*)callback forPort: (PortID)port isAnalog: (BOOL)isAnalog;
 
 @end
 
@@ -88,8 +238,10 @@ typedef struct {
         _wirekiteService = nil;
         notification = NULL;
         device = NULL;
-        interface = NULL;
+        transport = NULL;
+        eventExecutor = EventExecutor::shared();
         deviceStatus = StatusInitializing;
+        pthread_mutex_init(&callbackMutex, NULL);
     }
     
     return self;
@@ -103,18 +255,19 @@ typedef struct {
     [self close];
 
     _wirekiteService = nil;
+    pthread_mutex_destroy(&callbackMutex);
 }
 
 
 - (void) close
 {
-    [self stopWorkerThread];
-    
-    if (interface) {
-        (*interface)->USBInterfaceClose(interface);
-        (*interface)->Release(interface);
-        interface = NULL;
+    writeCoalescer.stop();
+    if (transport) {
+        transport->stop();
+        delete transport;
+        transport = NULL;
     }
+    eventExecutor->remove(&portEventListener);
     if (device) {
         (*device)->USBDeviceClose(device);
         (*device)->Release(device);
@@ -124,15 +277,18 @@ typedef struct {
     IOObjectRelease(notification);
     notification = NULL;
     
+    parser.reset();
     portList.clear();
     throttler.clear();
     pendingRequests.clear();
+    capture.close();
+    recorder.close();
     deviceStatus = StatusClosed;
 }
 
 
 -(bool)isClosed {
-    return interface == NULL;
+    return transport == NULL;
 }
 
 
@@ -185,14 +341,28 @@ retry:
     if (! [self configureDevice])
         return NO;
     
-    if (! [self findInterface])
+    IOUSBInterfaceInterface** interface = [self findInterface];
+    if (interface == NULL)
         return NO;
     
-    if (! [self setupAsyncComm])
-        return NO;
+    return [self openWithTransport: new USBTransport(interface)];
+}
+
+
+- (BOOL) openWithTransport: (Transport*) t
+{
+    transport = t;
+    listener.device = self;
+    parser.setHandler(&listener);
+    transport->setListener(&listener);
+    portEventListener.device = self;
     
-    pendingBuffer = 0;
-    [self submitRead];
+    if (! transport->start()) {
+        delete transport;
+        transport = NULL;
+        return NO;
+    }
+    writeCoalescer.start(transport, IOReactor::shared(), &transferPool);
     
     [self resetConfiguration];
     
@@ -222,13 +392,14 @@ retry:
 }
 
 
-- (BOOL) findInterface
+- (IOUSBInterfaceInterface**) findInterface
 {
     IOReturn                    kr;
     IOUSBFindInterfaceRequest   request;
     io_iterator_t               iterator;
     io_service_t                usbInterface;
     IOCFPlugInInterface         **plugInInterface = NULL;
+    IOUSBInterfaceInterface     **interface = NULL;
     SInt32                      score;
     HRESULT                     result;
 
@@ -244,7 +415,7 @@ retry:
     kr = (*device)->CreateInterfaceIterator(device, &request, &iterator);
     if (kr) {
         NSLog(@"Wirekite: CreateInterfaceIterator failed with code 0x%08x", kr);
-        return NO;
+        return NULL;
     }
     
     while ((usbInterface = IOIteratorNext(iterator))) {
@@ -260,7 +431,7 @@ retry:
         IOObjectRelease(usbInterface);
         if (kr != kIOReturnSuccess || !plugInInterface) {
             NSLog(@"Wirekite: Unable to create a plug-in (%08x)", kr);
-            return NO;
+            return NULL;
         }
         
         // Now create the device interface for the interface
@@ -272,7 +443,7 @@ retry:
         
         if (result || !interface) {
             NSLog(@"Wirekite: Couldn’t create a device interface for the interface (%08x)", (int) result);
-            return NO;
+            return NULL;
         }
         
         // Now open the interface. This will cause the pipes associated with
@@ -281,11 +452,11 @@ retry:
         if (kr != kIOReturnSuccess) {
             NSLog(@"Wirekite: Unable to open interface (%08x)", kr);
             (*interface)->Release(interface);
-            break;
+            return NULL;
         }
     }
     
-    return YES;
+    return interface;
 }
 
 
@@ -300,15 +471,15 @@ retry:
     request.action = WK_CFG_ACTION_RESET;
     
     wk_config_response* response = [self executeConfigRequest: &request];
-    free(response);
+    MessagePool::release(response);
     
     portList.clear();
     pendingRequests.clear();
     throttler.clear();
-    [digitalInputPinCallbacks removeAllObjects];
-    [digitalInputDispatchQueues removeAllObjects];
-    [analogInputPinCallbacks removeAllObjects];
-    [analogInputDispatchQueues removeAllObjects];
+    pthread_mutex_lock(&callbackMutex);
+    self.digitalInputCallbacks = nil;
+    self.analogInputCallbacks = nil;
+    pthread_mutex_unlock(&callbackMutex);
     deviceStatus = StatusReady;
 }
 
@@ -316,64 +487,146 @@ retry:
 - (void) configureFlowControlMemSize: (int)memSize maxOutstandingRequest: (int)maxRequests
 {
     throttler.configure(memSize, maxRequests);
+    transferPool.configure(throttler.memorySize(), throttler.maximumOutstanding());
+}
+
+
+- (void) enableAdaptiveFlowControl
+{
+    long memAvail = [self boardInfo:BoardInfoAvailableMemory];
+    long maxBlock = [self boardInfo:BoardInfoMaximumMemoryBlock];
+    if (memAvail <= 0 || maxBlock <= 0) {
+        NSLog(@"Wirekite: Adaptive flow control could not be enabled");
+        return;
+    }
+    
+    throttler.configureAdaptive((int)memAvail, (int)maxBlock);
+    transferPool.configure(throttler.memorySize(), throttler.maximumOutstanding());
+}
+
+
+- (void) reserveFlowControlMemSize: (int)memSize maxOutstandingRequests: (int)maxRequests forPriority: (RequestPriority)priority
+{
+    throttler.configureReservation((ThrottlerPriority)priority, memSize, maxRequests);
+}
+
+
+- (long) latencyForPriority: (RequestPriority)priority percentile: (double)percentile
+{
+    return throttler.latencies((ThrottlerPriority)priority).percentile(percentile);
 }
 
 
 #pragma mark - Basic communication
 
 
-- (BOOL) setupAsyncComm
+- (void) writeMessage:(wk_msg_header*)msg
 {
-    CFRunLoopSourceRef runLoopSource = NULL;
-    IOReturn kr = (*interface)->CreateInterfaceAsyncEventSource(interface, &runLoopSource);
-    if (kr != kIOReturnSuccess) {
-        NSLog(@"Wirekite: Unable to create asynchronous event source (%08x)", kr);
-        return NO;
+    if (_logsMessages)
+        [self logMessage:msg];
+    if (transport == NULL)
+        return; // has probably been disconnected
+    
+    capture.append(CAPTURE_DIRECTION_TX, (const uint8_t*)msg, msg->message_size);
+    [self trackRequest:msg];
+    writeCoalescer.write((const uint8_t*)msg, msg->message_size);
+}
+
+
+- (void) writeMessageBuffer:(wk_msg_header*)msg
+{
+    // takes ownership of the transfer pool buffer
+    if (transport == NULL) {
+        TransferPool::release(msg);
+        return; // has probably been disconnected
     }
     
-    workerThread = [[NSThread alloc] initWithTarget:self selector:@selector(threadMainRoutine:) object:[NSValue valueWithPointer: runLoopSource]];
-    [workerThread start];
+    capture.append(CAPTURE_DIRECTION_TX, (const uint8_t*)msg, msg->message_size);
+    [self trackRequest:msg];
+    writeCoalescer.writeBuffer((uint8_t*)msg, msg->message_size);
+}
+
+
+- (void) trackRequest:(wk_msg_header*)msg
+{
+    // port requests with a request ID receive a response; measure the round-trip time
+    if (msg->message_type == WK_MSG_TYPE_PORT_REQUEST && msg->request_id != 0)
+        requestTimer.requestSent(msg->request_id, ((wk_port_request*)msg)->action);
+}
+
+
+- (MetricsSnapshot) metricsSnapshot
+{
+    MetricsSnapshot snapshot;
+    for (int i = 0; i < THROTTLER_NUM_PRIORITIES; i++)
+        snapshot.throttleWaits[i].summarize(throttler.waitTimes((ThrottlerPriority)i));
+    snapshot.bytesInFlight = throttler.bytesInFlight();
+    snapshot.peakBytesInFlight = throttler.peakBytesInFlight();
+    snapshot.queueDrops = 0;
     
-    return YES;
+    portList.forEachPort(AddPortMetrics, &snapshot);
+    return snapshot;
 }
 
 
-- (void) submitRead
+- (NSString*) metricsReport
 {
-    IOReturn result = (*interface)->ReadPipeAsync(interface, EndpointReceive, rxBuffer[pendingBuffer],
-                                         RX_BUFFER_SIZE, ReadCompletion, (__bridge void*)self);
-    if (result != kIOReturnSuccess)
-        NSLog(@"Wirekite: Unable to perform asynchronous bulk read (%08x)", result);
+    return [NSString stringWithUTF8String:[self metricsSnapshot].format().c_str()];
 }
 
 
-- (void) writeMessage:(wk_msg_header*)msg
+- (NSString*) metricsReportAsJSON
 {
-    //NSLog(@"%s", MessageDump::dump(msg).c_str());
-    [self writeBytes:(const uint8_t*)msg size:msg->message_size];
+    return [NSString stringWithUTF8String:[self metricsSnapshot].formatJSON().c_str()];
 }
 
 
-- (void) writeBytes: (const uint8_t*)bytes size: (uint16_t) size
+- (BOOL) startCaptureToFile: (NSString*)path maxSize: (long)maxSize
 {
-    if (self->interface == NULL)
-        return; // has probably been disconnected
+    return capture.open(path.fileSystemRepresentation, maxSize) ? YES : NO;
+}
+
+
+- (void) stopCapture
+{
+    capture.close();
+}
+
+
+- (BOOL) startRecordingPorts: (const PortID*)ports count: (NSUInteger)count toFile: (NSString*)path
+{
+    if (count == 0 || count > RECORDER_MAX_CHANNELS)
+        return NO;
     
-    // data must be copied
-    Transfer* transfer = (Transfer*)malloc(sizeof(Transfer));
-    memset(transfer, 0, sizeof(Transfer));
-    transfer->device = self;
-    transfer->buffer = malloc(size);
-    memcpy(transfer->buffer, bytes, size);
+    uint16_t portIds[RECORDER_MAX_CHANNELS];
+    for (NSUInteger i = 0; i < count; i++)
+        portIds[i] = (uint16_t)ports[i];
     
-    IOReturn kr = (*interface)->WritePipeAsync(interface,
-                                               EndpointTransmit,
-                                               (void*)transfer->buffer,
-                                               size,
-                                               WriteCompletion,
-                                               transfer);
-    if (kr)
-        NSLog(@"Wirekite: Error on submitting write (0x%08x)", kr);
+    return recorder.open(path.fileSystemRepresentation, portIds, (int)count) ? YES : NO;
+}
+
+
+- (void) stopRecording
+{
+    recorder.close();
+}
+
+
+- (void) flush
+{
+    writeCoalescer.flush();
+}
+
+
+- (void) configureWriteCoalescingTransferSize: (long)transferSize deadline: (long)deadline
+{
+    writeCoalescer.configure((int)transferSize, (int)deadline);
+}
+
+
+- (double) messagesPerTransfer
+{
+    return writeCoalescer.messagesPerTransfer();
 }
 
 
@@ -382,16 +635,83 @@ retry:
     uint16_t requestId = request->header.request_id;
     pendingRequests.announceRequest(requestId);
     [self writeMessage:&request->header];
-    return (wk_config_response*)pendingRequests.waitForResponse(requestId);
+    writeCoalescer.flush();
+    wk_config_response* response = (wk_config_response*)pendingRequests.waitForResponse(requestId);
+    if (response == NULL) {
+        // device has been closed while waiting; the pool might be exhausted (MessagePool::release frees it)
+        response = (wk_config_response*)malloc(sizeof(wk_config_response));
+        memset(response, 0, sizeof(wk_config_response));
+        response->header.message_size = sizeof(wk_config_response);
+        response->header.message_type = WK_MSG_TYPE_CONFIG_RESPONSE;
+        response->header.request_id = requestId;
+        response->result = WK_RESULT_INV_DATA;
+    }
+    return response;
 }
 
 
 -(wk_port_event*)executePortRequest:(wk_port_request*)request
 {
+    // takes ownership of the request (allocated from transfer pool)
     uint16_t requestId = request->header.request_id;
     pendingRequests.announceRequest(requestId);
-    [self writeMessage:&request->header];
-    return (wk_port_event*)pendingRequests.waitForResponse(requestId);
+    [self writeMessageBuffer:&request->header];
+    writeCoalescer.flush();
+    wk_port_event* response = (wk_port_event*)pendingRequests.waitForResponse(requestId);
+    if (response == NULL) {
+        // device has been closed while waiting (same value as SPIResultUnknownError);
+        // the pool might be exhausted (MessagePool::release frees it)
+        response = (wk_port_event*)malloc(WK_PORT_EVENT_ALLOC_SIZE(0));
+        memset(response, 0, WK_PORT_EVENT_ALLOC_SIZE(0));
+        response->header.message_size = WK_PORT_EVENT_ALLOC_SIZE(0);
+        response->header.message_type = WK_MSG_TYPE_PORT_EVENT;
+        response->header.request_id = requestId;
+        response->event_attribute1 = I2CResultUnknownError;
+    }
+    return response;
+}
+
+
+-(void)setLastResult:(int32_t)result onPort:(PortID)port
+{
+    // the port might have been released while waiting for the response
+    int token = portList.beginRead();
+    Port* p = portList.getPort(port);
+    if (p != NULL)
+        p->setLastSample(result);
+    portList.endRead(token);
+}
+
+
+-(AsyncPortRequest*)createAsyncRequestForPort:(PortID)port isSPI:(BOOL)isSPI dispatchQueue:(dispatch_queue_t)dispatchQueue completion:(id)completion
+{
+    AsyncPortRequest* asyncRequest = [AsyncPortRequest new];
+    asyncRequest.port = port;
+    asyncRequest.isSPI = isSPI;
+    asyncRequest.dispatchQueue = dispatchQueue != nil ? dispatchQueue : dispatch_get_main_queue();
+    asyncRequest.completion = completion;
+    
+    if ([self isClosed]) {
+        NSLog(@"Wirekite: Device has been closed or disconnected. %@ operation is ignored.", isSPI ? @"SPI" : @"I2C");
+        // same value as SPIResultInvalidParameter
+        [asyncRequest completeWithData:nil result:I2CResultInvalidParameter];
+        return nil;
+    }
+    
+    if (portList.getPort(port) == NULL) {
+        [asyncRequest completeWithData:nil result:I2CResultInvalidParameter];
+        return nil;
+    }
+    
+    return asyncRequest;
+}
+
+
+-(void)submitPortRequest:(wk_port_request*)request asyncRequest:(AsyncPortRequest*)asyncRequest
+{
+    // the slot keeps the async request alive until the callback is called
+    pendingRequests.announceRequest(request->header.request_id, AsyncPortRequestCompleted, (__bridge_retained void*)asyncRequest);
+    [self writeMessageBuffer:&request->header];
 }
 
 
@@ -410,118 +730,43 @@ retry:
 }
 
 
-- (void) onWriteCompletedWithResult: (IOReturn)result argument: (void*) arg0
+- (void) logMessage: (wk_msg_header*)msg
 {
-    if (result)
-        NSLog(@"Wirekite: Write error (0x%08x)", result);
+    // formatted on the stack: tracing must not allocate on the I/O thread
+    char text[MESSAGE_LOG_SIZE];
+    MessageDump::format(msg, text, sizeof(text));
+    NSLog(@"%s", text);
 }
 
 
-- (void) onReadCompletedWithResult: (IOReturn)result argument: (void*) arg0
+- (void) onDataReceived: (const uint8_t*)data length: (uint32_t)length
 {
-    if (result) {
-        NSLog(@"Wirekite: Read error (0x%08x)", result);
-        return;
-    }
-    
-    uint8_t* data = rxBuffer[pendingBuffer];
-    pendingBuffer ^= 1;
-    [self submitRead];
-    
-    UInt32 receivedBytes = (UInt32)(unsigned long) arg0;
-    
-    if (partialSize > 0) {
-        // there is a partial message from the last USB packet
-        
-        if (partialSize == 1) {
-            // super special case: only half of the first word
-            // was transmitted
-            partialMessageSize += ((UInt32)data[0]) << 8;
-            partialMessage = (wk_msg_header*)malloc(partialMessageSize);
-            partialMessage->message_size = partialMessageSize;
-        }
-        
-        uint16_t len = receivedBytes;
-        if (partialSize + len > partialMessageSize)
-            len = partialMessageSize - partialSize;
-        
-        // append to partial message (buffer is big enough)
-        memcpy(((uint8_t*)partialMessage) + partialSize, data, len);
-        data += len;
-        receivedBytes -= len;
-        partialSize += len;
-        
-        // if message is complete handle it
-        if (partialSize == partialMessageSize) {
-            [self handleMessage:partialMessage];
-            partialSize = 0;
-            partialMessageSize = 0;
-            partialMessage = NULL;
-        }
-    }
-    
-    // Handle entire messages
-    while (receivedBytes >= 2) {
-        wk_msg_header* header = (wk_msg_header*)data;
-        uint16_t msgSize = header->message_size;
-        if (receivedBytes < msgSize)
-            break; // partial message
-        
-        if (msgSize < 8) {
-            NSLog(@"Wirkeite: Invalid message of size %d received", msgSize);
-            return;
-        }
-        
-        // create copy
-        wk_msg_header* copy = (wk_msg_header*) malloc(msgSize);
-        memcpy(copy, header, msgSize);
-
-        [self handleMessage:copy];
-        
-        data += msgSize;
-        receivedBytes -= msgSize;
-    }
-    
-    // Handle remainder
-    if (receivedBytes > 0) {
-        // a partial message remains
-        
-        if (receivedBytes == 1) {
-            // super special case: only 1 byte was transmitted;
-            // we don't know the size of the message
-            partialSize = 1;
-            partialMessageSize = data[0];
-            
-        } else {
-            // allocate buffer
-            wk_msg_header* header = (wk_msg_header*)data;
-            partialMessageSize = header->message_size;
-            partialMessage = (wk_msg_header*)malloc(partialMessageSize);
-            partialSize = receivedBytes;
-            memcpy(partialMessage, data, receivedBytes);
-        }
-    }
+    capture.append(CAPTURE_DIRECTION_RX, data, length);
+    if (! parser.processData(data, length))
+        NSLog(@"Wirekite: Invalid message received");
 }
 
 
 - (void)handleMessage: (wk_msg_header*) msg
 {
-    //NSLog(@"%s", MessageDump::dump(msg).c_str());
+    if (_logsMessages)
+        [self logMessage:msg];
 
     if (msg->message_type == WK_MSG_TYPE_CONFIG_RESPONSE) {
         wk_config_response* config_response = (wk_config_response*)msg;
         if (deviceStatus == StatusReady || config_response->header.request_id == 0xffff)
             [self handleConfigResponse: config_response];
         else
-            free(msg);
+            MessagePool::release(msg);
     } else if (msg->message_type == WK_MSG_TYPE_PORT_EVENT) {
+        // port events are handled on the executor's threads so the I/O thread only parses
         if (deviceStatus == StatusReady)
-            [self handlePortEvent: (wk_port_event*)msg];
+            eventExecutor->submit(&portEventListener, msg);
         else
-            free(msg);
+            MessagePool::release(msg);
     } else {
         NSLog(@"Wirekite: Message of unknown type %d received", msg->message_type);
-        free(msg);
+        MessagePool::release(msg);
     }
 }
 
@@ -548,7 +793,7 @@ retry:
         NSLog(@"Wirekite: Querying board information failed");
     }
     
-    free(response);
+    MessagePool::release(response);
     return result;
 }
 
@@ -610,13 +855,8 @@ retry:
     if (port == nil)
         return InvalidPortID;
     
-    NSNumber* key = [NSNumber numberWithUnsignedShort:port->portId()];
-    if (digitalInputPinCallbacks == nil) {
-        digitalInputPinCallbacks = [NSMutableDictionary<NSNumber*, DigitalInputPinCallback> new];
-        digitalInputDispatchQueues = [NSMutableDictionary<NSNumber*, dispatch_queue_t> new];
-    }
-    digitalInputPinCallbacks[key] = notifyBlock;
-    digitalInputDispatchQueues[key] = dispatchQueue;
+    InputPinCallback* callback = [[InputPinCallback alloc] initWithBlock:notifyBlock dispatchQueue:dispatchQueue];
+    [self setInputCallback:callback forPort:port->portId() isAnalog:NO];
     
     return port->portId();
 }
@@ -642,12 +882,12 @@ retry:
         port = new Port(response->header.port_id, type, 10);
         portList.addPort(port);
         if ((attributes & 1) == 0)
-            port->setLastSample(response->optional1);
+            port->setLastSample(response->optional1, HostTimeNanos());
     } else {
         NSLog(@"Wirekite: Digital pin configuration failed");
     }
     
-    free(response);
+    MessagePool::release(response);
     return port;
 }
 
@@ -667,14 +907,10 @@ retry:
     
     wk_config_response* response = [self executeConfigRequest: &request];
     
-    NSNumber* key = [NSNumber numberWithUnsignedShort:portId];
-    [digitalInputPinCallbacks removeObjectForKey:key];
-    [digitalInputDispatchQueues removeObjectForKey:key];
+    [self setInputCallback:nil forPort:portId isAnalog:NO];
     
-    Port* port = portList.getPort(portId);
     portList.removePort(portId);
-    free(response);
-    delete port;
+    MessagePool::release(response);
 }
 
 
@@ -695,7 +931,7 @@ retry:
     uint16_t requestId = 0;
     if (spiPort != 0) {
         requestId = portList.nextRequestId();
-        throttler.waitUntilAvailable(requestId, msg_len);
+        throttler.waitUntilAvailable(requestId, msg_len, ThrottlerPriorityControl);
     }
     
     wk_port_request request;
@@ -714,16 +950,22 @@ retry:
 
 - (BOOL) readDigitalPinOnPort: (PortID)portId
 {
-    Port* port = portList.getPort(portId);
+    // the port is retained as it is used while waiting for the event
+    Port* port = portList.retainPort(portId);
     if (port == NULL)
         return NO;
 
     PortType portType = port->type();
-    if (portType == PortTypeDigitalInputTriggering || portType == PortTypeDigitalInputPrecached)
-        return port->lastSample() != 0;
+    if (portType == PortTypeDigitalInputTriggering || portType == PortTypeDigitalInputPrecached) {
+        BOOL result = port->lastSample() != 0;
+        port->release();
+        return result;
+    }
     
-    if (portType != PortTypeDigitalInputOnDemand)
+    if (portType != PortTypeDigitalInputOnDemand) {
+        port->release();
         return NO;
+    }
     
     wk_port_request request;
     memset(&request, 0, WK_PORT_REQUEST_ALLOC_SIZE(0));
@@ -735,9 +977,10 @@ retry:
     [self writeMessage:&request.header];
 
     wk_port_event* event = port->waitForEvent();
+    port->release();
     
     BOOL result = event->value1 != 0;
-    free(event);
+    MessagePool::release(event);
     return result;
 }
 
@@ -747,7 +990,7 @@ retry:
 
 - (PortID) configureAnalogInputPin:(AnalogPin)pin
 {
-    Port* port = [self configureAnalogInputPin:pin interval:0];
+    Port* port = [self configureAnalogInputPin:pin interval:0 deadband:0 reportIntervals:0 filter:NULL context:nil];
     return port != nil ? port->portId() : InvalidPortID;
 }
 
@@ -760,30 +1003,151 @@ retry:
 
 - (PortID) configureAnalogInputPin: (AnalogPin)pin interval:(long)interval dispatchQueue: (dispatch_queue_t)dispatchQueue notification: (AnalogInputPinCallback)notifyBlock
 {
-    if (interval == 0) {
-        NSLog(@"Wirekite: Analog inputwith automatic sampling requires interval > 0");
+    return [self configureAnalogInputPin:pin interval:interval deadband:0 minReportInterval:0 maxReportInterval:0 dispatchQueue:dispatchQueue notification:notifyBlock];
+}
+
+
+- (PortID) configureAnalogInputPin: (AnalogPin)pin interval:(long)interval deadband:(double)deadband minReportInterval:(long)minReportInterval maxReportInterval:(long)maxReportInterval dispatchQueue: (dispatch_queue_t)dispatchQueue notification: (AnalogInputPinCallback)notifyBlock
+{
+    if (interval <= 0 || deadband < 0 || minReportInterval < 0 || maxReportInterval < 0) {
+        NSLog(@"Wirekite: Analog input with automatic sampling requires interval > 0, deadband >= 0 and report intervals >= 0");
+        return InvalidPortID;
+    }
+    
+    // deadband in units of 1/65536 of the sample range ([-1, 1])
+    double scaledDeadband = deadband * 32768 + 0.5;
+    uint16_t deadbandAttr = scaledDeadband < 65535 ? (uint16_t)scaledDeadband : 65535;
+    uint16_t reportIntervals = WK_ANALOG_REPORT_INTERVALS(ReportIntervals(minReportInterval, interval),
+                                                          ReportIntervals(maxReportInterval, interval));
+    
+    return [self configureAnalogInputPin:pin interval:interval deadband:deadbandAttr reportIntervals:reportIntervals filter:NULL dispatchQueue:dispatchQueue notification:notifyBlock];
+}
+
+
+- (PortID) configureAnalogInputPin: (AnalogPin)pin interval:(long)interval filters:(const AnalogFilterStage*)filters count:(NSUInteger)count dispatchQueue: (dispatch_queue_t)dispatchQueue notification: (AnalogInputPinCallback)notifyBlock
+{
+    if (interval <= 0) {
+        NSLog(@"Wirekite: Analog input with automatic sampling requires interval > 0");
         return InvalidPortID;
     }
     
-    Port* port = [self configureAnalogInputPin:pin interval:interval];
+    SampleFilter* filter = NULL;
+    if (!CreateFilter(filters, count, &filter))
+        return InvalidPortID;
+    
+    return [self configureAnalogInputPin:pin interval:interval deadband:0 reportIntervals:0 filter:filter dispatchQueue:dispatchQueue notification:notifyBlock];
+}
+
+
+- (PortID) configureAnalogInputPin: (AnalogPin)pin interval:(long)interval deadband:(uint16_t)deadband reportIntervals:(uint16_t)reportIntervals filter:(SampleFilter*)filter dispatchQueue: (dispatch_queue_t)dispatchQueue notification: (AnalogInputPinCallback)notifyBlock
+{
+    // takes ownership of the filter
+    Port* port = [self configureAnalogInputPin:pin interval:interval deadband:deadband reportIntervals:reportIntervals filter:filter context:nil];
     if (port == nil)
         return InvalidPortID;
     
-    NSNumber* key = [NSNumber numberWithUnsignedShort:port->portId()];
-    if (analogInputPinCallbacks == nil) {
-        analogInputPinCallbacks = [NSMutableDictionary<NSNumber*, AnalogInputPinCallback> new];
-        analogInputDispatchQueues = [NSMutableDictionary<NSNumber*, dispatch_queue_t> new];
-    }
-    analogInputPinCallbacks[key] = notifyBlock;
-    analogInputDispatchQueues[key] = dispatchQueue;
+    InputPinCallback* callback = [[InputPinCallback alloc] initWithBlock:notifyBlock dispatchQueue:dispatchQueue];
+    [self setInputCallback:callback forPort:port->portId() isAnalog:YES];
     
     return port->portId();
 }
 
 
+- (PortID) configureAnalogInputPin: (AnalogPin)pin interval:(long)interval blockSize:(long)blockSize maxDelay:(long)maxDelay dispatchQueue: (dispatch_queue_t)dispatchQueue notification: (AnalogInputBatchCallback)notifyBlock
+{
+    return [self configureAnalogInputPin:pin interval:interval filters:NULL count:0 blockSize:blockSize maxDelay:maxDelay dispatchQueue:dispatchQueue notification:notifyBlock];
+}
+
+
+- (PortID) configureAnalogInputPin: (AnalogPin)pin interval:(long)interval filters:(const AnalogFilterStage*)filters count:(NSUInteger)count blockSize:(long)blockSize maxDelay:(long)maxDelay dispatchQueue: (dispatch_queue_t)dispatchQueue notification: (AnalogInputBatchCallback)notifyBlock
+{
+    if (interval <= 0 || blockSize <= 0) {
+        NSLog(@"Wirekite: Analog input with batched sampling requires interval > 0 and block size > 0");
+        return InvalidPortID;
+    }
+    
+    SampleFilter* filter = NULL;
+    if (!CreateFilter(filters, count, &filter))
+        return InvalidPortID;
+    
+    // the batch must be attached before the first sample can arrive
+    Port* port = [self configureAnalogInputPin:pin interval:interval deadband:0 reportIntervals:0 filter:filter context:^id (PortID portId) {
+        return [[AnalogSampleBatch alloc] initWithPort:portId
+                                             blockSize:(int)blockSize
+                                              maxDelay:(uint64_t)maxDelay * 1000000
+                                         dispatchQueue:dispatchQueue
+                                            completion:notifyBlock];
+    }];
+    
+    return port != nil ? port->portId() : InvalidPortID;
+}
+
+
+- (PortID) configureAnalogScanOnPins: (const AnalogPin*)pins count:(NSUInteger)count interval:(long)interval dispatchQueue: (dispatch_queue_t)dispatchQueue notification: (AnalogScanCallback)notifyBlock
+{
+    if (interval <= 0 || count == 0 || count > 32) {
+        NSLog(@"Wirekite: Analog scan requires interval > 0 and between 1 and 32 pins");
+        return InvalidPortID;
+    }
+    
+    uint32_t channels = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        AnalogPin pin = pins[i];
+        if (pin < 0 || (pin > 27 && pin < 128) || pin > 131 || (channels & (1u << WK_SCAN_CHANNEL_BIT(pin))) != 0) {
+            NSLog(@"Wirekite: Invalid or duplicate pin for analog scan");
+            return InvalidPortID;
+        }
+        channels |= 1u << WK_SCAN_CHANNEL_BIT(pin);
+    }
+    
+    // position of each channel in the caller's pin order (the board sends the channels in bit order)
+    int channelOrder[32];
+    int numChannels = 0;
+    for (int bit = 0; bit < 32; bit++) {
+        if ((channels & (1u << bit)) == 0)
+            continue;
+        for (NSUInteger i = 0; i < count; i++)
+            if (WK_SCAN_CHANNEL_BIT(pins[i]) == bit)
+                channelOrder[numChannels] = (int)i;
+        numChannels++;
+    }
+    
+    wk_config_request request;
+    memset(&request, 0, sizeof(wk_config_request));
+    request.header.message_size = sizeof(wk_config_request);
+    request.header.message_type = WK_MSG_TYPE_CONFIG_REQUEST;
+    request.action = WK_CFG_ACTION_CONFIG_PORT;
+    request.port_type = WK_CFG_PORT_TYPE_ANALOG_SCAN;
+    request.header.request_id = portList.nextRequestId();
+    request.value1 = (int32_t)interval;
+    request.port_attributes1 = (uint16_t)channels;
+    request.port_attributes2 = (uint16_t)(channels >> 16);
+    
+    wk_config_response* response = [self executeConfigRequest: &request];
+    
+    PortID portId = InvalidPortID;
+    if (response->result == WK_RESULT_OK) {
+        Port* port = new Port(response->header.port_id, PortTypeAnalogScan, 10);
+        AnalogScanGroup* group = [[AnalogScanGroup alloc] initWithPort:port->portId()
+                                                          channelOrder:channelOrder
+                                                           numChannels:numChannels
+                                                         dispatchQueue:dispatchQueue
+                                                            completion:notifyBlock];
+        port->setContext((__bridge_retained void*)group, ReleaseObject);
+        portList.addPort(port);
+        portId = port->portId();
+    } else {
+        NSLog(@"Wirekite: Analog scan configuration failed");
+    }
+    
+    MessagePool::release(response);
+    return portId;
+}
+
 
-- (Port*) configureAnalogInputPin:(AnalogPin)pin interval:(long)interval
+- (Port*) configureAnalogInputPin:(AnalogPin)pin interval:(long)interval deadband:(uint16_t)deadband reportIntervals:(uint16_t)reportIntervals filter:(SampleFilter*)filter context:(id (^)(PortID port))makeContext
 {
+    // takes ownership of the filter
     wk_config_request request;
     memset(&request, 0, sizeof(wk_config_request));
     request.header.message_size = sizeof(wk_config_request);
@@ -793,18 +1157,24 @@ retry:
     request.header.request_id = portList.nextRequestId();
     request.pin_config = pin;
     request.value1 = (int32_t)interval;
+    request.port_attributes1 = deadband;
+    request.port_attributes2 = reportIntervals;
     
     wk_config_response* response = [self executeConfigRequest: &request];
     
     Port* port = NULL;
     if (response->result == WK_RESULT_OK) {
         port = new Port(response->header.port_id, interval == 0 ? PortTypeAnalogInputOnDemand : PortTypeAnalogInputSampling, 10);
+        port->setFilter(filter);
+        if (makeContext != nil)
+            port->setContext((__bridge_retained void*)makeContext(port->portId()), ReleaseObject);
         portList.addPort(port);
     } else {
         NSLog(@"Wirekite: Analog input pin configuration failed");
+        delete filter;
     }
     
-    free(response);
+    MessagePool::release(response);
     return port;
 }
 
@@ -824,23 +1194,26 @@ retry:
 
     wk_config_response* response = [self executeConfigRequest: &request];
 
-    NSNumber* key = [NSNumber numberWithUnsignedShort:portId];
-    [analogInputPinCallbacks removeObjectForKey:key];
-    [analogInputDispatchQueues removeObjectForKey:key];
+    [self setInputCallback:nil forPort:portId isAnalog:YES];
 
-    Port* port = portList.getPort(portId);
     portList.removePort(portId);
-    free(response);
-    delete port;
+    MessagePool::release(response);
 }
 
 
 - (double) readAnalogPinOnPort: (PortID)portId
 {
-    Port* port = portList.getPort(portId);
+    // the port is retained as it is used while waiting for the event
+    Port* port = portList.retainPort(portId);
     if (port == NULL)
         return 0;
     
+    if (port->type() == PortTypeAnalogInputSampling) {
+        int32_t r = port->lastSample();
+        port->release();
+        return r < 0 ? r / 2147483648.0 : r / 2147483647.0;
+    }
+    
     wk_port_request request;
     memset(&request, 0, WK_PORT_REQUEST_ALLOC_SIZE(0));
     request.header.message_size = WK_PORT_REQUEST_ALLOC_SIZE(0);
@@ -851,14 +1224,48 @@ retry:
     [self writeMessage:&request.header];
     
     wk_port_event* event = port->waitForEvent();
+    port->release();
     
     int32_t r = (int32_t)event->value1;
-    free(event);
+    MessagePool::release(event);
 
     return r < 0 ? r / 2147483648.0 : r / 2147483647.0;
 }
 
 
+- (void) readInputSnapshots: (InputSnapshot*)snapshots count: (NSUInteger)count
+{
+    int token = portList.beginRead();
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        InputSnapshot* snapshot = &snapshots[i];
+        snapshot->value = 0;
+        snapshot->sequence = 0;
+        snapshot->timestamp = 0;
+        
+        Port* port = snapshot->port >= 0 && snapshot->port <= 0xffff ? portList.getPort((uint16_t)snapshot->port) : NULL;
+        if (port == NULL)
+            continue;
+        
+        PortType portType = port->type();
+        if (portType != PortTypeDigitalInputPrecached && portType != PortTypeDigitalInputTriggering
+                && portType != PortTypeAnalogInputSampling)
+            continue;
+        
+        PortSample sample = port->lastSampleSnapshot();
+        int32_t r = sample.value;
+        if (portType == PortTypeAnalogInputSampling)
+            snapshot->value = r < 0 ? r / 2147483648.0 : r / 2147483647.0;
+        else
+            snapshot->value = r != 0 ? 1 : 0;
+        snapshot->sequence = sample.sequence;
+        snapshot->timestamp = sample.timestamp;
+    }
+    
+    portList.endRead(token);
+}
+
+
 #pragma mark - PWM output
 
 
@@ -892,7 +1299,7 @@ retry:
         NSLog(@"Wirekite: PWM pin configuration failed");
     }
     
-    free(response);
+    MessagePool::release(response);
     return portId;
 }
 
@@ -912,10 +1319,8 @@ retry:
 
     wk_config_response* response = [self executeConfigRequest: &request];
 
-    Port* port = portList.getPort(portId);
     portList.removePort(portId);
-    free(response);
-    delete port;
+    MessagePool::release(response);
 }
 
 
@@ -957,7 +1362,7 @@ retry:
     request.value1 = (int32_t)frequency;
     
     wk_config_response* response = [self executeConfigRequest: &request];
-    free(response);
+    MessagePool::release(response);
 }
 
 
@@ -980,7 +1385,7 @@ retry:
     request.value1 = (uint8_t)channel;
     
     wk_config_response* response = [self executeConfigRequest: &request];
-    free(response);
+    MessagePool::release(response);
 }
 
 
@@ -1010,7 +1415,7 @@ retry:
         NSLog(@"Wirekite: I2C configuration failed");
     }
     
-    free(response);
+    MessagePool::release(response);
     return portId;
 }
 
@@ -1030,10 +1435,8 @@ retry:
     
     wk_config_response* response = [self executeConfigRequest: &request];
     
-    Port* p = portList.getPort(port);
     portList.removePort(port);
-    free(response);
-    delete p;
+    MessagePool::release(response);
 }
 
 
@@ -1042,28 +1445,28 @@ retry:
     if ([self isClosed])
         return; // silently ignore
     
-    Port* p = portList.getPort(port);
-    if (p == nil)
+    if (portList.getPort(port) == NULL)
         return;
     
     uint16_t requestId = portList.nextRequestId();
     uint16_t msgLen = WK_PORT_REQUEST_ALLOC_SIZE(0);
-    wk_port_request request;
-    memset(&request, 0, msgLen);
-    request.header.message_size = msgLen;
-    request.header.message_type = WK_MSG_TYPE_PORT_REQUEST;
-    request.header.port_id = port;
-    request.header.request_id = requestId;
-    request.action = WK_PORT_ACTION_RESET;
     
-    throttler.waitUntilAvailable(requestId, msgLen);
+    throttler.waitUntilAvailable(requestId, msgLen, ThrottlerPriorityControl);
+    
+    wk_port_request* request = (wk_port_request*)transferPool.acquireBuffer(msgLen);
+    memset(request, 0, msgLen);
+    request->header.message_size = msgLen;
+    request->header.message_type = WK_MSG_TYPE_PORT_REQUEST;
+    request->header.port_id = port;
+    request->header.request_id = requestId;
+    request->action = WK_PORT_ACTION_RESET;
     
-    wk_port_event* response = [self executePortRequest:&request];
+    wk_port_event* response = [self executePortRequest:request];
     
     I2CResult result = (I2CResult)response->event_attribute1;
-    p->setLastSample(result);
+    [self setLastResult:result onPort:port];
     
-    free(response);
+    MessagePool::release(response);
 }
 
 
@@ -1074,17 +1477,15 @@ retry:
         return 0;
     }
     
-    Port* p = portList.getPort(port);
-    if (p == nil)
+    if (portList.getPort(port) == NULL)
         return 0;
     
     wk_port_request* request = [self createI2CTxRequestForPort:port data:data toSlave:slave];
     wk_port_event* response = [self executePortRequest:request];
-    free(request);
     
     uint16_t transmitted = response->event_attribute2;
-    p->setLastSample((I2CResult)response->event_attribute1);
-    free(response);
+    [self setLastResult:(I2CResult)response->event_attribute1 onPort:port];
+    MessagePool::release(response);
     return transmitted;
 }
 
@@ -1096,13 +1497,11 @@ retry:
         return;
     }
     
-    Port* p = portList.getPort(port);
-    if (p == nil)
+    if (portList.getPort(port) == NULL)
         return;
     
     wk_port_request* request = [self createI2CTxRequestForPort:port data:data toSlave:slave];
-    [self writeMessage:&request->header];
-    free(request);
+    [self writeMessageBuffer:&request->header];
 }
 
 
@@ -1114,7 +1513,7 @@ retry:
 
     throttler.waitUntilAvailable(requestId, msg_len);
 
-    wk_port_request* request = (wk_port_request*)malloc(msg_len);
+    wk_port_request* request = (wk_port_request*)transferPool.acquireBuffer(msg_len);
     memset(request, 0, msg_len);
     request->header.message_size = msg_len;
     request->header.message_type = WK_MSG_TYPE_PORT_REQUEST;
@@ -1130,34 +1529,21 @@ retry:
 
 - (NSData*) requestDataOnI2CPort: (PortID)port fromSlave: (long)slave length: (long)length
 {
-    Port* p = portList.getPort(port);
-    if (p == nil)
+    if (portList.getPort(port) == NULL)
         return nil;
     
-    uint16_t requestId = portList.nextRequestId();
-    wk_port_request request;
-    memset(&request, 0, WK_PORT_REQUEST_ALLOC_SIZE(0));
-    request.header.message_size = WK_PORT_REQUEST_ALLOC_SIZE(0);
-    request.header.message_type = WK_MSG_TYPE_PORT_REQUEST;
-    request.header.port_id = port;
-    request.header.request_id = requestId;
-    request.action = WK_PORT_ACTION_RX_DATA;
-    request.action_attribute2 = (uint16_t)slave;
-    request.value1 = (uint16_t)length;
-    
-    throttler.waitUntilAvailable(requestId, WK_PORT_EVENT_ALLOC_SIZE(length));
-    
-    wk_port_event* response = [self executePortRequest:&request];
+    wk_port_request* request = [self createI2CRxRequestForPort:port fromSlave:slave length:length];
+    wk_port_event* response = [self executePortRequest:request];
     
     I2CResult result = (I2CResult)response->event_attribute1;
-    p->setLastSample(result);
+    [self setLastResult:result onPort:port];
     
     NSData* data = nil;
     size_t dataLength = WK_PORT_EVENT_DATA_LEN(response);
     if (dataLength > 0)
         data = [NSData dataWithBytes:response->data length:dataLength];
     
-    free(response);
+    MessagePool::release(response);
     return data;
 }
 
@@ -1169,52 +1555,265 @@ retry:
         return 0;
     }
     
-    Port* p = portList.getPort(port);
-    if (p == nil)
+    if (portList.getPort(port) == NULL)
         return 0;
     
-    NSUInteger len = data.length;
-    size_t msg_len = WK_PORT_REQUEST_ALLOC_SIZE(len);
-    uint16 requestId = portList.nextRequestId();
-    wk_port_request* request = (wk_port_request*)malloc(msg_len);
+    wk_port_request* request = [self createI2CTxRxRequestForPort:port data:data toSlave:slave receiveLength:receiveLength];
+    wk_port_event* response = [self executePortRequest:request];
+    
+    I2CResult result = (I2CResult)response->event_attribute1;
+    [self setLastResult:result onPort:port];
+    
+    NSData* rxData = nil;
+    size_t dataLength = WK_PORT_EVENT_DATA_LEN(response);
+    if (dataLength > 0)
+        rxData = [NSData dataWithBytes:response->data length:dataLength];
+    
+    MessagePool::release(response);
+    return rxData;
+}
+
+
+-(wk_port_request*)createI2CRxRequestForPort: (PortID)port fromSlave: (long)slave length: (long)length
+{
+    size_t msg_len = WK_PORT_REQUEST_ALLOC_SIZE(0);
+    uint16_t requestId = portList.nextRequestId();
+    
+    throttler.waitUntilAvailable(requestId, WK_PORT_EVENT_ALLOC_SIZE(length));
+    
+    wk_port_request* request = (wk_port_request*)transferPool.acquireBuffer(msg_len);
     memset(request, 0, msg_len);
     request->header.message_size = msg_len;
     request->header.message_type = WK_MSG_TYPE_PORT_REQUEST;
     request->header.port_id = port;
     request->header.request_id = requestId;
-    request->action = WK_PORT_ACTION_TX_N_RX_DATA;
+    request->action = WK_PORT_ACTION_RX_DATA;
     request->action_attribute2 = (uint16_t)slave;
-    request->value1 = (uint16_t)receiveLength;
-    memcpy(request->data, data.bytes, len);
+    request->value1 = (uint16_t)length;
+    
+    return request;
+}
+
+
+-(wk_port_request*)createI2CTxRxRequestForPort: (PortID)port data: (NSData*)data toSlave: (long)slave receiveLength: (long)receiveLength
+{
+    return [self createI2CTxRxRequestForPort:port bytes:data.bytes length:data.length toSlave:slave receiveLength:receiveLength];
+}
+
+
+-(wk_port_request*)createI2CTxRxRequestForPort: (PortID)port bytes: (const void*)bytes length: (NSUInteger)len toSlave: (long)slave receiveLength: (long)receiveLength
+{
+    size_t msg_len = WK_PORT_REQUEST_ALLOC_SIZE(len);
+    uint16_t requestId = portList.nextRequestId();
     
     size_t mem_size = WK_PORT_EVENT_ALLOC_SIZE(receiveLength);
     if (msg_len > mem_size)
         mem_size = msg_len;
     throttler.waitUntilAvailable(requestId, mem_size);
     
+    wk_port_request* request = (wk_port_request*)transferPool.acquireBuffer(msg_len);
+    memset(request, 0, msg_len);
+    request->header.message_size = msg_len;
+    request->header.message_type = WK_MSG_TYPE_PORT_REQUEST;
+    request->header.port_id = port;
+    request->header.request_id = requestId;
+    request->action = WK_PORT_ACTION_TX_N_RX_DATA;
+    request->action_attribute2 = (uint16_t)slave;
+    request->value1 = (uint16_t)receiveLength;
+    memcpy(request->data, bytes, len);
+    
+    return request;
+}
+
+
+- (void) sendOnI2CPort: (PortID)port data: (NSData*)data toSlave: (long)slave dispatchQueue: (dispatch_queue_t)dispatchQueue completion: (I2CCompletion)completion
+{
+    AsyncPortRequest* asyncRequest = [self createAsyncRequestForPort:port isSPI:NO dispatchQueue:dispatchQueue completion:completion];
+    if (asyncRequest == nil)
+        return;
+    
+    wk_port_request* request = [self createI2CTxRequestForPort:port data:data toSlave:slave];
+    [self submitPortRequest:request asyncRequest:asyncRequest];
+}
+
+
+- (void) requestDataOnI2CPort: (PortID)port fromSlave: (long)slave length: (long)length dispatchQueue: (dispatch_queue_t)dispatchQueue completion: (I2CCompletion)completion
+{
+    AsyncPortRequest* asyncRequest = [self createAsyncRequestForPort:port isSPI:NO dispatchQueue:dispatchQueue completion:completion];
+    if (asyncRequest == nil)
+        return;
+    
+    wk_port_request* request = [self createI2CRxRequestForPort:port fromSlave:slave length:length];
+    [self submitPortRequest:request asyncRequest:asyncRequest];
+}
+
+
+- (void) sendAndRequestOnI2CPort: (PortID)port data: (NSData*)data toSlave: (long)slave receiveLength: (long)receiveLength dispatchQueue: (dispatch_queue_t)dispatchQueue completion: (I2CCompletion)completion
+{
+    AsyncPortRequest* asyncRequest = [self createAsyncRequestForPort:port isSPI:NO dispatchQueue:dispatchQueue completion:completion];
+    if (asyncRequest == nil)
+        return;
+    
+    wk_port_request* request = [self createI2CTxRxRequestForPort:port data:data toSlave:slave receiveLength:receiveLength];
+    [self submitPortRequest:request asyncRequest:asyncRequest];
+}
+
+
+- (BOOL) readRegistersOnI2CPort: (PortID)port reads: (I2CRegisterRead*)reads count: (NSUInteger)count
+{
+    for (NSUInteger i = 0; i < count; i++) {
+        reads[i].receivedLength = 0;
+        reads[i].result = I2CResultInvalidParameter;
+    }
+    
+    if ([self isClosed]) {
+        NSLog(@"Wirekite: Device has been closed or disconnected. I2C operation is ignored.");
+        return NO;
+    }
+    
+    int token = portList.beginRead();
+    bool isValidPort = portList.getPort(port) != NULL;
+    portList.endRead(token);
+    if (!isValidPort || count == 0)
+        return NO;
+    
+    // Submit the requests back-to-back in windows; the throttler blocks if the device
+    // runs out of memory. Responses occupy a slot of the pending request list until
+    // they are collected, so a window must not exceed the list's capacity.
+    BOOL success = YES;
+    std::vector<uint16_t> requestIds(MIN(count, (NSUInteger)I2C_REGISTER_READ_WINDOW));
+    for (NSUInteger start = 0; start < count; start += I2C_REGISTER_READ_WINDOW) {
+        NSUInteger end = MIN(count, start + I2C_REGISTER_READ_WINDOW);
+        for (NSUInteger i = start; i < end; i++) {
+            wk_port_request* request = [self createI2CTxRxRequestForPort:port bytes:&reads[i].startRegister length:1
+                                                                 toSlave:reads[i].slave receiveLength:reads[i].length];
+            requestIds[i - start] = request->header.request_id;
+            pendingRequests.announceRequest(request->header.request_id);
+            [self writeMessageBuffer:&request->header];
+        }
+        writeCoalescer.flush();
+        
+        // collect the responses
+        for (NSUInteger i = start; i < end; i++) {
+            wk_port_event* response = (wk_port_event*)pendingRequests.waitForResponse(requestIds[i - start]);
+            if (response == NULL) {
+                // device disconnected
+                reads[i].result = I2CResultUnknownError;
+                success = NO;
+                continue;
+            }
+            
+            size_t dataLength = WK_PORT_EVENT_DATA_LEN(response);
+            if (dataLength > reads[i].length)
+                dataLength = reads[i].length;
+            memcpy(reads[i].data, response->data, dataLength);
+            reads[i].receivedLength = (uint16_t)dataLength;
+            reads[i].result = (I2CResult)response->event_attribute1;
+            if (reads[i].result != I2CResultOK || dataLength < reads[i].length)
+                success = NO;
+            MessagePool::release(response);
+        }
+    }
+    
+    [self setLastResult:reads[count - 1].result onPort:port];
+    return success;
+}
+
+
+- (BOOL) startPollingOnI2CPort: (PortID)port data: (NSData*)data toSlave: (long)slave receiveLength: (long)receiveLength interval: (long)interval dispatchQueue: (dispatch_queue_t)dispatchQueue notification: (I2CPollCallback)notifyBlock
+{
+    if ([self isClosed]) {
+        NSLog(@"Wirekite: Device has been closed or disconnected. I2C operation is ignored.");
+        return NO;
+    }
+    
+    if (receiveLength < 1 || receiveLength > 255 || interval <= 0)
+        return NO;
+    
+    // the poll remains attached to the port until it is released
+    int token = portList.beginRead();
+    Port* p = portList.getPort(port);
+    I2CPoll* poll = nil;
+    if (p != NULL && p->type() == PortTypeI2C) {
+        poll = (__bridge I2CPoll*)p->context();
+        if (poll == nil) {
+            // another thread might attach a poll at the same time
+            I2CPoll* newPoll = [I2CPoll new];
+            newPoll.port = port;
+            void* context = (__bridge_retained void*)newPoll;
+            if (!p->setContext(context, ReleaseObject))
+                ReleaseObject(context);
+            poll = (__bridge I2CPoll*)p->context();
+        }
+        poll.dispatchQueue = dispatchQueue != nil ? dispatchQueue : dispatch_get_main_queue();
+        poll.completion = notifyBlock;
+    }
+    portList.endRead(token);
+    if (poll == nil)
+        return NO;
+    
+    NSUInteger len = data.length;
+    uint16_t msgLen = WK_PORT_REQUEST_ALLOC_SIZE(len);
+    uint16_t requestId = portList.nextRequestId();
+    
+    throttler.waitUntilAvailable(requestId, msgLen, ThrottlerPriorityControl);
+    
+    wk_port_request* request = (wk_port_request*)transferPool.acquireBuffer(msgLen);
+    memset(request, 0, msgLen);
+    request->header.message_size = msgLen;
+    request->header.message_type = WK_MSG_TYPE_PORT_REQUEST;
+    request->header.port_id = port;
+    request->header.request_id = requestId;
+    request->action = WK_PORT_ACTION_START_POLLING;
+    request->action_attribute1 = (uint8_t)receiveLength;
+    request->action_attribute2 = (uint16_t)slave;
+    request->value1 = (uint32_t)interval;
+    memcpy(request->data, data.bytes, len);
+    
     wk_port_event* response = [self executePortRequest:request];
-    free(request);
+    BOOL success = response->event_attribute1 == I2CResultOK;
+    MessagePool::release(response);
     
-    I2CResult result = (I2CResult)response->event_attribute1;
-    p->setLastSample(result);
+    if (!success)
+        NSLog(@"Wirekite: Starting I2C polling failed");
+    return success;
+}
+
+
+- (void) stopPollingOnI2CPort: (PortID)port
+{
+    if ([self isClosed])
+        return; // silently ignore
     
-    NSData* rxData = nil;
-    size_t dataLength = WK_PORT_EVENT_DATA_LEN(response);
-    if (dataLength > 0)
-        rxData = [NSData dataWithBytes:response->data length:dataLength];
+    if (portList.getPort(port) == NULL)
+        return;
     
-    free(response);
-    return rxData;
+    uint16_t requestId = portList.nextRequestId();
+    uint16_t msgLen = WK_PORT_REQUEST_ALLOC_SIZE(0);
+    
+    throttler.waitUntilAvailable(requestId, msgLen, ThrottlerPriorityControl);
+    
+    wk_port_request* request = (wk_port_request*)transferPool.acquireBuffer(msgLen);
+    memset(request, 0, msgLen);
+    request->header.message_size = msgLen;
+    request->header.message_type = WK_MSG_TYPE_PORT_REQUEST;
+    request->header.port_id = port;
+    request->header.request_id = requestId;
+    request->action = WK_PORT_ACTION_STOP_POLLING;
+    
+    // polls are sent before the response; so none follow it
+    wk_port_event* response = [self executePortRequest:request];
+    MessagePool::release(response);
 }
 
 
 - (I2CResult) lastResultOnI2CPort: (PortID)port
 {
+    int token = portList.beginRead();
     Port* p = portList.getPort(port);
-    if (p == nil)
-        return I2CResultInvalidParameter;
-    
-    return (I2CResult)p->lastSample();
+    I2CResult result = p != NULL ? (I2CResult)p->lastSample() : I2CResultInvalidParameter;
+    portList.endRead(token);
+    return result;
 }
 
 
@@ -1246,7 +1845,7 @@ retry:
         NSLog(@"Wirekite: SPI configuration failed");
     }
     
-    free(response);
+    MessagePool::release(response);
     return portId;
 }
 
@@ -1266,10 +1865,8 @@ retry:
 
     wk_config_response* response = [self executeConfigRequest:&request];
     
-    Port* p = portList.getPort(port);
     portList.removePort(port);
-    free(response);
-    delete p;
+    MessagePool::release(response);
 }
 
 
@@ -1280,17 +1877,15 @@ retry:
         return 0;
     }
     
-    Port* p = portList.getPort(port);
-    if (p == nil)
+    if (portList.getPort(port) == NULL)
         return 0;
     
     wk_port_request* request = [self createSPIRequestForPort:port action:WK_PORT_ACTION_TX_DATA data:data chipSelect:chipSelect];
     wk_port_event* response = [self executePortRequest:request];
-    free(request);
     
     uint16_t transmitted = response->event_attribute2;
-    p->setLastSample((SPIResult)response->event_attribute1);
-    free(response);
+    [self setLastResult:(SPIResult)response->event_attribute1 onPort:port];
+    MessagePool::release(response);
     return transmitted;
 }
 
@@ -1302,13 +1897,11 @@ retry:
         return;
     }
     
-    Port* p = portList.getPort(port);
-    if (p == nil)
+    if (portList.getPort(port) == NULL)
         return;
     
     wk_port_request* request = [self createSPIRequestForPort:port action:WK_PORT_ACTION_TX_DATA data:data chipSelect:chipSelect];
-    [self writeMessage:&request->header];
-    free(request);
+    [self writeMessageBuffer:&request->header];
 }
 
 
@@ -1325,38 +1918,21 @@ retry:
         return nil;
     }
     
-    Port* p = portList.getPort(port);
-    if (p == nil)
+    if (portList.getPort(port) == NULL)
         return nil;
     
-    uint16_t requestId = portList.nextRequestId();
-    size_t msg_len = WK_PORT_REQUEST_ALLOC_SIZE(0);
-    
-    throttler.waitUntilAvailable(requestId, msg_len);
-    
-    wk_port_request* request = (wk_port_request*)malloc(msg_len);
-    memset(request, 0, msg_len);
-    request->header.message_size = msg_len;
-    request->header.message_type = WK_MSG_TYPE_PORT_REQUEST;
-    request->header.port_id = port;
-    request->header.request_id = requestId;
-    request->action = WK_PORT_ACTION_RX_DATA;
-    request->action_attribute1 = (uint8_t)mosiValue;
-    request->action_attribute2 = chipSelect;
-    request->value1 = (uint32_t)length;
-    
+    wk_port_request* request = [self createSPIRxRequestForPort:port chipSelect:chipSelect length:length mosiValue:mosiValue];
     wk_port_event* response = [self executePortRequest:request];
-    free(request);
     
     SPIResult result = (SPIResult)response->event_attribute1;
-    p->setLastSample(result);
+    [self setLastResult:result onPort:port];
     
     NSData* rxData = nil;
     size_t dataLength = WK_PORT_EVENT_DATA_LEN(response);
     if (dataLength > 0)
         rxData = [NSData dataWithBytes:response->data length:dataLength];
     
-    free(response);
+    MessagePool::release(response);
     return rxData;
 }
 
@@ -1368,24 +1944,22 @@ retry:
         return nil;
     }
     
-    Port* p = portList.getPort(port);
-    if (p == nil)
+    if (portList.getPort(port) == NULL)
         return nil;
     
     wk_port_request* request = [self createSPIRequestForPort:port action:WK_PORT_ACTION_TX_N_RX_DATA data:data chipSelect:chipSelect];
     
     wk_port_event* response = [self executePortRequest:request];
-    free(request);
     
     SPIResult result = (SPIResult)response->event_attribute1;
-    p->setLastSample(result);
+    [self setLastResult:result onPort:port];
     
     NSData* rxData = nil;
     size_t dataLength = WK_PORT_EVENT_DATA_LEN(response);
     if (dataLength > 0)
         rxData = [NSData dataWithBytes:response->data length:dataLength];
     
-    free(response);
+    MessagePool::release(response);
     return rxData;
 }
 
@@ -1396,9 +1970,10 @@ retry:
     NSUInteger len = data.length;
     size_t msg_len = WK_PORT_REQUEST_ALLOC_SIZE(len);
     
-    throttler.waitUntilAvailable(requestId, msg_len);
+    ThrottlerPriority priority = len >= SPI_BULK_TX_SIZE ? ThrottlerPriorityBulk : ThrottlerPriorityNormal;
+    throttler.waitUntilAvailable(requestId, msg_len, priority);
     
-    wk_port_request* request = (wk_port_request*)malloc(msg_len);
+    wk_port_request* request = (wk_port_request*)transferPool.acquireBuffer(msg_len);
     memset(request, 0, msg_len);
     request->header.message_size = msg_len;
     request->header.message_type = WK_MSG_TYPE_PORT_REQUEST;
@@ -1412,19 +1987,208 @@ retry:
 }
 
 
+-(wk_port_request*)createSPIRxRequestForPort:(PortID)port chipSelect:(PortID)chipSelect length:(long)length mosiValue:(long)mosiValue
+{
+    uint16_t requestId = portList.nextRequestId();
+    size_t msg_len = WK_PORT_REQUEST_ALLOC_SIZE(0);
+    
+    throttler.waitUntilAvailable(requestId, msg_len);
+    
+    wk_port_request* request = (wk_port_request*)transferPool.acquireBuffer(msg_len);
+    memset(request, 0, msg_len);
+    request->header.message_size = msg_len;
+    request->header.message_type = WK_MSG_TYPE_PORT_REQUEST;
+    request->header.port_id = port;
+    request->header.request_id = requestId;
+    request->action = WK_PORT_ACTION_RX_DATA;
+    request->action_attribute1 = (uint8_t)mosiValue;
+    request->action_attribute2 = chipSelect;
+    request->value1 = (uint32_t)length;
+    
+    return request;
+}
+
+
+-(void)transmitOnSPIPort:(PortID)port data:(NSData*)data chipSelect:(PortID)chipSelect dispatchQueue:(dispatch_queue_t)dispatchQueue completion:(SPICompletion)completion
+{
+    AsyncPortRequest* asyncRequest = [self createAsyncRequestForPort:port isSPI:YES dispatchQueue:dispatchQueue completion:completion];
+    if (asyncRequest == nil)
+        return;
+    
+    wk_port_request* request = [self createSPIRequestForPort:port action:WK_PORT_ACTION_TX_DATA data:data chipSelect:chipSelect];
+    [self submitPortRequest:request asyncRequest:asyncRequest];
+}
+
+
+-(void)requestOnSPIPort:(PortID)port chipSelect:(PortID)chipSelect length:(long)length mosiValue:(long)mosiValue dispatchQueue:(dispatch_queue_t)dispatchQueue completion:(SPICompletion)completion
+{
+    AsyncPortRequest* asyncRequest = [self createAsyncRequestForPort:port isSPI:YES dispatchQueue:dispatchQueue completion:completion];
+    if (asyncRequest == nil)
+        return;
+    
+    wk_port_request* request = [self createSPIRxRequestForPort:port chipSelect:chipSelect length:length mosiValue:mosiValue];
+    [self submitPortRequest:request asyncRequest:asyncRequest];
+}
+
+
+-(void)transmitAndRequestOnSPIPort:(PortID)port data:(NSData*)data chipSelect:(PortID)chipSelect dispatchQueue:(dispatch_queue_t)dispatchQueue completion:(SPICompletion)completion
+{
+    AsyncPortRequest* asyncRequest = [self createAsyncRequestForPort:port isSPI:YES dispatchQueue:dispatchQueue completion:completion];
+    if (asyncRequest == nil)
+        return;
+    
+    wk_port_request* request = [self createSPIRequestForPort:port action:WK_PORT_ACTION_TX_N_RX_DATA data:data chipSelect:chipSelect];
+    [self submitPortRequest:request asyncRequest:asyncRequest];
+}
+
+
+-(void)transmitOnSPIPort:(PortID)port bytes:(const void*)bytes length:(long)length chipSelect:(PortID)chipSelect dispatchQueue:(dispatch_queue_t)dispatchQueue completion:(SPICompletion)completion
+{
+    DataSegment segment;
+    segment.bytes = (const uint8_t*)bytes;
+    segment.length = length;
+    [self transmitOnSPIPort:port segments:&segment count:1 chipSelect:chipSelect dispatchQueue:dispatchQueue completion:completion];
+}
+
+
+-(void)transmitOnSPIPort:(PortID)port dataArray:(NSArray<NSData*>*)dataArray chipSelect:(PortID)chipSelect dispatchQueue:(dispatch_queue_t)dispatchQueue completion:(SPICompletion)completion
+{
+    std::vector<DataSegment> segments(dataArray.count);
+    for (NSUInteger i = 0; i < dataArray.count; i++) {
+        segments[i].bytes = (const uint8_t*)dataArray[i].bytes;
+        segments[i].length = dataArray[i].length;
+    }
+    [self transmitOnSPIPort:port segments:segments.data() count:segments.size() chipSelect:chipSelect dispatchQueue:dispatchQueue completion:completion];
+}
+
+
+-(void)transmitOnSPIPort:(PortID)port segments:(const DataSegment*)segments count:(NSUInteger)count chipSelect:(PortID)chipSelect dispatchQueue:(dispatch_queue_t)dispatchQueue completion:(SPICompletion)completion
+{
+    AsyncSPIStream* stream = [AsyncSPIStream new];
+    stream.port = port;
+    stream.isSPI = YES;
+    stream.dispatchQueue = dispatchQueue != nil ? dispatchQueue : dispatch_get_main_queue();
+    stream.completion = completion;
+    
+    if ([self isClosed]) {
+        NSLog(@"Wirekite: Device has been closed or disconnected. SPI operation is ignored.");
+        [stream completeWithData:nil result:SPIResultInvalidParameter];
+        return;
+    }
+    
+    if (portList.getPort(port) == NULL) {
+        [stream completeWithData:nil result:SPIResultInvalidParameter];
+        return;
+    }
+    
+    size_t totalLength = 0;
+    for (NSUInteger i = 0; i < count; i++)
+        totalLength += segments[i].length;
+    
+    if (totalLength == 0) {
+        [stream completeWithData:nil result:SPIResultOK];
+        return;
+    }
+    
+    // split into chunks such that several of them fit into the board's memory
+    // (computed signed: a small memory size must not wrap around)
+    int maxSize = TRANSFER_POOL_LARGE_SIZE - (int)WK_PORT_REQUEST_ALLOC_SIZE(0);
+    int size = throttler.memorySize(ThrottlerPriorityBulk) / SPI_STREAM_CHUNKS_IN_FLIGHT - (int)WK_PORT_REQUEST_ALLOC_SIZE(0) - 8;
+    if (size > maxSize)
+        size = maxSize;
+    if (size < 64)
+        size = 64;
+    size_t chunkSize = size;
+    
+    size_t numChunks = (totalLength + chunkSize - 1) / chunkSize;
+    stream->remainingChunks.store((int)numChunks);
+    
+    NSUInteger segmentIndex = 0;
+    size_t segmentOffset = 0;
+    size_t remainingLength = totalLength;
+    
+    for (size_t i = 0; i < numChunks; i++) {
+        if ([self isClosed]) {
+            // the remaining chunks will never be sent
+            for (; i < numChunks; i++)
+                [stream chunkCompletedWithResult:SPIResultUnknownError];
+            break;
+        }
+        
+        size_t len = remainingLength < chunkSize ? remainingLength : chunkSize;
+        size_t msg_len = WK_PORT_REQUEST_ALLOC_SIZE(len);
+        uint16_t requestId = portList.nextRequestId();
+        
+        // blocks while the board's memory is full
+        throttler.waitUntilAvailable(requestId, msg_len, ThrottlerPriorityBulk);
+        
+        wk_port_request* request = (wk_port_request*)transferPool.acquireBuffer(msg_len);
+        memset(request, 0, WK_PORT_REQUEST_ALLOC_SIZE(0));
+        request->header.message_size = msg_len;
+        request->header.message_type = WK_MSG_TYPE_PORT_REQUEST;
+        request->header.port_id = port;
+        request->header.request_id = requestId;
+        request->action = WK_PORT_ACTION_TX_DATA;
+        request->action_attribute2 = chipSelect;
+        
+        // gather the data from the segments
+        size_t filled = 0;
+        while (filled < len) {
+            const DataSegment* segment = &segments[segmentIndex];
+            size_t n = segment->length - segmentOffset;
+            if (n > len - filled)
+                n = len - filled;
+            memcpy(request->data + filled, segment->bytes + segmentOffset, n);
+            filled += n;
+            segmentOffset += n;
+            if (segmentOffset == segment->length) {
+                segmentIndex++;
+                segmentOffset = 0;
+            }
+        }
+        remainingLength -= len;
+        
+        // each pending chunk holds a reference to the stream
+        pendingRequests.announceRequest(requestId, SPIStreamChunkCompleted, (__bridge_retained void*)stream);
+        [self writeMessageBuffer:&request->header];
+    }
+}
+
+
 -(SPIResult) lastResultOnSPIPort: (PortID)port
 {
+    int token = portList.beginRead();
     Port* p = portList.getPort(port);
-    if (p == nil)
-        return SPIResultInvalidParameter;
-    
-    return (SPIResult)p->lastSample();
+    SPIResult result = p != NULL ? (SPIResult)p->lastSample() : SPIResultInvalidParameter;
+    portList.endRead(token);
+    return result;
 }
 
 
 #pragma mark - Message handling
 
 
+- (void) setInputCallback: (InputPinCallback*)callback forPort: (PortID)port isAnalog: (BOOL)isAnalog
+{
+    // copy on write: the event executor keeps using the previous snapshot
+    NSNumber* key = [NSNumber numberWithUnsignedShort:port];
+    pthread_mutex_lock(&callbackMutex);
+    NSMutableDictionary<NSNumber*, InputPinCallback*>* callbacks = isAnalog
+        ? [self.analogInputCallbacks mutableCopy] : [self.digitalInputCallbacks mutableCopy];
+    if (callbacks == nil)
+        callbacks = [NSMutableDictionary<NSNumber*, InputPinCallback*> new];
+    if (callback != nil)
+        callbacks[key] = callback;
+    else
+        [callbacks removeObjectForKey:key];
+    if (isAnalog)
+        self.analogInputCallbacks = callbacks;
+    else
+        self.digitalInputCallbacks = callbacks;
+    pthread_mutex_unlock(&callbackMutex);
+}
+
+
 - (void) handleConfigResponse: (wk_config_response*) response
 {
     pendingRequests.putResponse(response->header.request_id, (wk_msg_header*)response);
@@ -1433,8 +2197,25 @@ retry:
 
 - (void) handlePortEvent: (wk_port_event*) event
 {
+    // the port must not be deleted while the event is handled
+    int readToken = portList.beginRead();
+    [self dispatchPortEvent: event];
+    portList.endRead(readToken);
+}
+
+
+- (void) dispatchPortEvent: (wk_port_event*) event
+{
+    Port* port = portList.getPort(event->header.port_id);
+    if (port != NULL) {
+        port->metrics().eventReceived();
+        uint8_t action;
+        uint32_t roundTrip;
+        if (event->header.request_id != 0 && requestTimer.requestCompleted(event->header.request_id, &action, &roundTrip))
+            port->metrics().recordRoundTrip(action, roundTrip);
+    }
+    
     if (event->event == WK_EVENT_SINGLE_SAMPLE) {
-        Port* port = portList.getPort(event->header.port_id);
         if (port == NULL)
             goto error;
         
@@ -1445,16 +2226,16 @@ retry:
             
         } else if (portType == PortTypeDigitalInputPrecached || portType == PortTypeDigitalInputTriggering) {
             uint8_t value = (uint8_t)event->value1;
-            free(event);
-            port->setLastSample(value);
+            MessagePool::release(event);
+            port->setLastSample(value, HostTimeNanos());
             
             if (portType == PortTypeDigitalInputTriggering) {
-                NSNumber* key = [NSNumber numberWithUnsignedShort:port->portId()];
-                DigitalInputPinCallback callback = digitalInputPinCallbacks[key];
-                dispatch_queue_t dispatchQueue = digitalInputDispatchQueues[key];
-                if (callback != nil && dispatchQueue != nil) {
-                    dispatch_async(dispatchQueue, ^{
-                        callback(port->portId(), value != 0);
+                PortID portId = port->portId();
+                InputPinCallback* callback = self.digitalInputCallbacks[[NSNumber numberWithUnsignedShort:portId]];
+                DigitalInputPinCallback block = callback.block;
+                if (block != nil && callback.dispatchQueue != nil) {
+                    dispatch_async(callback.dispatchQueue, ^{
+                        block(portId, value != 0);
                     });
                 }
             }
@@ -1466,75 +2247,350 @@ retry:
             
         } else if (portType == PortTypeAnalogInputSampling) {
             int32_t value = (int32_t)event->value1;
-            free(event);
-            port->setLastSample(value);
+            if (event->event_attribute2 > 1)
+                port->metrics().samplesSuppressed(event->event_attribute2 - 1);
+            MessagePool::release(event);
+            uint64_t timestamp = HostTimeNanos();
+            port->setLastSample(value, timestamp);
+            recorder.record(port->portId(), value, timestamp);
             
-            NSNumber* key = [NSNumber numberWithUnsignedShort:port->portId()];
-            AnalogInputPinCallback callback = analogInputPinCallbacks[key];
-            dispatch_queue_t dispatchQueue = analogInputDispatchQueues[key];
-            if (callback != nil && dispatchQueue != nil) {
-                dispatch_async(dispatchQueue, ^{
-                    double v = value < 0 ? value / 2147483648.0 : value / 2147483647.0;
-                    callback(port->portId(), v);
-                });
+            // filter before dispatching so that the consumer only receives the reduced samples;
+            // the samples are filtered in batches at the end of the executor's batch
+            if (port->filter() != NULL) {
+                if (port->addFilterSample(value, timestamp))
+                    [self dispatchFilteredSamples:port];
+                return;
             }
+            
+            [self dispatchAnalogSamples:port values:&value timestamps:&timestamp count:1];
             return;
         }
         
+    } else if (event->event == WK_EVENT_SCAN_FRAMES) {
+        if (port == NULL || port->type() != PortTypeAnalogScan)
+            goto error;
+        
+        AnalogScanGroup* group = (__bridge AnalogScanGroup*)port->context();
+        [group handleEvent:event];
+        MessagePool::release(event);
+        return;
+        
     } else if (event->event == WK_EVENT_TX_COMPLETE || event->event == WK_EVENT_DATA_RECV) {
-        Port* port = portList.getPort(event->header.port_id);
         if (port == NULL)
             goto error;
         
         PortType portType = port->type();
+        if (portType == PortTypeI2C && event->header.request_id == 0 && event->event == WK_EVENT_DATA_RECV) {
+            // result of a poll executed by the device
+            I2CPoll* poll = (__bridge I2CPoll*)port->context();
+            [poll handleEvent:event];
+            MessagePool::release(event);
+            return;
+        }
+        
         if (portType == PortTypeI2C || portType == PortTypeSPI) {
-            throttler.requestCompleted(event->header.request_id);
+            // SPI uses the same result code for insufficient memory
+            bool overrun = event->event_attribute1 == I2CResultOutOfMemory;
+            throttler.requestCompleted(event->header.request_id, overrun);
             pendingRequests.putResponse(event->header.request_id, (wk_msg_header*)event);
             return;
         }    
     } else if (event->event == WK_EVENT_SET_DONE) {
         throttler.requestCompleted(event->header.request_id);
-        free(event);
+        MessagePool::release(event);
         return;
     }
 
 error:
     NSLog(@"Wirekite: Unknown event (%d) for port (%d) received", event->event, event->header.port_id);
-    free(event);
+    MessagePool::release(event);
 }
 
 
-#pragma mark - Worker thread
+- (void) completePortEvents: (PortID)portId
+{
+    int readToken = portList.beginRead();
+    Port* port = portList.getPort(portId);
+    if (port != NULL && port->filter() != NULL)
+        [self dispatchFilteredSamples:port];
+    portList.endRead(readToken);
+}
+
 
-- (void) threadMainRoutine: (id) data
+- (void) dispatchFilteredSamples: (Port*)port
 {
-    @autoreleasepool {
+    int32_t* values;
+    uint64_t* timestamps;
+    int count = port->filterSamples(&values, &timestamps);
+    if (count > 0)
+        [self dispatchAnalogSamples:port values:values timestamps:timestamps count:count];
+}
 
-        NSValue* value = data;
-        CFRunLoopSourceRef runLoopSource = (CFRunLoopSourceRef) [value pointerValue];
-        CFRunLoopAddSource(CFRunLoopGetCurrent(), runLoopSource, kCFRunLoopDefaultMode);
 
-        // Keep processing events until the runloop is stopped.
-        CFRunLoopRun();
-        
-        CFRelease(runLoopSource);
+- (void) dispatchAnalogSamples: (Port*)port values: (const int32_t*)values timestamps: (const uint64_t*)timestamps count: (int)count
+{
+    if (port->context() != NULL) {
+        AnalogSampleBatch* batch = (__bridge AnalogSampleBatch*)port->context();
+        for (int i = 0; i < count; i++)
+            [batch addSample:values[i] timestamp:timestamps[i]];
+        return;
+    }
+    
+    PortID portId = port->portId();
+    InputPinCallback* callback = self.analogInputCallbacks[[NSNumber numberWithUnsignedShort:portId]];
+    AnalogInputPinCallback block = callback.block;
+    if (block == nil || callback.dispatchQueue == nil)
+        return;
+    
+    for (int i = 0; i < count; i++) {
+        int32_t value = values[i];
+        dispatch_async(callback.dispatchQueue, ^{
+            double v = value < 0 ? value / 2147483648.0 : value / 2147483647.0;
+            block(portId, v);
+        });
     }
 }
 
 
-- (void) stopWorkerThread
+@end
+
+
+@implementation AsyncPortRequest
+
+- (void) completeWithData: (NSData*)data result: (NSInteger)result
 {
-    [self performSelector:@selector(stopThisRunLoop) onThread:workerThread withObject:nil waitUntilDone:NO];
-    workerThread = nil;
+    if (_completion == nil)
+        return;
+    
+    PortID port = _port;
+    if (_isSPI) {
+        SPICompletion completion = _completion;
+        dispatch_async(_dispatchQueue, ^{
+            completion(port, data, (SPIResult)result);
+        });
+    } else {
+        I2CCompletion completion = _completion;
+        dispatch_async(_dispatchQueue, ^{
+            completion(port, data, (I2CResult)result);
+        });
+    }
 }
 
+@end
+
 
-- (void)stopThisRunLoop
+@implementation AsyncSPIStream
+
+- (instancetype) init
 {
-    CFRunLoopStop(CFRunLoopGetCurrent());
+    self = [super init];
+    if (self != nil) {
+        remainingChunks.store(0);
+        firstError.store(SPIResultOK);
+    }
+    return self;
 }
 
 
+- (void) chunkCompletedWithResult: (NSInteger)result
+{
+    if (result != SPIResultOK) {
+        int expected = SPIResultOK;
+        firstError.compare_exchange_strong(expected, (int)result);
+    }
+    
+    if (remainingChunks.fetch_sub(1) == 1)
+        [self completeWithData:nil result:firstError.load()];
+}
+
+@end
+
+
+@implementation AnalogSampleBatch
+{
+    PortID port;
+    dispatch_queue_t dispatchQueue;
+    AnalogInputBatchCallback completion;
+    uint64_t maxDelay;
+    int32_t* rawValues;
+    double* values;
+    uint64_t* timestamps;
+}
+
+- (instancetype) initWithPort: (PortID)port blockSize: (int)blockSize maxDelay: (uint64_t)maxDelay dispatchQueue: (dispatch_queue_t)dispatchQueue completion: (AnalogInputBatchCallback)completion
+{
+    self = [super init];
+    if (self != nil) {
+        self->port = port;
+        // deliveries must not overlap even if the target queue is concurrent
+        self->dispatchQueue = dispatch_queue_create("net.codecrete.wirekite.analogbatch", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(self->dispatchQueue, dispatchQueue);
+        self->completion = completion;
+        self->maxDelay = maxDelay;
+        sampleBuffer = new SampleBuffer(blockSize, maxDelay);
+        rawValues = new int32_t[sampleBuffer->blockSize()];
+        values = new double[sampleBuffer->blockSize()];
+        timestamps = new uint64_t[sampleBuffer->blockSize()];
+    }
+    return self;
+}
+
+
+- (void) dealloc
+{
+    delete sampleBuffer;
+    delete[] rawValues;
+    delete[] values;
+    delete[] timestamps;
+}
+
+
+- (void) addSample: (int32_t)value timestamp: (uint64_t)timestamp
+{
+    if (!sampleBuffer->add(value, timestamp)) {
+        // deliver a partial block even if no further samples arrive
+        if (sampleBuffer->needsFlushTimer())
+            [self startFlushTimer:maxDelay];
+        return;
+    }
+    
+    // the block retains the batch until the samples have been delivered
+    dispatch_async(dispatchQueue, ^{
+        [self deliverSamples];
+    });
+}
+
+
+- (void) startFlushTimer: (uint64_t)delay
+{
+    // the timer runs on the serial queue of the deliveries (consumer side)
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)delay), dispatchQueue, ^{
+        [self flushTimerFired];
+    });
+}
+
+
+- (void) flushTimerFired
+{
+    uint64_t delay;
+    if (sampleBuffer->flushTimerFired(HostTimeNanos(), &delay))
+        [self deliverSamples];
+    else if (delay != 0)
+        [self startFlushTimer:delay];
+}
+
+
+- (void) deliverSamples
+{
+    sampleBuffer->beginDelivery();
+    
+    int blockSize = sampleBuffer->blockSize();
+    int count;
+    while ((count = sampleBuffer->take(rawValues, timestamps, blockSize)) > 0) {
+        for (int i = 0; i < count; i++) {
+            int32_t r = rawValues[i];
+            values[i] = r < 0 ? r / 2147483648.0 : r / 2147483647.0;
+        }
+        completion(port, values, timestamps, count);
+    }
+}
+
+@end
+
+
+@implementation I2CPoll
+
+- (void) handleEvent: (wk_port_event*)event
+{
+    I2CPollCallback callback = self.completion;
+    if (callback == nil)
+        return;
+    
+    NSData* data = nil;
+    size_t dataLength = WK_PORT_EVENT_DATA_LEN(event);
+    if (dataLength > 0)
+        data = [NSData dataWithBytes:event->data length:dataLength];
+    
+    PortID portId = self.port;
+    I2CResult result = (I2CResult)event->event_attribute1;
+    NSUInteger sequence = event->value1;
+    dispatch_async(self.dispatchQueue, ^{
+        callback(portId, data, result, sequence);
+    });
+}
+
+@end
+
+
+@implementation AnalogScanGroup
+{
+    PortID port;
+    dispatch_queue_t dispatchQueue;
+    AnalogScanCallback completion;
+    int numChannels;
+    int channelOrder[32];
+}
+
+- (instancetype) initWithPort: (PortID)port channelOrder: (const int*)channelOrder numChannels: (int)numChannels dispatchQueue: (dispatch_queue_t)dispatchQueue completion: (AnalogScanCallback)completion
+{
+    self = [super init];
+    if (self != nil) {
+        self->port = port;
+        self->dispatchQueue = dispatchQueue;
+        self->completion = completion;
+        self->numChannels = numChannels;
+        memcpy(self->channelOrder, channelOrder, numChannels * sizeof(int));
+    }
+    return self;
+}
+
+
+- (void) handleEvent: (wk_port_event*)event
+{
+    if (event->event_attribute2 != numChannels)
+        return;
+    
+    NSUInteger numFrames = WK_PORT_EVENT_DATA_LEN(event) / (numChannels * 4);
+    if (numFrames == 0)
+        return;
+    
+    // demultiplex into frames in the caller's channel order
+    NSMutableData* data = [NSMutableData dataWithLength:numFrames * numChannels * sizeof(double)];
+    double* values = (double*)data.mutableBytes;
+    const uint8_t* samples = event->data;
+    for (NSUInteger frame = 0; frame < numFrames; frame++) {
+        double* frameValues = values + frame * numChannels;
+        for (int i = 0; i < numChannels; i++) {
+            int32_t r;
+            memcpy(&r, samples, 4);
+            samples += 4;
+            frameValues[channelOrder[i]] = r < 0 ? r / 2147483648.0 : r / 2147483647.0;
+        }
+    }
+    
+    PortID portId = port;
+    NSUInteger channelCount = numChannels;
+    AnalogScanCallback callback = completion;
+    dispatch_async(dispatchQueue, ^{
+        callback(portId, (const double*)data.bytes, channelCount, numFrames);
+    });
+}
+
+@end
+
+
+@implementation InputPinCallback
+
+- (instancetype) initWithBlock: (id)block dispatchQueue: (dispatch_queue_t)dispatchQueue
+{
+    self = [super init];
+    if (self != nil) {
+        _block = [block copy];
+        _dispatchQueue = dispatchQueue;
+    }
+    return self;
+}
+
 @end
 
 
@@ -1548,18 +2604,117 @@ void DeviceNotification(void *refCon, io_service_t service, natural_t messageTyp
 }
 
 
-void WriteCompletion(void *refCon, IOReturn result, void *arg0)
+void DeviceListener::onDataReceived(const uint8_t* data, uint32_t length)
 {
-    Transfer* transfer = (Transfer*)refCon;
-    [transfer->device onWriteCompletedWithResult: result argument: arg0];
-    free(transfer->buffer);
-    transfer->device = nil;
-    free(transfer);
+    [device onDataReceived:data length:length];
 }
 
 
-void ReadCompletion(void *refCon, IOReturn result, void *arg0)
+void DeviceListener::handleMessage(wk_msg_header* msg)
 {
-    WirekiteDevice* device = (__bridge WirekiteDevice*) refCon;
-    [device onReadCompletedWithResult: result argument: arg0];
+    [device handleMessage:msg];
+}
+
+
+void PortEventListener::handleMessage(wk_msg_header* msg)
+{
+    [device handlePortEvent:(wk_port_event*)msg];
+}
+
+
+void PortEventListener::handleBatchEnd(uint16_t portId)
+{
+    [device completePortEvents:portId];
+}
+
+
+void AddPortMetrics(Port* port, void* context)
+{
+    MetricsSnapshot* snapshot = (MetricsSnapshot*)context;
+    PortMetricsSnapshot portSnapshot;
+    portSnapshot.portId = port->portId();
+    port->metrics().snapshot(portSnapshot);
+    snapshot->queueDrops += portSnapshot.queueDrops;
+    snapshot->ports.push_back(portSnapshot);
+}
+
+
+void ReleaseObject(void* object)
+{
+    CFBridgingRelease(object);
+}
+
+
+uint64_t HostTimeNanos()
+{
+    // called concurrently by the event executor's threads
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info(&timebase);
+    });
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+}
+
+
+void AsyncPortRequestCompleted(void* context, wk_msg_header* response)
+{
+    AsyncPortRequest* asyncRequest = (__bridge_transfer AsyncPortRequest*) context;
+    if (response == NULL) {
+        // cancelled (same value as SPIResultUnknownError)
+        [asyncRequest completeWithData:nil result:I2CResultUnknownError];
+        return;
+    }
+    
+    wk_port_event* event = (wk_port_event*)response;
+    NSData* data = nil;
+    size_t dataLength = WK_PORT_EVENT_DATA_LEN(event);
+    if (dataLength > 0)
+        data = [NSData dataWithBytes:event->data length:dataLength];
+    NSInteger result = event->event_attribute1;
+    MessagePool::release(response);
+    
+    [asyncRequest completeWithData:data result:result];
+}
+
+
+void SPIStreamChunkCompleted(void* context, wk_msg_header* response)
+{
+    AsyncSPIStream* stream = (__bridge_transfer AsyncSPIStream*) context;
+    NSInteger result = SPIResultUnknownError; // cancelled
+    if (response != NULL) {
+        result = ((wk_port_event*)response)->event_attribute1;
+        MessagePool::release(response);
+    }
+    [stream chunkCompletedWithResult:result];
+}
+
+
+uint8_t ReportIntervals(long reportInterval, long interval)
+{
+    // report interval in number of sampling intervals
+    long numIntervals = (reportInterval + interval / 2) / interval;
+    if (reportInterval > 0 && numIntervals == 0)
+        numIntervals = 1;
+    return numIntervals <= 255 ? (uint8_t)numIntervals : 255;
+}
+
+
+bool CreateFilter(const AnalogFilterStage* filters, NSUInteger count, SampleFilter** filter)
+{
+    *filter = NULL;
+    if (count == 0)
+        return true;
+    
+    SampleFilter* f = new SampleFilter();
+    for (NSUInteger i = 0; i < count; i++) {
+        if (filters[i].parameter > INT_MAX || !f->addStage((SampleFilterType)filters[i].filter, (int)filters[i].parameter)) {
+            NSLog(@"Wirekite: Invalid analog filter stage %d", (int)i);
+            delete f;
+            return false;
+        }
+    }
+    
+    *filter = f;
+    return true;
 }
@@ -9,9 +9,22 @@
 #import <IOKit/IOKitLib.h>
 #import <IOKit/usb/IOUSBLib.h>
 
+#ifdef __cplusplus
+class Transport;
+struct MetricsSnapshot;
+#endif
+
 @interface WirekiteDevice (Internal)
 
 - (BOOL) registerNotificationOnPart: (IONotificationPortRef)notifyPort device: (io_service_t) usbDevice;
 - (BOOL) openDevice: (IOUSBDeviceInterface**) devInterface;
 
+#ifdef __cplusplus
+/* Opens the device using the specified transport (e.g. a `SimulatedDevice`). The device takes ownership of the transport. */
+- (BOOL) openWithTransport: (Transport*) transport;
+
+/* Takes a snapshot of the latency histograms and counters. */
+- (MetricsSnapshot) metricsSnapshot;
+#endif
+
 @end
@@ -0,0 +1,220 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <string.h>
+#include <chrono>
+#include "WriteCoalescer.hpp"
+#include "IOReactor.hpp"
+
+
+static int64_t currentTime()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+WriteCoalescer::WriteCoalescer()
+:   transport(NULL),
+    transferSize(WRITE_COALESCER_DEFAULT_TRANSFER_SIZE),
+    deadline(WRITE_COALESCER_DEFAULT_DEADLINE),
+    buffer(NULL),
+    bufferLength(0),
+    bufferMessages(0),
+    bufferTime(0),
+    numMessages(0),
+    numTransfers(0),
+    reactor(NULL),
+    pool(NULL),
+    mutex(PTHREAD_MUTEX_INITIALIZER),
+    isScheduled(false)
+{
+    pthread_mutex_init(&mutex, NULL);
+}
+
+
+WriteCoalescer::~WriteCoalescer()
+{
+    stop();
+    pthread_mutex_destroy(&mutex);
+}
+
+
+void WriteCoalescer::start(Transport* transport, IOReactor* reactor, TransferPool* pool)
+{
+    pthread_mutex_lock(&mutex);
+    this->transport = transport;
+    this->reactor = reactor;
+    this->pool = pool;
+    bufferLength = 0;
+    bufferMessages = 0;
+    isScheduled = true; // serviced immediately when attached
+    pthread_mutex_unlock(&mutex);
+
+    reactor->attach(this);
+}
+
+
+void WriteCoalescer::stop()
+{
+    pthread_mutex_lock(&mutex);
+    IOReactor* attachedReactor = reactor;
+    reactor = NULL;
+    transport = NULL;
+    TransferPool::release(buffer);
+    buffer = NULL;
+    bufferLength = 0;
+    bufferMessages = 0;
+    pthread_mutex_unlock(&mutex);
+
+    // a service call in progress needs the mutex
+    if (attachedReactor != NULL)
+        attachedReactor->detach(this);
+}
+
+
+void WriteCoalescer::configure(int transferSize, int deadline)
+{
+    if (transferSize < 64)
+        transferSize = 64;
+    if (transferSize > WRITE_COALESCER_MAX_TRANSFER_SIZE)
+        transferSize = WRITE_COALESCER_MAX_TRANSFER_SIZE;
+
+    pthread_mutex_lock(&mutex);
+    flushLocked();
+    this->transferSize = transferSize;
+    this->deadline = deadline;
+    pthread_mutex_unlock(&mutex);
+}
+
+
+void WriteCoalescer::write(const uint8_t* bytes, uint16_t size)
+{
+    pthread_mutex_lock(&mutex);
+
+    if (transport == NULL) {
+        pthread_mutex_unlock(&mutex);
+        return;
+    }
+
+    if (!appendLocked(bytes, size)) {
+        // write immediately
+        uint8_t* msgBuffer = pool->acquireBuffer(size);
+        memcpy(msgBuffer, bytes, size);
+        transport->writeBuffer(msgBuffer, size);
+        numMessages++;
+        numTransfers++;
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+
+void WriteCoalescer::writeBuffer(uint8_t* msgBuffer, uint16_t size)
+{
+    pthread_mutex_lock(&mutex);
+
+    if (transport == NULL) {
+        pthread_mutex_unlock(&mutex);
+        TransferPool::release(msgBuffer);
+        return;
+    }
+
+    if (appendLocked(msgBuffer, size)) {
+        TransferPool::release(msgBuffer);
+    } else {
+        // write immediately
+        transport->writeBuffer(msgBuffer, size);
+        numMessages++;
+        numTransfers++;
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+
+bool WriteCoalescer::appendLocked(const uint8_t* bytes, uint16_t size)
+{
+    if (bufferLength + size > transferSize)
+        flushLocked();
+
+    if (deadline == 0 || size > transferSize)
+        return false;
+
+    if (bufferLength == 0) {
+        if (buffer == NULL)
+            buffer = pool->acquireBuffer(transferSize);
+        bufferTime = currentTime();
+        if (!isScheduled && reactor != NULL) {
+            // the reactor learns the deadline when servicing the coalescer
+            isScheduled = true;
+            reactor->wake(this);
+        }
+    }
+    memcpy(buffer + bufferLength, bytes, size);
+    bufferLength += size;
+    bufferMessages++;
+
+    if (bufferLength == transferSize)
+        flushLocked();
+    return true;
+}
+
+
+void WriteCoalescer::flush()
+{
+    pthread_mutex_lock(&mutex);
+    flushLocked();
+    pthread_mutex_unlock(&mutex);
+}
+
+
+void WriteCoalescer::flushLocked()
+{
+    if (bufferLength == 0)
+        return;
+
+    if (transport != NULL) {
+        transport->writeBuffer(buffer, (uint16_t)bufferLength);
+        numMessages += bufferMessages;
+        numTransfers++;
+    } else {
+        TransferPool::release(buffer);
+    }
+    buffer = NULL;
+    bufferLength = 0;
+    bufferMessages = 0;
+}
+
+
+double WriteCoalescer::messagesPerTransfer()
+{
+    uint64_t transfers = numTransfers.load();
+    if (transfers == 0)
+        return 0;
+    return (double)numMessages.load() / transfers;
+}
+
+
+int64_t WriteCoalescer::service(int64_t now)
+{
+    pthread_mutex_lock(&mutex);
+
+    int64_t due = IO_REACTOR_NEVER;
+    if (bufferLength > 0) {
+        due = bufferTime + deadline;
+        if (due <= now) {
+            flushLocked();
+            due = IO_REACTOR_NEVER;
+        }
+    }
+    isScheduled = due != IO_REACTOR_NEVER;
+
+    pthread_mutex_unlock(&mutex);
+    return due;
+}
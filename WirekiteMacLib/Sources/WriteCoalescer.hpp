@@ -0,0 +1,125 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef WriteCoalescer_hpp
+#define WriteCoalescer_hpp
+
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include "Transport.hpp"
+#include "IOReactorClient.hpp"
+
+
+class IOReactor;
+class TransferPool;
+
+
+#define WRITE_COALESCER_MAX_TRANSFER_SIZE 512
+#define WRITE_COALESCER_DEFAULT_TRANSFER_SIZE 64
+#define WRITE_COALESCER_DEFAULT_DEADLINE 0 // write through
+
+
+/**
+ * Packs consecutive messages into a single transfer
+ *
+ * Messages are appended to a transfer buffer. The buffer is written
+ * to the transport if the next message does not fit anymore, if
+ * `flush` is called, or if the oldest message has been waiting for
+ * longer than the configured deadline.
+ *
+ * Coalescing is opt-in: with the default deadline of 0, each message
+ * is written immediately.
+ *
+ * Transfer buffers are taken from the device's `TransferPool` and
+ * handed to the transport without copying.
+ *
+ * The deadline is monitored by a shared I/O reactor instead of
+ * a thread of its own.
+ */
+class WriteCoalescer : private IOReactorClient {
+public:
+    WriteCoalescer();
+    ~WriteCoalescer();
+
+    /**
+     * Starts coalescing messages for the specified transport.
+     * @param transport the transport to write to
+     * @param reactor the I/O reactor flushing messages whose deadline has expired
+     * @param pool the pool providing the transfer buffers
+     */
+    void start(Transport* transport, IOReactor* reactor, TransferPool* pool);
+
+    /**
+     * Stops coalescing and discards messages that have not been written yet.
+     */
+    void stop();
+
+    /**
+     * Configures the transfer size and deadline.
+     *
+     * @param transferSize the maximum size of a transfer (in bytes, 64 to 512)
+     * @param deadline the maximum time a message is held back (in µs, or 0 to disable coalescing)
+     */
+    void configure(int transferSize, int deadline);
+
+    /**
+     * Writes a message.
+     *
+     * The message is copied and might be held back.
+     *
+     * @param bytes the message
+     * @param size the message size (in bytes)
+     */
+    void write(const uint8_t* bytes, uint16_t size);
+
+    /**
+     * Writes a message built in a `TransferPool` buffer.
+     *
+     * The coalescer takes ownership of the buffer. Messages that are not
+     * combined with others are handed to the transport without copying.
+     *
+     * @param buffer the buffer containing the message
+     * @param size the message size (in bytes)
+     */
+    void writeBuffer(uint8_t* buffer, uint16_t size);
+
+    /**
+     * Writes all messages held back.
+     */
+    void flush();
+
+    /**
+     * Gets the average number of messages per transfer.
+     * @return the number of messages
+     */
+    double messagesPerTransfer();
+
+private:
+    bool appendLocked(const uint8_t* bytes, uint16_t size);
+    void flushLocked();
+    virtual int64_t service(int64_t now);
+
+private:
+    Transport* transport;
+    int transferSize;
+    int deadline;
+    uint8_t* buffer;
+    int bufferLength;
+    int bufferMessages;
+    int64_t bufferTime;
+    std::atomic<uint64_t> numMessages;
+    std::atomic<uint64_t> numTransfers;
+    IOReactor* reactor;
+    TransferPool* pool;
+    pthread_mutex_t mutex;
+    bool isScheduled; // the reactor will service the coalescer
+};
+
+
+#endif /* WriteCoalescer_hpp */
@@ -34,12 +34,15 @@ extern "C" {
 #define WK_PORT_ACTION_RX_DATA 4
 #define WK_PORT_ACTION_TX_N_RX_DATA 5
 #define WK_PORT_ACTION_RESET 6
+#define WK_PORT_ACTION_START_POLLING 7
+#define WK_PORT_ACTION_STOP_POLLING 8
 
 #define WK_CFG_PORT_TYPE_DIGI_PIN 1
 #define WK_CFG_PORT_TYPE_ANALOG_IN 2
 #define WK_CFG_PORT_TYPE_PWM 3
 #define WK_CFG_PORT_TYPE_I2C 4
 #define WK_CFG_PORT_TYPE_SPI 5
+#define WK_CFG_PORT_TYPE_ANALOG_SCAN 6
 
 #define WK_CFG_QUERY_MEM_AVAIL 1
 #define WK_CFG_QUERY_MEM_MAX_BLOCK 2
@@ -60,6 +63,37 @@ extern "C" {
 #define WK_EVENT_TX_COMPLETE 2
 #define WK_EVENT_DATA_RECV 3
 #define WK_EVENT_SET_DONE 4
+#define WK_EVENT_SCAN_FRAMES 5
+
+// Analog scan ports sample a group of analog pins at the same time.
+// The pins are configured as a channel mask (port_attributes1: bits 0 to 15,
+// port_attributes2: bits 16 to 31). Bits 0 to 27 select pins 0 to 27,
+// bits 28 to 31 select pins 128 to 131. The samples are sent as
+// WK_EVENT_SCAN_FRAMES events with event_attribute2 = number of channels,
+// value1 = sequence number of the first frame and data = one or more frames,
+// each consisting of an int32_t sample per channel in ascending bit order.
+#define WK_SCAN_CHANNEL_BIT(pin) ((pin) >= 128 ? (pin) - 100 : (pin))
+#define WK_SCAN_CHANNEL_PIN(bit) ((bit) >= 28 ? (bit) + 100 : (bit))
+
+// Analog inputs with automatic sampling can suppress samples that have not
+// changed significantly: port_attributes1 is the deadband (in units of 1/65536
+// of the 32 bit sample range, 0 = report all samples) and port_attributes2 the
+// minimum (bits 0 to 7) and maximum (bits 8 to 15) number of sampling intervals
+// between two reports (0 = no limit). A sample is reported if the minimum interval
+// has elapsed and it differs from the last reported sample by at least the deadband,
+// or if the maximum interval has elapsed. The first sample is always reported.
+// WK_EVENT_SINGLE_SAMPLE events of sampled inputs carry the number of sampling
+// intervals since the previous report in event_attribute2.
+#define WK_ANALOG_REPORT_INTERVALS(min, max) ((uint16_t)((min) | ((max) << 8)))
+
+// I2C ports can repeat a write-then-read transaction periodically
+// (WK_PORT_ACTION_START_POLLING): data is transmitted to the slave
+// (action_attribute2), then action_attribute1 bytes are received, every
+// value1 µs. Both start and stop are confirmed with a WK_EVENT_TX_COMPLETE
+// event. Each result is sent as a WK_EVENT_DATA_RECV event with request ID 0,
+// event_attribute1 = result code, value1 = sequence number of the poll
+// and data = received bytes. A port has at most one active poll; starting
+// a new poll replaces the previous one.
 
 
 typedef struct {
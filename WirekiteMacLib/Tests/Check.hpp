@@ -0,0 +1,33 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#ifndef Check_hpp
+#define Check_hpp
+
+#include <stdio.h>
+
+
+/**
+ * Minimal test support: a failed check is reported and counted,
+ * and the test's exit code is the number of failed checks.
+ */
+static int numFailedChecks = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            numFailedChecks++; \
+        } \
+    } while (0)
+
+#define TEST_RESULT() \
+    (numFailedChecks == 0 ? (printf("all checks passed\n"), 0) : (fprintf(stderr, "%d checks failed\n", numFailedChecks), 1))
+
+
+#endif /* Check_hpp */
@@ -0,0 +1,109 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include "MessageCapture.hpp"
+#include "Check.hpp"
+
+
+#define NUM_THREADS 4
+#define RECORDS_PER_THREAD 10000
+
+
+class ChunkCounter : public MessageHandler {
+public:
+    ChunkCounter() : numMessages(0) { }
+    
+    virtual void handleMessage(wk_msg_header* msg)
+    {
+        numMessages++;
+        MessagePool::release(msg);
+    }
+    
+    int numMessages;
+};
+
+
+static void appendRecords(MessageCapture* capture, uint8_t direction)
+{
+    uint8_t data[24] = { 0 };
+    for (int i = 0; i < RECORDS_PER_THREAD; i++)
+        capture->append(direction, data, (uint32_t)(i % sizeof(data)));
+}
+
+
+// --- Records appended concurrently are in timestamp order ---
+
+static void testConcurrentOrder(const char* path)
+{
+    MessageCapture capture;
+    CHECK(capture.open(path, 4 * 1024 * 1024));
+    
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NUM_THREADS; i++)
+        threads.push_back(std::thread(appendRecords, &capture, CAPTURE_DIRECTION_TX));
+    for (int i = 0; i < NUM_THREADS; i++)
+        threads[i].join();
+    capture.close();
+    CHECK(capture.droppedRecords() == 0);
+    
+    MessageReplay replay;
+    CHECK(replay.open(path));
+    CaptureRecord record;
+    uint64_t lastTimestamp = 0;
+    int numRecords = 0;
+    int numOutOfOrder = 0;
+    while (replay.next(record)) {
+        if (record.timestamp < lastTimestamp)
+            numOutOfOrder++;
+        lastTimestamp = record.timestamp;
+        numRecords++;
+    }
+    CHECK(numRecords == NUM_THREADS * RECORDS_PER_THREAD);
+    CHECK(numOutOfOrder == 0);
+}
+
+
+// --- Replay at original speed completes ---
+
+static void testReplay(const char* path)
+{
+    MessageCapture capture;
+    CHECK(capture.open(path, 64 * 1024));
+    
+    wk_msg_header msg = { sizeof(wk_msg_header), WK_MSG_TYPE_PORT_EVENT, 0, 1, 0 };
+    for (int i = 0; i < 10; i++)
+        capture.append(CAPTURE_DIRECTION_RX, (const uint8_t*)&msg, sizeof(msg));
+    capture.close();
+    
+    ChunkCounter counter;
+    MessageReplay replay;
+    CHECK(replay.open(path));
+    CHECK(replay.replay(&counter, true) == 10);
+    CHECK(counter.numMessages == 10);
+}
+
+
+int main()
+{
+    char path[] = "/tmp/WirekiteCaptureXXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+    
+    testConcurrentOrder(path);
+    testReplay(path);
+    
+    unlink(path);
+    return TEST_RESULT();
+}
@@ -0,0 +1,73 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <stdint.h>
+#include <string.h>
+#include "MessageParser.hpp"
+#include "Check.hpp"
+
+
+#define NUM_MESSAGES 8
+
+
+class AlignmentChecker : public MessageHandler {
+public:
+    AlignmentChecker() : numMessages(0) { }
+
+    virtual void handleMessage(wk_msg_header* msg)
+    {
+        CHECK(((uintptr_t)msg & 3) == 0);
+        wk_port_event* event = (wk_port_event*)msg;
+        CHECK(msg->request_id == numMessages + 1);
+        CHECK(event->value1 == 0x01020304u * (numMessages + 1));
+        numMessages++;
+        MessagePool::release(msg);
+    }
+
+    int numMessages;
+};
+
+
+// --- Messages at unaligned offsets of a pool buffer are handed out aligned ---
+
+static void testUnalignedMessages()
+{
+    AlignmentChecker checker;
+    MessageParser parser;
+    parser.setHandler(&checker);
+    int buffersInUse = MessagePool::buffersInUse();
+
+    // events with 1 to NUM_MESSAGES data bytes: most of them start at an unaligned offset
+    uint8_t* buffer = MessagePool::acquireBuffer();
+    uint32_t length = 0;
+    for (int i = 0; i < NUM_MESSAGES; i++) {
+        wk_port_event event;
+        memset(&event, 0, sizeof(event));
+        event.header.message_size = WK_PORT_EVENT_ALLOC_SIZE(i + 1);
+        event.header.message_type = WK_MSG_TYPE_PORT_EVENT;
+        event.header.request_id = (uint16_t)(i + 1);
+        event.event = WK_EVENT_DATA_RECV;
+        event.value1 = 0x01020304u * (i + 1);
+        memcpy(buffer + length, &event, WK_PORT_EVENT_ALLOC_SIZE(0));
+        memset(buffer + length + WK_PORT_EVENT_ALLOC_SIZE(0), 0xa5, i + 1);
+        length += event.header.message_size;
+    }
+
+    CHECK(parser.processData(buffer, length));
+    MessagePool::release(buffer);
+    CHECK(checker.numMessages == NUM_MESSAGES);
+    CHECK(MessagePool::buffersInUse() == buffersInUse);
+}
+
+
+int main()
+{
+    testUnalignedMessages();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,157 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "PendingRequestList.hpp"
+#include "MessagePool.hpp"
+#include "Check.hpp"
+
+
+static wk_msg_header* createResponse(uint16_t requestId)
+{
+    wk_msg_header* response = (wk_msg_header*)MessagePool::acquireBuffer();
+    memset(response, 0, sizeof(wk_config_response));
+    response->message_size = sizeof(wk_config_response);
+    response->message_type = WK_MSG_TYPE_CONFIG_RESPONSE;
+    response->request_id = requestId;
+    return response;
+}
+
+
+struct WaitContext {
+    PendingRequestList* list;
+    uint16_t requestId;
+    wk_msg_header* response;
+};
+
+
+static void* waitForResponse(void* arg)
+{
+    WaitContext* context = (WaitContext*)arg;
+    context->response = context->list->waitForResponse(context->requestId);
+    return NULL;
+}
+
+
+static void testResponse()
+{
+    PendingRequestList list;
+    list.announceRequest(7);
+    list.putResponse(7, createResponse(7));
+    wk_msg_header* response = list.waitForResponse(7);
+    CHECK(response != NULL && response->request_id == 7);
+    MessagePool::release(response);
+
+    // unknown request IDs are discarded
+    list.putResponse(8, createResponse(8));
+}
+
+
+static void testCollidingRequestIds()
+{
+    // request IDs mapping to the same slot are pending at the same time
+    PendingRequestList list;
+    uint16_t id1 = 5, id2 = 5 + PENDING_REQUEST_NUM_SLOTS, id3 = 5 + 2 * PENDING_REQUEST_NUM_SLOTS;
+    list.announceRequest(id1);
+    list.announceRequest(id2);
+    list.announceRequest(id3);
+
+    list.putResponse(id2, createResponse(id2));
+    list.putResponse(id3, createResponse(id3));
+    list.putResponse(id1, createResponse(id1));
+
+    wk_msg_header* r1 = list.waitForResponse(id1);
+    wk_msg_header* r2 = list.waitForResponse(id2);
+    wk_msg_header* r3 = list.waitForResponse(id3);
+    CHECK(r1 != NULL && r1->request_id == id1);
+    CHECK(r2 != NULL && r2->request_id == id2);
+    CHECK(r3 != NULL && r3->request_id == id3);
+    MessagePool::release(r1);
+    MessagePool::release(r2);
+    MessagePool::release(r3);
+}
+
+
+static void testClearKeepsCompletedResponses()
+{
+    // a response that has arrived belongs to the thread about to pick it up
+    PendingRequestList list;
+    list.announceRequest(11);
+    list.putResponse(11, createResponse(11));
+    list.clear();
+    wk_msg_header* response = list.waitForResponse(11);
+    CHECK(response != NULL && response->request_id == 11);
+    MessagePool::release(response);
+}
+
+
+static void testClearCancelsWaiters()
+{
+    PendingRequestList list;
+    list.announceRequest(12);
+    list.announceRequest(13);
+
+    WaitContext context;
+    context.list = &list;
+    context.requestId = 12;
+    context.response = (wk_msg_header*)1;
+    pthread_t thread;
+    pthread_create(&thread, NULL, waitForResponse, &context);
+    usleep(20000); // let the thread block
+
+    list.clear();
+    pthread_join(thread, NULL);
+    CHECK(context.response == NULL);
+
+    // announced but not waiting yet
+    CHECK(list.waitForResponse(13) == NULL);
+
+    // a late response is discarded
+    list.putResponse(12, createResponse(12));
+}
+
+
+static int numCancelled = 0;
+
+static void asyncCompleted(void* context, wk_msg_header* response)
+{
+    if (response == NULL)
+        numCancelled++;
+    else
+        MessagePool::release(response);
+}
+
+
+static void testClearCancelsAsyncRequests()
+{
+    PendingRequestList list;
+    list.announceRequest(21, asyncCompleted, NULL);
+    list.announceRequest(22, asyncCompleted, NULL);
+    list.putResponse(21, createResponse(21));
+    list.clear();
+    CHECK(numCancelled == 1);
+}
+
+
+int main()
+{
+    int buffersInUse = MessagePool::buffersInUse();
+
+    testResponse();
+    testCollidingRequestIds();
+    testClearKeepsCompletedResponses();
+    testClearCancelsWaiters();
+    testClearCancelsAsyncRequests();
+
+    // no responses leaked
+    CHECK(MessagePool::buffersInUse() == buffersInUse);
+
+    return TEST_RESULT();
+}
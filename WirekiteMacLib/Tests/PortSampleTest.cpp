@@ -0,0 +1,171 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "Port.hpp"
+#include "SimulatedDevice.hpp"
+#include "EventExecutor.hpp"
+#include "Check.hpp"
+
+
+#define PORT_ID 1 // the simulated device assigns port IDs in order
+#define NUM_READERS 4
+#define NUM_UPDATES 200000
+#define TIMESTAMP(value) ((uint64_t)(value) * 3 + 1)
+
+
+/**
+ * Updates the last sample of the port from the events handled
+ * by the event executor (like the device does).
+ */
+class SampleUpdater : public MessageHandler {
+public:
+    SampleUpdater(Port* port) : port(port), numUpdates(0) { }
+
+    virtual void handleMessage(wk_msg_header* msg)
+    {
+        wk_port_event* event = (wk_port_event*)msg;
+        if (event->event == WK_EVENT_SINGLE_SAMPLE && event->header.port_id == PORT_ID) {
+            int32_t value = (int32_t)event->value1;
+            port->setLastSample(value, TIMESTAMP(value));
+            numUpdates.fetch_add(1, std::memory_order_relaxed);
+        }
+        MessagePool::release(msg);
+    }
+
+    Port* port;
+    std::atomic<uint32_t> numUpdates;
+};
+
+
+class Host : public TransportListener, public MessageHandler {
+public:
+    Host(EventExecutor* executor, Port* port)
+    :   executor(executor),
+        updater(port)
+    {
+        parser.setHandler(this);
+    }
+
+    virtual void onDataReceived(const uint8_t* data, uint32_t length)
+    {
+        parser.processData(data, length);
+    }
+
+    virtual void handleMessage(wk_msg_header* msg)
+    {
+        if (msg->message_type == WK_MSG_TYPE_PORT_EVENT)
+            executor->submit(&updater, msg);
+        else
+            MessagePool::release(msg);
+    }
+
+    MessageParser parser;
+    EventExecutor* executor;
+    SampleUpdater updater;
+};
+
+
+static std::atomic<bool> isStreaming(true);
+static std::atomic<int> numTornSamples(0);
+static std::atomic<int> numBackwardSamples(0);
+
+
+static void readSnapshots(Port* port)
+{
+    PortSample last;
+    memset(&last, 0, sizeof(last));
+    while (isStreaming.load(std::memory_order_relaxed)) {
+        PortSample sample = port->lastSampleSnapshot();
+        if (sample.sequence != 0 && sample.timestamp != TIMESTAMP(sample.value))
+            numTornSamples.fetch_add(1, std::memory_order_relaxed);
+        if (sample.sequence < last.sequence || sample.value < last.value)
+            numBackwardSamples.fetch_add(1, std::memory_order_relaxed);
+        last = sample;
+    }
+}
+
+
+static void writeRequest(SimulatedDevice& device, wk_msg_header* msg)
+{
+    device.writeBytes((const uint8_t*)msg, msg->message_size);
+}
+
+
+// --- Snapshots read while the simulated device streams samples are consistent ---
+
+static void testStreamingSnapshots()
+{
+    EventExecutor executor(2);
+    Port* port = new Port(PORT_ID, PortTypeAnalogInputSampling, 16);
+    Host host(&executor, port);
+    SimulatedDevice device;
+    device.configureLink(0, 0);
+    device.setListener(&host);
+    CHECK(device.start());
+
+    // sample the analog input every ms (deadband 0: every sample is reported)
+    wk_config_request config;
+    memset(&config, 0, sizeof(config));
+    config.header.message_size = sizeof(config);
+    config.header.message_type = WK_MSG_TYPE_CONFIG_REQUEST;
+    config.header.request_id = 1;
+    config.action = WK_CFG_ACTION_CONFIG_PORT;
+    config.port_type = WK_CFG_PORT_TYPE_ANALOG_IN;
+    config.value1 = 1;
+    writeRequest(device, &config.header);
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < NUM_READERS; i++)
+        readers.push_back(std::thread(readSnapshots, port));
+
+    // increase the input and additionally request its value to get many more updates
+    wk_port_request request;
+    memset(&request, 0, sizeof(request));
+    request.header.message_size = WK_PORT_REQUEST_ALLOC_SIZE(0);
+    request.header.message_type = WK_MSG_TYPE_PORT_REQUEST;
+    request.header.port_id = PORT_ID;
+    request.action = WK_PORT_ACTION_GET_VALUE;
+    for (int i = 1; i <= NUM_UPDATES; i++) {
+        device.setAnalogInput(0, i);
+        request.header.request_id = (uint16_t)(i + 1);
+        writeRequest(device, &request.header);
+        if (i % 256 == 0)
+            usleep(100);
+    }
+
+    // wait for the last update
+    for (int i = 0; i < 5000 && port->lastSample() != NUM_UPDATES; i++)
+        usleep(1000);
+    isStreaming.store(false);
+    for (int i = 0; i < NUM_READERS; i++)
+        readers[i].join();
+
+    device.stop();
+    executor.remove(&host.updater);
+
+    PortSample sample = port->lastSampleSnapshot();
+    CHECK(sample.value == NUM_UPDATES);
+    CHECK(sample.sequence == host.updater.numUpdates.load());
+    CHECK(numTornSamples.load() == 0);
+    CHECK(numBackwardSamples.load() == 0);
+    port->release();
+}
+
+
+int main()
+{
+    testStreamingSnapshots();
+
+    return TEST_RESULT();
+}
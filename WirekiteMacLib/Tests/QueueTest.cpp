@@ -0,0 +1,176 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+#include "Queue.hpp"
+#include "Check.hpp"
+
+
+#define CAPACITY 4
+#define NUM_ITEMS 200000
+#define END_MARKER UINT64_MAX
+
+
+// --- Capacity ---
+
+template <class Q> static void testCapacity()
+{
+    Q queue(CAPACITY);
+
+    // exactly CAPACITY elements fit, the next one is rejected
+    for (uint64_t i = 0; i < CAPACITY; i++)
+        CHECK(queue.put(i));
+    uint64_t extra = 99;
+    CHECK(!queue.put(extra));
+
+    // after removing one element, exactly one more fits
+    uint64_t elem = 0;
+    CHECK(queue.tryNext(elem));
+    CHECK(elem == 0);
+    uint64_t next = CAPACITY;
+    CHECK(queue.put(next));
+    CHECK(!queue.put(extra));
+
+    // FIFO order across the wrap-around
+    for (uint64_t i = 1; i <= CAPACITY; i++) {
+        CHECK(queue.tryNext(elem));
+        CHECK(elem == i);
+    }
+    CHECK(!queue.tryNext(elem));
+
+    // many rounds at the boundary
+    for (uint64_t round = 0; round < 1000; round++) {
+        for (uint64_t i = 0; i < CAPACITY; i++)
+            CHECK(queue.put(i));
+        CHECK(!queue.put(extra));
+        for (uint64_t i = 0; i < CAPACITY; i++) {
+            CHECK(queue.tryNext(elem));
+            CHECK(elem == i);
+        }
+        CHECK(!queue.tryNext(elem));
+    }
+}
+
+
+// --- Concurrency ---
+
+template <class Q> struct Shared {
+    Q* queue;
+    int numProducers;
+    int numConsumers;
+    int producerIndex;
+    uint64_t sum;
+    uint64_t count;
+    bool isOrdered;
+    pthread_mutex_t mutex;
+};
+
+
+template <class Q> static void* produce(void* arg)
+{
+    Shared<Q>* shared = (Shared<Q>*)arg;
+    pthread_mutex_lock(&shared->mutex);
+    uint64_t producer = shared->producerIndex++;
+    pthread_mutex_unlock(&shared->mutex);
+
+    // element = producer index (upper bits) and sequence number (lower bits)
+    for (uint64_t i = 0; i < NUM_ITEMS; i++) {
+        uint64_t elem = (producer << 32) | i;
+        while (!shared->queue->put(elem))
+            sched_yield();
+    }
+    return NULL;
+}
+
+
+template <class Q> static void* consume(void* arg)
+{
+    Shared<Q>* shared = (Shared<Q>*)arg;
+    uint64_t sum = 0, count = 0;
+    bool isOrdered = true;
+    std::vector<int64_t> last(shared->numProducers, -1);
+
+    while (true) {
+        uint64_t elem = shared->queue->waitForNext();
+        if (elem == END_MARKER)
+            break;
+        int producer = (int)(elem >> 32);
+        int64_t seq = (int64_t)(elem & 0xffffffff);
+        if (seq <= last[producer])
+            isOrdered = false;
+        last[producer] = seq;
+        sum += seq;
+        count++;
+    }
+
+    pthread_mutex_lock(&shared->mutex);
+    shared->sum += sum;
+    shared->count += count;
+    if (!isOrdered)
+        shared->isOrdered = false;
+    pthread_mutex_unlock(&shared->mutex);
+    return NULL;
+}
+
+
+template <class Q> static void testConcurrency(int numProducers, int numConsumers)
+{
+    Q queue(64);
+    Shared<Q> shared;
+    shared.queue = &queue;
+    shared.numProducers = numProducers;
+    shared.numConsumers = numConsumers;
+    shared.producerIndex = 0;
+    shared.sum = 0;
+    shared.count = 0;
+    shared.isOrdered = true;
+    pthread_mutex_init(&shared.mutex, NULL);
+
+    std::vector<pthread_t> producers(numProducers), consumers(numConsumers);
+    for (int i = 0; i < numConsumers; i++)
+        pthread_create(&consumers[i], NULL, consume<Q>, &shared);
+    for (int i = 0; i < numProducers; i++)
+        pthread_create(&producers[i], NULL, produce<Q>, &shared);
+
+    for (int i = 0; i < numProducers; i++)
+        pthread_join(producers[i], NULL);
+    // the end markers are added by the last producer (this thread)
+    for (int i = 0; i < numConsumers; i++) {
+        uint64_t marker = END_MARKER;
+        while (!queue.put(marker))
+            sched_yield();
+    }
+    for (int i = 0; i < numConsumers; i++)
+        pthread_join(consumers[i], NULL);
+
+    // every element is received exactly once, in order per producer
+    uint64_t expectedSum = (uint64_t)numProducers * NUM_ITEMS * (NUM_ITEMS - 1) / 2;
+    CHECK(shared.count == (uint64_t)numProducers * NUM_ITEMS);
+    CHECK(shared.sum == expectedSum);
+    CHECK(shared.isOrdered);
+
+    pthread_mutex_destroy(&shared.mutex);
+}
+
+
+int main()
+{
+    testCapacity<Queue<uint64_t> >();
+    testCapacity<Queue<uint64_t, true, false> >();
+    testCapacity<Queue<uint64_t, false, true> >();
+    testCapacity<Queue<uint64_t, true, true> >();
+
+    testConcurrency<Queue<uint64_t> >(3, 3);
+    testConcurrency<Queue<uint64_t, true, false> >(1, 3);
+    testConcurrency<Queue<uint64_t, false, true> >(3, 1);
+    testConcurrency<Queue<uint64_t, true, true> >(1, 1);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,76 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <stdint.h>
+#include "SampleBuffer.hpp"
+#include "Check.hpp"
+
+
+#define BLOCK_SIZE 10
+#define MAX_DELAY 1000 // ns
+
+
+// --- A complete block schedules a delivery ---
+
+static void testCompleteBlock()
+{
+    SampleBuffer buffer(BLOCK_SIZE, 0);
+    for (int i = 0; i < BLOCK_SIZE - 1; i++)
+        CHECK(!buffer.add(i, 100 + i));
+    CHECK(!buffer.needsFlushTimer()); // no maximum delay
+    CHECK(buffer.add(BLOCK_SIZE - 1, 200));
+
+    int32_t values[BLOCK_SIZE];
+    uint64_t timestamps[BLOCK_SIZE];
+    buffer.beginDelivery();
+    CHECK(buffer.take(values, timestamps, BLOCK_SIZE) == BLOCK_SIZE);
+    CHECK(values[0] == 0 && timestamps[BLOCK_SIZE - 1] == 200);
+}
+
+
+// --- A partial block is flushed by the timer without further samples ---
+
+static void testFlushTimer()
+{
+    SampleBuffer buffer(BLOCK_SIZE, MAX_DELAY);
+
+    // the first sample starts the timer, the next ones don't
+    CHECK(!buffer.add(1, 1000));
+    CHECK(buffer.needsFlushTimer());
+    CHECK(!buffer.add(2, 1500));
+    CHECK(!buffer.needsFlushTimer());
+
+    // too early: the timer is restarted for the remaining time
+    uint64_t delay = 0;
+    CHECK(!buffer.flushTimerFired(1600, &delay));
+    CHECK(delay == 400);
+
+    // due: the partial block is delivered
+    CHECK(buffer.flushTimerFired(2000, &delay));
+    CHECK(delay == 0);
+
+    int32_t values[BLOCK_SIZE];
+    uint64_t timestamps[BLOCK_SIZE];
+    buffer.beginDelivery();
+    CHECK(buffer.take(values, timestamps, BLOCK_SIZE) == 2);
+
+    // an empty buffer needs no timer; the next sample starts a new one
+    CHECK(!buffer.flushTimerFired(3000, &delay));
+    CHECK(delay == 0);
+    CHECK(!buffer.add(3, 4000));
+    CHECK(buffer.needsFlushTimer());
+}
+
+
+int main()
+{
+    testCompleteBlock();
+    testFlushTimer();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,78 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <stdint.h>
+#include <vector>
+#include "SampleFilter.hpp"
+#include "Check.hpp"
+
+
+#define NUM_SAMPLES 1000
+
+
+static int32_t sampleValue(int i)
+{
+    // a ramp with noise and spikes, covering the full 32 bit range
+    int32_t value = (int32_t)((int64_t)i * 4294967 - 2147483647) + (i * 7919) % 65536;
+    if (i % 97 == 0)
+        value = i % 2 == 0 ? INT32_MAX : INT32_MIN;
+    return value;
+}
+
+
+// --- Samples filtered one at a time match the batch result ---
+
+static void testSingleSamples(SampleFilterType type, int parameter)
+{
+    SampleFilter batchFilter;
+    SampleFilter singleFilter;
+    CHECK(batchFilter.addStage(type, parameter));
+    CHECK(singleFilter.addStage(type, parameter));
+    CHECK(batchFilter.addStage(SampleFilterBoxcar, 3));
+    CHECK(singleFilter.addStage(SampleFilterBoxcar, 3));
+
+    std::vector<int32_t> batchValues(NUM_SAMPLES);
+    std::vector<uint64_t> batchTimestamps(NUM_SAMPLES);
+    for (int i = 0; i < NUM_SAMPLES; i++) {
+        batchValues[i] = sampleValue(i);
+        batchTimestamps[i] = 1000 * i;
+    }
+    int batchCount = batchFilter.process(&batchValues[0], &batchTimestamps[0], NUM_SAMPLES);
+
+    std::vector<int32_t> singleValues;
+    std::vector<uint64_t> singleTimestamps;
+    for (int i = 0; i < NUM_SAMPLES; i++) {
+        int32_t value = sampleValue(i);
+        uint64_t timestamp = 1000 * i;
+        if (singleFilter.process(&value, &timestamp, 1) == 1) {
+            singleValues.push_back(value);
+            singleTimestamps.push_back(timestamp);
+        }
+    }
+
+    CHECK(batchCount == (int)singleValues.size());
+    int numMismatches = 0;
+    for (int i = 0; i < batchCount && i < (int)singleValues.size(); i++) {
+        if (batchValues[i] != singleValues[i] || batchTimestamps[i] != singleTimestamps[i])
+            numMismatches++;
+    }
+    CHECK(numMismatches == 0);
+}
+
+
+int main()
+{
+    testSingleSamples(SampleFilterBoxcar, 8);
+    testSingleSamples(SampleFilterDecimation, 5);
+    testSingleSamples(SampleFilterExponential, 4);
+    testSingleSamples(SampleFilterMedian, 7);
+    testSingleSamples(SampleFilterMinimum, 10);
+    testSingleSamples(SampleFilterMaximum, 10);
+
+    return TEST_RESULT();
+}
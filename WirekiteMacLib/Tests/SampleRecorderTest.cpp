@@ -0,0 +1,96 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "SampleRecorder.hpp"
+#include "Check.hpp"
+
+
+#define PORT_ID 7
+#define CHUNK_CAPACITY ((RECORDER_CHUNK_SIZE - 32) / 12) // same as in SampleRecorder.cpp
+#define BATCH_SIZE 1000
+
+
+static uint64_t recordSamples(SampleRecorder& recorder, uint64_t first, uint64_t count)
+{
+    for (uint64_t i = first; i < first + count; i++)
+        recorder.record(PORT_ID, (int32_t)i, i * 1000);
+    return first + count;
+}
+
+
+// --- Recording recovers after the spare chunk has run out ---
+
+static void testSpareRecovery(const char* path)
+{
+    SampleRecorder recorder;
+    uint16_t portIds[] = { PORT_ID };
+    CHECK(recorder.open(path, portIds, 1));
+
+    // limit the file to the header and the two initial chunks so no new spare chunk can be mapped
+    struct rlimit savedLimit;
+    getrlimit(RLIMIT_FSIZE, &savedLimit);
+    signal(SIGXFSZ, SIG_IGN);
+    struct rlimit limit = savedLimit;
+    limit.rlim_cur = RECORDER_HEADER_SIZE + 2 * RECORDER_CHUNK_SIZE;
+    setrlimit(RLIMIT_FSIZE, &limit);
+
+    // fill both chunks; the following samples are dropped
+    uint64_t n = recordSamples(recorder, 0, 2 * CHUNK_CAPACITY + 10);
+    CHECK(recorder.droppedSamples() == 10);
+    usleep(100000); // let the recorder thread fail on the retired chunks
+    setrlimit(RLIMIT_FSIZE, &savedLimit);
+
+    // no chunk is retired anymore: the dropped samples must request a new spare chunk
+    int numAttempts = 0;
+    uint64_t dropped = recorder.droppedSamples();
+    while (numAttempts < 1000) {
+        n = recordSamples(recorder, n, 1);
+        if (recorder.droppedSamples() == dropped)
+            break;
+        dropped = recorder.droppedSamples();
+        numAttempts++;
+        usleep(1000);
+    }
+    CHECK(numAttempts < 1000);
+
+    // the spare chunk taken without retiring a chunk must be replaced as well
+    for (int i = 0; i < 3 * CHUNK_CAPACITY / BATCH_SIZE; i++) {
+        n = recordSamples(recorder, n, BATCH_SIZE);
+        usleep(1000);
+    }
+    CHECK(recorder.droppedSamples() == dropped);
+    recorder.close();
+
+    SampleReader reader;
+    CHECK(reader.open(path));
+    CHECK(reader.sampleCount(0) == n - dropped);
+    reader.close();
+}
+
+
+int main()
+{
+    char path[] = "/tmp/SampleRecorderTest.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to create temporary file\n");
+        return 1;
+    }
+    close(fd);
+
+    testSpareRecovery(path);
+
+    unlink(path);
+    return TEST_RESULT();
+}
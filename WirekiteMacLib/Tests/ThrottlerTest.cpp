@@ -0,0 +1,169 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <pthread.h>
+#include <unistd.h>
+#include <atomic>
+#include "Throttler.hpp"
+#include "Check.hpp"
+
+
+#define WAIT_TIMEOUT 1000 // ms
+
+struct Request {
+    Throttler* throttler;
+    uint16_t requestId;
+    uint16_t size;
+    ThrottlerPriority priority;
+    std::atomic<bool> isAdmitted;
+};
+
+
+static void* waitForAdmission(void* arg)
+{
+    Request* request = (Request*)arg;
+    request->throttler->waitUntilAvailable(request->requestId, request->size, request->priority);
+    request->isAdmitted = true;
+    return NULL;
+}
+
+
+static bool waitUntilAdmitted(Request& request)
+{
+    for (int i = 0; i < WAIT_TIMEOUT && !request.isAdmitted; i++)
+        usleep(1000);
+    return request.isAdmitted;
+}
+
+
+// Joins the thread if the request has been admitted. Otherwise the thread
+// is still blocked in the throttler, and the throttler must be kept alive.
+static bool finishRequest(Request& request, pthread_t thread)
+{
+    if (!request.isAdmitted) {
+        pthread_detach(thread);
+        return false;
+    }
+    pthread_join(thread, NULL);
+    return true;
+}
+
+
+static void startRequest(Request& request, pthread_t* thread, Throttler* throttler,
+                         uint16_t requestId, uint16_t size, ThrottlerPriority priority)
+{
+    request.throttler = throttler;
+    request.requestId = requestId;
+    request.size = size;
+    request.priority = priority;
+    request.isAdmitted = false;
+    pthread_create(thread, NULL, waitForAdmission, &request);
+}
+
+
+// --- A single request larger than the unreserved memory is admitted ---
+
+static void testSingleLargeRequest(ThrottlerPriority priority, uint16_t size)
+{
+    Throttler* throttler = new Throttler();
+    Request* request = new Request();
+    pthread_t thread;
+    startRequest(*request, &thread, throttler, 1, size, priority);
+
+    CHECK(waitUntilAdmitted(*request));
+    if (!finishRequest(*request, thread))
+        return;
+    throttler->requestCompleted(1);
+    CHECK(throttler->bytesInFlight() == 0);
+    delete request;
+    delete throttler;
+}
+
+
+// --- A large request waits until the outstanding requests have completed ---
+
+static void testLargeRequestAfterOthers()
+{
+    Throttler* throttler = new Throttler();
+    throttler->waitUntilAvailable(1, 1000, ThrottlerPriorityBulk);
+
+    Request* request = new Request();
+    pthread_t thread;
+    startRequest(*request, &thread, throttler, 2, 4000, ThrottlerPriorityBulk);
+
+    usleep(50000);
+    CHECK(!request->isAdmitted);
+
+    throttler->requestCompleted(1);
+    CHECK(waitUntilAdmitted(*request));
+    if (!finishRequest(*request, thread))
+        return;
+    delete request;
+    delete throttler;
+}
+
+
+// --- Small requests are admitted up to the unreserved memory ---
+
+static void testReservation()
+{
+    Throttler* throttler = new Throttler();
+    int bulkMemory = throttler->memorySize(ThrottlerPriorityBulk);
+
+    // fill the unreserved memory with bulk requests of 1000 bytes (+ 8 bytes overhead)
+    int numAdmitted = bulkMemory / 1008;
+    for (int i = 0; i < numAdmitted; i++)
+        throttler->waitUntilAvailable((uint16_t)(i + 1), 1000, ThrottlerPriorityBulk);
+
+    // the next bulk request must wait, a control request uses the reservation
+    Request* bulk = new Request();
+    pthread_t thread;
+    startRequest(*bulk, &thread, throttler, 100, 1000, ThrottlerPriorityBulk);
+    throttler->waitUntilAvailable(101, 100, ThrottlerPriorityControl);
+    usleep(50000);
+    CHECK(!bulk->isAdmitted);
+
+    throttler->requestCompleted(1);
+    CHECK(waitUntilAdmitted(*bulk));
+    if (!finishRequest(*bulk, thread))
+        return;
+    delete bulk;
+    delete throttler;
+}
+
+
+// --- Requests whose IDs share a slot index are tracked separately ---
+
+static void testCollidingRequestIds()
+{
+    Throttler* throttler = new Throttler();
+    throttler->waitUntilAvailable(1, 100, ThrottlerPriorityBulk);
+    throttler->waitUntilAvailable(1 + THROTTLER_NUM_SLOTS, 200, ThrottlerPriorityBulk);
+    CHECK(throttler->bytesInFlight() == 316);
+
+    throttler->requestCompleted(1 + THROTTLER_NUM_SLOTS);
+    CHECK(throttler->bytesInFlight() == 108);
+    throttler->requestCompleted(1 + THROTTLER_NUM_SLOTS); // already completed
+    CHECK(throttler->bytesInFlight() == 108);
+    throttler->requestCompleted(1);
+    CHECK(throttler->bytesInFlight() == 0);
+    delete throttler;
+}
+
+
+int main()
+{
+    testCollidingRequestIds();
+    testSingleLargeRequest(ThrottlerPriorityBulk, THROTTLER_DEFAULT_MEM_SIZE - 100);
+    testSingleLargeRequest(ThrottlerPriorityNormal, 3500);
+    testSingleLargeRequest(ThrottlerPriorityBulk, 8000); // larger than the entire memory
+    testLargeRequestAfterOthers();
+    testReservation();
+
+    return TEST_RESULT();
+}
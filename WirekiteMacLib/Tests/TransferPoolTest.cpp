@@ -0,0 +1,141 @@
+//
+// Wirekite for MacOS
+//
+// Copyright (c) 2017 Manuel Bleichenbacher
+// Licensed under MIT License
+// https://opensource.org/licenses/MIT
+//
+
+#include <stdint.h>
+#include <vector>
+#include "TransferPool.hpp"
+#include "Throttler.hpp"
+#include "proto.h"
+#include "Check.hpp"
+
+
+// a display update chunk with 1 KB of data
+#define CHUNK_SIZE WK_PORT_REQUEST_ALLOC_SIZE(1024)
+#define REQUEST_OVERHEAD 8
+
+
+// --- Chunks as many as the throttler admits are taken from the pool ---
+
+static void testAdmittedChunks(int memSize, int maxOutstanding)
+{
+    TransferPool pool;
+    pool.configure(memSize, maxOutstanding);
+
+    int numAdmitted = memSize / (CHUNK_SIZE + REQUEST_OVERHEAD);
+    if (numAdmitted > maxOutstanding)
+        numAdmitted = maxOutstanding;
+
+    std::vector<uint8_t*> buffers;
+    for (int i = 0; i < numAdmitted; i++) {
+        uint8_t* buffer = pool.acquireBuffer(CHUNK_SIZE);
+        CHECK(pool.contains(buffer));
+        buffers.push_back(buffer);
+    }
+    CHECK(pool.buffersInUse() == numAdmitted);
+
+    for (size_t i = 0; i < buffers.size(); i++)
+        TransferPool::release(buffers[i]);
+    CHECK(pool.buffersInUse() == 0);
+}
+
+
+// --- Chunks use the block class, not the large class ---
+
+static void testBlockClass()
+{
+    TransferPool pool;
+    uint8_t* chunk = pool.acquireBuffer(CHUNK_SIZE);
+    uint8_t* large = pool.acquireBuffer(TRANSFER_POOL_LARGE_SIZE);
+    CHECK(pool.contains(chunk));
+    CHECK(pool.contains(large));
+    CHECK(pool.buffersInUse() == 2);
+
+    // released buffers are reused
+    TransferPool::release(chunk);
+    CHECK(pool.acquireBuffer(CHUNK_SIZE) == chunk);
+    TransferPool::release(chunk);
+    TransferPool::release(large);
+    CHECK(pool.buffersInUse() == 0);
+}
+
+
+// --- Exhausted classes and oversized requests fall back to malloc ---
+
+static void testFallback()
+{
+    TransferPool pool;
+    TransferPool other;
+
+    uint8_t* oversized = pool.acquireBuffer(TRANSFER_POOL_LARGE_SIZE + 1);
+    CHECK(!pool.contains(oversized));
+    TransferPool::release(oversized);
+
+    std::vector<uint8_t*> buffers;
+    int capacity = pool.capacity(TRANSFER_POOL_NUM_CLASSES - 1);
+    for (int i = 0; i < capacity; i++)
+        buffers.push_back(pool.acquireBuffer(TRANSFER_POOL_LARGE_SIZE));
+    uint8_t* extra = pool.acquireBuffer(TRANSFER_POOL_LARGE_SIZE);
+    CHECK(!pool.contains(extra));
+    CHECK(!other.contains(buffers[0]));
+    TransferPool::release(extra);
+
+    for (size_t i = 0; i < buffers.size(); i++)
+        TransferPool::release(buffers[i]);
+    CHECK(pool.buffersInUse() == 0);
+
+    uint8_t* unpooled = TransferPool::allocateBuffer(16);
+    CHECK(!pool.contains(unpooled));
+    TransferPool::release(unpooled);
+}
+
+
+// --- The pool only grows ---
+
+static void testGrowth()
+{
+    TransferPool pool;
+    int capacity = pool.capacity(2);
+    pool.configure(20000, 100);
+    CHECK(pool.capacity(2) > capacity);
+    capacity = pool.capacity(2);
+    pool.configure(THROTTLER_DEFAULT_MEM_SIZE, THROTTLER_DEFAULT_MAX_OUTSTANDING);
+    CHECK(pool.capacity(2) == capacity);
+}
+
+
+// --- Buffers may outlive the pool ---
+
+static void testOutlivingBuffers()
+{
+    TransferPool* pool = new TransferPool();
+    uint8_t* small = pool->acquireBuffer(TRANSFER_POOL_SMALL_SIZE);
+    uint8_t* large = pool->acquireBuffer(TRANSFER_POOL_LARGE_SIZE);
+    TransferPool::release(pool->acquireBuffer(CHUNK_SIZE)); // on the free list
+    CHECK(pool->buffersInUse() == 2);
+
+    // like a USB transfer completing after the device has been closed
+    delete pool;
+    small[0] = 1;
+    TransferPool::release(small);
+    large[TRANSFER_POOL_LARGE_SIZE - 1] = 1;
+    TransferPool::release(large);
+}
+
+
+int main()
+{
+    testAdmittedChunks(THROTTLER_DEFAULT_MEM_SIZE, THROTTLER_DEFAULT_MAX_OUTSTANDING);
+    testAdmittedChunks(20000, 100);
+    testAdmittedChunks(100000, THROTTLER_MAX_OUTSTANDING);
+    testBlockClass();
+    testFallback();
+    testGrowth();
+    testOutlivingBuffers();
+
+    return TEST_RESULT();
+}
@@ -190,13 +190,8 @@ class ColorTFT: NSObject {
             return
         }
         
-        var offset = 0
-        while offset < data.count {
-            let end = min(offset + 1024, data.count)
-            let commandLoad = Data(bytes: data[offset ..< end])
-            device!.submit(onSPIPort: spi, data: commandLoad, chipSelect: csPort)
-            offset = end
-        }
+        // streamed in chunks sized to the board's memory and sent back-to-back
+        device!.transmit(onSPIPort: spi, bytes: data, length: data.count, chipSelect: csPort, dispatchQueue: nil, completion: nil)
     }
     
     static func swapPairsOfBytes(_ bytes: [UInt8]) -> [UInt8] {
@@ -419,8 +419,17 @@ class DeviceViewController: NSViewController {
         createTFTPixelData()
         colorTFT!.initDevice()
         clearTFTDisplay()
+        var numFrames = 0
+        var startTime = Date()
         while !Thread.current.isCancelled {
             updateTFTInner()
+            numFrames += 1
+            let elapsed = Date().timeIntervalSince(startTime)
+            if elapsed >= 10 {
+                NSLog("Color TFT: %.1f frames/s", Double(numFrames) / elapsed)
+                numFrames = 0
+                startTime = Date()
+            }
         }
     }
     
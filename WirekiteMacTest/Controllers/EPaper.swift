@@ -175,8 +175,17 @@ class EPaper: NSObject {
         device!.writeDigitalPin(onPort: dcPort, value: true)
 
         if (data.count > 0) {
-            let commandLoad = Data(bytes: data)
-            guard device!.transmit(onSPIPort: spi, data: commandLoad, chipSelect: csPort) == commandLoad.count else {
+            // streamed in chunks sized to the board's memory; wait for completion
+            // as the next command must not be sent before
+            let completed = DispatchSemaphore(value: 0)
+            var result = SPIResult.OK
+            device!.transmit(onSPIPort: spi, bytes: data, length: data.count, chipSelect: csPort, dispatchQueue: DispatchQueue.global(qos: .background)) {
+                (_, _, res) in
+                result = res
+                completed.signal()
+            }
+            completed.wait()
+            guard result == .OK else {
                 NSLog("EPaper: Transmitting command data failed")
                 return
             }